@@ -0,0 +1,44 @@
+#ifndef CMS_ALLOC_H
+#define CMS_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Tracked allocation: every block is counted against the part of the
+   program that owns it, for STATS MEMORY. Blocks from cms_malloc,
+   cms_calloc and cms_realloc carry a small header and must be freed with
+   cms_free (never free), including result lists handed back to a caller
+   (search results, ID lists), which are CMS_MEM_TEMP. Counters are atomic,
+   so blocks may be allocated and freed on any thread. */
+typedef enum
+{
+    CMS_MEM_RECORDS = 0, /* row arrays, including names and programmes stored inline */
+    CMS_MEM_STRINGS,     /* copies of names kept apart from the rows (BK-tree keys) */
+    CMS_MEM_INDEXES,     /* ID hash, trigram postings, bitmaps, mark blocks, BK-tree IDs */
+    CMS_MEM_UNDO,        /* undo history and open transactions */
+    CMS_MEM_TEMP,        /* working buffers and result lists, freed once the command is done with them */
+    CMS_MEM_SESSION,     /* timing histograms, server clients and their buffers, watchers, handles */
+    CMS_MEM_KIND_COUNT
+} CmsMemKind;
+
+void *cms_malloc(CmsMemKind kind, size_t size);
+void *cms_calloc(CmsMemKind kind, size_t count, size_t size);
+/* A block keeps the kind it was allocated with; kind is used when block is NULL */
+void *cms_realloc(CmsMemKind kind, void *block, size_t size);
+void cms_free(void *block);
+
+typedef struct
+{
+    size_t current; /* bytes asked for and not yet freed */
+    size_t peak;
+    size_t blocks;  /* blocks not yet freed */
+} CmsMemUsage;
+
+/* One kind's figures, or all kinds together for CMS_MEM_KIND_COUNT (whose
+   peak is the highest total reached, not the sum of the peaks) */
+CmsMemUsage cms_mem_usage(CmsMemKind kind);
+const char *cms_mem_kind_name(CmsMemKind kind);
+/* Starts every peak again from the current figure */
+void cms_mem_reset_peaks(void);
+
+#endif /* CMS_ALLOC_H */
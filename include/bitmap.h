@@ -0,0 +1,49 @@
+#ifndef CMS_BITMAP_H
+#define CMS_BITMAP_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Compressed bitmap of 32-bit values (roaring layout): values are grouped
+   by their high 16 bits, and each group is stored either as a sorted array
+   of low halves (sparse) or as a 65536-bit bitset (dense). */
+#define CMS_BITMAP_ARRAY_MAX 4096
+#define CMS_BITMAP_WORDS 1024
+
+typedef struct
+{
+    uint16_t key;
+    uint32_t cardinality;
+    uint32_t array_capacity;
+    uint16_t *array;
+    uint64_t *words;
+} CmsBitmapContainer;
+
+typedef struct CmsBitmap
+{
+    CmsBitmapContainer *containers;
+    size_t count;
+    size_t capacity;
+} CmsBitmap;
+
+void cms_bitmap_init(CmsBitmap *bitmap);
+void cms_bitmap_free(CmsBitmap *bitmap);
+void cms_bitmap_clear(CmsBitmap *bitmap);
+
+bool cms_bitmap_add(CmsBitmap *bitmap, uint32_t value);
+void cms_bitmap_remove(CmsBitmap *bitmap, uint32_t value);
+bool cms_bitmap_contains(const CmsBitmap *bitmap, uint32_t value);
+size_t cms_bitmap_cardinality(const CmsBitmap *bitmap);
+
+/* Set algebra; out must be initialised and must not alias an input */
+CMS_STATUS cms_bitmap_and(const CmsBitmap *a, const CmsBitmap *b, CmsBitmap *out);
+CMS_STATUS cms_bitmap_or(const CmsBitmap *a, const CmsBitmap *b, CmsBitmap *out);
+CMS_STATUS cms_bitmap_copy(const CmsBitmap *src, CmsBitmap *out);
+size_t cms_bitmap_and_cardinality(const CmsBitmap *a, const CmsBitmap *b);
+
+/* Writes the members in ascending order; out must hold cardinality values */
+size_t cms_bitmap_to_array(const CmsBitmap *bitmap, uint32_t *out);
+
+#endif /* CMS_BITMAP_H */
@@ -27,24 +27,25 @@ typedef struct StudentRecord
     float mark;
 } StudentRecord;
 
-/* Undo tracking */
-typedef enum
-{
-    CMS_UNDO_NONE = 0,
-    CMS_UNDO_INSERT,
-    CMS_UNDO_UPDATE,
-    CMS_UNDO_DELETE
-} CmsUndoAction;
+/* Undo/redo history (see journal.h) */
+typedef struct CmsJournal CmsJournal;
+
+/* Open transaction's write set (see transaction.h) */
+typedef struct CmsTransaction CmsTransaction;
 
-typedef struct
+/* Secondary indexes (see index.h) */
+typedef struct CmsIndexSet CmsIndexSet;
+
+/* Row cursor (see database.h) */
+typedef struct CmsCursor CmsCursor;
+
+/* On-disk database formats; AUTO (as a save format) keeps the loaded file's */
+typedef enum
 {
-    CmsUndoAction action;
-    StudentRecord before;
-    StudentRecord after;
-    size_t index;
-    bool prev_dirty;
-    bool valid;
-} CmsUndoState;
+    CMS_FILE_FORMAT_AUTO = 0,
+    CMS_FILE_FORMAT_TEXT,
+    CMS_FILE_FORMAT_BINARY
+} CmsFileFormat;
 
 /* Database structure */
 typedef struct StudentDatabase
@@ -53,13 +54,23 @@ typedef struct StudentDatabase
     size_t count;
     size_t capacity;
     char file_path[CMS_MAX_FILE_PATH_LEN];
+    CmsFileFormat file_format; /* format file_path was read or written in */
+    CmsFileFormat save_format; /* format SAVE writes (--format); AUTO keeps file_format */
     bool is_loaded;
     bool is_dirty;
-    CmsUndoState undo_state;
+    CmsJournal *journal;
+    size_t undo_limit;       /* bytes of undo history kept (--undo-memory) */
+    CmsTransaction *transaction; /* changes held since BEGIN, NULL outside one */
+    CmsIndexSet *indexes;
+    unsigned long version;   /* bumped on every change; invalidates cursors */
+    unsigned long pending_version; /* bumped when the transaction's write set changes or it ends */
+    CmsCursor *page_cursor;  /* open SHOW ... PAGE listing, resumed by NEXT */
+    size_t page_size;
 } StudentDatabase;
 
 /* Status message handling */
 const char *cms_status_message(CMS_STATUS status);
+const char *cms_status_name(CMS_STATUS status); /* e.g. "NOT_FOUND", for scripts */
 void cms_print_status(CMS_STATUS status);
 
 /* Declaration function (not yet implemented) */
@@ -2,23 +2,69 @@
 #define CMS_COMMANDS_H
 
 #include "cms.h"
+#include "tokenizer.h"
+#include <stdio.h>
 
-/* Command handler functions */
-CMS_STATUS cmd_open(StudentDatabase *db, const char *filename);
+/* Session behaviour for scripted use */
+typedef struct
+{
+    bool batch;      /* no prompts; one "OK <line>" / "ERR <line> ..." status per command */
+    bool assume_yes; /* answer Y to confirmations (DELETE, saving at exit) */
+    bool lenient;    /* OPEN skips bad rows and reports them instead of failing */
+} CmsSessionOptions;
+
+void cms_set_session_options(const CmsSessionOptions *options);
+const CmsSessionOptions *cms_get_session_options(void);
+
+/* Command handler functions; text arguments are slices of the command line */
+CMS_STATUS cmd_open(StudentDatabase *db, CmsSlice filename);
 CMS_STATUS cmd_show(const StudentDatabase *db, const char *option, const char *order);
-CMS_STATUS cmd_insert(StudentDatabase *db, const char *params);
+CMS_STATUS cmd_show_page(StudentDatabase *db, const char *option, const char *order,
+                         size_t offset, size_t limit, bool paged);
+CMS_STATUS cmd_next(StudentDatabase *db);
+CMS_STATUS cmd_insert(StudentDatabase *db, CmsSlice params);
 CMS_STATUS cmd_query(const StudentDatabase *db, int student_id);
 CMS_STATUS cmd_update(StudentDatabase *db, int student_id);
+CMS_STATUS cmd_update_fields(StudentDatabase *db, int student_id, CmsSlice fields);
 CMS_STATUS cmd_delete(StudentDatabase *db, int student_id);
-CMS_STATUS cms_filter(const StudentDatabase *db, const char *programme);
-CMS_STATUS cmd_save(StudentDatabase *db, const char *filename);
-CMS_STATUS cmd_undo(StudentDatabase *db);
+CMS_STATUS cmd_delete_where(StudentDatabase *db, CmsSlice condition);
+CMS_STATUS cmd_update_where(StudentDatabase *db, CmsSlice args);
+CMS_STATUS cms_filter(const StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_count(const StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_search(const StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_save(StudentDatabase *db, CmsSlice filename);
+CMS_STATUS cmd_export(const StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_import(StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_diff(const StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_merge(StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_watch(StudentDatabase *db, CmsSlice args);
+CMS_STATUS cmd_undo(StudentDatabase *db, size_t steps);
+CMS_STATUS cmd_redo(StudentDatabase *db, size_t steps);
+CMS_STATUS cmd_begin(StudentDatabase *db);
+CMS_STATUS cmd_commit(StudentDatabase *db);
+CMS_STATUS cmd_rollback(StudentDatabase *db);
+CMS_STATUS cmd_timing(CmsSlice args);
+CMS_STATUS cmd_stats(const StudentDatabase *db, CmsSlice args);
 CMS_STATUS cmd_help(void);
 
 /* Main command loop */
 void cms_command_loop(StudentDatabase *db);
+/* The same while load_path is opened on a background thread: the prompt
+   comes up at once, HELP runs straight away, OPEN of another file drops
+   the load, a command that needs data waits for it with a progress line,
+   and the outcome (or load error) is printed as soon as it is known */
+void cms_command_loop_loading(StudentDatabase *db, const char *load_path);
+
+/* Runs commands from input without prompts; returns the number that failed */
+int cms_batch_loop(StudentDatabase *db, FILE *input);
+/* Same for a list of commands (-c), numbered from 1 in the status lines */
+int cms_batch_commands(StudentDatabase *db, char *const *commands, size_t count);
 
 /* Command parsing */
 CMS_STATUS cms_parse_command(const char *input, StudentDatabase *db);
+/* True if input only reads the table (SHOW, QUERY, COUNT, ...), so it may
+   run alongside other readers; the session's page cursor and transaction
+   are the only state it touches */
+bool cms_command_reads_only(const char *input);
 
 #endif /* CMS_COMMANDS_H */
@@ -3,25 +3,222 @@
 
 #include "cms.h"
 #include "summary.h"
+#include "index.h"
+#include <stdint.h>
+#include <stdio.h>
 
 /* Database initialization and cleanup */
 CMS_STATUS cms_database_init(StudentDatabase *db);
 void cms_database_cleanup(StudentDatabase *db);
 
-/* Database file operations */
+/* Database file operations. Loading recognises either format; saving
+   writes db->save_format, or the format the file was loaded in. */
+#define CMS_BINARY_MAGIC_LEN 8
 CMS_STATUS cms_database_load(StudentDatabase *db, const char *file_path);
 CMS_STATUS cms_database_save(StudentDatabase *db, const char *file_path);
+bool cms_file_format_from_name(const char *name, CmsFileFormat *out_format); /* "text" or "binary" */
+
+/* Loading with a report of the rows refused: the line (record number for a
+   binary file), field and reason of the first CMS_LOAD_REPORT_ERRORS. A
+   strict load stops at the first bad row or repeated ID and leaves the table
+   empty, as cms_database_load does. A lenient one skips them and keeps the
+   rest in one pass; only a damaged header fails it, and a binary file cut
+   short keeps the records before the break. */
+#define CMS_LOAD_REPORT_ERRORS 20
+
+typedef struct
+{
+    size_t line;
+    const char *field;  /* "ID", "Name", "Programme", "Mark", "line", "header", ... */
+    const char *reason;
+} CmsLoadError;
+
+typedef struct
+{
+    CmsFileFormat format; /* lines are record numbers for CMS_FILE_FORMAT_BINARY */
+    size_t loaded;
+    size_t skipped; /* rows left out by a lenient load */
+    bool indexes_restored; /* name indexes taken from the sidecar (sidecar.h) */
+    CmsLoadError errors[CMS_LOAD_REPORT_ERRORS];
+    size_t error_count;
+} CmsLoadReport;
+
+CMS_STATUS cms_database_load_checked(StudentDatabase *db, const char *file_path, bool lenient,
+                                     CmsLoadReport *out_report);
+
+/* Moves a table loaded elsewhere (e.g. on another thread) into db: db gets
+   loaded's rows, indexes and history, keeps its own settings (save format,
+   undo limit), and its old contents go to loaded for the caller to clean
+   up. Refused while either has a transaction open. */
+CMS_STATUS cms_database_take(StudentDatabase *db, StudentDatabase *loaded);
+
+/* The table matches its file again without having been saved, e.g. after
+   a reload took every difference from it (watch.h) */
+void cms_database_mark_clean(StudentDatabase *db);
+
+/* Reads a database file of either format one validated row at a time, for
+   callers that stream a file instead of loading it. next returns
+   CMS_STATUS_NOT_FOUND after the last row. */
+typedef struct
+{
+    FILE *fp;
+    CmsFileFormat format;
+    uint64_t remaining; /* rows still to come (binary) */
+    size_t line;        /* line of a text file, record number of a binary one */
+    const char *error_field;  /* why the last row was refused (CMS_STATUS_PARSE_ERROR) */
+    const char *error_reason;
+    bool error_fatal;   /* the rest of the file cannot be read past it */
+} CmsRowReader;
+
+CMS_STATUS cms_row_reader_open(CmsRowReader *reader, const char *file_path);
+CMS_STATUS cms_row_reader_next(CmsRowReader *reader, StudentRecord *out_record);
+void cms_row_reader_close(CmsRowReader *reader);
+
+/* Set-oriented changes to every row matching a filter: programme/grade
+   selection (either side may be empty) AND mark range. Deleting is one
+   stable compaction pass; the mark update sets mark = scale * mark + offset,
+   held to 0..100. Each statement is a single undo step, and inside a
+   transaction it is held like any other change. *out_count is the number of
+   rows deleted or whose mark changed. */
+typedef struct
+{
+    CmsSelection selection;
+    CmsMarkRange mark;
+} CmsRowFilter;
+
+bool cms_row_filter_matches(const CmsRowFilter *filter, const StudentRecord *record);
+size_t cms_database_count_where(const StudentDatabase *db, const CmsRowFilter *filter);
+CMS_STATUS cms_database_delete_where(StudentDatabase *db, const CmsRowFilter *filter, size_t *out_count);
+CMS_STATUS cms_database_update_marks_where(StudentDatabase *db, const CmsRowFilter *filter, float scale,
+                                           float offset, size_t *out_count);
+
+/* Bulk import of a database file (either format, validated as by load) into
+   the table. A row conflicts when its ID is already in the table or earlier
+   in the file: SKIP keeps the first, REPLACE keeps the last (overwriting the
+   table row in place) and FAIL imports nothing. New rows are appended in
+   file order. The whole import is one undo step. */
+typedef enum
+{
+    CMS_CONFLICT_FAIL = 0,
+    CMS_CONFLICT_SKIP,
+    CMS_CONFLICT_REPLACE
+} CmsConflictPolicy;
+
+#define CMS_IMPORT_REPORT_IDS 10
+
+typedef struct
+{
+    size_t read;      /* rows in the file */
+    size_t inserted;  /* new rows added */
+    size_t replaced;  /* rows that overwrote a table row or an earlier one in the file */
+    size_t skipped;   /* rows left out */
+    size_t conflicts; /* rows whose ID clashed */
+    int conflict_ids[CMS_IMPORT_REPORT_IDS]; /* the lowest conflicting IDs */
+    size_t conflict_id_count;
+} CmsImportReport;
+
+CMS_STATUS cms_database_import(StudentDatabase *db, const char *file_path, CmsConflictPolicy policy,
+                               CmsImportReport *out_report);
 
 /* Record operations */
 CMS_STATUS cms_database_insert(StudentDatabase *db, const StudentRecord *record);
 CMS_STATUS cms_database_query(const StudentDatabase *db, int student_id, StudentRecord *out_record);
 CMS_STATUS cms_database_update(StudentDatabase *db, int student_id, const StudentRecord *new_record);
 CMS_STATUS cms_database_delete(StudentDatabase *db, int student_id);
-CMS_STATUS cms_database_undo(StudentDatabase *db);
+
+/* Undo/redo up to steps changes (fewer if the history is shorter);
+   *out_done (may be NULL) is how many were. CMS_STATUS_INVALID_ARGUMENT
+   when there is nothing to undo or redo (or a transaction is open); any
+   other failure means the history no longer matched the rows and has been
+   cleared. */
+CMS_STATUS cms_database_undo(StudentDatabase *db, size_t steps, size_t *out_done);
+CMS_STATUS cms_database_redo(StudentDatabase *db, size_t steps, size_t *out_done);
+
+/* What COMMIT did. On CMS_STATUS_NOT_FOUND (or CMS_STATUS_DUPLICATE)
+   another session deleted (or inserted) conflict_id since BEGIN and nothing
+   was applied. On CMS_STATUS_ERROR memory ran out before anything was
+   applied and the transaction is still open. */
+typedef struct
+{
+    size_t inserted;
+    size_t updated;
+    size_t deleted;
+    int conflict_id;
+} CmsCommitReport;
+
+/* Transactions: after BEGIN, insert/update/delete are held in a write set
+   that reads see through; the table itself only changes at COMMIT, which
+   applies the set in one pass as a single undo step. ROLLBACK drops it.
+   Loading, saving, undo and redo are refused while one is open, and BEGIN
+   while one already is. out_report may be NULL. */
+CMS_STATUS cms_database_begin(StudentDatabase *db);
+CMS_STATUS cms_database_commit(StudentDatabase *db, CmsCommitReport *out_report);
+CMS_STATUS cms_database_rollback(StudentDatabase *db);
+
+/* Reads inside a transaction see its write set layered over the table.
+   find returns the row an ID names (NULL when there is none or the set
+   deletes it); copy_rows hands back the rows in the order COMMIT would
+   leave them (cms_free them). Index lookups only know the table, so their
+   results are patched: a CmsRowKey says whether a row matches and, if so,
+   its sort key. overlay_ids drops the IDs the set touches from a list
+   ordered by that key (or by table position when table_order is set, with
+   rows COMMIT appends last) and merges in the set's matching rows;
+   overlay_count does the same for a count. Both are no-ops outside a
+   transaction. */
+typedef bool (*CmsRowKey)(const StudentRecord *record, const void *context, double *out_key);
+
+bool cms_database_has_pending(const StudentDatabase *db);
+const StudentRecord *cms_database_find(const StudentDatabase *db, int student_id);
+size_t cms_database_row_count(const StudentDatabase *db);
+CMS_STATUS cms_database_copy_rows(const StudentDatabase *db, StudentRecord **out_rows, size_t *out_count);
+CMS_STATUS cms_database_overlay_ids(const StudentDatabase *db, CmsRowKey key, const void *context,
+                                    bool table_order, int **ids, size_t *count);
+void cms_database_overlay_count(const StudentDatabase *db, CmsRowKey key, const void *context, size_t *count);
 
 /* Display operations */
 CMS_STATUS cms_database_show_all(const StudentDatabase *db);
 CMS_STATUS cms_database_show_record(const StudentRecord *record);
 CMS_STATUS cms_database_show_sorted(const StudentDatabase *db, CmsSortKey sort_key, CmsSortOrder sort_order);
 
+/* Row cursors: yield records one at a time from the table (file order), an
+   ID list, or a sorted view that orders rows lazily as they are fetched.
+   Inside a transaction they see its write set. Any change to the database,
+   or to the write set, makes an open cursor stale. */
+typedef enum
+{
+    CMS_CURSOR_TABLE = 0,
+    CMS_CURSOR_IDS,
+    CMS_CURSOR_SORTED,
+    CMS_CURSOR_MARK_INDEX
+} CmsCursorSource;
+
+struct CmsCursor
+{
+    const StudentDatabase *db;
+    unsigned long version;
+    unsigned long pending_version;
+    CmsCursorSource source;
+    CmsSortKey sort_key;
+    CmsSortOrder sort_order;
+    size_t position; /* rows fetched or skipped so far */
+    size_t total;
+    int *ids;        /* owned ID list (CMS_CURSOR_IDS) */
+    uint32_t *heap;  /* pending row positions (CMS_CURSOR_SORTED) */
+    const StudentRecord **rows; /* the rows a transaction's reads see, when it holds changes */
+    size_t heap_count;
+    CmsMarkSeek mark_seek; /* position in the mark index (CMS_CURSOR_MARK_INDEX) */
+};
+
+CMS_STATUS cms_cursor_open(CmsCursor *cursor, const StudentDatabase *db);
+CMS_STATUS cms_cursor_open_sorted(CmsCursor *cursor, const StudentDatabase *db,
+                                  CmsSortKey sort_key, CmsSortOrder sort_order);
+/* Takes ownership of ids (from cms_malloc); IDs no longer present are skipped */
+CMS_STATUS cms_cursor_open_ids(CmsCursor *cursor, const StudentDatabase *db, int *ids, size_t count);
+/* CMS_STATUS_NOT_FOUND once exhausted, CMS_STATUS_ERROR when stale */
+CMS_STATUS cms_cursor_next(CmsCursor *cursor, const StudentRecord **out_record);
+size_t cms_cursor_skip(CmsCursor *cursor, size_t count);
+bool cms_cursor_has_next(const CmsCursor *cursor);
+bool cms_cursor_is_stale(const CmsCursor *cursor);
+void cms_cursor_close(CmsCursor *cursor);
+
 #endif /* CMS_DATABASE_H */
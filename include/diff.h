@@ -0,0 +1,69 @@
+#ifndef CMS_DIFF_H
+#define CMS_DIFF_H
+
+#include "cms.h"
+#include "database.h"
+
+/* Record-level differences between a base (a file or the open table) and
+   another database file, keyed by student ID. The base is held as an array
+   sorted by ID; the other file is streamed in fixed-size chunks, each sorted
+   and merged against the base, so memory is one side plus a chunk buffer and
+   the changes themselves. */
+#define CMS_DIFF_CHUNK_ROWS 4096
+
+typedef enum
+{
+    CMS_CHANGE_ADDED = 0, /* only in the other file */
+    CMS_CHANGE_REMOVED,   /* only in the base */
+    CMS_CHANGE_CHANGED    /* in both, with different fields */
+} CmsChangeKind;
+
+/* Fields that differ in a CHANGED record */
+#define CMS_CHANGE_NAME 0x1u
+#define CMS_CHANGE_PROGRAMME 0x2u
+#define CMS_CHANGE_MARK 0x4u
+
+typedef struct
+{
+    CmsChangeKind kind;
+    unsigned fields;      /* CMS_CHANGE_NAME | ... (CHANGED) */
+    StudentRecord before; /* the base row (REMOVED, CHANGED) */
+    StudentRecord after;  /* the other file's row (ADDED, CHANGED) */
+} CmsChange;
+
+/* Changes in ascending ID order */
+typedef struct
+{
+    CmsChange *changes;
+    size_t count;
+    size_t capacity;
+    size_t added;
+    size_t removed;
+    size_t changed;
+} CmsChangeList;
+
+void cms_change_list_init(CmsChangeList *list);
+void cms_change_list_free(CmsChangeList *list);
+
+/* CMS_STATUS_DUPLICATE if either side repeats an ID; parse errors as load */
+CMS_STATUS cms_diff_files(const char *base_path, const char *other_path, CmsChangeList *out_list);
+/* The open table (committed rows) against a file. With the table's ID hash
+   the file's rows are looked up directly and the table is not sorted. */
+CMS_STATUS cms_diff_database(const StudentDatabase *db, const char *other_path, CmsChangeList *out_list);
+
+/* Kinds of change cms_database_apply_changes may apply */
+#define CMS_APPLY_ADDED 0x1u
+#define CMS_APPLY_REMOVED 0x2u
+#define CMS_APPLY_CHANGED 0x4u
+
+/* Applies the selected changes of a list made by cms_diff_database in one
+   batch: rows changed in place, removals in one compaction pass, additions
+   appended behind one reservation, indexes refreshed once and the whole
+   batch recorded as one undo step. Every selected change is checked against
+   the table first: an added ID must be absent (else CMS_STATUS_DUPLICATE)
+   and a removed or changed one present (else CMS_STATUS_NOT_FOUND), and
+   nothing is applied if one is not. out_applied counts the rows touched. */
+CMS_STATUS cms_database_apply_changes(StudentDatabase *db, const CmsChangeList *list, unsigned kinds,
+                                      size_t *out_applied);
+
+#endif /* CMS_DIFF_H */
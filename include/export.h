@@ -0,0 +1,31 @@
+#ifndef CMS_EXPORT_H
+#define CMS_EXPORT_H
+
+#include "cms.h"
+#include "database.h"
+#include "render.h"
+
+/* Streaming export: rows are read from a cursor and escaped straight into a
+   writer's buffer, so memory use does not depend on the number of rows. */
+typedef enum
+{
+    CMS_EXPORT_CSV = 0,
+    CMS_EXPORT_JSON,
+    CMS_EXPORT_NDJSON
+} CmsExportFormat;
+
+/* Marks are exported with the same precision as the database file */
+#define CMS_EXPORT_MARK_DECIMALS 2
+
+bool cms_export_format_from_name(const char *name, CmsExportFormat *out_format);
+const char *cms_export_format_name(CmsExportFormat format);
+
+/* Writes every remaining row of cursor; rows written go to out_rows */
+CMS_STATUS cms_export_cursor(CmsWriter *writer, CmsCursor *cursor, CmsExportFormat format,
+                             size_t *out_rows);
+
+/* Creates (or truncates) file_path and exports the cursor into it */
+CMS_STATUS cms_export_file(const char *file_path, CmsCursor *cursor, CmsExportFormat format,
+                           size_t *out_rows);
+
+#endif /* CMS_EXPORT_H */
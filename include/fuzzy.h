@@ -0,0 +1,55 @@
+#ifndef CMS_FUZZY_H
+#define CMS_FUZZY_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Default and largest accepted distance for fuzzy name lookups */
+#define CMS_FUZZY_DEFAULT_DISTANCE 2
+#define CMS_FUZZY_MAX_DISTANCE 8
+
+/* A fuzzy match: student ID and its edit distance from the query */
+typedef struct
+{
+    int id;
+    int distance;
+} CmsFuzzyMatch;
+
+/* BK-tree over lower-cased names (metric: Levenshtein distance) */
+typedef struct CmsBkTree CmsBkTree;
+
+/* Case-insensitive Levenshtein distance, giving up once it exceeds
+   max_distance (returns max_distance + 1 in that case). */
+int cms_edit_distance_bounded(const char *a, const char *b, int max_distance);
+
+CmsBkTree *cms_bktree_create(void);
+void cms_bktree_destroy(CmsBkTree *tree);
+void cms_bktree_clear(CmsBkTree *tree);
+bool cms_bktree_add(CmsBkTree *tree, const char *name, int id);
+void cms_bktree_remove(CmsBkTree *tree, const char *name, int id);
+bool cms_bktree_needs_rebuild(const CmsBkTree *tree);
+
+/* Bulk mode, for loads and changes to many rows: adds append the ID
+   without looking for it (repeats are dropped later) and removes are
+   queued, then each node touched is sorted and has its removes dropped
+   once, so k changes to one name cost O(k log k) rather than O(k^2).
+   end_bulk returns false if a queued remove could not be recorded; the
+   tree then needs rebuilding. */
+void cms_bktree_begin_bulk(CmsBkTree *tree);
+bool cms_bktree_end_bulk(CmsBkTree *tree);
+
+/* The tree as bytes in native byte order, for the index sidecar: save
+   writes exactly saved_size bytes; restore replaces the tree with the one
+   they describe and returns false, leaving it empty, if they do not hold a
+   well-formed tree */
+size_t cms_bktree_saved_size(const CmsBkTree *tree);
+bool cms_bktree_save(const CmsBkTree *tree, FILE *fp);
+bool cms_bktree_restore(CmsBkTree *tree, const unsigned char *data, size_t size);
+
+/* Appends every (id, distance) within max_distance of text; the caller frees *out with cms_free */
+CMS_STATUS cms_bktree_search(const CmsBkTree *tree, const char *text, int max_distance,
+                             CmsFuzzyMatch **out, size_t *out_count);
+
+#endif /* CMS_FUZZY_H */
@@ -0,0 +1,105 @@
+#ifndef CMS_INDEX_H
+#define CMS_INDEX_H
+
+#include "cms.h"
+#include "bitmap.h"
+#include "fuzzy.h"
+#include "summary.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Index lifecycle (owned by StudentDatabase) */
+CMS_STATUS cms_index_create(StudentDatabase *db);
+void cms_index_destroy(StudentDatabase *db);
+void cms_index_clear(StudentDatabase *db);
+CMS_STATUS cms_index_rebuild(StudentDatabase *db);
+/* Loading: each row's ID goes into the ID hash as the row is read
+   (CMS_STATUS_DUPLICATE if already there), then load_finish builds the
+   other indexes once. Given the bytes save_names wrote for the same rows
+   (an index sidecar, see sidecar.h) it restores the name indexes from them
+   instead, which is most of the work; bytes that do not hold well-formed
+   indexes are ignored. out_restored (may be NULL) tells which happened. */
+CMS_STATUS cms_index_load_id(StudentDatabase *db, size_t index);
+CMS_STATUS cms_index_load_finish(StudentDatabase *db, const unsigned char *saved, size_t saved_size,
+                                 bool *out_restored);
+/* Writes the name indexes (BK-tree and trigram postings) in native byte
+   order; CMS_STATUS_ERROR if the set is stale */
+CMS_STATUS cms_index_save_names(const StudentDatabase *db, FILE *fp);
+
+/* Incremental maintenance, called after db->records has been changed */
+void cms_index_on_insert(StudentDatabase *db, size_t index);
+void cms_index_on_update(StudentDatabase *db, size_t index, const StudentRecord *before);
+void cms_index_on_delete(StudentDatabase *db, size_t index, const StudentRecord *removed);
+void cms_index_on_reorder(StudentDatabase *db);
+/* The same for many rows at once: removed rows (already out of the table)
+   and rows newly placed at the given positions, where every row from
+   `from` on may have moved. Positions are refreshed once, not per row. An
+   updated row is both: its old version removed, its new one placed. */
+void cms_index_on_bulk_change(StudentDatabase *db, const StudentRecord *removed, size_t removed_count,
+                              const size_t *placed, size_t placed_count, size_t from);
+
+/* ID lookup */
+bool cms_index_find_id(const StudentDatabase *db, int student_id, size_t *out_index);
+/* True while find_id hashes; it scans the rows otherwise */
+bool cms_index_has_ids(const StudentDatabase *db);
+
+/* Name search: substring (or prefix) match, results are sorted student IDs.
+   The caller frees *out_ids with cms_free. */
+CMS_STATUS cms_index_search_name(const StudentDatabase *db, const char *text, bool prefix_only,
+                                 int **out_ids, size_t *out_count);
+
+/* Fuzzy name lookup: matches within max_distance edits, closest first.
+   The caller frees *out_matches with cms_free. */
+CMS_STATUS cms_index_search_fuzzy(const StudentDatabase *db, const char *text, int max_distance,
+                                  CmsFuzzyMatch **out_matches, size_t *out_count);
+
+/* Programme / grade selection: a record matches when its programme is any
+   of the listed programmes AND its grade bucket is any of the listed
+   buckets. An empty list leaves that side unconstrained. */
+#define CMS_MAX_SELECT_TERMS 16
+
+typedef struct
+{
+    const char *programmes[CMS_MAX_SELECT_TERMS];
+    size_t programme_count;
+    CmsGradeBucket grades[CMS_GRADE_BUCKET_COUNT];
+    size_t grade_count;
+} CmsSelection;
+
+bool cms_selection_matches(const CmsSelection *selection, const StudentRecord *record);
+
+/* Fills out_ids (initialised, emptied first) with the matching student IDs */
+CMS_STATUS cms_index_select(const StudentDatabase *db, const CmsSelection *selection, CmsBitmap *out_ids);
+CMS_STATUS cms_index_count(const StudentDatabase *db, const CmsSelection *selection, size_t *out_count);
+
+/* Mark range: low/high bounds, each inclusive or exclusive */
+typedef struct
+{
+    float low;
+    float high;
+    bool low_inclusive;
+    bool high_inclusive;
+} CmsMarkRange;
+
+bool cms_mark_in_range(float mark, const CmsMarkRange *range);
+
+/* Student IDs with a mark in range, ordered by mark then ID.
+   The caller frees *out_ids with cms_free. */
+CMS_STATUS cms_index_mark_range(const StudentDatabase *db, const CmsMarkRange *range,
+                                int **out_ids, size_t *out_count);
+
+/* Rank access to the mark index for ordered cursors. Returns false when
+   the index is unavailable or rank is out of range. seek (zeroed before
+   the first call, may be NULL) remembers where the last lookup landed so a
+   walk in rank order takes O(1) per step; it is only valid while the index
+   is unchanged. */
+typedef struct
+{
+    size_t block;
+    size_t rank; /* rank of the first entry in block */
+} CmsMarkSeek;
+
+bool cms_index_mark_at(const StudentDatabase *db, size_t rank, CmsMarkSeek *seek, int *out_id);
+
+#endif /* CMS_INDEX_H */
@@ -0,0 +1,73 @@
+#ifndef CMS_JOURNAL_H
+#define CMS_JOURNAL_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Undo/redo history (owned by StudentDatabase). Changes are kept as compact
+   deltas in a ring buffer that never grows past the limit it is given: the
+   oldest steps are dropped to make room. A step is one change, or every
+   change between cms_journal_begin_group and cms_journal_end_group. */
+
+/* Default memory cap for the history (--undo-memory) */
+#define CMS_DEFAULT_UNDO_MEMORY (16u * 1024u * 1024u)
+#define CMS_MAX_UNDO_MEMORY_MIB 2048
+
+typedef enum
+{
+    CMS_JOURNAL_INSERT = 0,
+    CMS_JOURNAL_UPDATE,
+    CMS_JOURNAL_DELETE
+} CmsJournalAction;
+
+/* Fields an update changed */
+#define CMS_FIELD_NAME 0x1u
+#define CMS_FIELD_PROGRAMME 0x2u
+#define CMS_FIELD_MARK 0x4u
+
+typedef struct
+{
+    CmsJournalAction action;
+    unsigned fields;      /* CMS_FIELD_* (UPDATE) */
+    size_t index;         /* row position when the change was made */
+    StudentRecord before; /* DELETE: the removed row; UPDATE: the ID and old values of fields */
+    StudentRecord after;  /* INSERT: the new row; UPDATE: the ID and new values of fields */
+} CmsJournalEntry;
+
+CmsJournal *cms_journal_create(void);
+void cms_journal_destroy(CmsJournal *journal);
+void cms_journal_clear(CmsJournal *journal);
+
+/* Appends a change and drops anything that could have been redone. Returns
+   false when the change does not fit in limit bytes even on its own; the
+   history is then cleared (and the rest of an open group is not kept). */
+bool cms_journal_record(CmsJournal *journal, const CmsJournalEntry *entry, size_t limit);
+void cms_journal_begin_group(CmsJournal *journal);
+void cms_journal_end_group(CmsJournal *journal);
+
+size_t cms_journal_undo_steps(const CmsJournal *journal);
+size_t cms_journal_redo_steps(const CmsJournal *journal);
+
+/* Walk the history one entry at a time. back decodes the entry before the
+   current position and moves over it; forward does the same towards the
+   newest. Both return false at the end. A step has been fully walked when
+   cms_journal_at_step is true again. */
+bool cms_journal_back(CmsJournal *journal, CmsJournalEntry *out_entry);
+bool cms_journal_forward(CmsJournal *journal, CmsJournalEntry *out_entry);
+bool cms_journal_at_step(const CmsJournal *journal);
+
+/* The saved state: mark_clean when the table matches its file; is_clean
+   tells whether undo/redo has come back to that point */
+void cms_journal_mark_clean(CmsJournal *journal);
+bool cms_journal_is_clean(const CmsJournal *journal);
+
+/* Calls visit for every entry between the current position and the saved
+   state, in the order that leads back to it: newest first, to be undone,
+   when changes were made since; oldest first, to be redone (redo set),
+   when undo went back past it. The history itself does not move. False
+   (perhaps after some visits) when that stretch is no longer wholly kept. */
+typedef void (*CmsJournalVisit)(const CmsJournalEntry *entry, bool redo, void *context);
+bool cms_journal_since_clean(const CmsJournal *journal, CmsJournalVisit visit, void *context);
+
+#endif /* CMS_JOURNAL_H */
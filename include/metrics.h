@@ -0,0 +1,69 @@
+#ifndef CMS_METRICS_H
+#define CMS_METRICS_H
+
+#include "cms.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Command latency, counted per verb as commands are dispatched (TIMING,
+   --metrics). Off by default; while off, dispatch does not read the clock.
+   Recording takes a lock, so commands may run on several threads. */
+
+/* Log-bucketed histogram of nanoseconds: values below 2 * CMS_HISTOGRAM_SUB_BUCKETS
+   are exact, larger ones share a bucket with values within 1/16 of them.
+   Values of 2^(CMS_HISTOGRAM_MAX_SHIFT + 1) and up land in the last bucket. */
+#define CMS_HISTOGRAM_SUB_BITS 4
+#define CMS_HISTOGRAM_SUB_BUCKETS (1u << CMS_HISTOGRAM_SUB_BITS)
+#define CMS_HISTOGRAM_MAX_SHIFT 44
+#define CMS_HISTOGRAM_BUCKETS \
+    (CMS_HISTOGRAM_SUB_BUCKETS * (CMS_HISTOGRAM_MAX_SHIFT - CMS_HISTOGRAM_SUB_BITS + 2))
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[CMS_HISTOGRAM_BUCKETS];
+} CmsHistogram;
+
+void cms_histogram_record(CmsHistogram *histogram, uint64_t value);
+/* Highest value sharing a bucket with the value at percentile (0-100), capped at the maximum; 0 if empty */
+uint64_t cms_histogram_percentile(const CmsHistogram *histogram, double percentile);
+/* Smallest value that falls in bucket */
+uint64_t cms_histogram_bucket_low(size_t bucket);
+
+#define CMS_METRICS_MAX_VERBS 64
+#define CMS_METRICS_STATUSES (CMS_STATUS_NOT_IMPLEMENTED + 1)
+
+/* One verb's figures, in nanoseconds */
+typedef struct
+{
+    const char *verb;
+    uint64_t count;
+    uint64_t errors; /* commands that did not return CMS_STATUS_OK */
+    uint64_t statuses[CMS_METRICS_STATUSES];
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+    uint64_t total;
+} CmsVerbMetrics;
+
+void cms_metrics_set_enabled(bool enabled);
+bool cms_metrics_enabled(void);
+/* Monotonic clock in nanoseconds */
+uint64_t cms_metrics_now(void);
+
+/* slot identifies the verb (its row in the command table, below
+   CMS_METRICS_MAX_VERBS); verb must outlive the metrics */
+void cms_metrics_record(size_t slot, const char *verb, CMS_STATUS status, uint64_t elapsed_ns);
+
+/* Fills out with the verbs run so far, in slot order; returns how many */
+size_t cms_metrics_list(CmsVerbMetrics *out, size_t max);
+void cms_metrics_reset(void);
+
+/* Every verb's figures and non-empty buckets as one JSON object, so
+   histograms from several sessions can be added up */
+CMS_STATUS cms_metrics_write_json(FILE *fp);
+CMS_STATUS cms_metrics_save_json(const char *path);
+
+#endif /* CMS_METRICS_H */
@@ -0,0 +1,27 @@
+#ifndef CMS_PARALLEL_H
+#define CMS_PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Runs independent pieces of work on a small pool of threads. The thread
+   count is a process-wide setting (--threads); 1 runs everything inline. */
+#define CMS_MAX_THREADS 64
+
+typedef bool (*CmsTaskFunction)(void *context);
+
+typedef struct
+{
+    CmsTaskFunction run;
+    void *context;
+    bool ok; /* result of run, set by cms_run_tasks */
+} CmsTask;
+
+void cms_set_thread_count(unsigned count);
+unsigned cms_get_thread_count(void);
+
+/* Runs every task, in order of index as threads become free (so put the
+   longest first), and returns once all have finished; true if all did */
+bool cms_run_tasks(CmsTask *tasks, size_t count);
+
+#endif /* CMS_PARALLEL_H */
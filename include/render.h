@@ -0,0 +1,79 @@
+#ifndef CMS_RENDER_H
+#define CMS_RENDER_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Buffered output writer: text is formatted straight into a caller-owned
+   buffer and handed on one full buffer at a time, to a stdio stream (which
+   keeps it ordered with printf) or with one write() to a bare descriptor.
+   A memory writer keeps everything instead, in a buffer that grows. */
+#define CMS_WRITER_BUFFER_SIZE (64 * 1024)
+
+typedef struct
+{
+    int fd;
+    FILE *stream; /* stdio stream behind fd, or NULL to write() to fd directly */
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t bytes_written;
+    bool failed;
+    bool grows;   /* memory writer: buffer is its own, and never drained */
+} CmsWriter;
+
+void cms_writer_init(CmsWriter *writer, int fd, FILE *stream, char *buffer, size_t capacity);
+/* Writes through an open stdio stream */
+void cms_writer_init_stream(CmsWriter *writer, FILE *stream, char *buffer, size_t capacity);
+CMS_STATUS cms_writer_flush(CmsWriter *writer);
+/* Collects output in memory: buffer[0..length) once done, or failed if
+   memory ran out. cms_writer_free releases it. */
+void cms_writer_init_memory(CmsWriter *writer);
+void cms_writer_free(CmsWriter *writer);
+
+void cms_writer_put(CmsWriter *writer, const char *data, size_t length);
+void cms_writer_puts(CmsWriter *writer, const char *text);
+void cms_writer_putc(CmsWriter *writer, char c);
+void cms_writer_repeat(CmsWriter *writer, char c, size_t count);
+
+/* Direct access for hot loops: reserve returns room for length bytes (NULL
+   once the writer has failed), commit then accounts for what was used */
+char *cms_writer_reserve(CmsWriter *writer, size_t length);
+void cms_writer_commit(CmsWriter *writer, size_t length);
+
+/* Equivalents of "%d", "%-*s", "%-*d" and "%-*.1f" */
+void cms_writer_int(CmsWriter *writer, long long value);
+void cms_writer_pad(CmsWriter *writer, const char *text, size_t width);
+void cms_writer_pad_int(CmsWriter *writer, long long value, size_t width);
+void cms_writer_pad_mark(CmsWriter *writer, float mark, size_t width);
+
+/* Writes value in decimal into out (at least 21 bytes); returns the length */
+size_t cms_format_int(long long value, char *out);
+
+/* Formats value like printf("%.1f"); returns the length written to out
+   (out must hold at least CMS_MARK_TEXT_LEN bytes) */
+#define CMS_MARK_TEXT_LEN 48
+size_t cms_format_mark(float mark, char *out);
+
+/* Same for printf("%.*f", decimals, value), decimals up to CMS_FIXED_MAX_DECIMALS */
+#define CMS_FIXED_MAX_DECIMALS 4
+size_t cms_format_fixed(float value, unsigned decimals, char *out);
+
+/* Writer bound to standard output for the table renderer, one per thread,
+   unless the thread's output has been sent elsewhere */
+CmsWriter *cms_stdout_writer(void);
+
+/* Sends the calling thread's command output (cms_stdout_writer and
+   cms_printf) to writer, or back to standard output when NULL. The server
+   gives each request a memory writer this way. */
+void cms_set_thread_output(CmsWriter *writer);
+/* printf for command output: to the thread's writer if it has one */
+int cms_printf(const char *format, ...);
+
+/* Use full buffering for stdout when it is not an interactive terminal */
+void cms_configure_stdout(void);
+bool cms_is_terminal(FILE *stream);
+
+#endif /* CMS_RENDER_H */
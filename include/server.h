@@ -0,0 +1,26 @@
+#ifndef CMS_SERVER_H
+#define CMS_SERVER_H
+
+#include "cms.h"
+
+/* Keeps one database resident and serves the command language to any number
+   of clients over a UNIX domain socket (Linux only). Every request line gets
+   one response, in order, so clients may pipeline:
+
+       OK <line> <bytes>\n<bytes of output>
+       ERR <line> <STATUS> <bytes> <message>\n<bytes of output>
+
+   <line> counts the connection's lines from 1; blank lines and # comments
+   get no response. EXIT or QUIT closes the connection. The event loop hands
+   each client's lines, a bounded number per turn, to worker threads
+   (--threads, at least 4), which collect each command's output in memory.
+   The database sits behind shared.h's lock: commands that only read run
+   side by side, changes run one at a time. Each connection keeps its own
+   transaction and paged listing. */
+CMS_STATUS cms_serve(StudentDatabase *db, const char *socket_path);
+
+/* Makes a running cms_serve return; safe to call from a signal handler or
+   another thread */
+void cms_server_stop(void);
+
+#endif /* CMS_SERVER_H */
@@ -0,0 +1,87 @@
+#ifndef CMS_SHARED_H
+#define CMS_SHARED_H
+
+#include "cms.h"
+#include "index.h"
+#include "summary.h"
+
+/* Thread-safe front end to a StudentDatabase for embedding in multi-threaded
+   programs. Lookups, summaries and sorted views take the lock shared and run
+   in parallel; changes, loads and saves take it exclusively. Results are
+   copied out before the lock is released, so nothing returned points into
+   the database. The plain cms_database_* functions stay single-threaded. */
+typedef struct CmsSharedDatabase CmsSharedDatabase;
+
+/* NULL if memory or the lock could not be set up */
+CmsSharedDatabase *cms_shared_create(void);
+/* Puts the lock in front of a database the caller owns and keeps using
+   only through this handle until it is destroyed (which leaves db as it
+   is). No snapshots are published: cms_snapshot_acquire fails on it. */
+CmsSharedDatabase *cms_shared_attach(StudentDatabase *db);
+void cms_shared_destroy(CmsSharedDatabase *shared);
+
+/* Exclusive; a NULL path for save writes back to the file that was loaded */
+CMS_STATUS cms_shared_load(CmsSharedDatabase *shared, const char *file_path);
+CMS_STATUS cms_shared_save(CmsSharedDatabase *shared, const char *file_path);
+CMS_STATUS cms_shared_insert(CmsSharedDatabase *shared, const StudentRecord *record);
+CMS_STATUS cms_shared_update(CmsSharedDatabase *shared, int student_id, const StudentRecord *new_record);
+CMS_STATUS cms_shared_delete(CmsSharedDatabase *shared, int student_id);
+CMS_STATUS cms_shared_undo(CmsSharedDatabase *shared);
+CMS_STATUS cms_shared_redo(CmsSharedDatabase *shared);
+
+/* Shared */
+CMS_STATUS cms_shared_query(CmsSharedDatabase *shared, int student_id, StudentRecord *out_record);
+CMS_STATUS cms_shared_count(CmsSharedDatabase *shared, const CmsSelection *selection, size_t *out_count);
+CMS_STATUS cms_shared_summary(CmsSharedDatabase *shared, SummaryStats *out_stats);
+
+/* Copies up to capacity records of a sorted view, starting offset rows in,
+   into out_records; *out_count is how many were copied */
+CMS_STATUS cms_shared_sorted(CmsSharedDatabase *shared, CmsSortKey sort_key, CmsSortOrder sort_order,
+                             size_t offset, StudentRecord *out_records, size_t capacity, size_t *out_count);
+
+/* Sorted student IDs whose name contains (or starts with) text; the caller
+   frees *out_ids with cms_free */
+CMS_STATUS cms_shared_search_name(CmsSharedDatabase *shared, const char *text, bool prefix_only,
+                                  int **out_ids, size_t *out_count);
+
+/* Runs work against the database under the shared (read) or exclusive
+   (write) lock, for anything the calls above do not cover. A reader must
+   not change the database, and neither may keep pointers into it. */
+typedef CMS_STATUS (*CmsReadFunction)(const StudentDatabase *db, void *context);
+typedef CMS_STATUS (*CmsWriteFunction)(StudentDatabase *db, void *context);
+
+CMS_STATUS cms_shared_read(CmsSharedDatabase *shared, CmsReadFunction read, void *context);
+CMS_STATUS cms_shared_write(CmsSharedDatabase *shared, CmsWriteFunction write, void *context);
+
+/* Snapshots: every change publishes an immutable version of the table
+   (copy-on-write, so unchanged parts are shared with the previous version).
+   A snapshot pins the latest version without taking the lock, so a long scan
+   neither waits for writers nor holds them up. Versions are freed once no
+   snapshot taken before they were replaced is still held. Secondary indexes
+   are not versioned; snapshots offer scans in table order. */
+#define CMS_MAX_SNAPSHOT_READERS 64
+
+typedef struct CmsVersion CmsVersion;
+
+typedef struct
+{
+    CmsSharedDatabase *shared;
+    const CmsVersion *version;
+    size_t slot;
+} CmsSnapshot;
+
+/* CMS_STATUS_ERROR when CMS_MAX_SNAPSHOT_READERS snapshots are already held
+   or the handle is attached. Release every snapshot; a held one keeps later
+   versions from being freed. */
+CMS_STATUS cms_snapshot_acquire(CmsSharedDatabase *shared, CmsSnapshot *out_snapshot);
+void cms_snapshot_release(CmsSnapshot *snapshot);
+
+size_t cms_snapshot_count(const CmsSnapshot *snapshot);
+unsigned long cms_snapshot_version(const CmsSnapshot *snapshot); /* db->version it reflects */
+
+/* Rows from position on that are stored together: returns the first and sets
+   *out_count, or NULL past the end. Walk a snapshot with position += count. */
+const StudentRecord *cms_snapshot_rows(const CmsSnapshot *snapshot, size_t position, size_t *out_count);
+CMS_STATUS cms_snapshot_summary(const CmsSnapshot *snapshot, SummaryStats *out_stats);
+
+#endif /* CMS_SHARED_H */
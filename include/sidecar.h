@@ -0,0 +1,35 @@
+#ifndef CMS_SIDECAR_H
+#define CMS_SIDECAR_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Index sidecar: the name indexes (BK-tree and trigram postings), which take
+   most of the time of an index build, saved next to a database file as
+   "<file>.idx". It is stamped with the file's size, modification time and a
+   checksum of its contents, and with a checksum of the IDs and names it was
+   built over; a load uses it only while all of them still match and builds
+   the indexes otherwise. The sidecar is a cache of this machine: it is kept
+   in native byte order and one from another kind of machine is not used. */
+#define CMS_SIDECAR_SUFFIX ".idx"
+
+/* An open, validated sidecar: body is what cms_index_save_names wrote */
+typedef struct
+{
+    const unsigned char *body;
+    size_t body_size;
+    void *base;    /* the whole file, mapped or read */
+    size_t length;
+    bool mapped;
+} CmsSidecar;
+
+/* Maps the sidecar of db->file_path and checks it against that file and
+   db's rows; CMS_STATUS_NOT_FOUND when there is none or it is stale */
+CMS_STATUS cms_sidecar_open(const StudentDatabase *db, CmsSidecar *out_sidecar);
+void cms_sidecar_close(CmsSidecar *sidecar);
+
+/* Writes the sidecar of db->file_path, as just saved, from db's indexes */
+CMS_STATUS cms_sidecar_save(const StudentDatabase *db);
+
+#endif /* CMS_SIDECAR_H */
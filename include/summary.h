@@ -25,6 +25,9 @@ typedef enum
     SORT_DESCENDING
 } SortOrder;
 
+/* Record ordering used by sorted views: ascending on the key, ties by ID */
+int cms_compare_records(const StudentRecord *a, const StudentRecord *b, CmsSortKey sort_key);
+
 /* Sorting functions */
 CMS_STATUS cms_sort_by_id(StudentDatabase *db, SortOrder order);
 CMS_STATUS cms_sort_by_name(StudentDatabase *db, SortOrder order);
@@ -45,6 +48,10 @@ typedef enum
     CMS_GRADE_BUCKET_COUNT
 } CmsGradeBucket;
 
+CmsGradeBucket cms_grade_bucket_from_mark(float mark);
+const char *cms_grade_bucket_label(CmsGradeBucket bucket);
+bool cms_grade_bucket_from_label(const char *label, CmsGradeBucket *out_bucket);
+
 typedef struct
 {
     size_t count;
@@ -59,6 +66,11 @@ typedef struct
 } SummaryStats;
 
 CMS_STATUS cms_calculate_summary(const StudentDatabase *db, SummaryStats *stats);
+
+/* The same statistics over records that are not in one array: zero stats
+   and total, add each run of records, then finish to set the average */
+void cms_summary_add(SummaryStats *stats, float *total, const StudentRecord *records, size_t count);
+void cms_summary_finish(SummaryStats *stats, float total);
 CMS_STATUS cms_display_summary(const StudentDatabase *db);
 CMS_STATUS cms_show_summary(const StudentDatabase *db);
 CMS_STATUS cms_show_all(const StudentDatabase *db);
@@ -0,0 +1,73 @@
+#ifndef CMS_TOKENIZER_H
+#define CMS_TOKENIZER_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Zero-copy command tokenizer: tokens are slices of the caller's line, which
+   must outlive them. Nothing is copied, trimmed in place or upper-cased. */
+typedef struct
+{
+    const char *text;
+    size_t length;
+} CmsSlice;
+
+CmsSlice cms_slice(const char *text);
+CmsSlice cms_slice_trim(CmsSlice slice);
+bool cms_slice_is_empty(CmsSlice slice);
+
+/* Cuts the next whitespace-separated word off the front of *rest; false
+   once only whitespace is left */
+bool cms_slice_next_word(CmsSlice *rest, CmsSlice *word);
+
+/* Like cms_slice_next_word, but a "quoted phrase" is one word (without its
+   quotes); false when nothing is left or a quote is not closed */
+bool cms_slice_next_token(CmsSlice *rest, CmsSlice *word);
+
+/* Case-insensitive match of the whole slice against keyword */
+bool cms_slice_equals(CmsSlice slice, const char *keyword);
+
+/* Cuts a case-insensitive prefix off the front of *text; false (text
+   unchanged) when it does not start with it */
+bool cms_slice_skip_prefix(CmsSlice *text, const char *prefix);
+
+/* Same, but keyword must be a whole word: followed by whitespace or the end */
+bool cms_slice_skip_word(CmsSlice *text, const char *keyword);
+
+/* Splits text around the first whole-word, case-insensitive occurrence of
+   keyword; before and after are untrimmed. False if keyword is absent. */
+bool cms_slice_split_at_word(CmsSlice text, const char *keyword, CmsSlice *before, CmsSlice *after);
+
+/* Copies the slice into out as a C string; false (out empty) if it does not fit */
+bool cms_slice_copy(CmsSlice slice, char *out, size_t size);
+
+/* Same rules as cms_parse_int_argument / cms_parse_float_argument */
+bool cms_slice_to_int(CmsSlice slice, int *out_value);
+bool cms_slice_to_float(CmsSlice slice, float *out_value);
+
+/* A command line split once into its verb and the (trimmed) rest */
+typedef struct
+{
+    CmsSlice verb;
+    CmsSlice args;
+} CmsCommandLine;
+
+void cms_tokenize_command(const char *line, CmsCommandLine *out);
+
+/* Values of inline "ID=... NAME=... PROGRAMME=... MARK=..." fields, found in
+   one pass. A value runs up to the next " KEY=" or the end and is trimmed;
+   absent fields have a NULL text. Unknown keys are skipped, and scanning
+   stops at text without an '='. */
+typedef enum
+{
+    CMS_RECORD_FIELD_ID = 0,
+    CMS_RECORD_FIELD_NAME,
+    CMS_RECORD_FIELD_PROGRAMME,
+    CMS_RECORD_FIELD_MARK,
+    CMS_RECORD_FIELD_COUNT
+} CmsRecordField;
+
+void cms_scan_record_fields(CmsSlice text, CmsSlice fields[CMS_RECORD_FIELD_COUNT]);
+
+#endif /* CMS_TOKENIZER_H */
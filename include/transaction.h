@@ -0,0 +1,42 @@
+#ifndef CMS_TRANSACTION_H
+#define CMS_TRANSACTION_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Write set of an open transaction (BEGIN ... COMMIT). Every row the
+   transaction touches has one entry, keyed by student ID, holding the row
+   as the transaction last left it; the table itself is not changed until
+   COMMIT applies the set. */
+typedef struct
+{
+    StudentRecord record; /* latest contents (the removed row once deleted) */
+    bool in_table;        /* the row was in the table when first touched */
+    bool present;         /* the row exists after the transaction */
+    bool moved;           /* deleted and inserted again: it goes to the end */
+    size_t sequence;      /* order of its last insert, for placing new rows */
+} CmsPendingRow;
+
+struct CmsTransaction
+{
+    CmsPendingRow *rows; /* in the order they were first touched */
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;     /* open addressing: row number + 1, 0 when empty */
+    size_t slot_count;   /* power of two */
+    size_t inserts;      /* sequence for the next insert */
+};
+
+CmsTransaction *cms_transaction_create(void);
+void cms_transaction_destroy(CmsTransaction *transaction);
+
+/* The entry for student_id, or NULL if the transaction has not touched it.
+   Entries may move when another is added. */
+CmsPendingRow *cms_transaction_find(const CmsTransaction *transaction, int student_id);
+/* A new entry for an untouched student_id (zeroed, record.id set); NULL if
+   memory ran out */
+CmsPendingRow *cms_transaction_add(CmsTransaction *transaction, int student_id);
+
+#endif /* CMS_TRANSACTION_H */
@@ -16,6 +16,11 @@ void cms_trim_string(char *str);
 void cms_trim(char *str);
 bool cms_string_equals_ignore_case(const char *a, const char *b);
 void cms_string_to_upper(char *str);
+bool cms_string_starts_with_ignore_case(const char *str, const char *prefix);
+bool cms_string_contains_ignore_case(const char *haystack, const char *needle);
+/* Reentrant strtok for one delimiter: skips leading delimiters, cuts the
+   next token off *rest and returns it, or NULL when none is left */
+char *cms_next_token(char **rest, char delimiter);
 
 /* Input reading */
 bool cms_read_line(char *buffer, size_t size);
@@ -25,8 +30,12 @@ bool cms_read_string(const char *prompt, char *buffer, size_t size);
 
 /* Argument parsing */
 bool cms_parse_int_argument(const char *arg, int *out_value);
+bool cms_parse_float_argument(const char *arg, float *out_value);
 
 /* Table display */
 void cms_display_table(const StudentDatabase *db);
+void cms_display_table_header(void);
+void cms_display_table_row(const StudentRecord *record);
+void cms_display_table_footer(void);
 
 #endif /* CMS_UTILS_H */
@@ -0,0 +1,56 @@
+#ifndef CMS_WATCH_H
+#define CMS_WATCH_H
+
+#include "cms.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Follows the open table's file on disk (Linux only, through inotify on its
+   directory, so writers that replace the file by renaming are seen too).
+   When another program changes the file, the file is diffed against the
+   table (diff.h) and only the differing rows are applied, as one undo step
+   that refreshes the indexes for those rows alone.
+
+   A row is a local edit when this session changed it since the file was
+   last loaded, saved or reloaded, found from the undo history. A file
+   change to such a row is a conflict: PREFER_LOCAL keeps the table's row
+   (SAVE writes it back), PREFER_REMOTE takes the file's. */
+typedef enum
+{
+    CMS_WATCH_PREFER_LOCAL = 0,
+    CMS_WATCH_PREFER_REMOTE
+} CmsWatchPolicy;
+
+typedef struct CmsWatch CmsWatch;
+
+/* What one reload did */
+typedef struct
+{
+    size_t added;       /* rows applied from the file */
+    size_t removed;
+    size_t changed;
+    size_t kept;        /* file changes to local edits left out (PREFER_LOCAL) */
+    size_t overwritten; /* local edits replaced by the file (PREFER_REMOTE) */
+    const char *held;   /* why the reload has to wait (CMS_STATUS_INVALID_ARGUMENT) */
+} CmsWatchReport;
+
+/* Starts watching db->file_path as db holds it now. CMS_STATUS_NOT_IMPLEMENTED
+   off Linux. */
+CMS_STATUS cms_watch_start(const StudentDatabase *db, CmsWatchPolicy policy, CmsWatch **out_watch);
+void cms_watch_stop(CmsWatch *watch);
+void cms_watch_set_policy(CmsWatch *watch, CmsWatchPolicy policy);
+CmsWatchPolicy cms_watch_policy(const CmsWatch *watch);
+
+/* db now matches db->file_path on disk (it was just loaded or saved), which
+   is watched from here on; changes queued until now are dropped, so a save
+   of our own is not read back */
+void cms_watch_synced(CmsWatch *watch, const StudentDatabase *db);
+
+/* Applies the file's changes since the last call without blocking.
+   CMS_STATUS_NOT_FOUND when there are none; CMS_STATUS_INVALID_ARGUMENT,
+   once, when a change has to wait (report->held says why; it is retried on
+   later calls); load errors when the new file cannot be read, which leaves
+   the table as it is. */
+CMS_STATUS cms_watch_poll(CmsWatch *watch, StudentDatabase *db, CmsWatchReport *out_report);
+
+#endif /* CMS_WATCH_H */
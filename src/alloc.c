@@ -0,0 +1,148 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../include/alloc.h"
+
+/* In front of every block: two words, which keeps the block as aligned as
+   malloc's own on the platforms we build for */
+typedef struct
+{
+    size_t size;
+    size_t kind;
+} CmsBlockHeader;
+
+typedef struct
+{
+    atomic_size_t current;
+    atomic_size_t peak;
+    atomic_size_t blocks;
+} CmsMemCounter;
+
+/* One counter per kind, then the total */
+static CmsMemCounter cms_mem_counters[CMS_MEM_KIND_COUNT + 1];
+
+static const char *cms_mem_kind_names[CMS_MEM_KIND_COUNT + 1] = {"Records", "Strings", "Indexes", "Undo",
+                                                                  "Temp", "Session", "Total"};
+
+static void cms_mem_raise_peak(CmsMemCounter *counter, size_t current)
+{
+    size_t peak = atomic_load(&counter->peak);
+    while (current > peak && !atomic_compare_exchange_weak(&counter->peak, &peak, current))
+    {
+    }
+}
+
+static void cms_mem_count(size_t kind, size_t size, bool allocated)
+{
+    CmsMemCounter *counters[2] = {&cms_mem_counters[kind], &cms_mem_counters[CMS_MEM_KIND_COUNT]};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (allocated)
+        {
+            size_t current = atomic_fetch_add(&counters[i]->current, size) + size;
+            atomic_fetch_add(&counters[i]->blocks, 1);
+            cms_mem_raise_peak(counters[i], current);
+        }
+        else
+        {
+            atomic_fetch_sub(&counters[i]->current, size);
+            atomic_fetch_sub(&counters[i]->blocks, 1);
+        }
+    }
+}
+
+void *cms_malloc(CmsMemKind kind, size_t size)
+{
+    if ((unsigned)kind >= CMS_MEM_KIND_COUNT || size > SIZE_MAX - sizeof(CmsBlockHeader))
+    {
+        return NULL;
+    }
+    CmsBlockHeader *header = malloc(sizeof(CmsBlockHeader) + size);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    header->size = size;
+    header->kind = (size_t)kind;
+    cms_mem_count(header->kind, size, true);
+    return header + 1;
+}
+
+void *cms_calloc(CmsMemKind kind, size_t count, size_t size)
+{
+    if ((unsigned)kind >= CMS_MEM_KIND_COUNT || (size != 0 && count > (SIZE_MAX - sizeof(CmsBlockHeader)) / size))
+    {
+        return NULL;
+    }
+    CmsBlockHeader *header = calloc(1, sizeof(CmsBlockHeader) + count * size);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    header->size = count * size;
+    header->kind = (size_t)kind;
+    cms_mem_count(header->kind, header->size, true);
+    return header + 1;
+}
+
+void *cms_realloc(CmsMemKind kind, void *block, size_t size)
+{
+    if (block == NULL)
+    {
+        return cms_malloc(kind, size);
+    }
+    if (size > SIZE_MAX - sizeof(CmsBlockHeader))
+    {
+        return NULL;
+    }
+
+    CmsBlockHeader *header = (CmsBlockHeader *)block - 1;
+    size_t old_size = header->size;
+    size_t old_kind = header->kind;
+    CmsBlockHeader *moved = realloc(header, sizeof(CmsBlockHeader) + size);
+    if (moved == NULL)
+    {
+        return NULL;
+    }
+    moved->size = size;
+    cms_mem_count(old_kind, old_size, false);
+    cms_mem_count(old_kind, size, true);
+    return moved + 1;
+}
+
+void cms_free(void *block)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+    CmsBlockHeader *header = (CmsBlockHeader *)block - 1;
+    cms_mem_count(header->kind, header->size, false);
+    free(header);
+}
+
+CmsMemUsage cms_mem_usage(CmsMemKind kind)
+{
+    CmsMemUsage usage = {0, 0, 0};
+    if ((unsigned)kind > CMS_MEM_KIND_COUNT)
+    {
+        return usage;
+    }
+    usage.current = atomic_load(&cms_mem_counters[kind].current);
+    usage.peak = atomic_load(&cms_mem_counters[kind].peak);
+    usage.blocks = atomic_load(&cms_mem_counters[kind].blocks);
+    return usage;
+}
+
+const char *cms_mem_kind_name(CmsMemKind kind)
+{
+    return ((unsigned)kind <= CMS_MEM_KIND_COUNT) ? cms_mem_kind_names[kind] : "Unknown";
+}
+
+void cms_mem_reset_peaks(void)
+{
+    for (size_t i = 0; i <= CMS_MEM_KIND_COUNT; ++i)
+    {
+        atomic_store(&cms_mem_counters[i].peak, atomic_load(&cms_mem_counters[i].current));
+    }
+}
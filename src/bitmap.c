@@ -0,0 +1,788 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/bitmap.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+
+static unsigned cms_popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static unsigned cms_ctz64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned bit = 0;
+    while ((x & 1U) == 0)
+    {
+        x >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/* The word loops below are written as plain fixed-length loops over
+   independent lanes so the compiler can vectorise them (SSE/AVX/NEON). */
+static uint32_t cms_words_and(const uint64_t *a, const uint64_t *b, uint64_t *out)
+{
+    uint32_t cardinality = 0;
+    for (size_t i = 0; i < CMS_BITMAP_WORDS; ++i)
+    {
+        out[i] = a[i] & b[i];
+    }
+    for (size_t i = 0; i < CMS_BITMAP_WORDS; ++i)
+    {
+        cardinality += cms_popcount64(out[i]);
+    }
+    return cardinality;
+}
+
+static uint32_t cms_words_or(const uint64_t *a, const uint64_t *b, uint64_t *out)
+{
+    uint32_t cardinality = 0;
+    for (size_t i = 0; i < CMS_BITMAP_WORDS; ++i)
+    {
+        out[i] = a[i] | b[i];
+    }
+    for (size_t i = 0; i < CMS_BITMAP_WORDS; ++i)
+    {
+        cardinality += cms_popcount64(out[i]);
+    }
+    return cardinality;
+}
+
+static uint32_t cms_words_and_count(const uint64_t *a, const uint64_t *b)
+{
+    uint32_t cardinality = 0;
+    for (size_t i = 0; i < CMS_BITMAP_WORDS; ++i)
+    {
+        cardinality += cms_popcount64(a[i] & b[i]);
+    }
+    return cardinality;
+}
+
+static bool cms_words_test(const uint64_t *words, uint16_t low)
+{
+    return (words[low >> 6] >> (low & 63)) & 1U;
+}
+
+/* ===== Containers ===== */
+
+static void cms_container_free(CmsBitmapContainer *c)
+{
+    cms_free(c->array);
+    cms_free(c->words);
+    c->array = NULL;
+    c->words = NULL;
+    c->cardinality = 0;
+    c->array_capacity = 0;
+}
+
+static size_t cms_array_lower_bound(const uint16_t *array, size_t count, uint16_t low)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (array[mid] < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool cms_container_to_words(CmsBitmapContainer *c)
+{
+    uint64_t *words = cms_calloc(CMS_MEM_INDEXES, CMS_BITMAP_WORDS, sizeof(uint64_t));
+    if (words == NULL)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < c->cardinality; ++i)
+    {
+        words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+    }
+    cms_free(c->array);
+    c->array = NULL;
+    c->array_capacity = 0;
+    c->words = words;
+    return true;
+}
+
+static bool cms_container_to_array(CmsBitmapContainer *c)
+{
+    uint16_t *array = cms_malloc(CMS_MEM_INDEXES, (c->cardinality > 0 ? c->cardinality : 1) * sizeof(uint16_t));
+    if (array == NULL)
+    {
+        return false;
+    }
+    uint32_t n = 0;
+    for (uint32_t w = 0; w < CMS_BITMAP_WORDS; ++w)
+    {
+        uint64_t word = c->words[w];
+        while (word != 0)
+        {
+            unsigned bit = cms_ctz64(word);
+            array[n++] = (uint16_t)(w * 64 + bit);
+            word &= word - 1;
+        }
+    }
+    cms_free(c->words);
+    c->words = NULL;
+    c->array = array;
+    c->array_capacity = c->cardinality;
+    return true;
+}
+
+static bool cms_container_add(CmsBitmapContainer *c, uint16_t low)
+{
+    if (c->words != NULL)
+    {
+        uint64_t mask = 1ULL << (low & 63);
+        if ((c->words[low >> 6] & mask) == 0)
+        {
+            c->words[low >> 6] |= mask;
+            c->cardinality++;
+        }
+        return true;
+    }
+
+    size_t at = cms_array_lower_bound(c->array, c->cardinality, low);
+    if (at < c->cardinality && c->array[at] == low)
+    {
+        return true;
+    }
+
+    if (c->cardinality >= CMS_BITMAP_ARRAY_MAX)
+    {
+        return cms_container_to_words(c) && cms_container_add(c, low);
+    }
+
+    if (c->cardinality == c->array_capacity)
+    {
+        uint32_t new_capacity = (c->array_capacity == 0) ? 4 : c->array_capacity * CMS_GROWTH_FACTOR;
+        if (new_capacity > CMS_BITMAP_ARRAY_MAX)
+        {
+            new_capacity = CMS_BITMAP_ARRAY_MAX;
+        }
+        uint16_t *grown = cms_realloc(CMS_MEM_INDEXES, c->array, new_capacity * sizeof(uint16_t));
+        if (grown == NULL)
+        {
+            return false;
+        }
+        c->array = grown;
+        c->array_capacity = new_capacity;
+    }
+
+    memmove(&c->array[at + 1], &c->array[at], (c->cardinality - at) * sizeof(uint16_t));
+    c->array[at] = low;
+    c->cardinality++;
+    return true;
+}
+
+static void cms_container_remove(CmsBitmapContainer *c, uint16_t low)
+{
+    if (c->words != NULL)
+    {
+        uint64_t mask = 1ULL << (low & 63);
+        if (c->words[low >> 6] & mask)
+        {
+            c->words[low >> 6] &= ~mask;
+            c->cardinality--;
+            if (c->cardinality <= CMS_BITMAP_ARRAY_MAX / 2)
+            {
+                /* Keep the bitset on failure; it is still correct */
+                cms_container_to_array(c);
+            }
+        }
+        return;
+    }
+
+    size_t at = cms_array_lower_bound(c->array, c->cardinality, low);
+    if (at < c->cardinality && c->array[at] == low)
+    {
+        memmove(&c->array[at], &c->array[at + 1], (c->cardinality - at - 1) * sizeof(uint16_t));
+        c->cardinality--;
+    }
+}
+
+static bool cms_container_contains(const CmsBitmapContainer *c, uint16_t low)
+{
+    if (c->words != NULL)
+    {
+        return cms_words_test(c->words, low);
+    }
+    size_t at = cms_array_lower_bound(c->array, c->cardinality, low);
+    return at < c->cardinality && c->array[at] == low;
+}
+
+/* ===== Bitmap ===== */
+
+void cms_bitmap_init(CmsBitmap *bitmap)
+{
+    if (bitmap == NULL)
+    {
+        return;
+    }
+    bitmap->containers = NULL;
+    bitmap->count = 0;
+    bitmap->capacity = 0;
+}
+
+void cms_bitmap_clear(CmsBitmap *bitmap)
+{
+    if (bitmap == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < bitmap->count; ++i)
+    {
+        cms_container_free(&bitmap->containers[i]);
+    }
+    bitmap->count = 0;
+}
+
+void cms_bitmap_free(CmsBitmap *bitmap)
+{
+    if (bitmap == NULL)
+    {
+        return;
+    }
+    cms_bitmap_clear(bitmap);
+    cms_free(bitmap->containers);
+    cms_bitmap_init(bitmap);
+}
+
+static size_t cms_bitmap_find(const CmsBitmap *bitmap, uint16_t key)
+{
+    /* Appends in ascending order are the common case (bulk builds) */
+    if (bitmap->count > 0 && bitmap->containers[bitmap->count - 1].key < key)
+    {
+        return bitmap->count;
+    }
+
+    size_t lo = 0;
+    size_t hi = bitmap->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (bitmap->containers[mid].key < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static CmsBitmapContainer *cms_bitmap_insert_container(CmsBitmap *bitmap, size_t at, uint16_t key)
+{
+    if (bitmap->count == bitmap->capacity)
+    {
+        size_t new_capacity = (bitmap->capacity == 0) ? 4 : bitmap->capacity * CMS_GROWTH_FACTOR;
+        CmsBitmapContainer *grown =
+            cms_realloc(CMS_MEM_INDEXES, bitmap->containers, new_capacity * sizeof(CmsBitmapContainer));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        bitmap->containers = grown;
+        bitmap->capacity = new_capacity;
+    }
+
+    memmove(&bitmap->containers[at + 1], &bitmap->containers[at],
+            (bitmap->count - at) * sizeof(CmsBitmapContainer));
+    CmsBitmapContainer *c = &bitmap->containers[at];
+    memset(c, 0, sizeof(CmsBitmapContainer));
+    c->key = key;
+    bitmap->count++;
+    return c;
+}
+
+bool cms_bitmap_add(CmsBitmap *bitmap, uint32_t value)
+{
+    if (bitmap == NULL)
+    {
+        return false;
+    }
+
+    uint16_t key = (uint16_t)(value >> 16);
+    size_t at = cms_bitmap_find(bitmap, key);
+    CmsBitmapContainer *c;
+    if (at < bitmap->count && bitmap->containers[at].key == key)
+    {
+        c = &bitmap->containers[at];
+    }
+    else
+    {
+        c = cms_bitmap_insert_container(bitmap, at, key);
+        if (c == NULL)
+        {
+            return false;
+        }
+    }
+    return cms_container_add(c, (uint16_t)(value & 0xFFFFU));
+}
+
+void cms_bitmap_remove(CmsBitmap *bitmap, uint32_t value)
+{
+    if (bitmap == NULL)
+    {
+        return;
+    }
+
+    uint16_t key = (uint16_t)(value >> 16);
+    size_t at = cms_bitmap_find(bitmap, key);
+    if (at >= bitmap->count || bitmap->containers[at].key != key)
+    {
+        return;
+    }
+
+    CmsBitmapContainer *c = &bitmap->containers[at];
+    cms_container_remove(c, (uint16_t)(value & 0xFFFFU));
+    if (c->cardinality == 0)
+    {
+        cms_container_free(c);
+        memmove(&bitmap->containers[at], &bitmap->containers[at + 1],
+                (bitmap->count - at - 1) * sizeof(CmsBitmapContainer));
+        bitmap->count--;
+    }
+}
+
+bool cms_bitmap_contains(const CmsBitmap *bitmap, uint32_t value)
+{
+    if (bitmap == NULL)
+    {
+        return false;
+    }
+
+    uint16_t key = (uint16_t)(value >> 16);
+    size_t at = cms_bitmap_find(bitmap, key);
+    return at < bitmap->count && bitmap->containers[at].key == key &&
+           cms_container_contains(&bitmap->containers[at], (uint16_t)(value & 0xFFFFU));
+}
+
+size_t cms_bitmap_cardinality(const CmsBitmap *bitmap)
+{
+    if (bitmap == NULL)
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < bitmap->count; ++i)
+    {
+        total += bitmap->containers[i].cardinality;
+    }
+    return total;
+}
+
+/* Appends a finished container (keys arrive in ascending order) */
+static bool cms_bitmap_push(CmsBitmap *out, CmsBitmapContainer *c)
+{
+    if (c->cardinality == 0)
+    {
+        cms_container_free(c);
+        return true;
+    }
+
+    CmsBitmapContainer *slot = cms_bitmap_insert_container(out, out->count, c->key);
+    if (slot == NULL)
+    {
+        cms_container_free(c);
+        return false;
+    }
+    *slot = *c;
+    return true;
+}
+
+static bool cms_container_clone(const CmsBitmapContainer *src, CmsBitmapContainer *dst)
+{
+    memset(dst, 0, sizeof(CmsBitmapContainer));
+    dst->key = src->key;
+    dst->cardinality = src->cardinality;
+    if (src->words != NULL)
+    {
+        dst->words = cms_malloc(CMS_MEM_INDEXES, CMS_BITMAP_WORDS * sizeof(uint64_t));
+        if (dst->words == NULL)
+        {
+            return false;
+        }
+        memcpy(dst->words, src->words, CMS_BITMAP_WORDS * sizeof(uint64_t));
+        return true;
+    }
+
+    dst->array = cms_malloc(CMS_MEM_INDEXES, (src->cardinality > 0 ? src->cardinality : 1) * sizeof(uint16_t));
+    if (dst->array == NULL)
+    {
+        return false;
+    }
+    memcpy(dst->array, src->array, src->cardinality * sizeof(uint16_t));
+    dst->array_capacity = src->cardinality;
+    return true;
+}
+
+static bool cms_container_and(const CmsBitmapContainer *a, const CmsBitmapContainer *b,
+                              CmsBitmapContainer *out)
+{
+    memset(out, 0, sizeof(CmsBitmapContainer));
+    out->key = a->key;
+
+    if (a->words != NULL && b->words != NULL)
+    {
+        out->words = cms_malloc(CMS_MEM_INDEXES, CMS_BITMAP_WORDS * sizeof(uint64_t));
+        if (out->words == NULL)
+        {
+            return false;
+        }
+        out->cardinality = cms_words_and(a->words, b->words, out->words);
+        if (out->cardinality <= CMS_BITMAP_ARRAY_MAX)
+        {
+            return cms_container_to_array(out);
+        }
+        return true;
+    }
+
+    /* At least one side is an array: the result fits in the smaller array */
+    const CmsBitmapContainer *small = (a->words == NULL) ? a : b;
+    const CmsBitmapContainer *other = (small == a) ? b : a;
+    if (other->words == NULL && other->cardinality < small->cardinality)
+    {
+        const CmsBitmapContainer *tmp = small;
+        small = other;
+        other = tmp;
+    }
+
+    out->array = cms_malloc(CMS_MEM_INDEXES, (small->cardinality > 0 ? small->cardinality : 1) * sizeof(uint16_t));
+    if (out->array == NULL)
+    {
+        return false;
+    }
+    out->array_capacity = small->cardinality;
+
+    uint32_t n = 0;
+    if (other->words != NULL)
+    {
+        for (uint32_t i = 0; i < small->cardinality; ++i)
+        {
+            if (cms_words_test(other->words, small->array[i]))
+            {
+                out->array[n++] = small->array[i];
+            }
+        }
+    }
+    else
+    {
+        uint32_t i = 0;
+        uint32_t j = 0;
+        while (i < small->cardinality && j < other->cardinality)
+        {
+            if (small->array[i] < other->array[j])
+            {
+                i++;
+            }
+            else if (small->array[i] > other->array[j])
+            {
+                j++;
+            }
+            else
+            {
+                out->array[n++] = small->array[i];
+                i++;
+                j++;
+            }
+        }
+    }
+    out->cardinality = n;
+    return true;
+}
+
+static bool cms_container_or(const CmsBitmapContainer *a, const CmsBitmapContainer *b,
+                             CmsBitmapContainer *out)
+{
+    memset(out, 0, sizeof(CmsBitmapContainer));
+    out->key = a->key;
+
+    if (a->words != NULL && b->words != NULL)
+    {
+        out->words = cms_malloc(CMS_MEM_INDEXES, CMS_BITMAP_WORDS * sizeof(uint64_t));
+        if (out->words == NULL)
+        {
+            return false;
+        }
+        out->cardinality = cms_words_or(a->words, b->words, out->words);
+        return true;
+    }
+
+    if (a->words != NULL || b->words != NULL)
+    {
+        const CmsBitmapContainer *dense = (a->words != NULL) ? a : b;
+        const CmsBitmapContainer *sparse = (dense == a) ? b : a;
+        if (!cms_container_clone(dense, out))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < sparse->cardinality; ++i)
+        {
+            uint16_t low = sparse->array[i];
+            uint64_t mask = 1ULL << (low & 63);
+            if ((out->words[low >> 6] & mask) == 0)
+            {
+                out->words[low >> 6] |= mask;
+                out->cardinality++;
+            }
+        }
+        return true;
+    }
+
+    uint32_t total = a->cardinality + b->cardinality;
+    out->array = cms_malloc(CMS_MEM_INDEXES, (total > 0 ? total : 1) * sizeof(uint16_t));
+    if (out->array == NULL)
+    {
+        return false;
+    }
+    out->array_capacity = total;
+
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint32_t n = 0;
+    while (i < a->cardinality || j < b->cardinality)
+    {
+        if (j >= b->cardinality || (i < a->cardinality && a->array[i] < b->array[j]))
+        {
+            out->array[n++] = a->array[i++];
+        }
+        else if (i >= a->cardinality || b->array[j] < a->array[i])
+        {
+            out->array[n++] = b->array[j++];
+        }
+        else
+        {
+            out->array[n++] = a->array[i];
+            i++;
+            j++;
+        }
+    }
+    out->cardinality = n;
+
+    if (n > CMS_BITMAP_ARRAY_MAX)
+    {
+        return cms_container_to_words(out);
+    }
+    return true;
+}
+
+CMS_STATUS cms_bitmap_and(const CmsBitmap *a, const CmsBitmap *b, CmsBitmap *out)
+{
+    if (a == NULL || b == NULL || out == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_bitmap_clear(out);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a->count && j < b->count)
+    {
+        uint16_t ka = a->containers[i].key;
+        uint16_t kb = b->containers[j].key;
+        if (ka < kb)
+        {
+            i++;
+        }
+        else if (ka > kb)
+        {
+            j++;
+        }
+        else
+        {
+            CmsBitmapContainer c;
+            if (!cms_container_and(&a->containers[i], &b->containers[j], &c) ||
+                !cms_bitmap_push(out, &c))
+            {
+                cms_container_free(&c);
+                return CMS_STATUS_ERROR;
+            }
+            i++;
+            j++;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_bitmap_or(const CmsBitmap *a, const CmsBitmap *b, CmsBitmap *out)
+{
+    if (a == NULL || b == NULL || out == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_bitmap_clear(out);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a->count || j < b->count)
+    {
+        CmsBitmapContainer c;
+        bool ok;
+        if (j >= b->count || (i < a->count && a->containers[i].key < b->containers[j].key))
+        {
+            ok = cms_container_clone(&a->containers[i++], &c);
+        }
+        else if (i >= a->count || b->containers[j].key < a->containers[i].key)
+        {
+            ok = cms_container_clone(&b->containers[j++], &c);
+        }
+        else
+        {
+            ok = cms_container_or(&a->containers[i++], &b->containers[j++], &c);
+        }
+
+        if (!ok || !cms_bitmap_push(out, &c))
+        {
+            cms_container_free(&c);
+            return CMS_STATUS_ERROR;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_bitmap_copy(const CmsBitmap *src, CmsBitmap *out)
+{
+    if (src == NULL || out == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_bitmap_clear(out);
+    for (size_t i = 0; i < src->count; ++i)
+    {
+        CmsBitmapContainer c;
+        if (!cms_container_clone(&src->containers[i], &c) || !cms_bitmap_push(out, &c))
+        {
+            cms_container_free(&c);
+            return CMS_STATUS_ERROR;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+size_t cms_bitmap_and_cardinality(const CmsBitmap *a, const CmsBitmap *b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a->count && j < b->count)
+    {
+        const CmsBitmapContainer *ca = &a->containers[i];
+        const CmsBitmapContainer *cb = &b->containers[j];
+        if (ca->key < cb->key)
+        {
+            i++;
+            continue;
+        }
+        if (ca->key > cb->key)
+        {
+            j++;
+            continue;
+        }
+
+        if (ca->words != NULL && cb->words != NULL)
+        {
+            total += cms_words_and_count(ca->words, cb->words);
+        }
+        else if (ca->words != NULL || cb->words != NULL)
+        {
+            const CmsBitmapContainer *dense = (ca->words != NULL) ? ca : cb;
+            const CmsBitmapContainer *sparse = (dense == ca) ? cb : ca;
+            for (uint32_t k = 0; k < sparse->cardinality; ++k)
+            {
+                total += cms_words_test(dense->words, sparse->array[k]);
+            }
+        }
+        else
+        {
+            uint32_t x = 0;
+            uint32_t y = 0;
+            while (x < ca->cardinality && y < cb->cardinality)
+            {
+                if (ca->array[x] < cb->array[y])
+                {
+                    x++;
+                }
+                else if (ca->array[x] > cb->array[y])
+                {
+                    y++;
+                }
+                else
+                {
+                    total++;
+                    x++;
+                    y++;
+                }
+            }
+        }
+        i++;
+        j++;
+    }
+    return total;
+}
+
+size_t cms_bitmap_to_array(const CmsBitmap *bitmap, uint32_t *out)
+{
+    if (bitmap == NULL || out == NULL)
+    {
+        return 0;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < bitmap->count; ++i)
+    {
+        const CmsBitmapContainer *c = &bitmap->containers[i];
+        uint32_t high = (uint32_t)c->key << 16;
+        if (c->words == NULL)
+        {
+            for (uint32_t k = 0; k < c->cardinality; ++k)
+            {
+                out[n++] = high | c->array[k];
+            }
+            continue;
+        }
+
+        for (uint32_t w = 0; w < CMS_BITMAP_WORDS; ++w)
+        {
+            uint64_t word = c->words[w];
+            while (word != 0)
+            {
+                unsigned bit = cms_ctz64(word);
+                out[n++] = high | (w * 64 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+    return n;
+}
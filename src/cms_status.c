@@ -26,6 +26,31 @@ const char *cms_status_message(CMS_STATUS status)
     }
 }
 
+const char *cms_status_name(CMS_STATUS status)
+{
+    switch (status)
+    {
+    case CMS_STATUS_OK:
+        return "OK";
+    case CMS_STATUS_ERROR:
+        return "ERROR";
+    case CMS_STATUS_INVALID_ARGUMENT:
+        return "INVALID_ARGUMENT";
+    case CMS_STATUS_IO:
+        return "IO";
+    case CMS_STATUS_PARSE_ERROR:
+        return "PARSE_ERROR";
+    case CMS_STATUS_NOT_FOUND:
+        return "NOT_FOUND";
+    case CMS_STATUS_DUPLICATE:
+        return "DUPLICATE";
+    case CMS_STATUS_NOT_IMPLEMENTED:
+        return "NOT_IMPLEMENTED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
 void cms_print_status(CMS_STATUS status)
 {
     if (status != CMS_STATUS_OK)
@@ -2,41 +2,178 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <float.h>
+#include <pthread.h>
+#include <time.h>
 #include "../include/commands.h"
+#include "../include/alloc.h"
 #include "../include/database.h"
 #include "../include/summary.h"
 #include "../include/utils.h"
 #include "../include/config.h"
+#include "../include/index.h"
+#include "../include/export.h"
+#include "../include/diff.h"
+#include "../include/tokenizer.h"
+#include "../include/watch.h"
+#include "../include/metrics.h"
+#include "../include/transaction.h"
+#include "../include/render.h"
+
+/* Prompting behaviour for the session, set from the command line */
+static CmsSessionOptions cms_session = {false, false, false};
+
+void cms_set_session_options(const CmsSessionOptions *options)
+{
+    if (options != NULL)
+    {
+        cms_session = *options;
+    }
+}
+
+const CmsSessionOptions *cms_get_session_options(void)
+{
+    return &cms_session;
+}
+
+/* The open file followed by WATCH, NULL while it is off. WATCH OFF with
+   unsaved changes only pauses it: the watch keeps which rows earlier reloads
+   took from the file, which WATCH ON needs to tell them from edits made here. */
+static CmsWatch *cms_file_watch = NULL;
+static bool cms_file_watch_paused = false;
+
+/* Reports commands that must wait for COMMIT or ROLLBACK: loading, saving,
+   undo and redo work on committed rows only, and database.c refuses them
+   without saying why */
+static bool cms_in_open_transaction(const StudentDatabase *db)
+{
+    if (db->transaction == NULL)
+    {
+        return false;
+    }
+    cms_printf("CMS: Finish the open transaction with COMMIT or ROLLBACK first.\n");
+    return true;
+}
+
+/* Usage mistakes are only reported as text at the prompt, but count as
+   failed commands in batch mode */
+static CMS_STATUS cms_usage_status(void)
+{
+    return cms_session.batch ? CMS_STATUS_INVALID_ARGUMENT : CMS_STATUS_OK;
+}
+
+/* What a load read and which rows it refused */
+static void cms_print_load_report(const CmsLoadReport *report, CMS_STATUS status)
+{
+    /* Nothing was read if the file could not be opened */
+    if (status != CMS_STATUS_IO && status != CMS_STATUS_INVALID_ARGUMENT)
+    {
+        cms_printf("Loaded %zu record(s)\n", report->loaded);
+    }
+    for (size_t i = 0; i < report->error_count; ++i)
+    {
+        const CmsLoadError *error = &report->errors[i];
+        cms_printf("CMS: %s %zu, %s: %s\n", (report->format == CMS_FILE_FORMAT_BINARY) ? "Record" : "Line",
+               error->line, error->field, error->reason);
+    }
+    if (report->skipped > report->error_count)
+    {
+        cms_printf("CMS: ... and %zu more.\n", report->skipped - report->error_count);
+    }
+    if (status == CMS_STATUS_OK && report->skipped > 0)
+    {
+        cms_printf("CMS: Skipped %zu bad row(s); the file is unchanged until you SAVE.\n", report->skipped);
+    }
+}
 
 /**
  * Opens a student database file.
  * @param db Pointer to the StudentDatabase structure to load data into.
- * @param filename Path to the database file (uses CMS_DEFAULT_DATABASE_FILE if NULL or empty).
+ * @param filename Path to the database file (uses CMS_DEFAULT_DATABASE_FILE if empty).
  * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
  */
-CMS_STATUS cmd_open(StudentDatabase *db, const char *filename)
+CMS_STATUS cmd_open(StudentDatabase *db, CmsSlice filename)
 {
     if (db == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
+    filename = cms_slice_trim(filename);
+    if (cms_slice_is_empty(filename))
+    {
+        filename = cms_slice(CMS_DEFAULT_DATABASE_FILE);
+    }
+
     char path_buffer[CMS_MAX_FILE_PATH_LEN];
-    if (filename == NULL || filename[0] == '\0')
+    if (!cms_slice_copy(filename, path_buffer, sizeof(path_buffer)))
+    {
+        cms_printf("CMS: The file path is too long.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsLoadReport report;
+    CMS_STATUS status = cms_database_load_checked(db, path_buffer, cms_session.lenient, &report);
+    cms_print_load_report(&report, status);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_watch_synced(cms_file_watch, db);
+    }
+    return status;
+}
+
+/* SHOW with an option ("SUMMARY", "ALL" or a sort key, empty for ID) and an
+   optional "ASC"/"DESC" order, both matched without case */
+static CMS_STATUS cms_show_view(const StudentDatabase *db, CmsSlice option, CmsSlice order)
+{
+    if (cms_slice_equals(option, "SUMMARY"))
+    {
+        return cms_display_summary(db);
+    }
+
+    if (cms_slice_equals(option, "ALL"))
     {
-        filename = CMS_DEFAULT_DATABASE_FILE;
+        return cms_database_show_all(db);
     }
 
-    strncpy(path_buffer, filename, sizeof(path_buffer) - 1);
-    path_buffer[sizeof(path_buffer) - 1] = '\0';
-    cms_trim_string(path_buffer);
+    CmsSortKey sort_key;
+    if (cms_slice_is_empty(option) || cms_slice_equals(option, "ID"))
+    {
+        sort_key = CMS_SORT_KEY_ID;
+    }
+    else if (cms_slice_equals(option, "MARK"))
+    {
+        sort_key = CMS_SORT_KEY_MARK;
+    }
+    else if (cms_slice_equals(option, "NAME"))
+    {
+        sort_key = CMS_SORT_KEY_NAME;
+    }
+    else if (cms_slice_equals(option, "PROGRAMME"))
+    {
+        sort_key = CMS_SORT_KEY_PROGRAMME;
+    }
+    else
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
 
-    if (path_buffer[0] == '\0')
+    CmsSortOrder sort_order = CMS_SORT_ASC;
+    if (cms_slice_equals(order, "DESC"))
+    {
+        sort_order = CMS_SORT_DESC;
+    }
+    else if (!cms_slice_is_empty(order) && !cms_slice_equals(order, "ASC"))
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    return cms_database_load(db, path_buffer);
+    return cms_database_show_sorted(db, sort_key, sort_order);
 }
 
 /**
@@ -48,196 +185,278 @@ CMS_STATUS cmd_open(StudentDatabase *db, const char *filename)
  */
 CMS_STATUS cmd_show(const StudentDatabase *db, const char *option, const char *order)
 {
-    if (db == NULL)
+    if (db == NULL || option == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
-    if (option == NULL)
+    return cms_show_view(db, cms_slice_trim(cms_slice(option)), cms_slice_trim(cms_slice(order)));
+}
+
+/* Prints up to limit rows (0 for all remaining) from a cursor as one table */
+static void cms_show_cursor_page(CmsCursor *cursor, size_t limit)
+{
+    size_t first = cursor->position + 1;
+    size_t shown = 0;
+    const StudentRecord *record = NULL;
+    while ((limit == 0 || shown < limit) && cms_cursor_next(cursor, &record) == CMS_STATUS_OK)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        if (shown == 0)
+        {
+            cms_display_table_header();
+        }
+        cms_display_table_row(record);
+        shown++;
     }
 
-    char opt_buf[32];
-    char ord_buf[16];
+    if (shown == 0)
+    {
+        cms_printf("\nNo records in that range.\n\n");
+        return;
+    }
+    cms_display_table_footer();
+    cms_printf("CMS: Rows %zu-%zu of %zu.\n", first, first + shown - 1, cursor->total);
+}
 
-    strncpy(opt_buf, option, sizeof(opt_buf) - 1);
-    opt_buf[sizeof(opt_buf) - 1] = '\0';
-    cms_trim_string(opt_buf);
+static void cms_close_page_cursor(StudentDatabase *db)
+{
+    if (db->page_cursor != NULL)
+    {
+        cms_cursor_close(db->page_cursor);
+        cms_free(db->page_cursor);
+        db->page_cursor = NULL;
+    }
+    db->page_size = 0;
+}
 
-    if (order)
+/* Parses "ALL" (file order, also when empty) or a sort key with an optional
+   "ASC"/"DESC" order into a cursor view */
+static bool cms_parse_sort_view(CmsSlice option, CmsSlice order, bool *sorted,
+                                CmsSortKey *sort_key, CmsSortOrder *sort_order)
+{
+    *sorted = true;
+    *sort_key = CMS_SORT_KEY_ID;
+    if (cms_slice_is_empty(option) || cms_slice_equals(option, "ALL"))
     {
-        strncpy(ord_buf, order, sizeof(ord_buf) - 1);
-        ord_buf[sizeof(ord_buf) - 1] = '\0';
-        cms_trim_string(ord_buf);
+        *sorted = false;
     }
-    else
+    else if (cms_slice_equals(option, "MARK"))
     {
-        ord_buf[0] = '\0';
+        *sort_key = CMS_SORT_KEY_MARK;
     }
-
-    cms_string_to_upper(opt_buf);
-
-    if (strcmp(opt_buf, "SUMMARY") == 0)
+    else if (cms_slice_equals(option, "NAME"))
     {
-        return cms_display_summary(db);
+        *sort_key = CMS_SORT_KEY_NAME;
+    }
+    else if (cms_slice_equals(option, "PROGRAMME"))
+    {
+        *sort_key = CMS_SORT_KEY_PROGRAMME;
+    }
+    else if (!cms_slice_equals(option, "ID"))
+    {
+        return false;
     }
 
-    if (strcmp(opt_buf, "ALL") == 0)
+    *sort_order = CMS_SORT_ASC;
+    if (cms_slice_equals(order, "DESC"))
     {
-        return cms_database_show_all(db);
+        *sort_order = CMS_SORT_DESC;
+    }
+    else if (!cms_slice_is_empty(order) && !cms_slice_equals(order, "ASC"))
+    {
+        return false;
     }
+    return true;
+}
 
-    CmsSortKey sort_key;
-    if (strcmp(opt_buf, "ID") == 0)
+/* SHOW ... LIMIT/OFFSET/PAGE once its words are split into slices */
+static CMS_STATUS cms_show_page_view(StudentDatabase *db, CmsSlice option, CmsSlice order,
+                                     size_t offset, size_t limit, bool paged)
+{
+    if (db == NULL || (paged && limit == 0))
     {
-        sort_key = CMS_SORT_KEY_ID;
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
-    else if (strcmp(opt_buf, "MARK") == 0)
+
+    bool sorted = true;
+    CmsSortKey sort_key = CMS_SORT_KEY_ID;
+    CmsSortOrder sort_order = CMS_SORT_ASC;
+    if (!cms_parse_sort_view(option, order, &sorted, &sort_key, &sort_order))
     {
-        sort_key = CMS_SORT_KEY_MARK;
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
-    else if (strcmp(opt_buf, "NAME") == 0)
+
+    if (cms_database_row_count(db) == 0)
     {
-        sort_key = CMS_SORT_KEY_NAME;
+        cms_printf("\nNo records available.\n\n");
+        return CMS_STATUS_OK;
     }
-    else if (strcmp(opt_buf, "PROGRAMME") == 0)
+
+    CmsCursor *cursor = cms_malloc(CMS_MEM_TEMP, sizeof(CmsCursor));
+    if (cursor == NULL)
     {
-        sort_key = CMS_SORT_KEY_PROGRAMME;
+        return CMS_STATUS_ERROR;
     }
-    else
+
+    CMS_STATUS status = sorted ? cms_cursor_open_sorted(cursor, db, sort_key, sort_order)
+                               : cms_cursor_open(cursor, db);
+    if (status != CMS_STATUS_OK)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        cms_free(cursor);
+        return status;
     }
 
-    CmsSortOrder sort_order = CMS_SORT_ASC;
-    if (ord_buf[0] != '\0')
+    cms_cursor_skip(cursor, offset);
+    cms_show_cursor_page(cursor, limit);
+
+    if (paged && cms_cursor_has_next(cursor))
     {
-        if (strcmp(ord_buf, "ASC") == 0)
-        {
-            sort_order = CMS_SORT_ASC;
-        }
-        else if (strcmp(ord_buf, "DESC") == 0)
-        {
-            sort_order = CMS_SORT_DESC;
-        }
-        else
-        {
-            return CMS_STATUS_INVALID_ARGUMENT;
-        }
+        cms_close_page_cursor(db);
+        db->page_cursor = cursor;
+        db->page_size = limit;
+        cms_printf("CMS: Type NEXT for the next page.\n");
+        return CMS_STATUS_OK;
     }
 
-    return cms_database_show_sorted(db, sort_key, sort_order);
+    cms_cursor_close(cursor);
+    cms_free(cursor);
+    return CMS_STATUS_OK;
+}
+
+/**
+ * Displays a window of records through a row cursor, without copying the table.
+ * @param db Pointer to the StudentDatabase structure to read from.
+ * @param option "ALL" (file order) or a sort key: "ID", "MARK", "NAME", "PROGRAMME". NULL means ALL.
+ * @param order Sort order for sort keys: "ASC" or "DESC". NULL means ASC.
+ * @param offset Number of leading rows to skip.
+ * @param limit Maximum number of rows to print, or the page size when paged (0 prints every row).
+ * @param paged When true, the listing stays open and NEXT prints the following page.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_show_page(StudentDatabase *db, const char *option, const char *order,
+                         size_t offset, size_t limit, bool paged)
+{
+    return cms_show_page_view(db, cms_slice_trim(cms_slice(option)), cms_slice_trim(cms_slice(order)),
+                              offset, limit, paged);
 }
 
-CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
+/**
+ * Continues the listing opened by SHOW ... PAGE <n>.
+ * @param db Pointer to the StudentDatabase structure holding the open listing.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT otherwise.
+ */
+CMS_STATUS cmd_next(StudentDatabase *db)
 {
     if (db == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (!db->is_loaded)
+    if (db->page_cursor == NULL)
     {
-        printf("CMS: No database is currently opened.\n");
-        return CMS_STATUS_INVALID_ARGUMENT;
+        cms_printf("CMS: No paged listing is open. Use SHOW ... PAGE <n> first.\n");
+        return CMS_STATUS_OK;
     }
 
-    StudentRecord record;
-    memset(&record, 0, sizeof(record));
-
-    bool has_id = false;
-    bool has_name = false;
-    bool has_programme = false;
-    bool has_mark = false;
+    if (cms_cursor_is_stale(db->page_cursor))
+    {
+        cms_close_page_cursor(db);
+        cms_printf("CMS: The records changed since the listing was opened. Run SHOW again.\n");
+        return CMS_STATUS_OK;
+    }
 
-    char buffer[CMS_MAX_COMMAND_LEN];
-    if (params != NULL)
+    cms_show_cursor_page(db->page_cursor, db->page_size);
+    if (cms_cursor_has_next(db->page_cursor))
     {
-        strncpy(buffer, params, sizeof(buffer) - 1);
-        buffer[sizeof(buffer) - 1] = '\0';
-        cms_trim_string(buffer);
+        cms_printf("CMS: Type NEXT for the next page.\n");
     }
     else
     {
-        buffer[0] = '\0';
+        cms_close_page_cursor(db);
+        cms_printf("CMS: End of listing.\n");
     }
+    return CMS_STATUS_OK;
+}
 
-    /* Parse inline parameters if provided (e.g. "ID=2401234 NAME=MICHELLE LEE ...") */
-    if (buffer[0] != '\0')
-    {
-        char *ptr = buffer;
-        while (*ptr != '\0')
-        {
-            /* Skip leading spaces */
-            while (*ptr == ' ')
-            {
-                ptr++;
-            }
-            if (*ptr == '\0')
-            {
-                break;
-            }
+/* Fields found by cms_parse_record_fields */
+#define CMS_FIELD_ID 0x1u
+#define CMS_FIELD_NAME 0x2u
+#define CMS_FIELD_PROGRAMME 0x4u
+#define CMS_FIELD_MARK 0x8u
+#define CMS_FIELD_ALL (CMS_FIELD_ID | CMS_FIELD_NAME | CMS_FIELD_PROGRAMME | CMS_FIELD_MARK)
 
-            char *eq = strchr(ptr, '=');
-            if (eq == NULL)
-            {
-                break; /* malformed, stop parsing further */
-            }
+/* Copies a field value into a fixed-size record field, cutting it short if needed */
+static void cms_copy_field(CmsSlice value, char *out, size_t size)
+{
+    size_t length = (value.length < size - 1) ? value.length : size - 1;
+    memcpy(out, value.text, length);
+    out[length] = '\0';
+}
 
-            *eq = '\0';
-            char *key_start = ptr;
-            char *value_start = eq + 1;
+/* Reads inline "ID=... NAME=... PROGRAMME=... MARK=..." parameters into
+   record, setting a CMS_FIELD_* bit for each one found. Returns false when
+   ID or MARK is not a number. */
+static bool cms_parse_record_fields(CmsSlice text, StudentRecord *record, unsigned *fields)
+{
+    CmsSlice values[CMS_RECORD_FIELD_COUNT];
+    cms_scan_record_fields(text, values);
 
-            /* Find end of value: before next KEY= token or end-of-string */
-            char *value_end = value_start;
-            while (*value_end != '\0')
-            {
-                if (*value_end == ' ')
-                {
-                    char *next = value_end + 1;
-                    if (strncmp(next, "ID=", 3) == 0 ||
-                        strncmp(next, "NAME=", 5) == 0 ||
-                        strncmp(next, "PROGRAMME=", 10) == 0 ||
-                        strncmp(next, "MARK=", 5) == 0)
-                    {
-                        break;
-                    }
-                }
-                value_end++;
-            }
+    bool valid = true;
+    if (values[CMS_RECORD_FIELD_ID].text != NULL)
+    {
+        valid = cms_slice_to_int(values[CMS_RECORD_FIELD_ID], &record->id) && valid;
+        *fields |= CMS_FIELD_ID;
+    }
+    if (values[CMS_RECORD_FIELD_NAME].text != NULL)
+    {
+        cms_copy_field(values[CMS_RECORD_FIELD_NAME], record->name, sizeof(record->name));
+        *fields |= CMS_FIELD_NAME;
+    }
+    if (values[CMS_RECORD_FIELD_PROGRAMME].text != NULL)
+    {
+        cms_copy_field(values[CMS_RECORD_FIELD_PROGRAMME], record->programme, sizeof(record->programme));
+        *fields |= CMS_FIELD_PROGRAMME;
+    }
+    if (values[CMS_RECORD_FIELD_MARK].text != NULL)
+    {
+        valid = cms_slice_to_float(values[CMS_RECORD_FIELD_MARK], &record->mark) && valid;
+        *fields |= CMS_FIELD_MARK;
+    }
+    return valid;
+}
 
-            char saved = *value_end;
-            *value_end = '\0';
+CMS_STATUS cmd_insert(StudentDatabase *db, CmsSlice params)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
 
-            cms_trim_string(key_start);
-            cms_trim_string(value_start);
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
 
-            if (strcmp(key_start, "ID") == 0)
-            {
-                record.id = atoi(value_start);
-                has_id = true;
-            }
-            else if (strcmp(key_start, "NAME") == 0)
-            {
-                strncpy(record.name, value_start, sizeof(record.name) - 1);
-                record.name[sizeof(record.name) - 1] = '\0';
-                has_name = true;
-            }
-            else if (strcmp(key_start, "PROGRAMME") == 0)
-            {
-                strncpy(record.programme, value_start, sizeof(record.programme) - 1);
-                record.programme[sizeof(record.programme) - 1] = '\0';
-                has_programme = true;
-            }
-            else if (strcmp(key_start, "MARK") == 0)
-            {
-                record.mark = (float)atof(value_start);
-                has_mark = true;
-            }
+    StudentRecord record;
+    memset(&record, 0, sizeof(record));
 
-            *value_end = saved;
-            ptr = value_end;
-        }
+    /* Parse inline parameters if provided (e.g. "ID=2401234 NAME=MICHELLE LEE ...") */
+    unsigned fields = 0;
+    if (!cms_parse_record_fields(cms_slice_trim(params), &record, &fields))
+    {
+        cms_printf("CMS: Invalid data for new record.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    bool has_id = (fields & CMS_FIELD_ID) != 0;
+    bool has_name = (fields & CMS_FIELD_NAME) != 0;
+    bool has_programme = (fields & CMS_FIELD_PROGRAMME) != 0;
+    bool has_mark = (fields & CMS_FIELD_MARK) != 0;
+
+    if (cms_session.batch && fields != CMS_FIELD_ALL)
+    {
+        cms_printf("CMS: INSERT needs ID=, NAME=, PROGRAMME= and MARK= in batch mode.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
 
     /* If ID not provided as a parameter, prompt for it */
@@ -246,7 +465,7 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
         int id = 0;
         if (!cms_read_int("Enter student ID: ", &id))
         {
-            printf("CMS: Invalid input for ID.\n");
+            cms_printf("CMS: Invalid input for ID.\n");
             return CMS_STATUS_INVALID_ARGUMENT;
         }
         record.id = id;
@@ -256,18 +475,15 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
     /* Validate ID */
     if (!cms_validate_student_id(record.id))
     {
-        printf("CMS: Invalid student ID.\n");
+        cms_printf("CMS: Invalid student ID.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
     /* Check for duplicate ID before asking for other fields */
-    for (size_t i = 0; i < db->count; ++i)
+    if (cms_database_find(db, record.id) != NULL)
     {
-        if (db->records[i].id == record.id)
-        {
-            printf("CMS: The record with ID=%d already exists.\n", record.id);
-            return CMS_STATUS_DUPLICATE;
-        }
+        cms_printf("CMS: The record with ID=%d already exists.\n", record.id);
+        return CMS_STATUS_DUPLICATE;
     }
 
     /* Prompt for any missing fields (interactive mode) */
@@ -275,7 +491,7 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
     {
         if (!cms_read_string("Enter name: ", record.name, sizeof(record.name)))
         {
-            printf("CMS: Invalid input for name.\n");
+            cms_printf("CMS: Invalid input for name.\n");
             return CMS_STATUS_INVALID_ARGUMENT;
         }
         cms_trim_string(record.name);
@@ -285,7 +501,7 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
     {
         if (!cms_read_string("Enter programme: ", record.programme, sizeof(record.programme)))
         {
-            printf("CMS: Invalid input for programme.\n");
+            cms_printf("CMS: Invalid input for programme.\n");
             return CMS_STATUS_INVALID_ARGUMENT;
         }
         cms_trim_string(record.programme);
@@ -296,7 +512,7 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
         float mark = 0.0f;
         if (!cms_read_float("Enter mark (0-100): ", &mark))
         {
-            printf("CMS: Invalid input for mark.\n");
+            cms_printf("CMS: Invalid input for mark.\n");
             return CMS_STATUS_INVALID_ARGUMENT;
         }
         record.mark = mark;
@@ -307,22 +523,22 @@ CMS_STATUS cmd_insert(StudentDatabase *db, const char *params)
         !cms_validate_programme(record.programme) ||
         !cms_validate_mark(record.mark))
     {
-        printf("CMS: Invalid data for new record.\n");
+        cms_printf("CMS: Invalid data for new record.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
     CMS_STATUS status = cms_database_insert(db, &record);
     if (status == CMS_STATUS_OK)
     {
-        printf("CMS: A new record with ID=%d is successfully inserted.\n", record.id);
+        cms_printf("CMS: A new record with ID=%d is successfully inserted.\n", record.id);
     }
     else if (status == CMS_STATUS_DUPLICATE)
     {
-        printf("CMS: The record with ID=%d already exists.\n", record.id);
+        cms_printf("CMS: The record with ID=%d already exists.\n", record.id);
     }
     else
     {
-        printf("CMS: Failed to insert new record.\n");
+        cms_printf("CMS: Failed to insert new record.\n");
     }
 
     return status;
@@ -355,7 +571,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
     if (!cms_validate_student_id(student_id))
     {
-        printf("Invalid student ID.\n");
+        cms_printf("Invalid student ID.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
@@ -364,7 +580,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
     if (status == CMS_STATUS_NOT_FOUND)
     {
-        printf("No record found for ID %d.\n", student_id);
+        cms_printf("No record found for ID %d.\n", student_id);
         return status;
     }
     else if (status != CMS_STATUS_OK)
@@ -373,7 +589,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
         return status;
     }
 
-    printf("Current record: ID=%d, Name=%s, Programme=%s, Mark=%.2f\n",
+    cms_printf("Current record: ID=%d, Name=%s, Programme=%s, Mark=%.2f\n",
            current_record.id, current_record.name,
            current_record.programme, current_record.mark);
 
@@ -396,7 +612,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
         if (!cms_validate_name(input_buffer))
         {
-            printf("Invalid name. Please try again.\n");
+            cms_printf("Invalid name. Please try again.\n");
             continue;
         }
 
@@ -421,7 +637,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
         if (!cms_validate_programme(input_buffer))
         {
-            printf("Invalid programme. Please try again.\n");
+            cms_printf("Invalid programme. Please try again.\n");
             continue;
         }
 
@@ -434,7 +650,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
     char mark_buffer[32];
     while (1)
     {
-        printf("Enter mark (or press Enter to keep current): ");
+        cms_printf("Enter mark (or press Enter to keep current): ");
         if (!cms_read_line(mark_buffer, sizeof(mark_buffer)))
         {
             return CMS_STATUS_ERROR;
@@ -450,7 +666,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
         if (end_ptr == mark_buffer || *end_ptr != '\0' || !cms_validate_mark(new_mark))
         {
-            printf("Invalid mark. Please enter a value between %.2f and %.2f.\n",
+            cms_printf("Invalid mark. Please enter a value between %.2f and %.2f.\n",
                    CMS_MIN_MARK, CMS_MAX_MARK);
             continue;
         }
@@ -463,7 +679,7 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
 
     if (status == CMS_STATUS_OK)
     {
-        printf("Record updated successfully.\n");
+        cms_printf("Record updated successfully.\n");
     }
     else
     {
@@ -473,6 +689,62 @@ CMS_STATUS cmd_update(StudentDatabase *db, int student_id)
     return status;
 }
 
+/**
+ * Updates a record from inline fields, without prompting.
+ * @param db Pointer to the StudentDatabase structure to modify.
+ * @param student_id ID of the record to update.
+ * @param fields Any of "NAME=<name> PROGRAMME=<programme> MARK=<mark>"; unnamed fields are kept.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT, CMS_STATUS_NOT_FOUND or error code otherwise.
+ */
+CMS_STATUS cmd_update_fields(StudentDatabase *db, int student_id, CmsSlice fields)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    StudentRecord record;
+    CMS_STATUS status = cms_database_query(db, student_id, &record);
+    if (status == CMS_STATUS_NOT_FOUND)
+    {
+        cms_printf("CMS: The record with ID=%d does not exist.\n", student_id);
+        return status;
+    }
+    else if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    unsigned found = 0;
+    if (!cms_parse_record_fields(cms_slice_trim(fields), &record, &found) || found == 0 ||
+        (found & CMS_FIELD_ID) != 0 || record.id != student_id)
+    {
+        cms_printf("Usage: UPDATE <student_id> [NAME=<name>] [PROGRAMME=<programme>] [MARK=<mark>]\n");
+        return cms_usage_status();
+    }
+
+    if (!cms_validate_name(record.name) ||
+        !cms_validate_programme(record.programme) ||
+        !cms_validate_mark(record.mark))
+    {
+        cms_printf("CMS: Invalid data for record with ID=%d.\n", student_id);
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    status = cms_database_update(db, student_id, &record);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: The record with ID=%d is successfully updated.\n", student_id);
+    }
+    return status;
+}
+
 CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
 {
     if (db == NULL)
@@ -483,14 +755,14 @@ CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
     /* Ensure a database is loaded */
     if (!db->is_loaded)
     {
-        printf("CMS> No database is currently opened.\n");
+        cms_printf("CMS> No database is currently opened.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
     /* Validate student ID */
     if (!cms_validate_student_id(student_id))
     {
-        printf("CMS: Invalid student ID.\n");
+        cms_printf("CMS: Invalid student ID.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
@@ -500,7 +772,7 @@ CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
 
     if (status == CMS_STATUS_NOT_FOUND)
     {
-        printf("CMS: The record with ID=%d does not exist.\n", student_id);
+        cms_printf("CMS: The record with ID=%d does not exist.\n", student_id);
         return status;
     }
     else if (status != CMS_STATUS_OK)
@@ -509,17 +781,28 @@ CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
         return status;
     }
 
+    /* Scripts confirm by issuing the command; --yes confirms everywhere */
+    if (cms_session.batch || cms_session.assume_yes)
+    {
+        status = cms_database_delete(db, student_id);
+        if (status == CMS_STATUS_OK)
+        {
+            cms_printf("CMS: The record with ID=%d is successfully deleted.\n", student_id);
+        }
+        return status;
+    }
+
     /* Confirmation loop */
     char input_buffer[32];
     while (1)
     {
-        printf("CMS: Are you sure you want to delete record with ID=%d? Type \"Y\" to confirm or type \"N\" to cancel.\n",
+        cms_printf("CMS: Are you sure you want to delete record with ID=%d? Type \"Y\" to confirm or type \"N\" to cancel.\n",
                student_id);
 
         if (!cms_read_line(input_buffer, sizeof(input_buffer)))
         {
             /* Treat read failure as cancellation */
-            printf("CMS: The deletion is cancelled.\n");
+            cms_printf("CMS: The deletion is cancelled.\n");
             return CMS_STATUS_ERROR;
         }
 
@@ -531,7 +814,7 @@ CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
             status = cms_database_delete(db, student_id);
             if (status == CMS_STATUS_OK)
             {
-                printf("CMS: The record with ID=%d is successfully deleted.\n", student_id);
+                cms_printf("CMS: The record with ID=%d is successfully deleted.\n", student_id);
             }
             else
             {
@@ -541,141 +824,299 @@ CMS_STATUS cmd_delete(StudentDatabase *db, int student_id)
         }
         else if (strcmp(input_buffer, "N") == 0)
         {
-            printf("CMS: The deletion is cancelled.\n");
+            cms_printf("CMS: The deletion is cancelled.\n");
             return CMS_STATUS_OK;
         }
         else
         {
-            printf("CMS: Invalid input. Please type \"Y\" to confirm or \"N\" to cancel.\n");
+            cms_printf("CMS: Invalid input. Please type \"Y\" to confirm or \"N\" to cancel.\n");
         }
     }
 }
 
-CMS_STATUS cms_filter(const StudentDatabase *db, const char *programme)
+static const char *cms_filter_usage =
+    "Usage: FILTER [PROGRAMME] <programme>[,<programme>...] [GRADE <grade>[,<grade>...]]";
+
+/* Programme names of a parsed selection, copied out NUL-terminated because
+   the index looks them up as C strings */
+typedef struct
 {
-    if (db == NULL)
-    {
-        return CMS_STATUS_INVALID_ARGUMENT;
-    }
+    char names[CMS_MAX_SELECT_TERMS][CMS_MAX_PROGRAMME_LEN + 1];
+} CmsSelectionNames;
 
-    if (!db->is_loaded)
-    {
-        printf("CMS: No database is currently opened.\n");
-        return CMS_STATUS_INVALID_ARGUMENT;
+/* Longest grade label ("A+") with room to spare */
+#define CMS_GRADE_LABEL_LEN 8
+
+/* Parses "[PROGRAMME] <p>[,<p>...] [GRADE <g>[,<g>...]]" into a selection
+   whose programme entries point into names. Returns false on an unknown
+   grade label, an over-long programme or too many terms. */
+static bool cms_parse_selection(CmsSlice text, CmsSelection *selection, CmsSelectionNames *names)
+{
+    memset(selection, 0, sizeof(*selection));
+    text = cms_slice_trim(text);
+    cms_slice_skip_word(&text, "PROGRAMME");
+
+    CmsSlice programmes = text;
+    CmsSlice grades = {NULL, 0};
+    bool has_grades = cms_slice_split_at_word(text, "GRADE", &programmes, &grades);
+
+    while (programmes.length > 0)
+    {
+        const char *comma = memchr(programmes.text, ',', programmes.length);
+        CmsSlice term = {programmes.text, (comma != NULL) ? (size_t)(comma - programmes.text) : programmes.length};
+        term = cms_slice_trim(term);
+        if (!cms_slice_is_empty(term))
+        {
+            if (selection->programme_count == CMS_MAX_SELECT_TERMS)
+            {
+                return false;
+            }
+            char *name = names->names[selection->programme_count];
+            if (!cms_slice_copy(term, name, sizeof(names->names[0])))
+            {
+                return false;
+            }
+            selection->programmes[selection->programme_count++] = name;
+        }
+        if (comma == NULL)
+        {
+            break;
+        }
+        programmes.length -= (size_t)(comma + 1 - programmes.text);
+        programmes.text = comma + 1;
     }
 
-    if (programme == NULL || programme[0] == '\0')
+    if (!has_grades)
     {
-        printf("Usage: FILTER <programme>\n");
-        return CMS_STATUS_OK;
+        return true;
+    }
+
+    /* Grade labels may be separated by commas and/or spaces */
+    const char *label = grades.text;
+    const char *end = grades.text + grades.length;
+    while (label < end)
+    {
+        while (label < end && (*label == ',' || isspace((unsigned char)*label)))
+        {
+            label++;
+        }
+        if (label == end)
+        {
+            break;
+        }
+
+        const char *label_end = label;
+        while (label_end < end && *label_end != ',' && !isspace((unsigned char)*label_end))
+        {
+            label_end++;
+        }
+
+        char label_text[CMS_GRADE_LABEL_LEN];
+        CmsSlice word = {label, (size_t)(label_end - label)};
+        CmsGradeBucket bucket;
+        if (!cms_slice_copy(word, label_text, sizeof(label_text)) ||
+            !cms_grade_bucket_from_label(label_text, &bucket) ||
+            selection->grade_count == CMS_GRADE_BUCKET_COUNT)
+        {
+            return false;
+        }
+        selection->grades[selection->grade_count++] = bucket;
+        label = label_end;
     }
+    return selection->grade_count > 0;
+}
 
-    /* Accept either:
-       - FILTER <programme>
-       - FILTER PROGRAMME <programme> (ignore the PROGRAMME keyword if present) */
-    char prog_buf[CMS_MAX_COMMAND_LEN];
-    strncpy(prog_buf, programme, sizeof(prog_buf) - 1);
-    prog_buf[sizeof(prog_buf) - 1] = '\0';
-    cms_trim_string(prog_buf);
+/* Parses "BETWEEN <low> AND <high>" (inclusive) or "<op> <mark>" with op one
+   of >, >=, <, <= into a mark range */
+static bool cms_parse_mark_range(CmsSlice text, CmsMarkRange *range)
+{
+    text = cms_slice_trim(text);
+    range->low = -FLT_MAX;
+    range->high = FLT_MAX;
+    range->low_inclusive = true;
+    range->high_inclusive = true;
 
-    if (prog_buf[0] == '\0')
+    if (cms_slice_skip_word(&text, "BETWEEN"))
     {
-        printf("Usage: FILTER <programme>\n");
-        return CMS_STATUS_OK;
+        CmsSlice low;
+        CmsSlice high;
+        if (!cms_slice_split_at_word(text, "AND", &low, &high))
+        {
+            return false;
+        }
+        return cms_slice_to_float(cms_slice_trim(low), &range->low) &&
+               cms_slice_to_float(cms_slice_trim(high), &range->high) && range->low <= range->high;
     }
 
-    /* If the args start with the keyword PROGRAMME, skip it */
-    const char *keyword = "PROGRAMME";
-    size_t keyword_len = strlen(keyword);
-    if (cms_string_equals_ignore_case(prog_buf, keyword))
+    if (cms_slice_is_empty(text) || (text.text[0] != '>' && text.text[0] != '<'))
     {
-        printf("Usage: FILTER <programme>\n");
-        return CMS_STATUS_OK;
+        return false;
     }
-    else
+
+    bool above = (text.text[0] == '>');
+    bool inclusive = (text.length > 1 && text.text[1] == '=');
+    size_t op_length = inclusive ? 2 : 1;
+    CmsSlice value = {text.text + op_length, text.length - op_length};
+    value = cms_slice_trim(value);
+    if (above)
     {
-        /* Case-insensitive prefix check for "PROGRAMME " */
-        size_t buf_len = strlen(prog_buf);
-        if (buf_len > keyword_len)
-        {
-            bool prefix_match = true;
-            for (size_t i = 0; i < keyword_len; ++i)
-            {
-                if (tolower((unsigned char)prog_buf[i]) != tolower((unsigned char)keyword[i]))
-                {
-                    prefix_match = false;
-                    break;
-                }
-            }
+        range->low_inclusive = inclusive;
+        return cms_slice_to_float(value, &range->low);
+    }
+    range->high_inclusive = inclusive;
+    return cms_slice_to_float(value, &range->high);
+}
 
-            if (prefix_match && isspace((unsigned char)prog_buf[keyword_len]))
-            {
-                char *after_kw = prog_buf + keyword_len;
-                while (*after_kw && isspace((unsigned char)*after_kw))
-                {
-                    after_kw++;
-                }
-                memmove(prog_buf, after_kw, strlen(after_kw) + 1);
-            }
-        }
+/* Row keys for patching index results with an open transaction's changes */
+static bool cms_selection_key(const StudentRecord *record, const void *context, double *out_key)
+{
+    *out_key = 0.0;
+    return cms_selection_matches((const CmsSelection *)context, record);
+}
+
+static bool cms_mark_key(const StudentRecord *record, const void *context, double *out_key)
+{
+    *out_key = record->mark;
+    return cms_mark_in_range(record->mark, (const CmsMarkRange *)context);
+}
+
+/* The IDs in a mark range, lowest mark first, as the transaction sees them */
+static CMS_STATUS cms_mark_range_ids(const StudentDatabase *db, const CmsMarkRange *range, int **out_ids,
+                                     size_t *out_count)
+{
+    CMS_STATUS status = cms_index_mark_range(db, range, out_ids, out_count);
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_database_overlay_ids(db, cms_mark_key, range, false, out_ids, out_count);
+    }
+    return status;
+}
+
+/* Lists the records in a mark range, lowest mark first */
+static CMS_STATUS cms_filter_mark(const StudentDatabase *db, CmsSlice text)
+{
+    CmsSlice description = cms_slice_trim(text);
+
+    CmsMarkRange range;
+    if (!cms_parse_mark_range(text, &range))
+    {
+        cms_printf("Usage: FILTER MARK BETWEEN <low> AND <high> | FILTER MARK <op> <mark> (op: > >= < <=)\n");
+        return cms_usage_status();
     }
 
-    if (prog_buf[0] == '\0')
+    int *ids = NULL;
+    size_t id_count = 0;
+    CMS_STATUS status = cms_mark_range_ids(db, &range, &ids, &id_count);
+    if (status != CMS_STATUS_OK)
     {
-        printf("Usage: FILTER <programme>\n");
-        return CMS_STATUS_OK;
+        cms_free(ids);
+        return status;
     }
 
-    if (db->records == NULL || db->count == 0)
+    if (id_count == 0)
     {
-        printf("\nNo records available.\n\n");
+        cms_printf("\nNo records matched mark %.*s.\n\n", (int)description.length, description.text);
+        cms_free(ids);
         return CMS_STATUS_OK;
     }
 
-    StudentRecord *filtered_records = (StudentRecord *)malloc(db->count * sizeof(StudentRecord));
-    if (filtered_records == NULL)
+    StudentRecord *matched_records = cms_malloc(CMS_MEM_TEMP, id_count * sizeof(StudentRecord));
+    if (matched_records == NULL)
     {
+        cms_free(ids);
         return CMS_STATUS_ERROR;
     }
 
     size_t matches = 0;
-    for (size_t i = 0; i < db->count; ++i)
+    for (size_t i = 0; i < id_count; ++i)
     {
-        const StudentRecord *record = &db->records[i];
-        if (cms_string_equals_ignore_case(record->programme, prog_buf))
+        const StudentRecord *record = cms_database_find(db, ids[i]);
+        if (record != NULL)
         {
-            filtered_records[matches++] = *record;
+            matched_records[matches++] = *record;
         }
     }
+    cms_free(ids);
 
-    /* If none matched, report and free */
-    if (matches == 0)
-    {
-        printf("\nNo records matched programme \"%s\".\n\n", prog_buf);
-        free(filtered_records);
-        return CMS_STATUS_OK;
+    StudentDatabase matched_db;
+    memset(&matched_db, 0, sizeof(matched_db));
+    matched_db.records = matched_records;
+    matched_db.count = matches;
+
+    cms_printf("\nCMS: %zu record(s) matched mark %.*s, lowest mark first.\n", matches,
+           (int)description.length, description.text);
+    cms_display_table(&matched_db);
+
+    cms_free(matched_records);
+    return CMS_STATUS_OK;
+}
+
+static int cms_compare_position(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a;
+    size_t y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Collects the IDs matching a selection into a malloc'd array, listed in
+   file order as FILTER has always shown them (rows an open transaction
+   appends come last) */
+static CMS_STATUS cms_selection_ids(const StudentDatabase *db, const CmsSelection *selection,
+                                    int **out_ids, size_t *out_count)
+{
+    *out_ids = NULL;
+    *out_count = 0;
+
+    CmsBitmap matched_ids;
+    cms_bitmap_init(&matched_ids);
+    CMS_STATUS status = cms_index_select(db, selection, &matched_ids);
+    size_t id_count = cms_bitmap_cardinality(&matched_ids);
+    if (status != CMS_STATUS_OK || id_count == 0)
+    {
+        cms_bitmap_free(&matched_ids);
+        return (status == CMS_STATUS_OK)
+                   ? cms_database_overlay_ids(db, cms_selection_key, selection, true, out_ids, out_count)
+                   : status;
+    }
+
+    uint32_t *members = cms_malloc(CMS_MEM_TEMP, id_count * sizeof(uint32_t));
+    size_t *positions = cms_malloc(CMS_MEM_TEMP, id_count * sizeof(size_t));
+    int *ids = cms_malloc(CMS_MEM_TEMP, id_count * sizeof(int));
+    if (members == NULL || positions == NULL || ids == NULL)
+    {
+        cms_free(members);
+        cms_free(positions);
+        cms_free(ids);
+        cms_bitmap_free(&matched_ids);
+        return CMS_STATUS_ERROR;
     }
-    else
+
+    cms_bitmap_to_array(&matched_ids, members);
+    cms_bitmap_free(&matched_ids);
+
+    /* The bitmap yields ID order; sort the matches back into file order */
+    size_t matches = 0;
+    for (size_t i = 0; i < id_count; ++i)
     {
-        StudentDatabase *filtered_db = malloc(sizeof(StudentDatabase));
-        if (filtered_db == NULL)
+        if (cms_index_find_id(db, (int)members[i], &positions[matches]))
         {
-            free(filtered_records);
-            return CMS_STATUS_ERROR;
+            matches++;
         }
-        filtered_db->records = filtered_records;
-        filtered_db->count = matches;
-
-        cms_display_table(filtered_db);
-
-        free(filtered_records);
-        free(filtered_db);
-
-        return CMS_STATUS_OK;
     }
+    qsort(positions, matches, sizeof(size_t), cms_compare_position);
+    for (size_t i = 0; i < matches; ++i)
+    {
+        ids[i] = db->records[positions[i]].id;
+    }
+    cms_free(members);
+    cms_free(positions);
+
+    *out_ids = ids;
+    *out_count = matches;
+    return cms_database_overlay_ids(db, cms_selection_key, selection, true, out_ids, out_count);
 }
 
-CMS_STATUS cmd_save(StudentDatabase *db, const char *filename)
+CMS_STATUS cms_filter(const StudentDatabase *db, CmsSlice args)
 {
     if (db == NULL)
     {
@@ -684,272 +1125,2227 @@ CMS_STATUS cmd_save(StudentDatabase *db, const char *filename)
 
     if (!db->is_loaded)
     {
-        printf("CMS: No database is currently opened.\n");
+        cms_printf("CMS: No database is currently opened.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    const char *save_path = (filename != NULL && filename[0] != '\0') ? filename : db->file_path;
-    CMS_STATUS status = cms_database_save(db, save_path);
-    if (status == CMS_STATUS_OK)
+    CmsSlice text = cms_slice_trim(args);
+    CmsSlice range = text;
+    if (cms_slice_skip_word(&range, "MARK"))
     {
-        // Extract basename for cleaner display
-        const char *display_name = save_path;
-        char *slash = strrchr(save_path, '\\');
-        if (slash == NULL)
+        if (cms_database_row_count(db) == 0)
         {
-            slash = strrchr(save_path, '/');
+            cms_printf("\nNo records available.\n\n");
+            return CMS_STATUS_OK;
         }
-        if (slash != NULL)
+        return cms_filter_mark(db, range);
+    }
+
+    /* FILTER <programme> and FILTER PROGRAMME <programme> are the same; the
+       selection parser drops the keyword */
+    CmsSelection selection;
+    CmsSelectionNames names;
+    if (!cms_parse_selection(text, &selection, &names) ||
+        (selection.programme_count == 0 && selection.grade_count == 0))
+    {
+        cms_printf("%s\n", cms_filter_usage);
+        return cms_usage_status();
+    }
+
+    CmsSlice description = text;
+    cms_slice_skip_word(&description, "PROGRAMME");
+    description = cms_slice_trim(description);
+
+    if (cms_database_row_count(db) == 0)
+    {
+        cms_printf("\nNo records available.\n\n");
+        return CMS_STATUS_OK;
+    }
+
+    int *ids = NULL;
+    size_t matches = 0;
+    CMS_STATUS status = cms_selection_ids(db, &selection, &ids, &matches);
+
+    /* If none matched, report and free */
+    if (status != CMS_STATUS_OK || matches == 0)
+    {
+        cms_free(ids);
+        if (status == CMS_STATUS_OK)
         {
-            display_name = slash + 1; // Use basename after last path separator
+            cms_printf("\nNo records matched %s\"%.*s\".\n\n", selection.grade_count == 0 ? "programme " : "",
+                   (int)description.length, description.text);
         }
-        printf("CMS: The database file \"%s\" is successfully saved.\n", display_name);
+        return status;
     }
-    return status;
+
+    cms_display_table_header();
+    for (size_t i = 0; i < matches; ++i)
+    {
+        const StudentRecord *record = cms_database_find(db, ids[i]);
+        if (record != NULL)
+        {
+            cms_display_table_row(record);
+        }
+    }
+    cms_display_table_footer();
+
+    cms_free(ids);
+    return CMS_STATUS_OK;
 }
 
-CMS_STATUS cmd_undo(StudentDatabase *db)
+/* ===== Set-oriented DELETE and UPDATE ===== */
+
+static const char *cms_delete_usage = "Usage: DELETE <student_id> | DELETE WHERE <filter>";
+static const char *cms_update_usage =
+    "Usage: UPDATE <student_id> [NAME=<name>] [PROGRAMME=<programme>] [MARK=<mark>]\n"
+    "       UPDATE SET MARK = <mark> | MARK = MARK +|-|* <value> WHERE <filter>";
+
+/* "[PROGRAMME] <p>[,<p>...] [GRADE <g>[,<g>...]] [MARK <range>]" with at
+   least one part, as FILTER and FILTER MARK take them; programme entries
+   point into names */
+static bool cms_parse_row_filter(CmsSlice text, CmsRowFilter *filter, CmsSelectionNames *names)
 {
-    if (db == NULL)
+    memset(filter, 0, sizeof(*filter));
+    filter->mark.low = -FLT_MAX;
+    filter->mark.high = FLT_MAX;
+    filter->mark.low_inclusive = true;
+    filter->mark.high_inclusive = true;
+
+    CmsSlice selection = cms_slice_trim(text);
+    CmsSlice mark = {NULL, 0};
+    bool has_mark = cms_slice_split_at_word(selection, "MARK", &selection, &mark);
+    if (has_mark && !cms_parse_mark_range(mark, &filter->mark))
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        return false;
     }
 
-    if (!db->is_loaded && db->count == 0)
+    selection = cms_slice_trim(selection);
+    if (cms_slice_is_empty(selection))
     {
-        printf("CMS: No database is currently opened.\n");
-        return CMS_STATUS_INVALID_ARGUMENT;
+        return has_mark;
     }
-
-    return cms_database_undo(db);
+    return cms_parse_selection(selection, &filter->selection, names) &&
+           (filter->selection.programme_count > 0 || filter->selection.grade_count > 0);
 }
 
-CMS_STATUS cmd_help(void)
+/* Splits text at the WHERE keyword into the part before it and the parsed
+   filter after it */
+static bool cms_split_where(CmsSlice text, CmsSlice *before, CmsRowFilter *filter, CmsSelectionNames *names)
 {
-    printf("\nAvailable Commands:\n");
-    printf("  OPEN <filename>               - Load a database file\n");
-    printf("  SHOW [ID|MARK|NAME|PROGRAMME] [ASC|DESC] - Display records (defaults to ID ASC)\n");
-    printf("  SHOW ALL                      - Display all student records\n");
-    printf("  SHOW SUMMARY                  - Display summary statistics\n");
-    printf("  INSERT                        - Add a new student record\n");
-    printf("  QUERY <student_id>            - Find a specific record\n");
-    printf("  UPDATE <student_id>           - Modify an existing record\n");
-    printf("  DELETE <student_id>           - Remove a student record\n");
-    printf("  FILTER <programme>            - List students by programme (e.g FILTER Computer Science) \n");
-    printf("  UNDO                          - Revert the most recent change\n");
-    printf("  SAVE [filename]               - Save changes to file\n");
-    printf("  HELP                          - Display this help\n");
-    printf("  EXIT or QUIT                  - Exit the application\n\n");
-
-    return CMS_STATUS_OK;
+    CmsSlice condition;
+    return cms_slice_split_at_word(text, "WHERE", before, &condition) &&
+           cms_parse_row_filter(condition, filter, names);
 }
 
-void cms_command_loop(StudentDatabase *db)
+/* "MARK = <mark>" or "MARK = MARK <op> <value>" (op +, - or *) as
+   mark = scale * mark + offset */
+static bool cms_parse_mark_assignment(CmsSlice text, float *scale, float *offset)
 {
-    char input[CMS_MAX_COMMAND_LEN];
+    text = cms_slice_trim(text);
+    if (!cms_slice_skip_prefix(&text, "MARK"))
+    {
+        return false;
+    }
+    text = cms_slice_trim(text);
+    if (!cms_slice_skip_prefix(&text, "="))
+    {
+        return false;
+    }
+    text = cms_slice_trim(text);
 
-    while (1)
+    if (!cms_slice_skip_prefix(&text, "MARK"))
     {
-        printf("CMS> ");
+        *scale = 0.0f;
+        return cms_slice_to_float(text, offset) && cms_validate_mark(*offset);
+    }
 
-        if (!cms_read_line(input, CMS_MAX_COMMAND_LEN))
-        {
-            printf("\n");
-            break;
-        }
+    float value = 0.0f;
+    text = cms_slice_trim(text);
+    char op = cms_slice_is_empty(text) ? '\0' : text.text[0];
+    if (op != '+' && op != '-' && op != '*')
+    {
+        return false;
+    }
+    text.text++;
+    text.length--;
+    if (!cms_slice_to_float(cms_slice_trim(text), &value))
+    {
+        return false;
+    }
+    *scale = (op == '*') ? value : 1.0f;
+    *offset = (op == '+') ? value : (op == '-') ? -value : 0.0f;
+    return value >= 0.0f;
+}
 
-        cms_trim(input);
-        if (input[0] == '\0')
-        {
-            continue;
-        }
+/* Asks before a destructive change; scripts and --yes confirm by issuing it */
+static bool cms_confirm(const char *question)
+{
+    if (cms_session.batch || cms_session.assume_yes)
+    {
+        return true;
+    }
 
-        if (cms_string_equals_ignore_case(input, "EXIT") ||
-            cms_string_equals_ignore_case(input, "QUIT"))
+    char input_buffer[32];
+    while (1)
+    {
+        cms_printf("CMS: %s Type \"Y\" to confirm or type \"N\" to cancel.\n", question);
+        if (!cms_read_line(input_buffer, sizeof(input_buffer)))
         {
-            printf("Exiting CMS.\n");
-            break;
+            return false;
         }
-
-        CMS_STATUS status = cms_parse_command(input, db);
-        if (status != CMS_STATUS_OK)
+        cms_trim_string(input_buffer);
+        cms_string_to_upper(input_buffer);
+        if (strcmp(input_buffer, "Y") == 0 || strcmp(input_buffer, "N") == 0)
         {
-            cms_print_status(status);
+            return input_buffer[0] == 'Y';
         }
+        cms_printf("CMS: Invalid input. Please type \"Y\" to confirm or \"N\" to cancel.\n");
     }
 }
 
-CMS_STATUS cms_parse_command(const char *input, StudentDatabase *db)
+/**
+ * Deletes every record matching a filter in one pass, as one undoable change.
+ * @param db Pointer to the StudentDatabase structure.
+ * @param condition Filter after WHERE, e.g. "Computer Science GRADE F" or "MARK < 40".
+ * @return CMS_STATUS_OK on success (including no matches), CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_delete_where(StudentDatabase *db, CmsSlice condition)
 {
-    if (input == NULL || db == NULL)
+    if (db == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    char buffer[CMS_MAX_COMMAND_LEN];
-    strncpy(buffer, input, sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
-    cms_trim(buffer);
-
-    if (buffer[0] == '\0')
+    if (!db->is_loaded)
     {
-        return CMS_STATUS_OK;
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    char *args = NULL;
-    char *command = buffer;
-    char *split = buffer;
-    while (*split && !isspace((unsigned char)*split))
+    CmsRowFilter filter;
+    CmsSelectionNames names;
+    if (!cms_parse_row_filter(condition, &filter, &names))
     {
-        split++;
+        cms_printf("%s\n", cms_delete_usage);
+        return cms_usage_status();
     }
-    if (*split != '\0')
+
+    size_t matches = cms_database_count_where(db, &filter);
+    if (matches == 0)
     {
-        *split = '\0';
-        args = split + 1;
-        while (*args && isspace((unsigned char)*args))
-        {
-            args++;
-        }
-        if (args[0] == '\0')
-        {
-            args = NULL;
-        }
+        cms_printf("CMS: No records matched.\n");
+        return CMS_STATUS_OK;
     }
 
-    cms_string_to_upper(command);
-
-    if (strcmp(command, "HELP") == 0)
+    char question[96];
+    snprintf(question, sizeof(question), "Are you sure you want to delete %zu record(s)?", matches);
+    if (!cms_confirm(question))
     {
-        if (args != NULL)
-        {
-            printf("HELP does not take any arguments. Ignoring extra input.\n");
-        }
-        return cmd_help();
+        cms_printf("CMS: The deletion is cancelled.\n");
+        return CMS_STATUS_OK;
     }
 
-    if (strcmp(command, "OPEN") == 0)
+    size_t deleted = 0;
+    CMS_STATUS status = cms_database_delete_where(db, &filter, &deleted);
+    if (status == CMS_STATUS_OK)
     {
-        const char *path = args;
-        return cmd_open(db, path);
+        cms_printf("CMS: %zu record(s) deleted.\n", deleted);
     }
+    return status;
+}
 
-    if (strcmp(command, "SHOW") == 0)
+/**
+ * Applies a mark adjustment to every record matching a filter.
+ * @param db Pointer to the StudentDatabase structure.
+ * @param args Text after SET: "MARK = MARK + <k> WHERE <filter>" (also -, * or a plain mark).
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_update_where(StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
     {
-        if (args == NULL)
-        {
-            /* Default to showing ID ascending when no arguments are given */
-            return cmd_show(db, NULL, NULL);
-        }
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
 
-        char *option = args;
-        char *order = NULL;
-        char *cursor = option;
-        while (*cursor && !isspace((unsigned char)*cursor))
-        {
-            cursor++;
-        }
-        if (*cursor != '\0')
-        {
-            *cursor = '\0';
-            cursor++;
-            while (*cursor && isspace((unsigned char)*cursor))
-            {
-                cursor++;
-            }
-            if (*cursor != '\0')
-            {
-                order = cursor;
-                char *order_end = order;
-                while (*order_end && !isspace((unsigned char)*order_end))
-                {
-                    order_end++;
-                }
-                if (*order_end != '\0')
-                {
-                    *order_end = '\0';
-                    order_end++;
-                    while (*order_end && isspace((unsigned char)*order_end))
-                    {
-                        order_end++;
-                    }
-                    if (*order_end != '\0')
-                    {
-                        printf("Usage: SHOW [ALL|SUMMARY|ID|MARK|NAME|PROGRAMME] [ASC|DESC]\n");
-                        return CMS_STATUS_OK;
-                    }
-                }
-            }
-        }
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
 
-        return cmd_show(db, option, order);
+    CmsRowFilter filter;
+    CmsSelectionNames names;
+    CmsSlice assignment;
+    float scale = 1.0f;
+    float offset = 0.0f;
+    if (!cms_split_where(args, &assignment, &filter, &names) ||
+        !cms_parse_mark_assignment(assignment, &scale, &offset))
+    {
+        cms_printf("%s\n", cms_update_usage);
+        return cms_usage_status();
     }
 
-    if (strcmp(command, "INSERT") == 0)
+    size_t changed = 0;
+    CMS_STATUS status = cms_database_update_marks_where(db, &filter, scale, offset, &changed);
+    if (status == CMS_STATUS_OK)
     {
-        return cmd_insert(db, args);
+        cms_printf("CMS: %zu record(s) updated.\n", changed);
     }
+    return status;
+}
 
-    if (strcmp(command, "QUERY") == 0)
+/**
+ * Counts the records matching a programme and/or grade selection.
+ * @param db Pointer to the StudentDatabase structure to count.
+ * @param args Optional "[PROGRAMME <p>[,<p>...]] [GRADE <g>[,<g>...]]"; empty counts every record.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_count(const StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
     {
-        int student_id = 0;
-        if (!cms_parse_int_argument(args, &student_id))
-        {
-            printf("Usage: QUERY <student_id>\n");
-            return CMS_STATUS_OK;
-        }
-        return cmd_query(db, student_id);
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (strcmp(command, "UPDATE") == 0)
+    if (!db->is_loaded)
     {
-        int student_id = 0;
-        if (!cms_parse_int_argument(args, &student_id))
-        {
-            printf("Usage: UPDATE <student_id>\n");
-            return CMS_STATUS_OK;
-        }
-        return cmd_update(db, student_id);
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (strcmp(command, "DELETE") == 0)
+    CmsSelection selection;
+    CmsSelectionNames names;
+    if (!cms_parse_selection(args, &selection, &names))
     {
-        int student_id = 0;
-        if (!cms_parse_int_argument(args, &student_id))
-        {
-            printf("Usage: DELETE <student_id>\n");
-            return CMS_STATUS_OK;
-        }
-        return cmd_delete(db, student_id);
+        cms_printf("Usage: COUNT [PROGRAMME <programme>[,<programme>...]] [GRADE <grade>[,<grade>...]]\n");
+        return cms_usage_status();
     }
 
-    if (strcmp(command, "FILTER") == 0)
+    size_t count = 0;
+    CMS_STATUS status = cms_index_count(db, &selection, &count);
+    if (status != CMS_STATUS_OK)
     {
-        return cms_filter(db, args);
+        return status;
     }
+    cms_database_overlay_count(db, cms_selection_key, &selection, &count);
+
+    cms_printf("CMS: %zu record(s) matched.\n", count);
+    return CMS_STATUS_OK;
+}
+
+/* A name search as a row key: the edit distance for a fuzzy one */
+typedef struct
+{
+    const char *pattern;
+    bool prefix_only;
+    int max_distance; /* negative for a substring or prefix match */
+} CmsNameQuery;
 
-    if (strcmp(command, "SAVE") == 0)
+static bool cms_name_key(const StudentRecord *record, const void *context, double *out_key)
+{
+    const CmsNameQuery *query = (const CmsNameQuery *)context;
+    if (query->max_distance >= 0)
     {
-        const char *save_path = args;
-        return cmd_save(db, save_path);
+        int distance = cms_edit_distance_bounded(query->pattern, record->name, query->max_distance);
+        *out_key = distance;
+        return distance <= query->max_distance;
     }
+    *out_key = 0.0;
+    return query->prefix_only ? cms_string_starts_with_ignore_case(record->name, query->pattern)
+                              : cms_string_contains_ignore_case(record->name, query->pattern);
+}
+
+/* Lists names within an edit distance of pattern, closest first.
+   A trailing integer in pattern overrides the default distance. */
+static CMS_STATUS cms_search_fuzzy(const StudentDatabase *db, CmsSlice text)
+{
+    int max_distance = CMS_FUZZY_DEFAULT_DISTANCE;
 
-    if (strcmp(command, "UNDO") == 0)
+    text = cms_slice_trim(text);
+    size_t last_space = text.length;
+    while (last_space > 0 && text.text[last_space - 1] != ' ')
+    {
+        last_space--;
+    }
+    if (last_space > 0)
     {
-        if (args != NULL)
+        CmsSlice word = {text.text + last_space, text.length - last_space};
+        int parsed = 0;
+        if (cms_slice_to_int(word, &parsed))
         {
-            printf("Usage: UNDO\n");
-            return CMS_STATUS_OK;
+            max_distance = parsed;
+            text.length = last_space;
+            text = cms_slice_trim(text);
         }
-        return cmd_undo(db);
     }
 
-    if (strcmp(command, "EXIT") == 0 || strcmp(command, "QUIT") == 0)
+    if (cms_slice_is_empty(text) || max_distance < 0 || max_distance > CMS_FUZZY_MAX_DISTANCE)
     {
-        printf("Type EXIT or QUIT directly at the prompt to leave the program.\n");
-        return CMS_STATUS_OK;
+        cms_printf("Usage: SEARCH NAME ~<text> [maxdist] (maxdist 0-%d)\n", CMS_FUZZY_MAX_DISTANCE);
+        return cms_usage_status();
     }
 
-    printf("Unknown command. Type HELP to see the list of commands.\n");
-    return CMS_STATUS_OK;
+    /* The index compares C strings; a pattern too long for the buffer is
+       further than any distance from every name, so it matches nothing */
+    char pattern[CMS_MAX_NAME_LEN + CMS_FUZZY_MAX_DISTANCE + 1];
+    CmsFuzzyMatch *matches = NULL;
+    int *ids = NULL;
+    size_t match_count = 0;
+    CMS_STATUS status = CMS_STATUS_OK;
+    if (cms_slice_copy(text, pattern, sizeof(pattern)))
+    {
+        status = cms_index_search_fuzzy(db, pattern, max_distance, &matches, &match_count);
+        ids = (status == CMS_STATUS_OK) ? cms_malloc(CMS_MEM_TEMP, (match_count + 1) * sizeof(int)) : NULL;
+        status = (status == CMS_STATUS_OK && ids == NULL) ? CMS_STATUS_ERROR : status;
+        for (size_t i = 0; status == CMS_STATUS_OK && i < match_count; ++i)
+        {
+            ids[i] = matches[i].id;
+        }
+        CmsNameQuery query = {pattern, false, max_distance};
+        if (status == CMS_STATUS_OK)
+        {
+            status = cms_database_overlay_ids(db, cms_name_key, &query, false, &ids, &match_count);
+        }
+        cms_free(matches);
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_free(ids);
+        return status;
+    }
+
+    if (match_count == 0)
+    {
+        cms_printf("\nNo names within distance %d of \"%.*s\".\n\n", max_distance, (int)text.length, text.text);
+        cms_free(ids);
+        return CMS_STATUS_OK;
+    }
+
+    StudentRecord *matched_records = cms_malloc(CMS_MEM_TEMP, match_count * sizeof(StudentRecord));
+    if (matched_records == NULL)
+    {
+        cms_free(ids);
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t found = 0;
+    for (size_t i = 0; i < match_count; ++i)
+    {
+        const StudentRecord *record = cms_database_find(db, ids[i]);
+        if (record != NULL)
+        {
+            matched_records[found++] = *record;
+        }
+    }
+
+    StudentDatabase matched_db;
+    memset(&matched_db, 0, sizeof(matched_db));
+    matched_db.records = matched_records;
+    matched_db.count = found;
+
+    cms_printf("\nCMS: %zu record(s) within edit distance %d of \"%s\", closest first.\n",
+           found, max_distance, pattern);
+    cms_display_table(&matched_db);
+
+    cms_free(matched_records);
+    cms_free(ids);
+    return CMS_STATUS_OK;
+}
+
+/**
+ * Searches student names using the name indexes.
+ * @param db Pointer to the StudentDatabase structure to search.
+ * @param args "NAME <text>" for a substring match, "NAME ^<text>" for a prefix match,
+ *             or "NAME ~<text> [maxdist]" for a fuzzy (edit distance) match.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_search(const StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    /* Expect the NAME keyword followed by the search text */
+    CmsSlice text = cms_slice_trim(args);
+    if (!cms_slice_skip_word(&text, "NAME") || cms_slice_is_empty(cms_slice_trim(text)))
+    {
+        cms_printf("Usage: SEARCH NAME <text> | SEARCH NAME ^<prefix> | SEARCH NAME ~<text> [maxdist]\n");
+        return cms_usage_status();
+    }
+
+    text = cms_slice_trim(text);
+    if (cms_slice_skip_prefix(&text, "~"))
+    {
+        return cms_search_fuzzy(db, text);
+    }
+
+    bool prefix_only = cms_slice_skip_prefix(&text, "^");
+    if (cms_slice_is_empty(text))
+    {
+        cms_printf("Usage: SEARCH NAME <text> | SEARCH NAME ^<prefix> | SEARCH NAME ~<text> [maxdist]\n");
+        return cms_usage_status();
+    }
+
+    /* A pattern that does not fit a name cannot be part of one */
+    char pattern[CMS_MAX_NAME_LEN + 1];
+    int *ids = NULL;
+    size_t id_count = 0;
+    CMS_STATUS status = CMS_STATUS_OK;
+    if (cms_slice_copy(text, pattern, sizeof(pattern)))
+    {
+        CmsNameQuery query = {pattern, prefix_only, -1};
+        status = cms_index_search_name(db, pattern, prefix_only, &ids, &id_count);
+        if (status == CMS_STATUS_OK)
+        {
+            status = cms_database_overlay_ids(db, cms_name_key, &query, false, &ids, &id_count);
+        }
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_free(ids);
+        return status;
+    }
+
+    if (id_count == 0)
+    {
+        cms_printf("\nNo records matched name \"%.*s\".\n\n", (int)text.length, text.text);
+        cms_free(ids);
+        return CMS_STATUS_OK;
+    }
+
+    StudentRecord *matched_records = cms_malloc(CMS_MEM_TEMP, id_count * sizeof(StudentRecord));
+    if (matched_records == NULL)
+    {
+        cms_free(ids);
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t matches = 0;
+    for (size_t i = 0; i < id_count; ++i)
+    {
+        const StudentRecord *record = cms_database_find(db, ids[i]);
+        if (record != NULL)
+        {
+            matched_records[matches++] = *record;
+        }
+    }
+    cms_free(ids);
+
+    StudentDatabase matched_db;
+    memset(&matched_db, 0, sizeof(matched_db));
+    matched_db.records = matched_records;
+    matched_db.count = matches;
+
+    cms_printf("\nCMS: %zu record(s) matched name \"%s\".\n", matches, pattern);
+    cms_display_table(&matched_db);
+
+    cms_free(matched_records);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cmd_save(StudentDatabase *db, CmsSlice filename)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    char path_buffer[CMS_MAX_FILE_PATH_LEN];
+    const char *save_path = db->file_path;
+    filename = cms_slice_trim(filename);
+    if (!cms_slice_is_empty(filename))
+    {
+        if (!cms_slice_copy(filename, path_buffer, sizeof(path_buffer)))
+        {
+            cms_printf("CMS: The file path is too long.\n");
+            return CMS_STATUS_INVALID_ARGUMENT;
+        }
+        save_path = path_buffer;
+    }
+    CMS_STATUS status = cms_database_save(db, save_path);
+    if (status == CMS_STATUS_OK)
+    {
+        // Extract basename for cleaner display
+        const char *display_name = save_path;
+        char *slash = strrchr(save_path, '\\');
+        if (slash == NULL)
+        {
+            slash = strrchr(save_path, '/');
+        }
+        if (slash != NULL)
+        {
+            display_name = slash + 1; // Use basename after last path separator
+        }
+        cms_printf("CMS: The database file \"%s\" is successfully saved.\n", display_name);
+        cms_watch_synced(cms_file_watch, db);
+    }
+    return status;
+}
+
+static const char *cms_export_usage =
+    "Usage: EXPORT CSV|JSON|NDJSON <path> [SORT <key> [ASC|DESC] | FILTER <programme/grade/mark filter>]";
+
+/* Cuts the next word or "quoted path" off *rest into path; false when there
+   is none or it is too long */
+static bool cms_next_path(CmsSlice *rest, char *path, size_t size)
+{
+    CmsSlice word = {NULL, 0};
+    return cms_slice_next_token(rest, &word) && !cms_slice_is_empty(word) && cms_slice_copy(word, path, size);
+}
+
+/* Opens a cursor over the rows an EXPORT view names: the whole table,
+   "SORT <key> [ASC|DESC]" or "FILTER <filter>" as accepted by FILTER */
+static CMS_STATUS cms_open_export_view(const StudentDatabase *db, CmsSlice view, CmsCursor *cursor,
+                                       bool *valid)
+{
+    *valid = true;
+    view = cms_slice_trim(view);
+    if (cms_slice_is_empty(view))
+    {
+        return cms_cursor_open(cursor, db);
+    }
+
+    if (cms_slice_skip_word(&view, "SORT"))
+    {
+        CmsSlice key = {NULL, 0};
+        CmsSlice order = {NULL, 0};
+        bool sorted = true;
+        CmsSortKey sort_key = CMS_SORT_KEY_ID;
+        CmsSortOrder sort_order = CMS_SORT_ASC;
+        if (!cms_slice_next_word(&view, &key) ||
+            (cms_slice_next_word(&view, &order) && !cms_slice_is_empty(cms_slice_trim(view))) ||
+            !cms_parse_sort_view(key, order, &sorted, &sort_key, &sort_order))
+        {
+            *valid = false;
+            return CMS_STATUS_OK;
+        }
+        return sorted ? cms_cursor_open_sorted(cursor, db, sort_key, sort_order)
+                      : cms_cursor_open(cursor, db);
+    }
+
+    CmsSlice filter = view;
+    if (!cms_slice_skip_word(&filter, "FILTER"))
+    {
+        *valid = false;
+        return CMS_STATUS_OK;
+    }
+
+    filter = cms_slice_trim(filter);
+    int *ids = NULL;
+    size_t count = 0;
+    CMS_STATUS status;
+    if (cms_slice_skip_word(&filter, "MARK"))
+    {
+        CmsMarkRange range;
+        if (!cms_parse_mark_range(filter, &range))
+        {
+            *valid = false;
+            return CMS_STATUS_OK;
+        }
+        status = cms_mark_range_ids(db, &range, &ids, &count);
+    }
+    else
+    {
+        CmsSelection selection;
+        CmsSelectionNames names;
+        if (!cms_parse_selection(filter, &selection, &names) ||
+            (selection.programme_count == 0 && selection.grade_count == 0))
+        {
+            *valid = false;
+            return CMS_STATUS_OK;
+        }
+        status = cms_selection_ids(db, &selection, &ids, &count);
+    }
+
+    if (status != CMS_STATUS_OK)
+    {
+        cms_free(ids);
+        return status;
+    }
+    return cms_cursor_open_ids(cursor, db, ids, count);
+}
+
+/* Longest format name ("NDJSON") with room to spare */
+#define CMS_EXPORT_FORMAT_NAME_LEN 16
+
+/**
+ * Streams records to a CSV, JSON or NDJSON file, straight from the table or
+ * a sorted or filtered view, without copying the records.
+ * @param db Pointer to the StudentDatabase structure to export.
+ * @param args "<format> <path> [SORT <key> [ASC|DESC] | FILTER <filter>]"; quote paths with spaces.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_export(const StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSlice rest = args;
+    CmsSlice format_word = {NULL, 0};
+    char format_name[CMS_EXPORT_FORMAT_NAME_LEN];
+    char path[CMS_MAX_FILE_PATH_LEN];
+    CmsExportFormat format;
+    if (!cms_slice_next_token(&rest, &format_word) || !cms_next_path(&rest, path, sizeof(path)) ||
+        !cms_slice_copy(format_word, format_name, sizeof(format_name)) ||
+        !cms_export_format_from_name(format_name, &format))
+    {
+        cms_printf("%s\n", cms_export_usage);
+        return cms_usage_status();
+    }
+
+    CmsCursor cursor;
+    bool valid = true;
+    CMS_STATUS status = cms_open_export_view(db, rest, &cursor, &valid);
+    if (!valid)
+    {
+        cms_printf("%s\n", cms_export_usage);
+        return cms_usage_status();
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    size_t rows = 0;
+    status = cms_export_file(path, &cursor, format, &rows);
+    cms_cursor_close(&cursor);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: Exported %zu record(s) to \"%s\" as %s.\n", rows, path,
+               cms_export_format_name(format));
+    }
+    return status;
+}
+
+static const char *cms_import_usage = "Usage: IMPORT <path> [ON CONFLICT SKIP|REPLACE|FAIL]";
+
+static void cms_print_conflict_ids(const CmsImportReport *report)
+{
+    if (report->conflict_id_count == 0)
+    {
+        return;
+    }
+    cms_printf("CMS: %zu row(s) had a student ID already present. IDs:", report->conflicts);
+    for (size_t i = 0; i < report->conflict_id_count; ++i)
+    {
+        cms_printf(" %d", report->conflict_ids[i]);
+    }
+    cms_printf("%s\n", (report->conflicts > report->conflict_id_count) ? " ..." : "");
+}
+
+/**
+ * Appends the records of a database file to the open table.
+ * @param db Pointer to the StudentDatabase structure.
+ * @param args "<path> [ON CONFLICT SKIP|REPLACE|FAIL]"; FAIL is the default.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_DUPLICATE if FAIL found conflicts, or error code otherwise.
+ */
+CMS_STATUS cmd_import(StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSlice options = args;
+    char path[CMS_MAX_FILE_PATH_LEN];
+    CmsConflictPolicy policy = CMS_CONFLICT_FAIL;
+    CmsSlice on = {NULL, 0};
+    CmsSlice conflict = {NULL, 0};
+    CmsSlice action = {NULL, 0};
+    bool valid = cms_next_path(&options, path, sizeof(path));
+    if (valid && cms_slice_next_word(&options, &on))
+    {
+        valid = cms_slice_equals(on, "ON") && cms_slice_next_word(&options, &conflict) &&
+                cms_slice_equals(conflict, "CONFLICT") && cms_slice_next_word(&options, &action) &&
+                cms_slice_is_empty(cms_slice_trim(options));
+        if (valid && cms_slice_equals(action, "SKIP"))
+        {
+            policy = CMS_CONFLICT_SKIP;
+        }
+        else if (valid && cms_slice_equals(action, "REPLACE"))
+        {
+            policy = CMS_CONFLICT_REPLACE;
+        }
+        else if (!valid || !cms_slice_equals(action, "FAIL"))
+        {
+            valid = false;
+        }
+    }
+    if (!valid)
+    {
+        cms_printf("%s\n", cms_import_usage);
+        return cms_usage_status();
+    }
+
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsImportReport report;
+    CMS_STATUS status = cms_database_import(db, path, policy, &report);
+    if (status == CMS_STATUS_DUPLICATE)
+    {
+        cms_print_conflict_ids(&report);
+        cms_printf("CMS: Nothing was imported. Use ON CONFLICT SKIP or REPLACE to import the rest.\n");
+        return status;
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    cms_printf("CMS: Imported %zu record(s) from \"%s\": %zu inserted, %zu replaced, %zu skipped.\n",
+           report.read, path, report.inserted, report.replaced, report.skipped);
+    cms_print_conflict_ids(&report);
+    return CMS_STATUS_OK;
+}
+
+static const char *cms_diff_usage = "Usage: DIFF <file> [<other file>]";
+static const char *cms_merge_usage = "Usage: MERGE <path> [PREFER LOCAL|REMOTE]";
+
+static void cms_print_change(const CmsChange *change)
+{
+    const StudentRecord *before = &change->before;
+    const StudentRecord *after = &change->after;
+    switch (change->kind)
+    {
+    case CMS_CHANGE_ADDED:
+        cms_printf("+ %d\t%s\t%s\t%.1f\n", after->id, after->name, after->programme, after->mark);
+        break;
+    case CMS_CHANGE_REMOVED:
+        cms_printf("- %d\t%s\t%s\t%.1f\n", before->id, before->name, before->programme, before->mark);
+        break;
+    case CMS_CHANGE_CHANGED:
+        cms_printf("~ %d", before->id);
+        if (change->fields & CMS_CHANGE_NAME)
+        {
+            cms_printf("\tNAME %s -> %s", before->name, after->name);
+        }
+        if (change->fields & CMS_CHANGE_PROGRAMME)
+        {
+            cms_printf("\tPROGRAMME %s -> %s", before->programme, after->programme);
+        }
+        if (change->fields & CMS_CHANGE_MARK)
+        {
+            cms_printf("\tMARK %.1f -> %.1f", before->mark, after->mark);
+        }
+        cms_printf("\n");
+        break;
+    }
+}
+
+static void cms_report_diff_failure(CMS_STATUS status)
+{
+    if (status == CMS_STATUS_DUPLICATE)
+    {
+        cms_printf("CMS: A student ID appears twice in one of the files; IDs must be unique to compare.\n");
+    }
+}
+
+/**
+ * Lists the records added, removed and changed between two database files,
+ * by student ID. With one file, the open table is compared against it.
+ * @param db Pointer to the StudentDatabase structure.
+ * @param args "<file> [<other file>]"; quote paths with spaces.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_diff(const StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSlice rest = args;
+    char first[CMS_MAX_FILE_PATH_LEN];
+    char second_path[CMS_MAX_FILE_PATH_LEN];
+    const char *second = NULL;
+    bool valid = cms_next_path(&rest, first, sizeof(first));
+    if (valid && !cms_slice_is_empty(cms_slice_trim(rest)))
+    {
+        valid = cms_next_path(&rest, second_path, sizeof(second_path)) &&
+                cms_slice_is_empty(cms_slice_trim(rest));
+        second = second_path;
+    }
+    if (!valid)
+    {
+        cms_printf("%s\n", cms_diff_usage);
+        return cms_usage_status();
+    }
+    if (second == NULL && !db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsChangeList list;
+    CMS_STATUS status = (second != NULL) ? cms_diff_files(first, second, &list)
+                                         : cms_diff_database(db, first, &list);
+    if (status != CMS_STATUS_OK)
+    {
+        cms_report_diff_failure(status);
+        return status;
+    }
+
+    for (size_t i = 0; i < list.count; ++i)
+    {
+        cms_print_change(&list.changes[i]);
+    }
+    cms_printf("CMS: %zu added, %zu removed, %zu changed.\n", list.added, list.removed, list.changed);
+    cms_change_list_free(&list);
+    return CMS_STATUS_OK;
+}
+
+/**
+ * Merges another database file into the open table in one batch. Rows only
+ * in the file are added; rows only in the table are kept; rows in both that
+ * differ keep the table's values (PREFER LOCAL, the default) or take the
+ * file's (PREFER REMOTE).
+ * @param db Pointer to the StudentDatabase structure.
+ * @param args "<path> [PREFER LOCAL|REMOTE]".
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_merge(StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSlice options = args;
+    char path[CMS_MAX_FILE_PATH_LEN];
+    bool prefer_remote = false;
+    CmsSlice prefer = {NULL, 0};
+    CmsSlice side = {NULL, 0};
+    bool valid = cms_next_path(&options, path, sizeof(path));
+    if (valid && cms_slice_next_word(&options, &prefer))
+    {
+        valid = cms_slice_equals(prefer, "PREFER") && cms_slice_next_word(&options, &side) &&
+                cms_slice_is_empty(cms_slice_trim(options)) &&
+                (cms_slice_equals(side, "LOCAL") || cms_slice_equals(side, "REMOTE"));
+        prefer_remote = valid && cms_slice_equals(side, "REMOTE");
+    }
+    if (!valid)
+    {
+        cms_printf("%s\n", cms_merge_usage);
+        return cms_usage_status();
+    }
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsChangeList list;
+    CMS_STATUS status = cms_diff_database(db, path, &list);
+    if (status != CMS_STATUS_OK)
+    {
+        cms_report_diff_failure(status);
+        return status;
+    }
+
+    size_t applied = 0;
+    unsigned kinds = CMS_APPLY_ADDED | (prefer_remote ? CMS_APPLY_CHANGED : 0u);
+    status = cms_database_apply_changes(db, &list, kinds, &applied);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: Merged \"%s\": %zu added, %zu %s.\n", path, list.added, list.changed,
+               prefer_remote ? "updated" : "differing left as they are");
+    }
+    cms_change_list_free(&list);
+    return status;
+}
+
+static const char *cms_watch_usage = "Usage: WATCH [ON [LOCAL|REMOTE] | OFF]";
+
+/* Takes in what another program wrote to the watched file since the last
+   command, before a command that reads the table */
+static void cms_watch_reload(StudentDatabase *db)
+{
+    CmsWatchReport report;
+    CMS_STATUS status = cms_watch_poll(cms_file_watch, db, &report);
+    if (status == CMS_STATUS_NOT_FOUND)
+    {
+        return;
+    }
+    if (status == CMS_STATUS_INVALID_ARGUMENT)
+    {
+        cms_printf("CMS: \"%s\" changed on disk; not reloaded while %s.\n", db->file_path, report.held);
+        return;
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_printf("CMS: \"%s\" changed on disk but could not be read; the table is unchanged.\n", db->file_path);
+        cms_report_diff_failure(status);
+        cms_print_status(status);
+        return;
+    }
+
+    cms_printf("CMS: Reloaded \"%s\": %zu added, %zu removed, %zu changed.\n", db->file_path, report.added,
+           report.removed, report.changed);
+    if (report.kept > 0)
+    {
+        cms_printf("CMS: %zu row(s) changed both here and in the file keep the edits made here; SAVE writes them.\n",
+               report.kept);
+    }
+    if (report.overwritten > 0)
+    {
+        cms_printf("CMS: %zu row(s) edited here took the file's version instead; UNDO brings the edits back.\n",
+               report.overwritten);
+    }
+}
+
+/**
+ * Follows the open file on disk: changes another program writes to it are
+ * applied before the next command that reads the table, row by row. A row
+ * changed both here and in the file keeps the edit made here (LOCAL, the
+ * default) or takes the file's (REMOTE). Without arguments, shows whether
+ * the file is watched. OFF while the table has unsaved changes pauses the
+ * watch instead, so that ON resumes it knowing which rows came from the
+ * file; what the file gained in between is taken in then.
+ * @param db Pointer to the StudentDatabase structure.
+ * @param args "ON [LOCAL|REMOTE]", "OFF" or empty.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT or error code otherwise.
+ */
+CMS_STATUS cmd_watch(StudentDatabase *db, CmsSlice args)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSlice rest = cms_slice_trim(args);
+    CmsSlice mode = {NULL, 0};
+    CmsSlice side = {NULL, 0};
+    bool has_mode = cms_slice_next_word(&rest, &mode);
+    bool has_side = has_mode && cms_slice_next_word(&rest, &side);
+    bool valid = !has_mode || (cms_slice_equals(mode, "OFF") && !has_side) ||
+                 (cms_slice_equals(mode, "ON") &&
+                  (!has_side || cms_slice_equals(side, "LOCAL") || cms_slice_equals(side, "REMOTE")));
+    if (!valid || !cms_slice_is_empty(cms_slice_trim(rest)))
+    {
+        cms_printf("%s\n", cms_watch_usage);
+        return cms_usage_status();
+    }
+
+    if (!has_mode)
+    {
+        if (cms_file_watch == NULL || cms_file_watch_paused)
+        {
+            cms_printf("CMS: WATCH is off.\n");
+        }
+        else
+        {
+            cms_printf("CMS: Watching \"%s\"; %s.\n", db->file_path,
+                   (cms_watch_policy(cms_file_watch) == CMS_WATCH_PREFER_REMOTE) ? "the file wins conflicts"
+                                                                               : "edits made here win conflicts");
+        }
+        return CMS_STATUS_OK;
+    }
+
+    if (cms_slice_equals(mode, "OFF"))
+    {
+        cms_file_watch_paused = (cms_file_watch != NULL) && db->is_dirty;
+        if (!cms_file_watch_paused)
+        {
+            cms_watch_stop(cms_file_watch);
+            cms_file_watch = NULL;
+        }
+        cms_printf("CMS: WATCH is off.\n");
+        return CMS_STATUS_OK;
+    }
+
+    if (!db->is_loaded)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsWatchPolicy policy = (has_side && cms_slice_equals(side, "REMOTE")) ? CMS_WATCH_PREFER_REMOTE
+                                                                           : CMS_WATCH_PREFER_LOCAL;
+    if (cms_file_watch != NULL)
+    {
+        cms_watch_set_policy(cms_file_watch, policy);
+        cms_file_watch_paused = false;
+    }
+    else
+    {
+        CMS_STATUS status = cms_watch_start(db, policy, &cms_file_watch);
+        if (status == CMS_STATUS_NOT_IMPLEMENTED)
+        {
+            cms_printf("CMS: WATCH is only available on Linux.\n");
+        }
+        if (status != CMS_STATUS_OK)
+        {
+            return status;
+        }
+    }
+    cms_printf("CMS: Watching \"%s\"; %s.\n", db->file_path,
+           (policy == CMS_WATCH_PREFER_REMOTE) ? "the file wins conflicts" : "edits made here win conflicts");
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cmd_undo(StudentDatabase *db, size_t steps)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!db->is_loaded && db->count == 0)
+    {
+        cms_printf("CMS: No database is currently opened.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t done = 0;
+    CMS_STATUS status = cms_database_undo(db, steps, &done);
+    if (status == CMS_STATUS_INVALID_ARGUMENT)
+    {
+        cms_printf("CMS: Nothing to undo.\n");
+        return status;
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_printf("CMS: The undo history no longer matches the records and has been cleared.\n");
+        return status;
+    }
+
+    if (steps == 1)
+    {
+        cms_printf("CMS: Last change has been undone.\n");
+    }
+    else if (done == steps)
+    {
+        cms_printf("CMS: Undid %zu changes.\n", done);
+    }
+    else
+    {
+        cms_printf("CMS: Undid %zu of %zu changes; there is no earlier history.\n", done, steps);
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cmd_redo(StudentDatabase *db, size_t steps)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (cms_in_open_transaction(db))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t done = 0;
+    CMS_STATUS status = cms_database_redo(db, steps, &done);
+    if (status == CMS_STATUS_INVALID_ARGUMENT)
+    {
+        cms_printf("CMS: Nothing to redo.\n");
+        return status;
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_printf("CMS: The undo history no longer matches the records and has been cleared.\n");
+        return status;
+    }
+
+    if (steps == 1)
+    {
+        cms_printf("CMS: Change has been redone.\n");
+    }
+    else if (done == steps)
+    {
+        cms_printf("CMS: Redid %zu changes.\n", done);
+    }
+    else
+    {
+        cms_printf("CMS: Redid %zu of %zu changes; there is nothing more to redo.\n", done, steps);
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cmd_begin(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        cms_printf("CMS: A transaction is already open.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    CMS_STATUS status = cms_database_begin(db);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: Transaction started. Changes are held until COMMIT or ROLLBACK.\n");
+    }
+    return status;
+}
+
+CMS_STATUS cmd_commit(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction == NULL)
+    {
+        cms_printf("CMS: No transaction is open.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsCommitReport report;
+    CMS_STATUS status = cms_database_commit(db, &report);
+    if (status == CMS_STATUS_NOT_FOUND || status == CMS_STATUS_DUPLICATE)
+    {
+        cms_printf("CMS: Student %d was %s by another session since BEGIN.\n", report.conflict_id,
+               (status == CMS_STATUS_NOT_FOUND) ? "deleted" : "inserted");
+        cms_printf("CMS: Nothing was committed; the transaction has been rolled back.\n");
+    }
+    else if (status == CMS_STATUS_ERROR)
+    {
+        cms_printf("CMS: Out of memory; nothing was committed and the transaction is still open.\n");
+    }
+    else if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: Transaction committed (%zu inserted, %zu updated, %zu deleted).\n", report.inserted,
+               report.updated, report.deleted);
+    }
+    return status;
+}
+
+CMS_STATUS cmd_rollback(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction == NULL)
+    {
+        cms_printf("CMS: No transaction is open.\n");
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t touched = db->transaction->count;
+    CMS_STATUS status = cms_database_rollback(db);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("CMS: Transaction rolled back; changes to %zu record(s) discarded.\n", touched);
+    }
+    return status;
+}
+
+/**
+ * Starts or stops timing commands for STATS. Without arguments, shows
+ * whether commands are timed.
+ * @param args "ON", "OFF" or empty.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT otherwise.
+ */
+CMS_STATUS cmd_timing(CmsSlice args)
+{
+    CmsSlice rest = cms_slice_trim(args);
+    CmsSlice mode = {NULL, 0};
+    if (cms_slice_next_word(&rest, &mode))
+    {
+        if (!cms_slice_is_empty(cms_slice_trim(rest)) ||
+            (!cms_slice_equals(mode, "ON") && !cms_slice_equals(mode, "OFF")))
+        {
+            cms_printf("Usage: TIMING [ON|OFF]\n");
+            return cms_usage_status();
+        }
+        cms_metrics_set_enabled(cms_slice_equals(mode, "ON"));
+    }
+    cms_printf("CMS: TIMING is %s.\n", cms_metrics_enabled() ? "on" : "off");
+    return CMS_STATUS_OK;
+}
+
+/* Bytes held by each part of the program, then how the loaded table's
+   capacity is used and what the whole program costs per record */
+static void cms_print_memory(const StudentDatabase *db)
+{
+    cms_printf("\n%-10s %14s %14s %10s\n", "Memory", "Current (B)", "Peak (B)", "Blocks");
+    for (int kind = 0; kind <= CMS_MEM_KIND_COUNT; ++kind)
+    {
+        CmsMemUsage usage = cms_mem_usage((CmsMemKind)kind);
+        cms_printf("%-10s %14zu %14zu %10zu\n", cms_mem_kind_name((CmsMemKind)kind), usage.current, usage.peak,
+               usage.blocks);
+    }
+
+    size_t count = (db != NULL) ? db->count : 0;
+    size_t capacity = (db != NULL && db->records != NULL) ? db->capacity : 0;
+    cms_printf("\nRecords: %zu of %zu slots in use, %zu bytes unused (%zu bytes per slot)\n", count, capacity,
+           (capacity - count) * sizeof(StudentRecord), sizeof(StudentRecord));
+    if (count > 0)
+    {
+        cms_printf("Bytes per record: %.1f\n", (double)cms_mem_usage(CMS_MEM_KIND_COUNT).current / (double)count);
+    }
+    cms_printf("\n");
+}
+
+/**
+ * Prints, for every command timed so far, how often it ran, how often it
+ * failed and its median, 99th percentile and slowest time. RESET clears
+ * the figures and starts the memory peaks again; MEMORY prints the bytes
+ * held by records, strings, indexes, undo history and temporary buffers.
+ * @param db Pointer to the StudentDatabase structure (for MEMORY).
+ * @param args "RESET", "MEMORY" or empty.
+ * @return CMS_STATUS_OK on success, CMS_STATUS_INVALID_ARGUMENT otherwise.
+ */
+CMS_STATUS cmd_stats(const StudentDatabase *db, CmsSlice args)
+{
+    CmsSlice rest = cms_slice_trim(args);
+    CmsSlice option = {NULL, 0};
+    if (cms_slice_next_word(&rest, &option))
+    {
+        bool reset = cms_slice_equals(option, "RESET");
+        if ((!reset && !cms_slice_equals(option, "MEMORY")) || !cms_slice_is_empty(cms_slice_trim(rest)))
+        {
+            cms_printf("Usage: STATS [RESET|MEMORY]\n");
+            return cms_usage_status();
+        }
+        if (!reset)
+        {
+            cms_print_memory(db);
+            return CMS_STATUS_OK;
+        }
+        cms_metrics_reset();
+        cms_mem_reset_peaks();
+        cms_printf("CMS: Command statistics cleared.\n");
+        return CMS_STATUS_OK;
+    }
+
+    CmsVerbMetrics verbs[CMS_METRICS_MAX_VERBS];
+    size_t count = cms_metrics_list(verbs, CMS_METRICS_MAX_VERBS);
+    if (count == 0)
+    {
+        cms_printf("CMS: No commands timed yet. Use TIMING ON, or start with --metrics <file>.\n");
+        return CMS_STATUS_OK;
+    }
+
+    cms_printf("\n%-10s %10s %8s %12s %12s %12s\n", "Command", "Count", "Errors", "p50 (ms)", "p99 (ms)", "Max (ms)");
+    for (size_t i = 0; i < count; ++i)
+    {
+        cms_printf("%-10s %10llu %8llu %12.3f %12.3f %12.3f\n", verbs[i].verb, (unsigned long long)verbs[i].count,
+               (unsigned long long)verbs[i].errors, (double)verbs[i].p50 / 1e6, (double)verbs[i].p99 / 1e6,
+               (double)verbs[i].max / 1e6);
+    }
+    if (!cms_metrics_enabled())
+    {
+        cms_printf("(TIMING is off; these are the figures from while it was on.)\n");
+    }
+    cms_printf("\n");
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cmd_help(void)
+{
+    cms_printf("\nAvailable Commands:\n");
+    cms_printf("  OPEN <filename>               - Load a database file\n");
+    cms_printf("  SHOW [ID|MARK|NAME|PROGRAMME] [ASC|DESC] - Display records (defaults to ID ASC)\n");
+    cms_printf("  SHOW ALL                      - Display all student records\n");
+    cms_printf("  SHOW ... LIMIT <n> [OFFSET <m>] - Display a window of rows (e.g SHOW NAME LIMIT 10 OFFSET 20)\n");
+    cms_printf("  SHOW ... PAGE <n>             - Display <n> rows at a time; NEXT shows the following page\n");
+    cms_printf("  SHOW SUMMARY                  - Display summary statistics\n");
+    cms_printf("  INSERT                        - Add a new student record\n");
+    cms_printf("  QUERY <student_id>            - Find a specific record\n");
+    cms_printf("  UPDATE <student_id>           - Modify an existing record\n");
+    cms_printf("  UPDATE <id> [NAME=..] [PROGRAMME=..] [MARK=..] - Modify fields inline without prompts\n");
+    cms_printf("  DELETE <student_id>           - Remove a student record\n");
+    cms_printf("  DELETE WHERE <filter>         - Remove every matching record (e.g DELETE WHERE Physics GRADE F)\n");
+    cms_printf("  UPDATE SET MARK = MARK + <k> WHERE <filter> - Adjust matching marks (also -, * or a fixed mark)\n");
+    cms_printf("  FILTER <programme>            - List students by programme (e.g FILTER Computer Science) \n");
+    cms_printf("  FILTER <p>[,<p>] GRADE <g>[,<g>] - List students by programme(s) and grade(s) (e.g FILTER GRADE A+,A)\n");
+    cms_printf("  FILTER MARK BETWEEN <a> AND <b> - List students in a mark range, lowest first (also > >= < <=)\n");
+    cms_printf("  COUNT [PROGRAMME <p>] [GRADE <g>] - Count matching students (grades: A+ A B+ B C+ C D F)\n");
+    cms_printf("  SEARCH NAME <text>            - Find students whose name contains text (^text for prefix)\n");
+    cms_printf("  SEARCH NAME ~<text> [maxdist] - Find names within an edit distance, closest first\n");
+    cms_printf("  EXPORT CSV|JSON|NDJSON <path> [SORT <key> [ASC|DESC] | FILTER <filter>] - Write records to a file\n");
+    cms_printf("  IMPORT <path> [ON CONFLICT SKIP|REPLACE|FAIL] - Append the records of a database file\n");
+    cms_printf("  DIFF <file> [<other file>]    - List records added, removed and changed (by ID) between two files\n");
+    cms_printf("  MERGE <path> [PREFER LOCAL|REMOTE] - Add a file's new records; PREFER REMOTE also takes its changes\n");
+    cms_printf("  WATCH [ON [LOCAL|REMOTE] | OFF] - Reload rows another program changes in the open file\n");
+    cms_printf("  UNDO [n]                      - Revert the last change (or the last n changes)\n");
+    cms_printf("  REDO [n]                      - Reapply changes reverted by UNDO\n");
+    cms_printf("  BEGIN                         - Hold changes until COMMIT (applied at once) or ROLLBACK (dropped)\n");
+    cms_printf("  COMMIT                        - Apply the open transaction as one change\n");
+    cms_printf("  ROLLBACK                      - Discard the open transaction\n");
+    cms_printf("  SAVE [filename]               - Save changes to file\n");
+    cms_printf("  TIMING [ON|OFF]               - Time every command for STATS\n");
+    cms_printf("  STATS [RESET]                 - Count, errors and p50/p99/max time of each command timed\n");
+    cms_printf("  STATS MEMORY                  - Current and peak bytes of records, indexes, undo and buffers\n");
+    cms_printf("  HELP                          - Display this help\n");
+    cms_printf("  EXIT or QUIT                  - Exit the application\n\n");
+
+    return CMS_STATUS_OK;
+}
+
+void cms_command_loop(StudentDatabase *db)
+{
+    cms_command_loop_loading(db, NULL);
+}
+
+/* Longest batch line accepted; longer lines are rejected rather than split */
+#define CMS_BATCH_LINE_LEN (CMS_MAX_COMMAND_LEN * 4)
+
+/* Runs one batch line (already trimmed) and prints its status line;
+   returns false once the line asks to stop */
+static bool cms_batch_execute(StudentDatabase *db, const char *line, unsigned long line_number,
+                              bool too_long, int *failures)
+{
+    if (too_long || strlen(line) >= CMS_MAX_COMMAND_LEN)
+    {
+        /* Never run a command that would be cut short */
+        cms_printf("ERR %lu %s Line too long\n", line_number, cms_status_name(CMS_STATUS_INVALID_ARGUMENT));
+        (*failures)++;
+        return true;
+    }
+    if (line[0] == '\0' || line[0] == '#')
+    {
+        return true;
+    }
+
+    if (cms_string_equals_ignore_case(line, "EXIT") ||
+        cms_string_equals_ignore_case(line, "QUIT"))
+    {
+        cms_printf("OK %lu\n", line_number);
+        return false;
+    }
+
+    CMS_STATUS status = cms_parse_command(line, db);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_printf("OK %lu\n", line_number);
+    }
+    else
+    {
+        cms_printf("ERR %lu %s %s\n", line_number, cms_status_name(status), cms_status_message(status));
+        (*failures)++;
+    }
+    return true;
+}
+
+int cms_batch_loop(StudentDatabase *db, FILE *input)
+{
+    char line[CMS_BATCH_LINE_LEN];
+    unsigned long line_number = 0;
+    int failures = 0;
+
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        line_number++;
+        size_t length = strlen(line);
+        bool truncated = false;
+        if (length > 0 && line[length - 1] != '\n' && !feof(input))
+        {
+            /* Drop the rest of a line that did not fit */
+            int c;
+            while ((c = fgetc(input)) != '\n' && c != EOF)
+            {
+            }
+            truncated = true;
+        }
+
+        cms_trim(line);
+        if (!cms_batch_execute(db, line, line_number, truncated, &failures))
+        {
+            break;
+        }
+    }
+    return failures;
+}
+
+int cms_batch_commands(StudentDatabase *db, char *const *commands, size_t count)
+{
+    char line[CMS_MAX_COMMAND_LEN];
+    int failures = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t length = strlen(commands[i]);
+        bool too_long = length >= sizeof(line);
+        if (!too_long)
+        {
+            memcpy(line, commands[i], length + 1);
+            cms_trim(line);
+        }
+        else
+        {
+            line[0] = '\0';
+        }
+
+        if (!cms_batch_execute(db, line, (unsigned long)(i + 1), too_long, &failures))
+        {
+            break;
+        }
+    }
+    return failures;
+}
+
+/* Parses "LIMIT <n>", "OFFSET <m>" and "PAGE <n>" clauses in any order.
+   LIMIT and PAGE need a positive count and cannot be combined. */
+static bool cms_parse_show_window(CmsSlice text, size_t *offset, int *limit, int *page)
+{
+    CmsSlice keyword;
+    while (cms_slice_next_word(&text, &keyword))
+    {
+        CmsSlice value = {NULL, 0};
+        int parsed = 0;
+        if (!cms_slice_next_word(&text, &value) || !cms_slice_to_int(value, &parsed) || parsed < 0)
+        {
+            return false;
+        }
+        if (cms_slice_equals(keyword, "LIMIT") && parsed > 0)
+        {
+            *limit = parsed;
+        }
+        else if (cms_slice_equals(keyword, "PAGE") && parsed > 0)
+        {
+            *page = parsed;
+        }
+        else if (cms_slice_equals(keyword, "OFFSET"))
+        {
+            *offset = (size_t)parsed;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !(*limit > 0 && *page > 0);
+}
+
+/* ===== Command dispatch ===== */
+
+/* How a command's arguments are checked before its handler runs */
+typedef enum
+{
+    CMS_ARGS_NONE = 0, /* nothing may follow the verb */
+    CMS_ARGS_TEXT,     /* free text, possibly empty, left to the handler */
+    CMS_ARGS_ID        /* exactly one student ID */
+} CmsArgSchema;
+
+/* Arguments as the schema delivers them; text is a slice of the input line */
+typedef struct
+{
+    CmsSlice text;
+    int id;
+} CmsCommandArgs;
+
+typedef CMS_STATUS (*CmsCommandHandler)(StudentDatabase *db, const CmsCommandArgs *args);
+
+typedef struct
+{
+    const char *verb;
+    size_t length;
+    CmsArgSchema schema;
+    const char *usage; /* printed when the arguments do not fit the schema */
+    CmsCommandHandler run;
+    bool needs_table;  /* waits for a background load to finish first */
+    bool reads_table;  /* lists, counts or copies rows without changing them */
+} CmsCommandSpec;
+
+static CMS_STATUS cms_run_help(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)db;
+    if (!cms_slice_is_empty(args->text))
+    {
+        cms_printf("HELP does not take any arguments. Ignoring extra input.\n");
+    }
+    return cmd_help();
+}
+
+static CMS_STATUS cms_run_open(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_open(db, args->text);
+}
+
+static CMS_STATUS cms_run_show(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    /* Up to two words (option and order), then optional LIMIT / OFFSET / PAGE
+       clauses that select a window */
+    CmsSlice words[2] = {{NULL, 0}, {NULL, 0}};
+    size_t word_count = 0;
+    CmsSlice rest = args->text;
+    CmsSlice window = {NULL, 0};
+    CmsSlice word;
+    while (cms_slice_next_word(&rest, &word))
+    {
+        if (cms_slice_equals(word, "LIMIT") || cms_slice_equals(word, "OFFSET") ||
+            cms_slice_equals(word, "PAGE"))
+        {
+            window.text = word.text;
+            window.length = (size_t)(rest.text + rest.length - word.text);
+            break;
+        }
+        if (word_count == 2)
+        {
+            cms_printf("Usage: SHOW [ALL|SUMMARY|ID|MARK|NAME|PROGRAMME] [ASC|DESC]\n");
+            return cms_usage_status();
+        }
+        words[word_count++] = word;
+    }
+
+    if (window.text == NULL)
+    {
+        return cms_show_view(db, words[0], words[1]);
+    }
+
+    size_t offset = 0;
+    int limit = 0;
+    int page = 0;
+    if (!cms_parse_show_window(window, &offset, &limit, &page))
+    {
+        cms_printf("Usage: SHOW [ALL|ID|MARK|NAME|PROGRAMME] [ASC|DESC] [LIMIT <n>] [OFFSET <m>] | ... PAGE <n>\n");
+        return cms_usage_status();
+    }
+    return cms_show_page_view(db, words[0], words[1], offset, (size_t)(page > 0 ? page : limit), page > 0);
+}
+
+static CMS_STATUS cms_run_next(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)args;
+    return cmd_next(db);
+}
+
+static CMS_STATUS cms_run_insert(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_insert(db, args->text);
+}
+
+static CMS_STATUS cms_run_query(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_query(db, args->id);
+}
+
+
+static CMS_STATUS cms_run_update(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    CmsSlice rest = args->text;
+    CmsSlice word = {NULL, 0};
+    int student_id = 0;
+    bool has_word = cms_slice_next_word(&rest, &word);
+    if (has_word && cms_slice_equals(word, "SET"))
+    {
+        return cmd_update_where(db, rest);
+    }
+    if (!has_word || !cms_slice_to_int(word, &student_id))
+    {
+        cms_printf("%s\n", cms_update_usage);
+        return cms_usage_status();
+    }
+
+    /* UPDATE <id> prompts for each field; UPDATE <id> NAME=... sets them inline */
+    CmsSlice fields = cms_slice_trim(rest);
+    if (!cms_slice_is_empty(fields))
+    {
+        return cmd_update_fields(db, student_id, fields);
+    }
+    if (cms_session.batch)
+    {
+        cms_printf("CMS: UPDATE needs inline fields in batch mode, e.g. UPDATE %d MARK=75\n", student_id);
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    return cmd_update(db, student_id);
+}
+
+static CMS_STATUS cms_run_delete(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    CmsSlice rest = args->text;
+    CmsSlice word = {NULL, 0};
+    int student_id = 0;
+    bool has_word = cms_slice_next_word(&rest, &word);
+    if (has_word && cms_slice_equals(word, "WHERE"))
+    {
+        return cmd_delete_where(db, rest);
+    }
+    if (!has_word || !cms_slice_to_int(word, &student_id) || !cms_slice_is_empty(cms_slice_trim(rest)))
+    {
+        cms_printf("%s\n", cms_delete_usage);
+        return cms_usage_status();
+    }
+    return cmd_delete(db, student_id);
+}
+
+static CMS_STATUS cms_run_filter(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cms_filter(db, args->text);
+}
+
+static CMS_STATUS cms_run_count(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_count(db, args->text);
+}
+
+static CMS_STATUS cms_run_search(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_search(db, args->text);
+}
+
+static CMS_STATUS cms_run_save(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_save(db, args->text);
+}
+
+static CMS_STATUS cms_run_export(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_export(db, args->text);
+}
+
+/* Optional step count for UNDO and REDO; 1 when absent */
+static bool cms_parse_steps(CmsSlice text, size_t *out_steps)
+{
+    CmsSlice word = {NULL, 0};
+    int steps = 1;
+    if (cms_slice_next_word(&text, &word) &&
+        (!cms_slice_to_int(word, &steps) || steps < 1 || !cms_slice_is_empty(cms_slice_trim(text))))
+    {
+        return false;
+    }
+    *out_steps = (size_t)steps;
+    return true;
+}
+
+static CMS_STATUS cms_run_import(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_import(db, args->text);
+}
+
+static CMS_STATUS cms_run_diff(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_diff(db, args->text);
+}
+
+static CMS_STATUS cms_run_merge(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_merge(db, args->text);
+}
+
+static CMS_STATUS cms_run_watch(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_watch(db, args->text);
+}
+
+static CMS_STATUS cms_run_undo(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    size_t steps = 1;
+    if (!cms_parse_steps(args->text, &steps))
+    {
+        cms_printf("Usage: UNDO [n]\n");
+        return cms_usage_status();
+    }
+    return cmd_undo(db, steps);
+}
+
+static CMS_STATUS cms_run_redo(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    size_t steps = 1;
+    if (!cms_parse_steps(args->text, &steps))
+    {
+        cms_printf("Usage: REDO [n]\n");
+        return cms_usage_status();
+    }
+    return cmd_redo(db, steps);
+}
+
+static CMS_STATUS cms_run_begin(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)args;
+    return cmd_begin(db);
+}
+
+static CMS_STATUS cms_run_commit(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)args;
+    return cmd_commit(db);
+}
+
+static CMS_STATUS cms_run_rollback(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)args;
+    return cmd_rollback(db);
+}
+
+static CMS_STATUS cms_run_timing(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)db;
+    return cmd_timing(args->text);
+}
+
+static CMS_STATUS cms_run_stats(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    return cmd_stats(db, args->text);
+}
+
+static CMS_STATUS cms_run_exit(StudentDatabase *db, const CmsCommandArgs *args)
+{
+    (void)db;
+    (void)args;
+    cms_printf("Type EXIT or QUIT directly at the prompt to leave the program.\n");
+    return CMS_STATUS_OK;
+}
+
+#define CMS_VERB(name) name, sizeof(name) - 1
+
+/* Every command the CLI accepts; a new verb only needs a row here */
+static const CmsCommandSpec cms_commands[] = {
+    {CMS_VERB("SHOW"), CMS_ARGS_TEXT, NULL, cms_run_show, true, true},
+    {CMS_VERB("QUERY"), CMS_ARGS_ID, "Usage: QUERY <student_id>", cms_run_query, true, true},
+    {CMS_VERB("UPDATE"), CMS_ARGS_TEXT, NULL, cms_run_update, true, false},
+    {CMS_VERB("INSERT"), CMS_ARGS_TEXT, NULL, cms_run_insert, true, false},
+    {CMS_VERB("DELETE"), CMS_ARGS_TEXT, NULL, cms_run_delete, true, false},
+    {CMS_VERB("FILTER"), CMS_ARGS_TEXT, NULL, cms_run_filter, true, true},
+    {CMS_VERB("COUNT"), CMS_ARGS_TEXT, NULL, cms_run_count, true, true},
+    {CMS_VERB("SEARCH"), CMS_ARGS_TEXT, NULL, cms_run_search, true, true},
+    {CMS_VERB("NEXT"), CMS_ARGS_NONE, "Usage: NEXT", cms_run_next, true, true},
+    {CMS_VERB("OPEN"), CMS_ARGS_TEXT, NULL, cms_run_open, false, false},
+    {CMS_VERB("SAVE"), CMS_ARGS_TEXT, NULL, cms_run_save, true, false},
+    {CMS_VERB("EXPORT"), CMS_ARGS_TEXT, NULL, cms_run_export, true, true},
+    {CMS_VERB("IMPORT"), CMS_ARGS_TEXT, NULL, cms_run_import, true, false},
+    {CMS_VERB("DIFF"), CMS_ARGS_TEXT, NULL, cms_run_diff, true, true},
+    {CMS_VERB("MERGE"), CMS_ARGS_TEXT, NULL, cms_run_merge, true, false},
+    {CMS_VERB("WATCH"), CMS_ARGS_TEXT, NULL, cms_run_watch, true, false},
+    {CMS_VERB("UNDO"), CMS_ARGS_TEXT, NULL, cms_run_undo, true, false},
+    {CMS_VERB("REDO"), CMS_ARGS_TEXT, NULL, cms_run_redo, true, false},
+    {CMS_VERB("BEGIN"), CMS_ARGS_NONE, "Usage: BEGIN", cms_run_begin, true, false},
+    {CMS_VERB("COMMIT"), CMS_ARGS_NONE, "Usage: COMMIT", cms_run_commit, true, false},
+    {CMS_VERB("ROLLBACK"), CMS_ARGS_NONE, "Usage: ROLLBACK", cms_run_rollback, true, false},
+    {CMS_VERB("TIMING"), CMS_ARGS_TEXT, NULL, cms_run_timing, false, false},
+    {CMS_VERB("STATS"), CMS_ARGS_TEXT, NULL, cms_run_stats, false, false},
+    {CMS_VERB("HELP"), CMS_ARGS_TEXT, NULL, cms_run_help, false, false},
+    {CMS_VERB("EXIT"), CMS_ARGS_TEXT, NULL, cms_run_exit, false, false},
+    {CMS_VERB("QUIT"), CMS_ARGS_TEXT, NULL, cms_run_exit, false, false}};
+
+/* With this few verbs, comparing lengths first makes a scan as cheap as
+   hashing and keeps the table the only thing to edit */
+static const CmsCommandSpec *cms_find_command(CmsSlice verb)
+{
+    for (size_t i = 0; i < sizeof(cms_commands) / sizeof(cms_commands[0]); ++i)
+    {
+        if (cms_commands[i].length == verb.length && cms_slice_equals(verb, cms_commands[i].verb))
+        {
+            return &cms_commands[i];
+        }
+    }
+    return NULL;
+}
+
+bool cms_command_reads_only(const char *input)
+{
+    if (input == NULL)
+    {
+        return false;
+    }
+    CmsCommandLine line;
+    cms_tokenize_command(input, &line);
+    const CmsCommandSpec *command = cms_find_command(line.verb);
+    /* While a file is watched, dispatch may reload it before the command */
+    return command != NULL && command->reads_table && (cms_file_watch == NULL || cms_file_watch_paused);
+}
+
+/* Checks the arguments against the verb's schema and runs its handler */
+static CMS_STATUS cms_dispatch_command(const CmsCommandSpec *command, CmsSlice text, StudentDatabase *db)
+{
+    if (cms_file_watch != NULL && !cms_file_watch_paused && command->needs_table)
+    {
+        cms_watch_reload(db);
+    }
+
+    CmsCommandArgs args;
+    args.text = text;
+    args.id = 0;
+
+    bool fits = true;
+    if (command->schema == CMS_ARGS_NONE)
+    {
+        fits = cms_slice_is_empty(args.text);
+    }
+    else if (command->schema == CMS_ARGS_ID)
+    {
+        CmsSlice id_word = {NULL, 0};
+        fits = cms_slice_next_word(&args.text, &id_word) && cms_slice_to_int(id_word, &args.id);
+        args.text = cms_slice_trim(args.text);
+        if (!cms_slice_is_empty(args.text))
+        {
+            fits = false;
+        }
+    }
+    if (!fits)
+    {
+        cms_printf("%s\n", command->usage);
+        return cms_usage_status();
+    }
+
+    return command->run(db, &args);
+}
+
+CMS_STATUS cms_parse_command(const char *input, StudentDatabase *db)
+{
+    if (input == NULL || db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsCommandLine line;
+    cms_tokenize_command(input, &line);
+    if (cms_slice_is_empty(line.verb))
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsCommandSpec *command = cms_find_command(line.verb);
+    if (command == NULL)
+    {
+        cms_printf("Unknown command. Type HELP to see the list of commands.\n");
+        return cms_usage_status();
+    }
+    if (!cms_metrics_enabled())
+    {
+        return cms_dispatch_command(command, line.args, db);
+    }
+
+    uint64_t started = cms_metrics_now();
+    CMS_STATUS status = cms_dispatch_command(command, line.args, db);
+    cms_metrics_record((size_t)(command - cms_commands), command->verb, status, cms_metrics_now() - started);
+    return status;
+}
+
+/* ===== Background load ===== */
+
+#define CMS_LOAD_PROGRESS_MS 200
+
+/* A file opened on a thread of its own while the prompt is already up. The
+   thread fills a table of its own, which the loop takes over before the next
+   command once the load is done, or waits for before a command that needs
+   data. The outcome is printed once: by the thread if it finishes while the
+   loop sits at the prompt, otherwise by the loop after its current command. */
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t finished_signal;
+    char path[CMS_MAX_FILE_PATH_LEN];
+    struct timespec started;
+    StudentDatabase table;
+    CmsLoadReport report;
+    CMS_STATUS status;
+    bool finished;  /* the thread is done with table, report and status */
+    bool reported;  /* the outcome has been printed */
+    bool busy;      /* the loop is running a command, not waiting at the prompt */
+    bool abandoned; /* nobody will take the table; the thread frees everything */
+} CmsBackgroundLoad;
+
+static void cms_background_load_free(CmsBackgroundLoad *load)
+{
+    cms_database_cleanup(&load->table);
+    pthread_cond_destroy(&load->finished_signal);
+    pthread_mutex_destroy(&load->lock);
+    cms_free(load);
+}
+
+/* Prints the outcome unless already done; call with the lock held */
+static void cms_background_load_report(CmsBackgroundLoad *load, bool at_prompt)
+{
+    if (load->reported)
+    {
+        return;
+    }
+    load->reported = true;
+
+    if (at_prompt)
+    {
+        cms_printf("\n");
+    }
+    cms_print_load_report(&load->report, load->status);
+    if (load->status == CMS_STATUS_OK)
+    {
+        cms_printf("Successfully loaded '%s'.\n", load->path);
+    }
+    else
+    {
+        cms_printf("Warning: Failed to load '%s'.\n", load->path);
+        fflush(stdout);
+        cms_print_status(load->status);
+        cms_printf("You may use the OPEN command to load another file.\n");
+    }
+    if (at_prompt)
+    {
+        cms_printf("CMS> ");
+    }
+    fflush(stdout);
+}
+
+static void *cms_background_load_run(void *context)
+{
+    CmsBackgroundLoad *load = context;
+    CmsLoadReport report;
+    CMS_STATUS status = cms_database_load_checked(&load->table, load->path, cms_session.lenient, &report);
+
+    pthread_mutex_lock(&load->lock);
+    load->report = report;
+    load->status = status;
+    load->finished = true;
+    if (load->abandoned)
+    {
+        pthread_mutex_unlock(&load->lock);
+        cms_background_load_free(load);
+        return NULL;
+    }
+    if (!load->busy)
+    {
+        cms_background_load_report(load, true);
+    }
+    pthread_cond_signal(&load->finished_signal);
+    pthread_mutex_unlock(&load->lock);
+    return NULL;
+}
+
+/* NULL if the load could not even be set up; a failed thread start loads
+   on the calling thread instead */
+static CmsBackgroundLoad *cms_background_load_start(const StudentDatabase *db, const char *path)
+{
+    CmsBackgroundLoad *load = cms_calloc(CMS_MEM_SESSION, 1, sizeof(CmsBackgroundLoad));
+    if (load == NULL)
+    {
+        return NULL;
+    }
+    if (cms_database_init(&load->table) != CMS_STATUS_OK)
+    {
+        cms_free(load);
+        return NULL;
+    }
+    load->table.save_format = db->save_format;
+    load->table.undo_limit = db->undo_limit;
+    strncpy(load->path, path, sizeof(load->path) - 1);
+    timespec_get(&load->started, TIME_UTC);
+    pthread_mutex_init(&load->lock, NULL);
+    pthread_cond_init(&load->finished_signal, NULL);
+
+    if (pthread_create(&load->thread, NULL, cms_background_load_run, load) != 0)
+    {
+        /* Reported at the first prompt, like a load that finished early */
+        load->busy = true;
+        cms_background_load_run(load);
+        load->thread = pthread_self();
+    }
+    return load;
+}
+
+static double cms_seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Blocks until the thread is done, showing how long the load has taken so
+   far; call with the lock held */
+static void cms_background_load_wait(CmsBackgroundLoad *load)
+{
+    bool shown = false;
+    while (!load->finished)
+    {
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_nsec += CMS_LOAD_PROGRESS_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&load->finished_signal, &load->lock, &deadline);
+        if (!load->finished)
+        {
+            cms_printf("\rWaiting for '%s' to load... %.1fs", load->path, cms_seconds_since(&load->started));
+            fflush(stdout);
+            shown = true;
+        }
+    }
+    if (shown)
+    {
+        cms_printf("\n");
+    }
+}
+
+/* Ends a load: a finished one is joined and its table moved into db (when
+   take is set and it succeeded), an unfinished one is left to free itself */
+static void cms_background_load_close(CmsBackgroundLoad *load, StudentDatabase *db, bool take)
+{
+    pthread_mutex_lock(&load->lock);
+    if (!load->finished)
+    {
+        load->abandoned = true;
+        pthread_detach(load->thread);
+        pthread_mutex_unlock(&load->lock);
+        return;
+    }
+    cms_background_load_report(load, false);
+    pthread_mutex_unlock(&load->lock);
+
+    if (!pthread_equal(load->thread, pthread_self()))
+    {
+        pthread_join(load->thread, NULL);
+    }
+    if (take && load->status == CMS_STATUS_OK && !cms_in_open_transaction(db) &&
+        cms_database_take(db, &load->table) == CMS_STATUS_OK)
+    {
+        cms_watch_synced(cms_file_watch, db);
+    }
+    cms_background_load_free(load);
+}
+
+/* Settles a pending load before input runs: OPEN replaces it, a command
+   that needs data waits for it, anything else leaves it running. Returns
+   the load if it is still pending. */
+static CmsBackgroundLoad *cms_background_load_before(CmsBackgroundLoad *load, StudentDatabase *db,
+                                                     const char *input)
+{
+    CmsCommandLine line;
+    cms_tokenize_command(input, &line);
+    const CmsCommandSpec *command = cms_find_command(line.verb);
+
+    pthread_mutex_lock(&load->lock);
+    bool finished = load->finished;
+    if (!finished && command != NULL && command->needs_table)
+    {
+        cms_background_load_wait(load);
+        finished = true;
+    }
+    pthread_mutex_unlock(&load->lock);
+
+    if (finished)
+    {
+        cms_background_load_close(load, db, true);
+        return NULL;
+    }
+    if (command != NULL && command->run == cms_run_open)
+    {
+        cms_printf("CMS: Stopped loading '%s'.\n", load->path);
+        cms_background_load_close(load, db, false);
+        return NULL;
+    }
+    return load;
+}
+
+void cms_command_loop_loading(StudentDatabase *db, const char *load_path)
+{
+    char input[CMS_MAX_COMMAND_LEN];
+    CmsBackgroundLoad *load = NULL;
+    if (load_path != NULL)
+    {
+        load = cms_background_load_start(db, load_path);
+        if (load == NULL)
+        {
+            cms_print_status(cmd_open(db, cms_slice(load_path)));
+        }
+    }
+
+    while (1)
+    {
+        /* The thread prints its outcome itself only while this loop is idle
+           here; one that finished while a command ran is reported now */
+        if (load != NULL)
+        {
+            pthread_mutex_lock(&load->lock);
+            if (load->finished)
+            {
+                cms_background_load_report(load, false);
+            }
+            load->busy = false;
+            cms_printf("CMS> ");
+            fflush(stdout);
+            pthread_mutex_unlock(&load->lock);
+        }
+        else
+        {
+            cms_printf("CMS> ");
+        }
+
+        bool read = cms_read_line(input, CMS_MAX_COMMAND_LEN);
+        if (load != NULL)
+        {
+            pthread_mutex_lock(&load->lock);
+            load->busy = true;
+            pthread_mutex_unlock(&load->lock);
+        }
+        if (!read)
+        {
+            cms_printf("\n");
+            break;
+        }
+
+        cms_trim(input);
+        if (input[0] == '\0')
+        {
+            continue;
+        }
+
+        if (cms_string_equals_ignore_case(input, "EXIT") ||
+            cms_string_equals_ignore_case(input, "QUIT"))
+        {
+            cms_printf("Exiting CMS.\n");
+            break;
+        }
+
+        if (load != NULL)
+        {
+            load = cms_background_load_before(load, db, input);
+        }
+        CMS_STATUS status = cms_parse_command(input, db);
+        if (status != CMS_STATUS_OK)
+        {
+            cms_print_status(status);
+        }
+    }
+
+    if (load != NULL)
+    {
+        cms_background_load_close(load, db, false);
+    }
 }
@@ -2,67 +2,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../include/database.h"
+#include "../include/alloc.h"
 #include "../include/config.h"
 #include "../include/utils.h"
-
-static void cms_clear_undo_state(StudentDatabase *db)
-{
-    if (db == NULL)
-    {
-        return;
-    }
-    db->undo_state.action = CMS_UNDO_NONE;
-    db->undo_state.valid = false;
-    db->undo_state.index = 0;
-    db->undo_state.prev_dirty = db->is_dirty;
-    memset(&db->undo_state.before, 0, sizeof(StudentRecord));
-    memset(&db->undo_state.after, 0, sizeof(StudentRecord));
-}
-
-static void cms_set_undo_state(StudentDatabase *db,
-                               CmsUndoAction action,
-                               const StudentRecord *before,
-                               const StudentRecord *after,
-                               size_t index,
-                               bool prev_dirty)
+#include "../include/render.h"
+#include "../include/index.h"
+#include "../include/journal.h"
+#include "../include/transaction.h"
+#include "../include/diff.h"
+#include "../include/sidecar.h"
+
+/* Adds a change to the undo history; an UPDATE keeps only the fields that changed */
+static void cms_database_journal(StudentDatabase *db, CmsJournalAction action, size_t index,
+                                 const StudentRecord *before, const StudentRecord *after)
 {
-    if (db == NULL)
-    {
-        return;
-    }
-
-    db->undo_state.action = action;
-    db->undo_state.valid = true;
-    db->undo_state.index = index;
-    db->undo_state.prev_dirty = prev_dirty;
-
+    CmsJournalEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.action = action;
+    entry.index = index;
     if (before != NULL)
     {
-        db->undo_state.before = *before;
-    }
-    else
-    {
-        memset(&db->undo_state.before, 0, sizeof(StudentRecord));
+        entry.before = *before;
     }
-
     if (after != NULL)
     {
-        db->undo_state.after = *after;
+        entry.after = *after;
     }
-    else
+    if (action == CMS_JOURNAL_UPDATE)
     {
-        memset(&db->undo_state.after, 0, sizeof(StudentRecord));
+        entry.fields |= (strcmp(before->name, after->name) != 0) ? CMS_FIELD_NAME : 0u;
+        entry.fields |= (strcmp(before->programme, after->programme) != 0) ? CMS_FIELD_PROGRAMME : 0u;
+        entry.fields |= (before->mark != after->mark) ? CMS_FIELD_MARK : 0u;
     }
+    cms_journal_record(db->journal, &entry, db->undo_limit);
 }
 
-static CMS_STATUS cms_ensure_capacity(StudentDatabase *db)
+/* Room for at least wanted records */
+static CMS_STATUS cms_reserve_records(StudentDatabase *db, size_t wanted)
 {
     if (db == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (db->count < db->capacity)
+    if (wanted <= db->capacity)
     {
         return CMS_STATUS_OK;
     }
@@ -70,8 +53,12 @@ static CMS_STATUS cms_ensure_capacity(StudentDatabase *db)
     size_t new_capacity = (db->capacity == 0)
                               ? CMS_INITIAL_CAPACITY
                               : db->capacity * CMS_GROWTH_FACTOR;
+    while (new_capacity < wanted)
+    {
+        new_capacity *= CMS_GROWTH_FACTOR;
+    }
 
-    StudentRecord *new_records = realloc(db->records, new_capacity * sizeof(StudentRecord));
+    StudentRecord *new_records = cms_realloc(CMS_MEM_RECORDS, db->records, new_capacity * sizeof(StudentRecord));
     if (new_records == NULL)
     {
         return CMS_STATUS_ERROR;
@@ -82,26 +69,25 @@ static CMS_STATUS cms_ensure_capacity(StudentDatabase *db)
     return CMS_STATUS_OK;
 }
 
-static bool cms_database_find_index(const StudentDatabase *db, int student_id, size_t *out_index)
+static CMS_STATUS cms_ensure_capacity(StudentDatabase *db)
 {
-    if (db == NULL || db->records == NULL || db->count == 0)
-    {
-        return false;
-    }
+    return (db != NULL) ? cms_reserve_records(db, db->count + 1) : CMS_STATUS_INVALID_ARGUMENT;
+}
 
-    for (size_t i = 0; i < db->count; ++i)
-    {
-        if (db->records[i].id == student_id)
-        {
-            if (out_index != NULL)
-            {
-                *out_index = i;
-            }
-            return true;
-        }
-    }
+static bool cms_database_find_index(const StudentDatabase *db, int student_id, size_t *out_index)
+{
+    return cms_index_find_id(db, student_id, out_index);
+}
 
-    return false;
+/* Copies a validated record into place, bounding both strings */
+static void cms_store_record(StudentRecord *dest, int student_id, const StudentRecord *source)
+{
+    dest->id = student_id;
+    strncpy(dest->name, source->name, CMS_MAX_NAME_LEN);
+    dest->name[CMS_MAX_NAME_LEN] = '\0';
+    strncpy(dest->programme, source->programme, CMS_MAX_PROGRAMME_LEN);
+    dest->programme[CMS_MAX_PROGRAMME_LEN] = '\0';
+    dest->mark = source->mark;
 }
 
 CMS_STATUS cms_database_init(StudentDatabase *db)
@@ -114,7 +100,7 @@ CMS_STATUS cms_database_init(StudentDatabase *db)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    db->records = malloc(sizeof(StudentRecord) * CMS_INITIAL_CAPACITY);
+    db->records = cms_malloc(CMS_MEM_RECORDS, sizeof(StudentRecord) * CMS_INITIAL_CAPACITY);
     if (db->records == NULL)
     {
         return CMS_STATUS_ERROR;
@@ -123,9 +109,34 @@ CMS_STATUS cms_database_init(StudentDatabase *db)
     db->count = 0;
     db->capacity = CMS_INITIAL_CAPACITY;
     db->file_path[0] = '\0';
+    db->file_format = CMS_FILE_FORMAT_TEXT;
+    db->save_format = CMS_FILE_FORMAT_AUTO;
     db->is_loaded = false;
     db->is_dirty = false;
-    cms_clear_undo_state(db);
+    db->indexes = NULL;
+    db->version = 0;
+    db->pending_version = 0;
+    db->page_cursor = NULL;
+    db->page_size = 0;
+    db->undo_limit = CMS_DEFAULT_UNDO_MEMORY;
+    db->transaction = NULL;
+    db->journal = cms_journal_create();
+    if (db->journal == NULL)
+    {
+        cms_free(db->records);
+        db->records = NULL;
+        return CMS_STATUS_ERROR;
+    }
+    cms_journal_mark_clean(db->journal);
+
+    if (cms_index_create(db) != CMS_STATUS_OK)
+    {
+        cms_journal_destroy(db->journal);
+        db->journal = NULL;
+        cms_free(db->records);
+        db->records = NULL;
+        return CMS_STATUS_ERROR;
+    }
 
     return CMS_STATUS_OK;
 }
@@ -139,16 +150,28 @@ void cms_database_cleanup(StudentDatabase *db)
 
     if (db->records != NULL)
     {
-        free(db->records);
+        cms_free(db->records);
         db->records = NULL;
     }
 
+    cms_index_destroy(db);
+
+    if (db->page_cursor != NULL)
+    {
+        cms_cursor_close(db->page_cursor);
+        cms_free(db->page_cursor);
+        db->page_cursor = NULL;
+    }
+
     db->count = 0;
     db->capacity = 0;
     db->file_path[0] = '\0';
     db->is_loaded = false;
     db->is_dirty = false;
-    cms_clear_undo_state(db);
+    cms_journal_destroy(db->journal);
+    db->journal = NULL;
+    cms_transaction_destroy(db->transaction);
+    db->transaction = NULL;
 }
 
 static void cms_database_reset_runtime_state(StudentDatabase *db)
@@ -160,76 +183,175 @@ static void cms_database_reset_runtime_state(StudentDatabase *db)
     db->count = 0;
     db->is_loaded = false;
     db->is_dirty = false;
-    cms_clear_undo_state(db);
+    cms_journal_clear(db->journal);
+    cms_journal_mark_clean(db->journal);
+    cms_index_clear(db);
+    db->version++;
 }
 
-CMS_STATUS cms_database_load(StudentDatabase *db, const char *file_path)
+bool cms_file_format_from_name(const char *name, CmsFileFormat *out_format)
 {
-    if (db == NULL || file_path == NULL)
+    if (name == NULL || out_format == NULL)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        return false;
     }
 
-    FILE *fp = fopen(file_path, "r");
-    if (fp == NULL)
+    if (cms_string_equals_ignore_case(name, "text"))
     {
-        return CMS_STATUS_IO;
+        *out_format = CMS_FILE_FORMAT_TEXT;
+    }
+    else if (cms_string_equals_ignore_case(name, "binary"))
+    {
+        *out_format = CMS_FILE_FORMAT_BINARY;
+    }
+    else
+    {
+        return false;
     }
+    return true;
+}
 
-    // if (db != NULL){
-    //     cms_database_cleanup(db);
-    // }
+/* Binary database file: the magic, a 64-bit record count, then for each
+   record its ID and mark (little-endian int32 and IEEE float32) followed by
+   the name and programme, each as a length byte and that many bytes.
+   Unlike the text format, marks round-trip exactly. */
+static const unsigned char cms_binary_magic[CMS_BINARY_MAGIC_LEN] = {'C', 'M', 'S', 'B', 'I', 'N', '\0', 1};
 
-    cms_database_reset_runtime_state(db);
+#define CMS_BINARY_FIXED_LEN 10 /* id, mark and the two length bytes */
 
-    char line[CMS_MAX_COMMAND_LEN];
+static void cms_put_u32(unsigned char *out, uint32_t value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t cms_get_u32(const unsigned char *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/* Records why the current row was refused; fatal when the rest of the file
+   cannot be read past it */
+static CMS_STATUS cms_row_reader_fail(CmsRowReader *reader, const char *field, const char *reason, bool fatal)
+{
+    reader->error_field = field;
+    reader->error_reason = reason;
+    reader->error_fatal = fatal;
+    return CMS_STATUS_PARSE_ERROR;
+}
 
-    /* Read and validate table name */
-    if (fgets(line, sizeof(line), fp) == NULL)
+/* Reads and checks everything before the first row, leaving fp there */
+static CMS_STATUS cms_row_reader_start(CmsRowReader *reader, FILE *fp)
+{
+    reader->fp = fp;
+    reader->remaining = 0;
+    reader->line = 0;
+
+    /* The format is recognised by the magic, whatever --format says */
+    unsigned char magic[CMS_BINARY_MAGIC_LEN];
+    reader->format = CMS_FILE_FORMAT_TEXT;
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+        memcmp(magic, cms_binary_magic, sizeof(magic)) == 0)
     {
-        fclose(fp);
-        return CMS_STATUS_PARSE_ERROR;
+        reader->format = CMS_FILE_FORMAT_BINARY;
+    }
+    else
+    {
+        rewind(fp);
     }
 
-    cms_trim_string(line);
-    if (strcmp(line, "Table Name: StudentRecords") != 0)
+    if (reader->format == CMS_FILE_FORMAT_TEXT)
     {
-        fclose(fp);
-        return CMS_STATUS_PARSE_ERROR;
+        char line[CMS_MAX_COMMAND_LEN];
+
+        /* Read and validate table name */
+        reader->line = 1;
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            return cms_row_reader_fail(reader, "header", "file is empty", true);
+        }
+
+        cms_trim_string(line);
+        if (strcmp(line, "Table Name: StudentRecords") != 0)
+        {
+            return cms_row_reader_fail(reader, "header", "expected \"Table Name: StudentRecords\"", true);
+        }
+
+        /* Read and validate column header line */
+        reader->line = 2;
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            return cms_row_reader_fail(reader, "header", "missing column header", true);
+        }
+
+        cms_trim_string(line);
+        if (strcmp(line, "ID\tName\tProgramme\tMark") != 0)
+        {
+            return cms_row_reader_fail(reader, "header", "expected columns ID, Name, Programme, Mark", true);
+        }
+        return CMS_STATUS_OK;
     }
 
-    /* Read and validate column header line */
-    if (fgets(line, sizeof(line), fp) == NULL)
+    unsigned char header[8];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header))
     {
-        fclose(fp);
-        return CMS_STATUS_PARSE_ERROR;
+        return cms_row_reader_fail(reader, "header", "missing record count", true);
     }
+    uint64_t count = cms_get_u32(header) | ((uint64_t)cms_get_u32(header + 4) << 32);
 
-    cms_trim_string(line);
-    if (strcmp(line, "ID\tName\tProgramme\tMark") != 0)
+    /* Every record takes at least CMS_BINARY_FIXED_LEN + 2 bytes, which
+       rules out a corrupt count before it is used to size the table */
+    long start = ftell(fp);
+    if (start >= 0 && fseek(fp, 0, SEEK_END) == 0)
     {
-        fclose(fp);
-        return CMS_STATUS_PARSE_ERROR;
+        long end = ftell(fp);
+        if (end < start || count > (uint64_t)(end - start) / (CMS_BINARY_FIXED_LEN + 2) ||
+            fseek(fp, start, SEEK_SET) != 0)
+        {
+            return cms_row_reader_fail(reader, "header", "record count does not fit the file", true);
+        }
     }
+    reader->remaining = count;
+    return CMS_STATUS_OK;
+}
 
-    CMS_STATUS status = CMS_STATUS_OK;
-    while (fgets(line, sizeof(line), fp) != NULL)
+static CMS_STATUS cms_row_reader_next_text(CmsRowReader *reader, StudentRecord *record)
+{
+    char line[CMS_MAX_COMMAND_LEN];
+    while (fgets(line, sizeof(line), reader->fp) != NULL)
     {
+        reader->line++;
+        size_t length = strlen(line);
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n')
+        {
+            /* Drop the rest so the next read starts on the next line */
+            int c = fgetc(reader->fp);
+            if (c != EOF && c != '\n')
+            {
+                while ((c = fgetc(reader->fp)) != EOF && c != '\n')
+                {
+                }
+                return cms_row_reader_fail(reader, "line", "too long", false);
+            }
+        }
+
         cms_trim_string(line);
         if (line[0] == '\0')
         {
             continue;
         }
 
-        char *id_str = strtok(line, "\t");
-        char *name = strtok(NULL, "\t");
-        char *programme = strtok(NULL, "\t");
-        char *mark_str = strtok(NULL, "\t");
+        char *rest = line;
+        char *id_str = cms_next_token(&rest, '\t');
+        char *name = cms_next_token(&rest, '\t');
+        char *programme = cms_next_token(&rest, '\t');
+        char *mark_str = cms_next_token(&rest, '\t');
 
         if (!id_str || !name || !programme || !mark_str)
         {
-            status = CMS_STATUS_PARSE_ERROR;
-            break;
+            return cms_row_reader_fail(reader, "line", "expected four tab-separated fields", false);
         }
 
         cms_trim_string(id_str);
@@ -240,368 +362,2231 @@ CMS_STATUS cms_database_load(StudentDatabase *db, const char *file_path)
         int id = atoi(id_str);
         if (!cms_validate_student_id(id))
         {
-            status = CMS_STATUS_PARSE_ERROR;
-            break;
+            return cms_row_reader_fail(reader, "ID", "not a 7-digit student ID", false);
         }
 
-        if (!cms_validate_name(name) || !cms_validate_programme(programme))
+        if (!cms_validate_name(name))
         {
-            status = CMS_STATUS_PARSE_ERROR;
-            break;
+            return cms_row_reader_fail(reader, "Name", "empty or too long", false);
+        }
+        if (!cms_validate_programme(programme))
+        {
+            return cms_row_reader_fail(reader, "Programme", "empty or too long", false);
         }
 
         char *endptr = NULL;
         float mark = strtof(mark_str, &endptr);
         if (endptr == mark_str || !cms_validate_mark(mark))
         {
-            status = CMS_STATUS_PARSE_ERROR;
-            break;
-        }
-
-        status = cms_ensure_capacity(db);
-        if (status != CMS_STATUS_OK)
-        {
-            break;
+            return cms_row_reader_fail(reader, "Mark", "not a number from 0 to 100", false);
         }
 
-        StudentRecord *record = &db->records[db->count];
         record->id = id;
         strncpy(record->name, name, CMS_MAX_NAME_LEN);
         record->name[CMS_MAX_NAME_LEN] = '\0';
         strncpy(record->programme, programme, CMS_MAX_PROGRAMME_LEN);
         record->programme[CMS_MAX_PROGRAMME_LEN] = '\0';
         record->mark = mark;
-        db->count++;
-    }
-
-    printf("Loaded %zu record(s)\n", db->count);
-
-    if (status != CMS_STATUS_OK)
-    {
-        cms_database_reset_runtime_state(db);
-        fclose(fp);
-        return status;
+        return CMS_STATUS_OK;
     }
-
-    strncpy(db->file_path, file_path, CMS_MAX_FILE_PATH_LEN - 1);
-    db->file_path[CMS_MAX_FILE_PATH_LEN - 1] = '\0';
-    db->is_loaded = true;
-    db->is_dirty = false;
-
-    fclose(fp);
-
-    /* Mark database as successfully loaded and record file path */
-    db->is_loaded = true;
-    db->is_dirty = false;
-    strncpy(db->file_path, file_path, CMS_MAX_FILE_PATH_LEN - 1);
-    db->file_path[CMS_MAX_FILE_PATH_LEN - 1] = '\0';
-    cms_clear_undo_state(db);
-
-    return CMS_STATUS_OK;
+    return CMS_STATUS_NOT_FOUND;
 }
 
-CMS_STATUS cms_database_save(StudentDatabase *db, const char *file_path)
+static CMS_STATUS cms_row_reader_next_binary(CmsRowReader *reader, StudentRecord *record)
 {
-    if (db == NULL || file_path == NULL)
+    if (reader->remaining == 0)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        return (fgetc(reader->fp) == EOF) ? CMS_STATUS_NOT_FOUND
+                                          : cms_row_reader_fail(reader, "file", "data after the last record", true);
     }
 
-    if (file_path[0] == '\0')
+    /* Binary rows are numbered from 1 in place of lines */
+    reader->line++;
+    unsigned char fixed[CMS_BINARY_FIXED_LEN];
+    if (fread(fixed, 1, sizeof(fixed), reader->fp) != sizeof(fixed))
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        return cms_row_reader_fail(reader, "record", "file ends inside a record", true);
     }
 
-    FILE *fp = fopen(file_path, "w");
-    if (fp == NULL)
+    size_t name_length = fixed[8];
+    size_t programme_length = fixed[9];
+    if (name_length > CMS_MAX_NAME_LEN || programme_length > CMS_MAX_PROGRAMME_LEN)
     {
-        return CMS_STATUS_IO;
+        return cms_row_reader_fail(reader, (name_length > CMS_MAX_NAME_LEN) ? "Name" : "Programme",
+                                   "length byte out of range", true);
+    }
+    if (fread(record->name, 1, name_length, reader->fp) != name_length ||
+        fread(record->programme, 1, programme_length, reader->fp) != programme_length)
+    {
+        return cms_row_reader_fail(reader, "record", "file ends inside a record", true);
     }
+    record->name[name_length] = '\0';
+    record->programme[programme_length] = '\0';
+    reader->remaining--;
 
-    CMS_STATUS status = CMS_STATUS_OK;
+    uint32_t mark_bits = cms_get_u32(fixed + 4);
+    record->id = (int)cms_get_u32(fixed);
+    memcpy(&record->mark, &mark_bits, sizeof(record->mark));
 
-    if (fprintf(fp, "Table Name: StudentRecords\n") < 0 ||
-        fprintf(fp, "ID\tName\tProgramme\tMark\n") < 0)
+    /* Same rules as the text format */
+    if (!cms_validate_student_id(record->id))
     {
-        status = CMS_STATUS_IO;
+        return cms_row_reader_fail(reader, "ID", "not a 7-digit student ID", false);
     }
-    else
+    if (!cms_validate_name(record->name))
     {
-        for (size_t i = 0; i < db->count; i++)
-        {
-            const StudentRecord *rec = &db->records[i];
-            if (fprintf(fp, "%d\t%s\t%s\t%.2f\n",
-                        rec->id, rec->name, rec->programme, rec->mark) < 0)
-            {
-                status = CMS_STATUS_IO;
-                break;
-            }
-        }
+        return cms_row_reader_fail(reader, "Name", "empty or too long", false);
     }
-
-    if (fclose(fp) != 0)
+    if (!cms_validate_programme(record->programme))
     {
-        status = CMS_STATUS_IO;
+        return cms_row_reader_fail(reader, "Programme", "empty or too long", false);
     }
-
-    if (status != CMS_STATUS_OK)
+    if (!cms_validate_mark(record->mark))
     {
-        return status;
+        return cms_row_reader_fail(reader, "Mark", "not a number from 0 to 100", false);
     }
-
-    strncpy(db->file_path, file_path, CMS_MAX_FILE_PATH_LEN - 1);
-    db->file_path[CMS_MAX_FILE_PATH_LEN - 1] = '\0';
-    db->is_dirty = false;
-    db->is_loaded = true;
-
     return CMS_STATUS_OK;
 }
 
-CMS_STATUS cms_database_insert(StudentDatabase *db, const StudentRecord *record)
+CMS_STATUS cms_row_reader_open(CmsRowReader *reader, const char *file_path)
 {
-    if (db == NULL || record == NULL)
-    {
-        return CMS_STATUS_INVALID_ARGUMENT;
-    }
-
-    if (!cms_validate_student_id(record->id) ||
-        !cms_validate_name(record->name) ||
-        !cms_validate_programme(record->programme) ||
-        !cms_validate_mark(record->mark))
+    if (reader == NULL || file_path == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    size_t existing_index = 0;
-    if (cms_database_find_index(db, record->id, &existing_index))
+    FILE *fp = fopen(file_path, "rb");
+    if (fp == NULL)
     {
-        return CMS_STATUS_DUPLICATE;
+        return CMS_STATUS_IO;
     }
 
-    CMS_STATUS status = cms_ensure_capacity(db);
+    CMS_STATUS status = cms_row_reader_start(reader, fp);
     if (status != CMS_STATUS_OK)
     {
-        return status;
+        fclose(fp);
+        reader->fp = NULL;
     }
-
-    StudentRecord *dest = &db->records[db->count];
-    dest->id = record->id;
-    strncpy(dest->name, record->name, CMS_MAX_NAME_LEN);
-    dest->name[CMS_MAX_NAME_LEN] = '\0';
-    strncpy(dest->programme, record->programme, CMS_MAX_PROGRAMME_LEN);
-    dest->programme[CMS_MAX_PROGRAMME_LEN] = '\0';
-    dest->mark = record->mark;
-    db->count++;
-
-    bool prev_dirty = db->is_dirty;
-    db->is_dirty = true;
-    db->is_loaded = true;
-    cms_set_undo_state(db, CMS_UNDO_INSERT, NULL, dest, db->count - 1, prev_dirty);
-
-    return CMS_STATUS_OK;
+    return status;
 }
 
-CMS_STATUS cms_database_query(const StudentDatabase *db, int student_id, StudentRecord *out_record)
+CMS_STATUS cms_row_reader_next(CmsRowReader *reader, StudentRecord *out_record)
 {
-    if (db == NULL || out_record == NULL)
+    if (reader == NULL || reader->fp == NULL || out_record == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (!cms_validate_student_id(student_id))
-    {
-        return CMS_STATUS_INVALID_ARGUMENT;
-    }
+    return (reader->format == CMS_FILE_FORMAT_BINARY) ? cms_row_reader_next_binary(reader, out_record)
+                                                      : cms_row_reader_next_text(reader, out_record);
+}
 
-    if (db->records == NULL || db->count == 0)
+void cms_row_reader_close(CmsRowReader *reader)
+{
+    if (reader != NULL && reader->fp != NULL)
     {
-        return CMS_STATUS_NOT_FOUND;
+        fclose(reader->fp);
+        reader->fp = NULL;
     }
+}
 
-    size_t index = 0;
-    if (!cms_database_find_index(db, student_id, &index))
+static void cms_load_note_error(CmsLoadReport *report, size_t line, const char *field, const char *reason)
+{
+    if (report != NULL && report->error_count < CMS_LOAD_REPORT_ERRORS)
     {
-        return CMS_STATUS_NOT_FOUND;
+        CmsLoadError *error = &report->errors[report->error_count++];
+        error->line = line;
+        error->field = field;
+        error->reason = reason;
     }
-
-    *out_record = db->records[index];
-    return CMS_STATUS_OK;
 }
 
-CMS_STATUS cms_database_update(StudentDatabase *db, int student_id, const StudentRecord *new_record)
+/* Reads a file of either format into db->records, which must be empty. With
+   check_ids each ID goes into the ID hash as its row is read, so a repeat is
+   caught in the same pass. A bad or repeated row ends a strict read; a
+   lenient one skips it and goes on. Problems are noted in report (may be
+   NULL). */
+static CMS_STATUS cms_database_read(StudentDatabase *db, FILE *fp, CmsFileFormat *out_format, bool lenient,
+                                    bool check_ids, CmsLoadReport *report)
 {
-    if (db == NULL || new_record == NULL)
+    CmsRowReader reader;
+    CMS_STATUS status = cms_row_reader_start(&reader, fp);
+    *out_format = reader.format;
+    if (status != CMS_STATUS_OK)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        cms_load_note_error(report, reader.line, reader.error_field, reader.error_reason);
+        return status;
     }
 
-    if (!cms_validate_student_id(student_id))
+    /* A binary file gives its count up front: size the table once */
+    if (reader.remaining > db->capacity)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
+        StudentRecord *records =
+            cms_realloc(CMS_MEM_RECORDS, db->records, (size_t)reader.remaining * sizeof(StudentRecord));
+        if (records == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        db->records = records;
+        db->capacity = (size_t)reader.remaining;
     }
 
-    if (!cms_validate_name(new_record->name) ||
-        !cms_validate_programme(new_record->programme) ||
-        !cms_validate_mark(new_record->mark))
+    while (1)
     {
-        return CMS_STATUS_INVALID_ARGUMENT;
-    }
+        status = cms_ensure_capacity(db);
+        if (status != CMS_STATUS_OK)
+        {
+            return status;
+        }
+        status = cms_row_reader_next(&reader, &db->records[db->count]);
+        if (status == CMS_STATUS_NOT_FOUND)
+        {
+            return CMS_STATUS_OK;
+        }
+        if (status == CMS_STATUS_OK && check_ids)
+        {
+            status = cms_index_load_id(db, db->count);
+            if (status == CMS_STATUS_DUPLICATE)
+            {
+                reader.error_field = "ID";
+                reader.error_reason = "repeats the ID of an earlier row";
+                reader.error_fatal = false;
+            }
+        }
+        if (status == CMS_STATUS_OK)
+        {
+            db->count++;
+            continue;
+        }
+        if (status != CMS_STATUS_PARSE_ERROR && status != CMS_STATUS_DUPLICATE)
+        {
+            return status;
+        }
 
-    if (db->records == NULL || db->count == 0)
+        cms_load_note_error(report, reader.line, reader.error_field, reader.error_reason);
+        if (!lenient)
+        {
+            return status;
+        }
+        if (report != NULL)
+        {
+            report->skipped++;
+        }
+        /* Past a broken binary record nothing lines up; keep what came before */
+        if (reader.error_fatal)
+        {
+            return CMS_STATUS_OK;
+        }
+    }
+}
+
+CMS_STATUS cms_database_load_checked(StudentDatabase *db, const char *file_path, bool lenient,
+                                     CmsLoadReport *out_report)
+{
+    if (db == NULL || file_path == NULL || out_report == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    memset(out_report, 0, sizeof(*out_report));
+
+    if (db->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    FILE *fp = fopen(file_path, "rb");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    cms_database_reset_runtime_state(db);
+
+    CmsFileFormat format = CMS_FILE_FORMAT_TEXT;
+    CMS_STATUS status = cms_database_read(db, fp, &format, lenient, true, out_report);
+    fclose(fp);
+    out_report->format = format;
+    out_report->loaded = db->count;
+
+    if (status != CMS_STATUS_OK)
+    {
+        cms_database_reset_runtime_state(db);
+        return status;
+    }
+
+    /* Mark database as successfully loaded and record file path */
+    db->is_loaded = true;
+    db->is_dirty = false;
+    db->file_format = format;
+    strncpy(db->file_path, file_path, CMS_MAX_FILE_PATH_LEN - 1);
+    db->file_path[CMS_MAX_FILE_PATH_LEN - 1] = '\0';
+    cms_journal_clear(db->journal);
+    cms_journal_mark_clean(db->journal);
+
+    /* The ID hash was filled while reading; build the other indexes once,
+       taking the name indexes from a sidecar that still matches the file */
+    db->version++;
+    CmsSidecar sidecar;
+    bool have_sidecar = db->indexes != NULL && cms_sidecar_open(db, &sidecar) == CMS_STATUS_OK;
+    status = cms_index_load_finish(db, have_sidecar ? sidecar.body : NULL, have_sidecar ? sidecar.body_size : 0,
+                                   &out_report->indexes_restored);
+    if (have_sidecar)
+    {
+        cms_sidecar_close(&sidecar);
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_database_reset_runtime_state(db);
+        return CMS_STATUS_ERROR;
+    }
+
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_load(StudentDatabase *db, const char *file_path)
+{
+    CmsLoadReport report;
+    return cms_database_load_checked(db, file_path, false, &report);
+}
+
+CMS_STATUS cms_database_take(StudentDatabase *db, StudentDatabase *loaded)
+{
+    if (db == NULL || loaded == NULL || db == loaded)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (db->transaction != NULL || loaded->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    StudentDatabase previous = *db;
+    *db = *loaded;
+    *loaded = previous;
+
+    /* Settings stay with db; version only moves forward, so cursors on the
+       old contents see the change */
+    db->save_format = previous.save_format;
+    db->undo_limit = previous.undo_limit;
+    db->version = ((previous.version > db->version) ? previous.version : db->version) + 1;
+    return CMS_STATUS_OK;
+}
+
+void cms_database_mark_clean(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return;
+    }
+    db->is_dirty = false;
+    cms_journal_mark_clean(db->journal);
+}
+
+static CMS_STATUS cms_database_save_text(const StudentDatabase *db, FILE *fp)
+{
+    if (fprintf(fp, "Table Name: StudentRecords\n") < 0 ||
+        fprintf(fp, "ID\tName\tProgramme\tMark\n") < 0)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    for (size_t i = 0; i < db->count; i++)
+    {
+        const StudentRecord *rec = &db->records[i];
+        if (fprintf(fp, "%d\t%s\t%s\t%.2f\n",
+                    rec->id, rec->name, rec->programme, rec->mark) < 0)
+        {
+            return CMS_STATUS_IO;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_database_save_binary(const StudentDatabase *db, FILE *fp)
+{
+    unsigned char header[CMS_BINARY_MAGIC_LEN + 8];
+    memcpy(header, cms_binary_magic, CMS_BINARY_MAGIC_LEN);
+    uint64_t count = db->count;
+    cms_put_u32(header + CMS_BINARY_MAGIC_LEN, (uint32_t)count);
+    cms_put_u32(header + CMS_BINARY_MAGIC_LEN + 4, (uint32_t)(count >> 32));
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        return CMS_STATUS_IO;
+    }
+
+    unsigned char row[CMS_BINARY_FIXED_LEN + CMS_MAX_NAME_LEN + CMS_MAX_PROGRAMME_LEN];
+    for (size_t i = 0; i < db->count; i++)
+    {
+        const StudentRecord *rec = &db->records[i];
+        size_t name_length = strlen(rec->name);
+        size_t programme_length = strlen(rec->programme);
+        uint32_t mark_bits;
+        memcpy(&mark_bits, &rec->mark, sizeof(mark_bits));
+
+        cms_put_u32(row, (uint32_t)rec->id);
+        cms_put_u32(row + 4, mark_bits);
+        row[8] = (unsigned char)name_length;
+        row[9] = (unsigned char)programme_length;
+        memcpy(row + CMS_BINARY_FIXED_LEN, rec->name, name_length);
+        memcpy(row + CMS_BINARY_FIXED_LEN + name_length, rec->programme, programme_length);
+
+        size_t length = CMS_BINARY_FIXED_LEN + name_length + programme_length;
+        if (fwrite(row, 1, length, fp) != length)
+        {
+            return CMS_STATUS_IO;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_save(StudentDatabase *db, const char *file_path)
+{
+    if (db == NULL || file_path == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (file_path[0] == '\0' || db->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsFileFormat format = (db->save_format != CMS_FILE_FORMAT_AUTO) ? db->save_format : db->file_format;
+    FILE *fp = fopen(file_path, (format == CMS_FILE_FORMAT_BINARY) ? "wb" : "w");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    CMS_STATUS status = (format == CMS_FILE_FORMAT_BINARY) ? cms_database_save_binary(db, fp)
+                                                           : cms_database_save_text(db, fp);
+
+    if (fclose(fp) != 0)
+    {
+        status = CMS_STATUS_IO;
+    }
+
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    if (file_path != db->file_path)
+    {
+        strncpy(db->file_path, file_path, CMS_MAX_FILE_PATH_LEN - 1);
+        db->file_path[CMS_MAX_FILE_PATH_LEN - 1] = '\0';
+    }
+    db->file_format = format;
+    db->is_dirty = false;
+    db->is_loaded = true;
+    cms_journal_mark_clean(db->journal);
+
+    /* A sidecar that cannot be written only costs the next load a rebuild */
+    if (db->indexes != NULL)
+    {
+        cms_sidecar_save(db);
+    }
+
+    return CMS_STATUS_OK;
+}
+
+/* ===== Changes held by an open transaction ===== */
+
+/* What committing a touched row does to the table */
+static bool cms_pending_removes(const CmsPendingRow *row)
+{
+    return row->in_table && (!row->present || row->moved);
+}
+
+static bool cms_pending_places(const CmsPendingRow *row)
+{
+    return row->present && (!row->in_table || row->moved);
+}
+
+static int cms_compare_pending_sequence(const void *a, const void *b)
+{
+    size_t left = (*(const CmsPendingRow *const *)a)->sequence;
+    size_t right = (*(const CmsPendingRow *const *)b)->sequence;
+    return (left > right) - (left < right);
+}
+
+static CMS_STATUS cms_pending_insert(StudentDatabase *db, const StudentRecord *record)
+{
+    CmsTransaction *transaction = db->transaction;
+    CmsPendingRow *row = cms_transaction_find(transaction, record->id);
+    if (row == NULL)
+    {
+        if (cms_database_find_index(db, record->id, NULL))
+        {
+            return CMS_STATUS_DUPLICATE;
+        }
+        row = cms_transaction_add(transaction, record->id);
+        if (row == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+    }
+    else if (row->present)
+    {
+        return CMS_STATUS_DUPLICATE;
+    }
+    else
+    {
+        /* Re-inserting a deleted row moves it to the end, as it would outside a transaction */
+        row->moved = row->in_table;
+    }
+
+    cms_store_record(&row->record, record->id, record);
+    row->present = true;
+    row->sequence = transaction->inserts++;
+    db->pending_version++;
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_pending_update(StudentDatabase *db, int student_id, const StudentRecord *new_record)
+{
+    CmsPendingRow *row = cms_transaction_find(db->transaction, student_id);
+    if (row == NULL)
+    {
+        if (!cms_database_find_index(db, student_id, NULL))
+        {
+            return CMS_STATUS_NOT_FOUND;
+        }
+        row = cms_transaction_add(db->transaction, student_id);
+        if (row == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        row->in_table = true;
+        row->present = true;
+    }
+    else if (!row->present)
     {
         return CMS_STATUS_NOT_FOUND;
     }
 
-    size_t index = 0;
-    if (!cms_database_find_index(db, student_id, &index))
+    cms_store_record(&row->record, student_id, new_record);
+    db->pending_version++;
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_pending_delete(StudentDatabase *db, int student_id)
+{
+    CmsPendingRow *row = cms_transaction_find(db->transaction, student_id);
+    if (row == NULL)
+    {
+        size_t index = 0;
+        if (!cms_database_find_index(db, student_id, &index))
+        {
+            return CMS_STATUS_NOT_FOUND;
+        }
+        row = cms_transaction_add(db->transaction, student_id);
+        if (row == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        row->in_table = true;
+        row->record = db->records[index];
+    }
+    else if (!row->present)
     {
         return CMS_STATUS_NOT_FOUND;
     }
 
-    StudentRecord previous = db->records[index];
-    bool prev_dirty = db->is_dirty;
+    row->present = false;
+    db->pending_version++;
+    return CMS_STATUS_OK;
+}
 
-    StudentRecord *target = &db->records[index];
-    target->id = student_id;
-    strncpy(target->name, new_record->name, CMS_MAX_NAME_LEN);
-    target->name[CMS_MAX_NAME_LEN] = '\0';
-    strncpy(target->programme, new_record->programme, CMS_MAX_PROGRAMME_LEN);
-    target->programme[CMS_MAX_PROGRAMME_LEN] = '\0';
-    target->mark = new_record->mark;
+/* ===== Reads through the write set ===== */
 
-    db->is_dirty = true;
-    cms_set_undo_state(db, CMS_UNDO_UPDATE, &previous, target, index, prev_dirty);
+bool cms_database_has_pending(const StudentDatabase *db)
+{
+    return db != NULL && db->transaction != NULL && db->transaction->count > 0;
+}
+
+const StudentRecord *cms_database_find(const StudentDatabase *db, int student_id)
+{
+    if (db == NULL)
+    {
+        return NULL;
+    }
+
+    const CmsPendingRow *pending = cms_transaction_find(db->transaction, student_id);
+    if (pending != NULL)
+    {
+        return pending->present ? &pending->record : NULL;
+    }
+    size_t index = 0;
+    return cms_database_find_index(db, student_id, &index) ? &db->records[index] : NULL;
+}
+
+size_t cms_database_row_count(const StudentDatabase *db)
+{
+    if (db == NULL || db->records == NULL)
+    {
+        return 0;
+    }
+
+    size_t count = db->count;
+    for (size_t i = 0; db->transaction != NULL && i < db->transaction->count; ++i)
+    {
+        const CmsPendingRow *row = &db->transaction->rows[i];
+        count -= cms_pending_removes(row) ? 1 : 0;
+        count += cms_pending_places(row) ? 1 : 0;
+    }
+    return count;
+}
+
+/* The rows reads see, in the order COMMIT would leave them: the table with
+   touched rows replaced or dropped, then the rows COMMIT appends. *out_rows
+   is from cms_malloc. */
+static CMS_STATUS cms_visible_rows(const StudentDatabase *db, const StudentRecord ***out_rows, size_t *out_count)
+{
+    const CmsTransaction *transaction = db->transaction;
+    const StudentRecord **rows = cms_malloc(CMS_MEM_TEMP, (db->count + transaction->count + 1) * sizeof(rows[0]));
+    const CmsPendingRow **placed = cms_malloc(CMS_MEM_TEMP, (transaction->count + 1) * sizeof(placed[0]));
+    if (rows == NULL || placed == NULL)
+    {
+        cms_free(rows);
+        cms_free(placed);
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        const CmsPendingRow *pending = cms_transaction_find(transaction, db->records[i].id);
+        if (pending == NULL)
+        {
+            rows[count++] = &db->records[i];
+        }
+        else if (pending->present && !pending->moved)
+        {
+            rows[count++] = &pending->record;
+        }
+    }
+
+    size_t placements = 0;
+    for (size_t i = 0; i < transaction->count; ++i)
+    {
+        if (cms_pending_places(&transaction->rows[i]))
+        {
+            placed[placements++] = &transaction->rows[i];
+        }
+    }
+    qsort(placed, placements, sizeof(placed[0]), cms_compare_pending_sequence);
+    for (size_t i = 0; i < placements; ++i)
+    {
+        rows[count++] = &placed[i]->record;
+    }
+    cms_free(placed);
+
+    *out_rows = rows;
+    *out_count = count;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_copy_rows(const StudentDatabase *db, StudentRecord **out_rows, size_t *out_count)
+{
+    if (db == NULL || out_rows == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    const StudentRecord **visible = NULL;
+    size_t count = 0;
+    CMS_STATUS status = CMS_STATUS_OK;
+    if (cms_database_has_pending(db))
+    {
+        status = cms_visible_rows(db, &visible, &count);
+    }
+    else
+    {
+        count = (db->records != NULL) ? db->count : 0;
+    }
+    StudentRecord *rows = (status == CMS_STATUS_OK) ? cms_malloc(CMS_MEM_TEMP, (count + 1) * sizeof(StudentRecord))
+                                                    : NULL;
+    if (rows == NULL)
+    {
+        cms_free(visible);
+        return CMS_STATUS_ERROR;
+    }
 
+    for (size_t i = 0; i < count; ++i)
+    {
+        rows[i] = (visible != NULL) ? *visible[i] : db->records[i];
+    }
+    cms_free(visible);
+    *out_rows = rows;
+    *out_count = count;
     return CMS_STATUS_OK;
 }
 
-CMS_STATUS cms_database_delete(StudentDatabase *db, int student_id)
+/* Where a touched row sits in a list: its key, or its place in the table
+   (rows COMMIT appends come after every table row, in insert order) */
+typedef struct
+{
+    double key;
+    int id;
+} CmsOverlayEntry;
+
+static int cms_compare_overlay_entries(const void *a, const void *b)
+{
+    const CmsOverlayEntry *x = (const CmsOverlayEntry *)a;
+    const CmsOverlayEntry *y = (const CmsOverlayEntry *)b;
+    if (x->key != y->key)
+    {
+        return (x->key > y->key) - (x->key < y->key);
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+CMS_STATUS cms_database_overlay_ids(const StudentDatabase *db, CmsRowKey key, const void *context,
+                                    bool table_order, int **ids, size_t *count)
+{
+    if (db == NULL || key == NULL || ids == NULL || count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (!cms_database_has_pending(db))
+    {
+        return CMS_STATUS_OK;
+    }
+
+    /* The table no longer answers for a row the transaction touched */
+    const CmsTransaction *transaction = db->transaction;
+    size_t kept = 0;
+    for (size_t i = 0; i < *count; ++i)
+    {
+        if (cms_transaction_find(transaction, (*ids)[i]) == NULL)
+        {
+            (*ids)[kept++] = (*ids)[i];
+        }
+    }
+    *count = kept;
+
+    CmsOverlayEntry *added = cms_malloc(CMS_MEM_TEMP, transaction->count * sizeof(CmsOverlayEntry));
+    if (added == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    size_t add_count = 0;
+    for (size_t i = 0; i < transaction->count; ++i)
+    {
+        const CmsPendingRow *row = &transaction->rows[i];
+        double row_key = 0.0;
+        size_t index = 0;
+        if (!row->present || !key(&row->record, context, &row_key))
+        {
+            continue;
+        }
+        if (table_order)
+        {
+            row_key = (!cms_pending_places(row) && cms_database_find_index(db, row->record.id, &index))
+                          ? (double)index
+                          : (double)db->count + (double)row->sequence;
+        }
+        added[add_count].key = row_key;
+        added[add_count].id = row->record.id;
+        add_count++;
+    }
+    if (add_count == 0)
+    {
+        cms_free(added);
+        return CMS_STATUS_OK;
+    }
+    qsort(added, add_count, sizeof(CmsOverlayEntry), cms_compare_overlay_entries);
+
+    int *merged = cms_malloc(CMS_MEM_TEMP, (kept + add_count) * sizeof(int));
+    if (merged == NULL)
+    {
+        cms_free(added);
+        return CMS_STATUS_ERROR;
+    }
+
+    /* Both runs are in the list's order; untouched rows are keyed from the table */
+    size_t from_list = 0;
+    size_t from_added = 0;
+    size_t total = 0;
+    while (from_list < kept || from_added < add_count)
+    {
+        bool take_list = from_added == add_count;
+        if (from_list < kept && !take_list)
+        {
+            CmsOverlayEntry entry = {0.0, (*ids)[from_list]};
+            size_t index = 0;
+            if (cms_database_find_index(db, entry.id, &index))
+            {
+                if (table_order)
+                {
+                    entry.key = (double)index;
+                }
+                else
+                {
+                    key(&db->records[index], context, &entry.key);
+                }
+            }
+            take_list = cms_compare_overlay_entries(&entry, &added[from_added]) < 0;
+        }
+        merged[total++] = take_list ? (*ids)[from_list++] : added[from_added++].id;
+    }
+    cms_free(added);
+    cms_free(*ids);
+    *ids = merged;
+    *count = total;
+    return CMS_STATUS_OK;
+}
+
+void cms_database_overlay_count(const StudentDatabase *db, CmsRowKey key, const void *context, size_t *count)
+{
+    if (!cms_database_has_pending(db) || key == NULL || count == NULL)
+    {
+        return;
+    }
+
+    double ignored = 0.0;
+    for (size_t i = 0; i < db->transaction->count; ++i)
+    {
+        const CmsPendingRow *row = &db->transaction->rows[i];
+        size_t index = 0;
+        if (row->in_table && cms_database_find_index(db, row->record.id, &index) &&
+            key(&db->records[index], context, &ignored))
+        {
+            (*count)--;
+        }
+        if (row->present && key(&row->record, context, &ignored))
+        {
+            (*count)++;
+        }
+    }
+}
+
+CMS_STATUS cms_database_insert(StudentDatabase *db, const StudentRecord *record)
+{
+    if (db == NULL || record == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!cms_validate_student_id(record->id) ||
+        !cms_validate_name(record->name) ||
+        !cms_validate_programme(record->programme) ||
+        !cms_validate_mark(record->mark))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        return cms_pending_insert(db, record);
+    }
+
+    size_t existing_index = 0;
+    if (cms_database_find_index(db, record->id, &existing_index))
+    {
+        return CMS_STATUS_DUPLICATE;
+    }
+
+    CMS_STATUS status = cms_ensure_capacity(db);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    StudentRecord *dest = &db->records[db->count];
+    cms_store_record(dest, record->id, record);
+    db->count++;
+    cms_index_on_insert(db, db->count - 1);
+    db->version++;
+
+    db->is_dirty = true;
+    db->is_loaded = true;
+    cms_database_journal(db, CMS_JOURNAL_INSERT, db->count - 1, NULL, dest);
+
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_query(const StudentDatabase *db, int student_id, StudentRecord *out_record)
+{
+    if (db == NULL || out_record == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!cms_validate_student_id(student_id))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    /* An open transaction sees its own changes */
+    const CmsPendingRow *pending = cms_transaction_find(db->transaction, student_id);
+    if (pending != NULL)
+    {
+        if (!pending->present)
+        {
+            return CMS_STATUS_NOT_FOUND;
+        }
+        *out_record = pending->record;
+        return CMS_STATUS_OK;
+    }
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    size_t index = 0;
+    if (!cms_database_find_index(db, student_id, &index))
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    *out_record = db->records[index];
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_update(StudentDatabase *db, int student_id, const StudentRecord *new_record)
+{
+    if (db == NULL || new_record == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!cms_validate_student_id(student_id))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!cms_validate_name(new_record->name) ||
+        !cms_validate_programme(new_record->programme) ||
+        !cms_validate_mark(new_record->mark))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        return cms_pending_update(db, student_id, new_record);
+    }
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    size_t index = 0;
+    if (!cms_database_find_index(db, student_id, &index))
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    StudentRecord previous = db->records[index];
+
+    StudentRecord *target = &db->records[index];
+    cms_store_record(target, student_id, new_record);
+    cms_index_on_update(db, index, &previous);
+    db->version++;
+
+    db->is_dirty = true;
+    cms_database_journal(db, CMS_JOURNAL_UPDATE, index, &previous, target);
+
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_delete(StudentDatabase *db, int student_id)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!cms_validate_student_id(student_id))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        return cms_pending_delete(db, student_id);
+    }
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    size_t index = 0;
+    if (!cms_database_find_index(db, student_id, &index))
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    StudentRecord removed = db->records[index];
+
+    if (index < db->count - 1)
+    {
+        memmove(&db->records[index],
+                &db->records[index + 1],
+                (db->count - index - 1) * sizeof(StudentRecord));
+    }
+
+    db->count--;
+    cms_index_on_delete(db, index, &removed);
+    db->version++;
+    db->is_dirty = true;
+    cms_database_journal(db, CMS_JOURNAL_DELETE, index, &removed, NULL);
+
+    return CMS_STATUS_OK;
+}
+
+/* ===== Set-oriented changes ===== */
+
+bool cms_row_filter_matches(const CmsRowFilter *filter, const StudentRecord *record)
+{
+    return cms_selection_matches(&filter->selection, record) && cms_mark_in_range(record->mark, &filter->mark);
+}
+
+static float cms_mark_kernel(float mark, float scale, float offset)
+{
+    float value = scale * mark + offset;
+    return (value < (float)CMS_MIN_MARK) ? (float)CMS_MIN_MARK
+                                         : (value > (float)CMS_MAX_MARK) ? (float)CMS_MAX_MARK : value;
+}
+
+/* Inside a transaction the statement sees the transaction's rows, and each
+   match becomes an ordinary pending change */
+static CMS_STATUS cms_pending_where(StudentDatabase *db, const CmsRowFilter *filter, bool remove, float scale,
+                                    float offset, size_t *out_count)
+{
+    int *ids = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    CMS_STATUS status = CMS_STATUS_OK;
+    CmsTransaction *transaction = db->transaction;
+    size_t total = db->count + transaction->count;
+
+    for (size_t i = 0; i < total && status == CMS_STATUS_OK; ++i)
+    {
+        const StudentRecord *row = NULL;
+        if (i < db->count)
+        {
+            const CmsPendingRow *pending = cms_transaction_find(transaction, db->records[i].id);
+            row = (pending == NULL) ? &db->records[i] : pending->present ? &pending->record : NULL;
+        }
+        else
+        {
+            const CmsPendingRow *pending = &transaction->rows[i - db->count];
+            row = (!pending->in_table && pending->present) ? &pending->record : NULL;
+        }
+        if (row == NULL || !cms_row_filter_matches(filter, row))
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity = (capacity == 0) ? CMS_INITIAL_CAPACITY : capacity * CMS_GROWTH_FACTOR;
+            int *grown = cms_realloc(CMS_MEM_TEMP, ids, capacity * sizeof(int));
+            if (grown == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            ids = grown;
+        }
+        ids[count++] = row->id;
+    }
+
+    for (size_t i = 0; i < count && status == CMS_STATUS_OK; ++i)
+    {
+        StudentRecord record;
+        if (remove)
+        {
+            status = cms_pending_delete(db, ids[i]);
+        }
+        else if ((status = cms_database_query(db, ids[i], &record)) == CMS_STATUS_OK)
+        {
+            record.mark = cms_mark_kernel(record.mark, scale, offset);
+            status = cms_pending_update(db, ids[i], &record);
+        }
+    }
+    cms_free(ids);
+    *out_count = (status == CMS_STATUS_OK) ? count : 0;
+    return status;
+}
+
+static bool cms_row_filter_key(const StudentRecord *record, const void *context, double *out_key)
+{
+    *out_key = 0.0;
+    return cms_row_filter_matches((const CmsRowFilter *)context, record);
+}
+
+size_t cms_database_count_where(const StudentDatabase *db, const CmsRowFilter *filter)
+{
+    size_t matches = 0;
+    for (size_t i = 0; db != NULL && filter != NULL && i < db->count; ++i)
+    {
+        matches += cms_row_filter_matches(filter, &db->records[i]) ? 1 : 0;
+    }
+    if (filter != NULL)
+    {
+        cms_database_overlay_count(db, cms_row_filter_key, filter, &matches);
+    }
+    return matches;
+}
+
+CMS_STATUS cms_database_delete_where(StudentDatabase *db, const CmsRowFilter *filter, size_t *out_count)
+{
+    if (db == NULL || filter == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    *out_count = 0;
+
+    if (db->transaction != NULL)
+    {
+        return cms_pending_where(db, filter, true, 1.0f, 0.0f, out_count);
+    }
+
+    size_t first = 0;
+    size_t matches = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (cms_row_filter_matches(filter, &db->records[i]))
+        {
+            first = (matches == 0) ? i : first;
+            matches++;
+        }
+    }
+    if (matches == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    StudentRecord *removed = cms_malloc(CMS_MEM_TEMP, matches * sizeof(StudentRecord));
+    if (removed == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    /* One stable compaction pass. Taken front to back, each row is
+       journalled at the position it has when its turn comes: the write
+       cursor, since every earlier match is already gone. */
+    cms_journal_begin_group(db->journal);
+    size_t write = first;
+    size_t taken = 0;
+    for (size_t read = first; read < db->count; ++read)
+    {
+        if (taken < matches && cms_row_filter_matches(filter, &db->records[read]))
+        {
+            cms_database_journal(db, CMS_JOURNAL_DELETE, write, &db->records[read], NULL);
+            removed[taken++] = db->records[read];
+        }
+        else
+        {
+            db->records[write++] = db->records[read];
+        }
+    }
+    db->count = write;
+    cms_index_on_bulk_change(db, removed, matches, NULL, 0, first);
+    cms_journal_end_group(db->journal);
+    cms_free(removed);
+
+    db->version++;
+    db->is_dirty = true;
+    *out_count = matches;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_update_marks_where(StudentDatabase *db, const CmsRowFilter *filter, float scale,
+                                           float offset, size_t *out_count)
+{
+    if (db == NULL || filter == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    *out_count = 0;
+
+    if (db->transaction != NULL)
+    {
+        return cms_pending_where(db, filter, false, scale, offset, out_count);
+    }
+
+    uint32_t *positions = cms_malloc(CMS_MEM_TEMP, (db->count + 1) * sizeof(uint32_t));
+    float *before = cms_malloc(CMS_MEM_TEMP, (db->count + 1) * sizeof(float));
+    if (positions == NULL || before == NULL)
+    {
+        cms_free(positions);
+        cms_free(before);
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t matches = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (cms_row_filter_matches(filter, &db->records[i]))
+        {
+            positions[matches++] = (uint32_t)i;
+        }
+    }
+
+    /* The kernel touches nothing but the marks of the matched rows */
+    for (size_t k = 0; k < matches; ++k)
+    {
+        float *mark = &db->records[positions[k]].mark;
+        before[k] = *mark;
+        *mark = cms_mark_kernel(*mark, scale, offset);
+    }
+
+    /* Indexes and journal only hear about marks that moved */
+    cms_journal_begin_group(db->journal);
+    size_t changed = 0;
+    for (size_t k = 0; k < matches; ++k)
+    {
+        StudentRecord *record = &db->records[positions[k]];
+        if (record->mark == before[k])
+        {
+            continue;
+        }
+        StudentRecord previous = *record;
+        previous.mark = before[k];
+        cms_index_on_update(db, positions[k], &previous);
+        cms_database_journal(db, CMS_JOURNAL_UPDATE, positions[k], &previous, record);
+        changed++;
+    }
+    cms_journal_end_group(db->journal);
+    cms_free(positions);
+    cms_free(before);
+
+    if (changed > 0)
+    {
+        db->version++;
+        db->is_dirty = true;
+    }
+    *out_count = changed;
+    return CMS_STATUS_OK;
+}
+
+/* ===== Bulk import ===== */
+
+typedef struct
+{
+    int id;
+    size_t row; /* line order in the incoming file */
+} CmsImportKey;
+
+static int cms_compare_import_keys(const void *a, const void *b)
+{
+    const CmsImportKey *left = a;
+    const CmsImportKey *right = b;
+    if (left->id != right->id)
+    {
+        return (left->id > right->id) - (left->id < right->id);
+    }
+    return (left->row > right->row) - (left->row < right->row);
+}
+
+static void cms_import_note_conflict(CmsImportReport *report, int student_id, size_t rows)
+{
+    if (report->conflict_id_count < CMS_IMPORT_REPORT_IDS)
+    {
+        report->conflict_ids[report->conflict_id_count++] = student_id;
+    }
+    report->conflicts += rows;
+}
+
+/* Sorting the incoming IDs brings duplicates within the file together; each
+   distinct ID then costs one probe of the table's ID hash. An ID that clashes
+   becomes one row: at the first occurrence's place (or in the table), with
+   the first occurrence's contents under SKIP and the last one's under REPLACE.
+   Sets keep[row] to the file row whose contents go at row, or SIZE_MAX, and
+   lists table rows to overwrite as (position, file row) pairs in updates. */
+static CMS_STATUS cms_import_plan(const StudentDatabase *db, const StudentRecord *incoming, size_t count,
+                                  CmsConflictPolicy policy, size_t *keep, size_t *updates,
+                                  size_t *out_update_count, CmsImportReport *report)
+{
+    CmsImportKey *keys = cms_malloc(CMS_MEM_TEMP, (count + 1) * sizeof(CmsImportKey));
+    if (keys == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i].id = incoming[i].id;
+        keys[i].row = i;
+        keep[i] = SIZE_MAX;
+    }
+    qsort(keys, count, sizeof(CmsImportKey), cms_compare_import_keys);
+
+    *out_update_count = 0;
+    for (size_t start = 0, end = 0; start < count; start = end)
+    {
+        while (end < count && keys[end].id == keys[start].id)
+        {
+            end++;
+        }
+        size_t rows = end - start;
+        size_t chosen = (policy == CMS_CONFLICT_REPLACE) ? keys[end - 1].row : keys[start].row;
+        size_t position = 0;
+        bool in_table = cms_database_find_index(db, keys[start].id, &position);
+
+        if (!in_table)
+        {
+            keep[keys[start].row] = chosen;
+            report->inserted++;
+            if (rows > 1)
+            {
+                cms_import_note_conflict(report, keys[start].id, rows - 1);
+            }
+        }
+        else
+        {
+            cms_import_note_conflict(report, keys[start].id, rows);
+            if (policy == CMS_CONFLICT_REPLACE)
+            {
+                updates[2 * *out_update_count] = position;
+                updates[2 * *out_update_count + 1] = chosen;
+                (*out_update_count)++;
+            }
+        }
+        if (policy == CMS_CONFLICT_REPLACE)
+        {
+            report->replaced += rows - (in_table ? 0 : 1);
+        }
+        else
+        {
+            report->skipped += rows - (in_table ? 0 : 1);
+        }
+    }
+    cms_free(keys);
+    return CMS_STATUS_OK;
+}
+
+/* Writes the plan: table rows overwritten in place, then every new row
+   appended behind a single reservation, recorded as one undo step. If the
+   indexes cannot take the new rows the table is put back as it was and
+   nothing is recorded. */
+static CMS_STATUS cms_import_apply(StudentDatabase *db, const StudentRecord *incoming, size_t count,
+                                   const size_t *keep, const size_t *updates, size_t update_count,
+                                   size_t inserts)
+{
+    CMS_STATUS status = cms_reserve_records(db, db->count + inserts);
+    size_t *placed = cms_malloc(CMS_MEM_TEMP, (inserts + 1) * sizeof(size_t));
+    StudentRecord *previous = cms_malloc(CMS_MEM_TEMP, (update_count + 1) * sizeof(StudentRecord));
+    if (status != CMS_STATUS_OK || placed == NULL || previous == NULL)
+    {
+        cms_free(placed);
+        cms_free(previous);
+        return CMS_STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < update_count; ++i)
+    {
+        size_t index = updates[2 * i];
+        previous[i] = db->records[index];
+        db->records[index] = incoming[updates[2 * i + 1]];
+        cms_index_on_update(db, index, &previous[i]);
+    }
+
+    size_t old_count = db->count;
+    for (size_t row = 0; row < count; ++row)
+    {
+        if (keep[row] != SIZE_MAX)
+        {
+            placed[db->count - old_count] = db->count;
+            db->records[db->count++] = incoming[keep[row]];
+        }
+    }
+    /* Rebuilding beats adding row by row once the import outgrows the table */
+    if (inserts > old_count)
+    {
+        status = cms_index_rebuild(db);
+    }
+    else
+    {
+        cms_index_on_bulk_change(db, NULL, 0, placed, inserts, old_count);
+    }
+
+    if (status != CMS_STATUS_OK)
+    {
+        db->count = old_count;
+        for (size_t i = update_count; i-- > 0;)
+        {
+            db->records[updates[2 * i]] = previous[i];
+        }
+        /* Left invalid if this fails too; the next change rebuilds it */
+        cms_index_rebuild(db);
+    }
+    else
+    {
+        cms_journal_begin_group(db->journal);
+        for (size_t i = 0; i < update_count; ++i)
+        {
+            size_t index = updates[2 * i];
+            cms_database_journal(db, CMS_JOURNAL_UPDATE, index, &previous[i], &db->records[index]);
+        }
+        for (size_t i = 0; i < inserts; ++i)
+        {
+            cms_database_journal(db, CMS_JOURNAL_INSERT, placed[i], NULL, &db->records[placed[i]]);
+        }
+        cms_journal_end_group(db->journal);
+    }
+    cms_free(placed);
+    cms_free(previous);
+    return status;
+}
+
+CMS_STATUS cms_database_import(StudentDatabase *db, const char *file_path, CmsConflictPolicy policy,
+                               CmsImportReport *out_report)
+{
+    if (db == NULL || file_path == NULL || out_report == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    memset(out_report, 0, sizeof(*out_report));
+
+    if (db->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    FILE *fp = fopen(file_path, "rb");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    /* Parsed and validated exactly as OPEN would, into a table of its own */
+    StudentDatabase incoming;
+    memset(&incoming, 0, sizeof(incoming));
+    CmsFileFormat format = CMS_FILE_FORMAT_TEXT;
+    CMS_STATUS status = cms_database_read(&incoming, fp, &format, false, false, NULL);
+    fclose(fp);
+    out_report->read = incoming.count;
+
+    size_t count = incoming.count;
+    size_t *keep = cms_malloc(CMS_MEM_TEMP, (count + 1) * sizeof(size_t));
+    size_t *updates = cms_malloc(CMS_MEM_TEMP, (2 * count + 1) * sizeof(size_t));
+    size_t update_count = 0;
+    if (status == CMS_STATUS_OK && (keep == NULL || updates == NULL))
+    {
+        status = CMS_STATUS_ERROR;
+    }
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_import_plan(db, incoming.records, count, policy, keep, updates, &update_count, out_report);
+    }
+    if (status == CMS_STATUS_OK && policy == CMS_CONFLICT_FAIL && out_report->conflicts > 0)
+    {
+        out_report->inserted = 0;
+        out_report->skipped = out_report->read;
+        status = CMS_STATUS_DUPLICATE;
+    }
+    if (status == CMS_STATUS_OK && out_report->inserted + update_count > 0)
+    {
+        status = cms_import_apply(db, incoming.records, count, keep, updates, update_count,
+                                  out_report->inserted);
+        if (status == CMS_STATUS_OK)
+        {
+            db->version++;
+            db->is_dirty = true;
+            db->is_loaded = true;
+        }
+        else
+        {
+            out_report->inserted = 0;
+            out_report->replaced = 0;
+            out_report->skipped = out_report->read;
+        }
+    }
+
+    cms_free(keep);
+    cms_free(updates);
+    cms_free(incoming.records);
+    return status;
+}
+
+/* ===== Undo and redo ===== */
+
+/* Changes replayed from the journal are gathered into runs of one kind and
+   applied a run at a time: removals in one compaction pass and insertions
+   in one merge pass, with index positions refreshed once per run. Undoing
+   a batch of k row changes costs O(n + k log n) rather than O(k * n). */
+typedef struct
+{
+    CmsJournalAction kind; /* INSERT or DELETE while count > 0 */
+    StudentRecord *rows;   /* rows to place (INSERT) */
+    size_t *positions;     /* where each goes, as if inserted one by one */
+    int *ids;              /* rows to remove (DELETE) */
+    size_t count;
+    size_t capacity;
+} CmsReplay;
+
+static int cms_compare_positions(const void *a, const void *b)
+{
+    size_t left = *(const size_t *)a;
+    size_t right = *(const size_t *)b;
+    return (left > right) - (left < right);
+}
+
+/* Removes the rows at positions (ascending, distinct) in one compaction pass */
+static CMS_STATUS cms_remove_positions(StudentDatabase *db, const size_t *positions, size_t count)
+{
+    StudentRecord *removed = cms_malloc(CMS_MEM_TEMP, count * sizeof(StudentRecord));
+    if (removed == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t write = positions[0];
+    size_t next = 0;
+    for (size_t read = positions[0]; read < db->count; ++read)
+    {
+        if (next < count && positions[next] == read)
+        {
+            removed[next++] = db->records[read];
+        }
+        else
+        {
+            db->records[write++] = db->records[read];
+        }
+    }
+    db->count = write;
+    cms_index_on_bulk_change(db, removed, count, NULL, 0, positions[0]);
+    cms_free(removed);
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_remove_rows(StudentDatabase *db, const int *ids, size_t count)
+{
+    size_t *positions = cms_malloc(CMS_MEM_TEMP, count * sizeof(size_t));
+    if (positions == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!cms_database_find_index(db, ids[i], &positions[i]))
+        {
+            cms_free(positions);
+            return CMS_STATUS_NOT_FOUND;
+        }
+    }
+    qsort(positions, count, sizeof(size_t), cms_compare_positions);
+
+    CMS_STATUS status = cms_remove_positions(db, positions, count);
+    cms_free(positions);
+    return status;
+}
+
+/* Free-slot finder for placing inserts: a Fenwick tree of free slots per
+   64-slot block plus a bitmask of taken slots in each block */
+typedef struct
+{
+    uint64_t *taken;
+    size_t *tree;
+    size_t blocks;
+} CmsSlotFinder;
+
+static bool cms_slots_init(CmsSlotFinder *finder, size_t slots)
+{
+    finder->blocks = (slots + 63) / 64;
+    finder->taken = cms_calloc(CMS_MEM_TEMP, finder->blocks, sizeof(uint64_t));
+    finder->tree = cms_calloc(CMS_MEM_TEMP, finder->blocks + 1, sizeof(size_t));
+    if (finder->taken == NULL || finder->tree == NULL)
+    {
+        cms_free(finder->taken);
+        cms_free(finder->tree);
+        return false;
+    }
+    if (slots % 64 != 0)
+    {
+        finder->taken[finder->blocks - 1] = ~0ULL << (slots % 64);
+    }
+    for (size_t i = 1; i <= finder->blocks; ++i)
+    {
+        size_t free_slots = 64;
+        for (uint64_t mask = finder->taken[i - 1]; mask != 0; mask &= mask - 1)
+        {
+            free_slots--;
+        }
+        finder->tree[i] += free_slots;
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= finder->blocks)
+        {
+            finder->tree[parent] += finder->tree[i];
+        }
+    }
+    return true;
+}
+
+/* Takes the free slot with rank free slots before it */
+static size_t cms_slots_take(CmsSlotFinder *finder, size_t rank)
+{
+    size_t block = 0;
+    size_t step = 1;
+    while (step * 2 <= finder->blocks)
+    {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2)
+    {
+        if (block + step <= finder->blocks && finder->tree[block + step] <= rank)
+        {
+            block += step;
+            rank -= finder->tree[block];
+        }
+    }
+
+    uint64_t mask = finder->taken[block];
+    unsigned bit = 0;
+    for (;; ++bit)
+    {
+        if ((mask & (1ULL << bit)) == 0 && rank-- == 0)
+        {
+            break;
+        }
+    }
+    finder->taken[block] |= 1ULL << bit;
+    for (size_t i = block + 1; i <= finder->blocks; i += i & (~i + 1))
+    {
+        finder->tree[i]--;
+    }
+    return block * 64 + bit;
+}
+
+static CMS_STATUS cms_insert_rows(StudentDatabase *db, const StudentRecord *rows, const size_t *positions,
+                                  size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (cms_database_find_index(db, rows[i].id, NULL))
+        {
+            return CMS_STATUS_DUPLICATE;
+        }
+    }
+    CMS_STATUS status = cms_reserve_records(db, db->count + count);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    /* Going backwards, a row inserted at p ends up in the p-th slot not
+       taken by a row inserted after it */
+    size_t total = db->count + count;
+    size_t *slots = cms_malloc(CMS_MEM_TEMP, count * sizeof(size_t));
+    size_t *order = cms_malloc(CMS_MEM_TEMP, count * 2 * sizeof(size_t));
+    CmsSlotFinder finder;
+    if (slots == NULL || order == NULL || !cms_slots_init(&finder, total))
+    {
+        cms_free(slots);
+        cms_free(order);
+        return CMS_STATUS_ERROR;
+    }
+    for (size_t i = count; i-- > 0;)
+    {
+        size_t limit = db->count + i;
+        slots[i] = cms_slots_take(&finder, (positions[i] < limit) ? positions[i] : limit);
+        order[2 * i] = slots[i];
+        order[2 * i + 1] = i;
+    }
+    cms_free(finder.taken);
+    cms_free(finder.tree);
+
+    /* Merge from the back so rows only ever move up */
+    qsort(order, count, 2 * sizeof(size_t), cms_compare_positions);
+    size_t old = db->count;
+    size_t next = count;
+    for (size_t slot = total; next > 0 && slot-- > 0;)
+    {
+        if (order[2 * (next - 1)] == slot)
+        {
+            db->records[slot] = rows[order[2 * (next - 1) + 1]];
+            next--;
+        }
+        else
+        {
+            db->records[slot] = db->records[--old];
+        }
+    }
+    db->count = total;
+    cms_index_on_bulk_change(db, NULL, 0, slots, count, order[0]);
+    cms_free(slots);
+    cms_free(order);
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_replay_flush(StudentDatabase *db, CmsReplay *replay)
+{
+    CMS_STATUS status = CMS_STATUS_OK;
+    if (replay->count > 0)
+    {
+        status = (replay->kind == CMS_JOURNAL_INSERT)
+                     ? cms_insert_rows(db, replay->rows, replay->positions, replay->count)
+                     : cms_remove_rows(db, replay->ids, replay->count);
+    }
+    replay->count = 0;
+    return status;
+}
+
+static CMS_STATUS cms_replay_push(StudentDatabase *db, CmsReplay *replay, CmsJournalAction kind,
+                                  const StudentRecord *row, size_t position)
+{
+    if (replay->count > 0 && replay->kind != kind)
+    {
+        CMS_STATUS status = cms_replay_flush(db, replay);
+        if (status != CMS_STATUS_OK)
+        {
+            return status;
+        }
+    }
+    if (replay->count == replay->capacity)
+    {
+        size_t capacity = (replay->capacity == 0) ? CMS_INITIAL_CAPACITY : replay->capacity * CMS_GROWTH_FACTOR;
+        StudentRecord *rows = cms_realloc(CMS_MEM_TEMP, replay->rows, capacity * sizeof(StudentRecord));
+        if (rows != NULL)
+        {
+            replay->rows = rows;
+        }
+        size_t *positions = cms_realloc(CMS_MEM_TEMP, replay->positions, capacity * sizeof(size_t));
+        if (positions != NULL)
+        {
+            replay->positions = positions;
+        }
+        int *ids = cms_realloc(CMS_MEM_TEMP, replay->ids, capacity * sizeof(int));
+        if (ids != NULL)
+        {
+            replay->ids = ids;
+        }
+        if (rows == NULL || positions == NULL || ids == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        replay->capacity = capacity;
+    }
+
+    replay->kind = kind;
+    replay->rows[replay->count] = *row;
+    replay->positions[replay->count] = position;
+    replay->ids[replay->count] = row->id;
+    replay->count++;
+    return CMS_STATUS_OK;
+}
+
+/* Applies one journal entry forwards (redo) or backwards (undo) */
+static CMS_STATUS cms_replay_entry(StudentDatabase *db, CmsReplay *replay, const CmsJournalEntry *entry,
+                                   bool undo)
+{
+    if (entry->action == CMS_JOURNAL_UPDATE)
+    {
+        CMS_STATUS status = cms_replay_flush(db, replay);
+        size_t index = 0;
+        if (status != CMS_STATUS_OK)
+        {
+            return status;
+        }
+        if (!cms_database_find_index(db, entry->before.id, &index))
+        {
+            return CMS_STATUS_NOT_FOUND;
+        }
+
+        const StudentRecord *source = undo ? &entry->before : &entry->after;
+        StudentRecord previous = db->records[index];
+        StudentRecord *target = &db->records[index];
+        if (entry->fields & CMS_FIELD_NAME)
+        {
+            memcpy(target->name, source->name, sizeof(target->name));
+        }
+        if (entry->fields & CMS_FIELD_PROGRAMME)
+        {
+            memcpy(target->programme, source->programme, sizeof(target->programme));
+        }
+        if (entry->fields & CMS_FIELD_MARK)
+        {
+            target->mark = source->mark;
+        }
+        cms_index_on_update(db, index, &previous);
+        return CMS_STATUS_OK;
+    }
+
+    bool adds_row = (entry->action == CMS_JOURNAL_INSERT) != undo;
+    const StudentRecord *row = (entry->action == CMS_JOURNAL_INSERT) ? &entry->after : &entry->before;
+    return cms_replay_push(db, replay, adds_row ? CMS_JOURNAL_INSERT : CMS_JOURNAL_DELETE, row, entry->index);
+}
+
+/* Walks steps whole steps back (undo) or forward (redo) */
+static CMS_STATUS cms_database_replay(StudentDatabase *db, size_t steps, bool undo)
+{
+    CmsReplay replay;
+    CmsJournalEntry entry;
+    CMS_STATUS status = CMS_STATUS_OK;
+    memset(&replay, 0, sizeof(replay));
+
+    for (size_t step = 0; step < steps && status == CMS_STATUS_OK; ++step)
+    {
+        do
+        {
+            if (!(undo ? cms_journal_back(db->journal, &entry) : cms_journal_forward(db->journal, &entry)))
+            {
+                break;
+            }
+            status = cms_replay_entry(db, &replay, &entry, undo);
+        } while (status == CMS_STATUS_OK && !cms_journal_at_step(db->journal));
+    }
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_replay_flush(db, &replay);
+    }
+    cms_free(replay.rows);
+    cms_free(replay.positions);
+    cms_free(replay.ids);
+
+    db->version++;
+    if (status != CMS_STATUS_OK)
+    {
+        /* Only possible if the table was changed behind the journal's back */
+        cms_journal_clear(db->journal);
+        db->is_dirty = true;
+        return status;
+    }
+    db->is_dirty = !cms_journal_is_clean(db->journal);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_undo(StudentDatabase *db, size_t steps, size_t *out_done)
+{
+    if (out_done != NULL)
+    {
+        *out_done = 0;
+    }
+    if (db == NULL || steps == 0)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t available = cms_journal_undo_steps(db->journal);
+    if (available == 0)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t done = (steps < available) ? steps : available;
+    CMS_STATUS status = cms_database_replay(db, done, true);
+    if (status == CMS_STATUS_OK && out_done != NULL)
+    {
+        *out_done = done;
+    }
+    return status;
+}
+
+CMS_STATUS cms_database_redo(StudentDatabase *db, size_t steps, size_t *out_done)
+{
+    if (out_done != NULL)
+    {
+        *out_done = 0;
+    }
+    if (db == NULL || steps == 0)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->transaction != NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t available = cms_journal_redo_steps(db->journal);
+    if (available == 0)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t done = (steps < available) ? steps : available;
+    CMS_STATUS status = cms_database_replay(db, done, false);
+    if (status == CMS_STATUS_OK && out_done != NULL)
+    {
+        *out_done = done;
+    }
+    return status;
+}
+
+/* ===== Applying a change list ===== */
+
+static bool cms_change_selected(const CmsChange *change, unsigned kinds)
+{
+    switch (change->kind)
+    {
+    case CMS_CHANGE_ADDED:
+        return (kinds & CMS_APPLY_ADDED) != 0;
+    case CMS_CHANGE_REMOVED:
+        return (kinds & CMS_APPLY_REMOVED) != 0;
+    case CMS_CHANGE_CHANGED:
+        return (kinds & CMS_APPLY_CHANGED) != 0;
+    default:
+        return false;
+    }
+}
+
+CMS_STATUS cms_database_apply_changes(StudentDatabase *db, const CmsChangeList *list, unsigned kinds,
+                                      size_t *out_applied)
 {
-    if (db == NULL)
+    if (db == NULL || list == NULL || out_applied == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
+    *out_applied = 0;
 
-    if (!cms_validate_student_id(student_id))
+    if (db->transaction != NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (db->records == NULL || db->count == 0)
+    /* Nothing is applied unless every selected change still fits the table */
+    size_t inserts = 0;
+    size_t removals = 0;
+    size_t updates = 0;
+    for (size_t i = 0; i < list->count; ++i)
     {
-        return CMS_STATUS_NOT_FOUND;
+        const CmsChange *change = &list->changes[i];
+        if (!cms_change_selected(change, kinds))
+        {
+            continue;
+        }
+        if (change->kind == CMS_CHANGE_ADDED)
+        {
+            if (cms_database_find_index(db, change->after.id, NULL))
+            {
+                return CMS_STATUS_DUPLICATE;
+            }
+            inserts++;
+        }
+        else
+        {
+            if (!cms_database_find_index(db, change->before.id, NULL))
+            {
+                return CMS_STATUS_NOT_FOUND;
+            }
+            removals += (change->kind == CMS_CHANGE_REMOVED);
+            updates += (change->kind == CMS_CHANGE_CHANGED);
+        }
     }
 
-    size_t index = 0;
-    if (!cms_database_find_index(db, student_id, &index))
+    CMS_STATUS status = cms_reserve_records(db, db->count + inserts);
+    size_t *positions = cms_malloc(CMS_MEM_TEMP, (removals + inserts + 1) * sizeof(size_t));
+    if (status != CMS_STATUS_OK || positions == NULL)
     {
-        return CMS_STATUS_NOT_FOUND;
+        cms_free(positions);
+        return CMS_STATUS_ERROR;
     }
 
-    StudentRecord removed = db->records[index];
-    bool prev_dirty = db->is_dirty;
+    cms_journal_begin_group(db->journal);
+    size_t removed = 0;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        const CmsChange *change = &list->changes[i];
+        size_t index = 0;
+        if (!cms_change_selected(change, kinds) || change->kind == CMS_CHANGE_ADDED)
+        {
+            continue;
+        }
+        cms_database_find_index(db, change->before.id, &index);
+        if (change->kind == CMS_CHANGE_REMOVED)
+        {
+            positions[removed++] = index;
+            continue;
+        }
+        StudentRecord previous = db->records[index];
+        cms_store_record(&db->records[index], previous.id, &change->after);
+        cms_index_on_update(db, index, &previous);
+        cms_database_journal(db, CMS_JOURNAL_UPDATE, index, &previous, &db->records[index]);
+    }
 
-    if (index < db->count - 1)
+    /* Journalled from the back so each removal still sees its own position */
+    if (removed > 0)
     {
-        memmove(&db->records[index],
-                &db->records[index + 1],
-                (db->count - index - 1) * sizeof(StudentRecord));
+        qsort(positions, removed, sizeof(size_t), cms_compare_positions);
+        for (size_t i = removed; i-- > 0;)
+        {
+            cms_database_journal(db, CMS_JOURNAL_DELETE, positions[i], &db->records[positions[i]], NULL);
+        }
+        status = cms_remove_positions(db, positions, removed);
     }
 
-    db->count--;
-    db->is_dirty = true;
-    cms_set_undo_state(db, CMS_UNDO_DELETE, &removed, NULL, index, prev_dirty);
+    size_t old_count = db->count;
+    size_t *placed = positions + removed;
+    for (size_t i = 0; status == CMS_STATUS_OK && i < list->count; ++i)
+    {
+        const CmsChange *change = &list->changes[i];
+        if (cms_change_selected(change, kinds) && change->kind == CMS_CHANGE_ADDED)
+        {
+            placed[db->count - old_count] = db->count;
+            cms_store_record(&db->records[db->count], change->after.id, &change->after);
+            db->count++;
+        }
+    }
+    if (status == CMS_STATUS_OK && inserts > 0)
+    {
+        /* As with IMPORT, rebuilding wins once the additions outgrow the table */
+        if (inserts > old_count)
+        {
+            status = cms_index_rebuild(db);
+        }
+        else
+        {
+            cms_index_on_bulk_change(db, NULL, 0, placed, inserts, old_count);
+        }
+        for (size_t i = 0; i < inserts; ++i)
+        {
+            cms_database_journal(db, CMS_JOURNAL_INSERT, placed[i], NULL, &db->records[placed[i]]);
+        }
+    }
+    cms_journal_end_group(db->journal);
+    cms_free(positions);
 
-    return CMS_STATUS_OK;
+    *out_applied = inserts + removals + updates;
+    if (*out_applied > 0)
+    {
+        db->version++;
+        db->is_dirty = true;
+    }
+    return status;
 }
 
-CMS_STATUS cms_database_undo(StudentDatabase *db)
+/* ===== Transactions ===== */
+
+CMS_STATUS cms_database_begin(StudentDatabase *db)
 {
     if (db == NULL)
     {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (!db->undo_state.valid || db->undo_state.action == CMS_UNDO_NONE)
+    if (db->transaction != NULL)
     {
-        printf("CMS: Nothing to undo.\n");
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    CMS_STATUS status = CMS_STATUS_OK;
+    db->transaction = cms_transaction_create();
+    return (db->transaction != NULL) ? CMS_STATUS_OK : CMS_STATUS_ERROR;
+}
 
-    switch (db->undo_state.action)
+CMS_STATUS cms_database_rollback(StudentDatabase *db)
+{
+    if (db == NULL || db->transaction == NULL)
     {
-    case CMS_UNDO_INSERT:
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_transaction_destroy(db->transaction);
+    db->transaction = NULL;
+    db->pending_version++;
+    return CMS_STATUS_OK;
+}
+
+/* Checks the write set against the table as it is now: in server mode other
+   sessions may have changed it since BEGIN */
+static CMS_STATUS cms_commit_check(const StudentDatabase *db, const CmsTransaction *transaction,
+                                   size_t *out_removals, size_t *out_placements, int *out_conflict_id)
+{
+    *out_removals = 0;
+    *out_placements = 0;
+    for (size_t i = 0; i < transaction->count; ++i)
     {
-        size_t index = 0;
-        if (!cms_database_find_index(db, db->undo_state.after.id, &index))
+        const CmsPendingRow *row = &transaction->rows[i];
+        if (!row->in_table && !row->present)
         {
-            printf("CMS: Unable to undo insert; record not found.\n");
-            cms_clear_undo_state(db);
-            return CMS_STATUS_NOT_FOUND;
+            continue; /* inserted and deleted again */
         }
-
-        if (index < db->count - 1)
+        if (cms_database_find_index(db, row->record.id, NULL) != row->in_table)
         {
-            memmove(&db->records[index],
-                    &db->records[index + 1],
-                    (db->count - index - 1) * sizeof(StudentRecord));
+            *out_conflict_id = row->record.id;
+            return row->in_table ? CMS_STATUS_NOT_FOUND : CMS_STATUS_DUPLICATE;
         }
-        db->count--;
-        db->is_dirty = db->undo_state.prev_dirty;
-        break;
+        *out_removals += cms_pending_removes(row) ? 1 : 0;
+        *out_placements += cms_pending_places(row) ? 1 : 0;
     }
-    case CMS_UNDO_DELETE:
+    return CMS_STATUS_OK;
+}
+
+/* Where a row at old position `position` ends up once the rows at
+   removed[0..count) (ascending) are gone */
+static size_t cms_position_after_removals(const size_t *removed, size_t count, size_t position)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
     {
-        status = cms_ensure_capacity(db);
-        if (status != CMS_STATUS_OK)
+        size_t middle = low + (high - low) / 2;
+        if (removed[middle] < position)
         {
-            return status;
+            low = middle + 1;
         }
-
-        size_t insert_index = db->undo_state.index;
-        if (insert_index > db->count)
+        else
         {
-            insert_index = db->count;
+            high = middle;
         }
+    }
+    return position - low;
+}
+
+/* Applies the write set: updates in place, all removals in one compaction
+   pass and all new rows appended, then one bulk index pass for the lot.
+   Everything that can fail is allocated first, so on error the table is
+   untouched. The journal records it as one step, so a single UNDO reverts
+   the whole transaction. */
+static CMS_STATUS cms_commit_apply(StudentDatabase *db, const CmsTransaction *transaction,
+                                   size_t removals, size_t placements, size_t *out_updates)
+{
+    size_t touched = transaction->count;
+    size_t *positions = cms_malloc(CMS_MEM_TEMP, (removals + touched + placements + 1) * sizeof(size_t));
+    const CmsPendingRow **placed = cms_malloc(CMS_MEM_TEMP, (placements + 1) * sizeof(CmsPendingRow *));
+    StudentRecord *removed = cms_malloc(CMS_MEM_TEMP, (removals + touched + 1) * sizeof(StudentRecord));
+    if (positions == NULL || placed == NULL || removed == NULL ||
+        cms_reserve_records(db, db->count - removals + placements) != CMS_STATUS_OK)
+    {
+        cms_free(positions);
+        cms_free(placed);
+        cms_free(removed);
+        return CMS_STATUS_ERROR;
+    }
 
-        if (insert_index < db->count)
+    /* Positions are looked up while the ID index still matches the table */
+    size_t *updated = positions + removals;
+    size_t update_count = 0;
+    size_t removing = 0;
+    size_t placing = 0;
+    for (size_t i = 0; i < touched; ++i)
+    {
+        const CmsPendingRow *row = &transaction->rows[i];
+        size_t index = 0;
+        if (cms_pending_removes(row))
         {
-            memmove(&db->records[insert_index + 1],
-                    &db->records[insert_index],
-                    (db->count - insert_index) * sizeof(StudentRecord));
+            cms_database_find_index(db, row->record.id, &positions[removing++]);
         }
+        if (cms_pending_places(row))
+        {
+            placed[placing++] = row;
+        }
+        if (row->in_table && row->present && !row->moved && cms_database_find_index(db, row->record.id, &index))
+        {
+            const StudentRecord *current = &db->records[index];
+            if (strcmp(current->name, row->record.name) != 0 ||
+                strcmp(current->programme, row->record.programme) != 0 || current->mark != row->record.mark)
+            {
+                updated[update_count++] = index;
+            }
+        }
+    }
 
-        db->records[insert_index] = db->undo_state.before;
-        db->count++;
-        db->is_dirty = db->undo_state.prev_dirty;
-        break;
+    /* Updates first, journalled at the positions they have before any row
+       is removed; their previous versions leave the indexes with the
+       removed rows */
+    size_t old_count = db->count;
+    for (size_t i = 0; i < update_count; ++i)
+    {
+        size_t index = updated[i];
+        removed[removals + i] = db->records[index];
+        db->records[index] = cms_transaction_find(transaction, db->records[index].id)->record;
+        cms_database_journal(db, CMS_JOURNAL_UPDATE, index, &removed[removals + i], &db->records[index]);
     }
-    case CMS_UNDO_UPDATE:
+
+    if (removals > 0)
     {
-        size_t index = db->undo_state.index;
-        if (index >= db->count || db->records[index].id != db->undo_state.before.id)
+        /* Journalled from the back, each position is still the row's own when replayed in order */
+        qsort(positions, removals, sizeof(size_t), cms_compare_positions);
+        for (size_t k = removals; k-- > 0;)
+        {
+            cms_database_journal(db, CMS_JOURNAL_DELETE, positions[k], &db->records[positions[k]], NULL);
+        }
+        size_t write = positions[0];
+        size_t next = 0;
+        for (size_t read = positions[0]; read < old_count; ++read)
         {
-            if (!cms_database_find_index(db, db->undo_state.before.id, &index))
+            if (next < removals && positions[next] == read)
             {
-                printf("CMS: Unable to undo update; record not found.\n");
-                cms_clear_undo_state(db);
-                return CMS_STATUS_NOT_FOUND;
+                removed[next++] = db->records[read];
+            }
+            else
+            {
+                db->records[write++] = db->records[read];
             }
         }
+        db->count = write;
+    }
 
-        db->records[index] = db->undo_state.before;
-        db->is_dirty = db->undo_state.prev_dirty;
-        break;
+    /* The indexes learn where updated rows now sit, then every appended row */
+    for (size_t i = 0; i < update_count; ++i)
+    {
+        updated[i] = cms_position_after_removals(positions, removals, updated[i]);
     }
-    default:
+    qsort(placed, placements, sizeof(placed[0]), cms_compare_pending_sequence);
+    size_t from = (removals > 0) ? positions[0] : db->count;
+    for (size_t i = 0; i < placements; ++i)
+    {
+        size_t index = db->count++;
+        db->records[index] = placed[i]->record;
+        updated[update_count + i] = index;
+        cms_database_journal(db, CMS_JOURNAL_INSERT, index, NULL, &db->records[index]);
+    }
+    cms_index_on_bulk_change(db, removed, removals + update_count, updated, update_count + placements, from);
+
+    cms_free(positions);
+    cms_free(placed);
+    cms_free(removed);
+    *out_updates = update_count;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_database_commit(StudentDatabase *db, CmsCommitReport *out_report)
+{
+    CmsCommitReport ignored;
+    CmsCommitReport *report = (out_report != NULL) ? out_report : &ignored;
+    memset(report, 0, sizeof(*report));
+
+    if (db == NULL || db->transaction == NULL)
+    {
         return CMS_STATUS_INVALID_ARGUMENT;
     }
+    CmsTransaction *transaction = db->transaction;
 
-    cms_clear_undo_state(db);
-    printf("CMS: Last change has been undone.\n");
-    return status;
+    size_t removals = 0;
+    size_t placements = 0;
+    size_t updates = 0;
+    CMS_STATUS status = cms_commit_check(db, transaction, &removals, &placements, &report->conflict_id);
+    if (status == CMS_STATUS_OK)
+    {
+        cms_journal_begin_group(db->journal);
+        status = cms_commit_apply(db, transaction, removals, placements, &updates);
+        cms_journal_end_group(db->journal);
+    }
+    if (status == CMS_STATUS_ERROR)
+    {
+        return status; /* out of memory before anything changed: the transaction stays open */
+    }
+    db->transaction = NULL;
+    db->pending_version++;
+    cms_transaction_destroy(transaction);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    if (removals + placements + updates > 0)
+    {
+        db->version++;
+        db->is_dirty = true;
+        db->is_loaded = true;
+    }
+    report->inserted = placements;
+    report->updated = updates;
+    report->deleted = removals;
+    return CMS_STATUS_OK;
 }
 
 CMS_STATUS cms_database_show_all(const StudentDatabase *db)
@@ -611,14 +2596,28 @@ CMS_STATUS cms_database_show_all(const StudentDatabase *db)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (db->records == NULL || db->count == 0)
+    if (cms_database_row_count(db) == 0)
     {
-        printf("\nNo records available.\n\n");
-        return CMS_STATUS_OK;
+        CmsWriter *out = cms_stdout_writer();
+        cms_writer_puts(out, "\nNo records available.\n\n");
+        return cms_writer_flush(out);
     }
 
-    cms_display_table(db);
+    if (!cms_database_has_pending(db))
+    {
+        cms_display_table(db);
+        return CMS_STATUS_OK;
+    }
 
+    /* A transaction shows the rows it sees */
+    StudentDatabase view;
+    memset(&view, 0, sizeof(view));
+    if (cms_database_copy_rows(db, &view.records, &view.count) != CMS_STATUS_OK)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    cms_display_table(&view);
+    cms_free(view.records);
     return CMS_STATUS_OK;
 }
 
@@ -629,10 +2628,20 @@ CMS_STATUS cms_database_show_record(const StudentRecord *record)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    printf("ID: %d, Name: %s, Programme: %s, Mark: %.2f\n",
-           record->id, record->name, record->programme, record->mark);
-
-    return CMS_STATUS_OK;
+    char mark[32];
+    mark[cms_format_fixed(record->mark, 2, mark)] = '\0';
+
+    CmsWriter *out = cms_stdout_writer();
+    cms_writer_puts(out, "ID: ");
+    cms_writer_int(out, record->id);
+    cms_writer_puts(out, ", Name: ");
+    cms_writer_puts(out, record->name);
+    cms_writer_puts(out, ", Programme: ");
+    cms_writer_puts(out, record->programme);
+    cms_writer_puts(out, ", Mark: ");
+    cms_writer_puts(out, mark);
+    cms_writer_putc(out, '\n');
+    return cms_writer_flush(out);
 }
 
 CMS_STATUS cms_database_show_sorted(const StudentDatabase *db, CmsSortKey sort_key, CmsSortOrder sort_order)
@@ -648,54 +2657,271 @@ CMS_STATUS cms_database_show_sorted(const StudentDatabase *db, CmsSortKey sort_k
 
     if (db->records == NULL || db->count == 0)
     {
-        printf("No records to display.\n");
+        CmsWriter *out = cms_stdout_writer();
+        cms_writer_puts(out, "No records to display.\n");
+        return cms_writer_flush(out);
+    }
+
+    /* Stream rows from a sorted view instead of sorting a copy of the table */
+    CmsCursor cursor;
+    CMS_STATUS status = cms_cursor_open_sorted(&cursor, db, sort_key, sort_order);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    const StudentRecord *record = NULL;
+    cms_display_table_header();
+    while (cms_cursor_next(&cursor, &record) == CMS_STATUS_OK)
+    {
+        cms_display_table_row(record);
+    }
+    cms_display_table_footer();
+
+    cms_cursor_close(&cursor);
+    return CMS_STATUS_OK;
+}
+
+/* ===== Row cursors ===== */
+
+static void cms_cursor_reset(CmsCursor *cursor, const StudentDatabase *db, CmsCursorSource source, size_t total)
+{
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->db = db;
+    cursor->version = db->version;
+    cursor->pending_version = db->pending_version;
+    cursor->source = source;
+    cursor->total = total;
+}
+
+/* While a transaction holds changes, table and sorted cursors run over the
+   rows it sees instead of the table */
+static CMS_STATUS cms_cursor_take_rows(CmsCursor *cursor, const StudentDatabase *db)
+{
+    if (!cms_database_has_pending(db))
+    {
+        return CMS_STATUS_OK;
+    }
+    return cms_visible_rows(db, &cursor->rows, &cursor->total);
+}
+
+/* The row at position i of what the cursor runs over */
+static const StudentRecord *cms_cursor_row(const CmsCursor *cursor, size_t i)
+{
+    return (cursor->rows != NULL) ? cursor->rows[i] : &cursor->db->records[i];
+}
+
+CMS_STATUS cms_cursor_open(CmsCursor *cursor, const StudentDatabase *db)
+{
+    if (cursor == NULL || db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_cursor_reset(cursor, db, CMS_CURSOR_TABLE, (db->records != NULL) ? db->count : 0);
+    return cms_cursor_take_rows(cursor, db);
+}
+
+CMS_STATUS cms_cursor_open_ids(CmsCursor *cursor, const StudentDatabase *db, int *ids, size_t count)
+{
+    if (cursor == NULL || db == NULL || (ids == NULL && count > 0))
+    {
+        cms_free(ids);
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_cursor_reset(cursor, db, CMS_CURSOR_IDS, count);
+    cursor->ids = ids;
+    return CMS_STATUS_OK;
+}
+
+/* True when the row at position a is listed before the row at position b */
+static bool cms_cursor_before(const CmsCursor *cursor, uint32_t a, uint32_t b)
+{
+    int result = cms_compare_records(cms_cursor_row(cursor, a), cms_cursor_row(cursor, b), cursor->sort_key);
+    return (cursor->sort_order == CMS_SORT_DESC) ? (result > 0) : (result < 0);
+}
+
+static void cms_cursor_sift_down(CmsCursor *cursor, size_t at)
+{
+    uint32_t *heap = cursor->heap;
+    size_t count = cursor->heap_count;
+    while (1)
+    {
+        size_t first = at;
+        size_t left = 2 * at + 1;
+        size_t right = left + 1;
+        if (left < count && cms_cursor_before(cursor, heap[left], heap[first]))
+        {
+            first = left;
+        }
+        if (right < count && cms_cursor_before(cursor, heap[right], heap[first]))
+        {
+            first = right;
+        }
+        if (first == at)
+        {
+            return;
+        }
+        uint32_t swap = heap[at];
+        heap[at] = heap[first];
+        heap[first] = swap;
+        at = first;
+    }
+}
+
+CMS_STATUS cms_cursor_open_sorted(CmsCursor *cursor, const StudentDatabase *db,
+                                  CmsSortKey sort_key, CmsSortOrder sort_order)
+{
+    if (cursor == NULL || db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t count = (db->records != NULL) ? db->count : 0;
+    if (count > UINT32_MAX)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    /* Mark order is already held by the mark index: walk it by rank. The
+       index only knows the table, so pending changes take the heap. */
+    if (sort_key == CMS_SORT_KEY_MARK && !cms_database_has_pending(db) &&
+        (count == 0 || cms_index_mark_at(db, 0, NULL, NULL)))
+    {
+        cms_cursor_reset(cursor, db, CMS_CURSOR_MARK_INDEX, count);
+        cursor->sort_key = sort_key;
+        cursor->sort_order = sort_order;
         return CMS_STATUS_OK;
     }
 
-    /* Create a copy of the records to sort */
-    StudentRecord *sorted_records = (StudentRecord *)malloc(db->count * sizeof(StudentRecord));
-    if (sorted_records == NULL)
+    cms_cursor_reset(cursor, db, CMS_CURSOR_SORTED, count);
+    cursor->sort_key = sort_key;
+    cursor->sort_order = sort_order;
+    CMS_STATUS status = cms_cursor_take_rows(cursor, db);
+    count = cursor->total;
+    if (status != CMS_STATUS_OK || count == 0)
+    {
+        return status;
+    }
+
+    /* Heapify row positions in O(n); each fetch then costs O(log n), so a
+       first page never pays for ordering the whole table */
+    cursor->heap = cms_malloc(CMS_MEM_TEMP, count * sizeof(uint32_t));
+    if (cursor->heap == NULL)
     {
         return CMS_STATUS_ERROR;
     }
+    for (size_t i = 0; i < count; ++i)
+    {
+        cursor->heap[i] = (uint32_t)i;
+    }
+    cursor->heap_count = count;
+    for (size_t i = count / 2; i-- > 0;)
+    {
+        cms_cursor_sift_down(cursor, i);
+    }
+    return CMS_STATUS_OK;
+}
 
-    /* Copy records */
-    memcpy(sorted_records, db->records, db->count * sizeof(StudentRecord));
+bool cms_cursor_is_stale(const CmsCursor *cursor)
+{
+    return cursor == NULL || cursor->db == NULL || cursor->version != cursor->db->version ||
+           cursor->pending_version != cursor->db->pending_version;
+}
+
+bool cms_cursor_has_next(const CmsCursor *cursor)
+{
+    return !cms_cursor_is_stale(cursor) && cursor->position < cursor->total;
+}
 
-    StudentDatabase *sortable_db = malloc(sizeof(StudentDatabase));
-    if (sortable_db == NULL)
+CMS_STATUS cms_cursor_next(CmsCursor *cursor, const StudentRecord **out_record)
+{
+    if (cursor == NULL || out_record == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (cms_cursor_is_stale(cursor))
     {
-        free(sortable_db);
         return CMS_STATUS_ERROR;
     }
-    sortable_db->records = sorted_records;
-    sortable_db->count = db->count;
-
-    // Updated sorting logic to use the cms_sort functions and sortable_db
-    switch (sort_key)
-    {
-    case CMS_SORT_KEY_ID:
-        cms_sort_by_id(sortable_db, sort_order);
-        break;
-    case CMS_SORT_KEY_MARK:
-        cms_sort_by_mark(sortable_db, sort_order);
-        break;
-    case CMS_SORT_KEY_NAME:
-        cms_sort_by_name(sortable_db, sort_order);
-        break;
-    case CMS_SORT_KEY_PROGRAMME:
-        cms_sort_by_prog(sortable_db, sort_order);
-        break;
-    default:
-        cms_sort_by_id(sortable_db, sort_order);
-        break;
+
+    const StudentDatabase *db = cursor->db;
+    while (cursor->position < cursor->total)
+    {
+        size_t rank = cursor->position++;
+        size_t index = 0;
+        int id = 0;
+        switch (cursor->source)
+        {
+        case CMS_CURSOR_TABLE:
+            *out_record = cms_cursor_row(cursor, rank);
+            return CMS_STATUS_OK;
+        case CMS_CURSOR_IDS:
+            if ((*out_record = cms_database_find(db, cursor->ids[rank])) != NULL)
+            {
+                return CMS_STATUS_OK;
+            }
+            break;
+        case CMS_CURSOR_SORTED:
+            *out_record = cms_cursor_row(cursor, cursor->heap[0]);
+            cursor->heap[0] = cursor->heap[--cursor->heap_count];
+            cms_cursor_sift_down(cursor, 0);
+            return CMS_STATUS_OK;
+        case CMS_CURSOR_MARK_INDEX:
+            if (cursor->sort_order == CMS_SORT_DESC)
+            {
+                rank = cursor->total - 1 - rank;
+            }
+            if (cms_index_mark_at(db, rank, &cursor->mark_seek, &id) && cms_database_find_index(db, id, &index))
+            {
+                *out_record = &db->records[index];
+                return CMS_STATUS_OK;
+            }
+            break;
+        }
+    }
+    return CMS_STATUS_NOT_FOUND;
+}
+
+size_t cms_cursor_skip(CmsCursor *cursor, size_t count)
+{
+    if (cms_cursor_is_stale(cursor))
+    {
+        return 0;
     }
 
-    cms_display_table(sortable_db);
+    size_t available = cursor->total - cursor->position;
+    if (count > available)
+    {
+        count = available;
+    }
+
+    /* Only the heap has to produce the rows it passes over */
+    if (cursor->source == CMS_CURSOR_SORTED)
+    {
+        const StudentRecord *record = NULL;
+        for (size_t i = 0; i < count; ++i)
+        {
+            cms_cursor_next(cursor, &record);
+        }
+    }
+    else
+    {
+        cursor->position += count;
+    }
+    return count;
+}
 
-    /* Free the copied records */
-    free(sorted_records);
-    free(sortable_db);
+void cms_cursor_close(CmsCursor *cursor)
+{
+    if (cursor == NULL)
+    {
+        return;
+    }
 
-    return CMS_STATUS_OK;
+    cms_free(cursor->ids);
+    cms_free(cursor->heap);
+    cms_free(cursor->rows);
+    memset(cursor, 0, sizeof(*cursor));
 }
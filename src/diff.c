@@ -0,0 +1,473 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/diff.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+#include "../include/index.h"
+
+void cms_change_list_init(CmsChangeList *list)
+{
+    if (list != NULL)
+    {
+        memset(list, 0, sizeof(*list));
+    }
+}
+
+void cms_change_list_free(CmsChangeList *list)
+{
+    if (list != NULL)
+    {
+        cms_free(list->changes);
+        cms_change_list_init(list);
+    }
+}
+
+static CmsChange *cms_change_list_push(CmsChangeList *list, CmsChangeKind kind)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = (list->capacity == 0) ? CMS_INITIAL_CAPACITY : list->capacity * CMS_GROWTH_FACTOR;
+        CmsChange *changes = cms_realloc(CMS_MEM_TEMP, list->changes, capacity * sizeof(CmsChange));
+        if (changes == NULL)
+        {
+            return NULL;
+        }
+        list->changes = changes;
+        list->capacity = capacity;
+    }
+
+    CmsChange *change = &list->changes[list->count++];
+    memset(change, 0, sizeof(*change));
+    change->kind = kind;
+    list->added += (kind == CMS_CHANGE_ADDED);
+    list->removed += (kind == CMS_CHANGE_REMOVED);
+    list->changed += (kind == CMS_CHANGE_CHANGED);
+    return change;
+}
+
+static unsigned cms_diff_fields(const StudentRecord *before, const StudentRecord *after)
+{
+    unsigned fields = 0;
+    fields |= (strcmp(before->name, after->name) != 0) ? CMS_CHANGE_NAME : 0u;
+    fields |= (strcmp(before->programme, after->programme) != 0) ? CMS_CHANGE_PROGRAMME : 0u;
+    fields |= (before->mark != after->mark) ? CMS_CHANGE_MARK : 0u;
+    return fields;
+}
+
+static int cms_compare_record_ids(const void *a, const void *b)
+{
+    int left = ((const StudentRecord *)a)->id;
+    int right = ((const StudentRecord *)b)->id;
+    return (left > right) - (left < right);
+}
+
+static int cms_compare_change_ids(const void *a, const void *b)
+{
+    const CmsChange *left = a;
+    const CmsChange *right = b;
+    int left_id = (left->kind == CMS_CHANGE_ADDED) ? left->after.id : left->before.id;
+    int right_id = (right->kind == CMS_CHANGE_ADDED) ? right->after.id : right->before.id;
+    return (left_id > right_id) - (left_id < right_id);
+}
+
+/* The base side: row numbers of base sorted by ID, with a flag per sorted
+   slot once the other file has matched it */
+typedef struct
+{
+    const StudentRecord *rows;
+    uint32_t *order;
+    bool *matched;
+    size_t count;
+} CmsDiffBase;
+
+static const StudentRecord *cms_diff_base_row(const CmsDiffBase *base, size_t slot)
+{
+    return &base->rows[base->order[slot]];
+}
+
+static int cms_diff_base_id(const CmsDiffBase *base, size_t slot)
+{
+    return cms_diff_base_row(base, slot)->id;
+}
+
+/* Sorting row numbers by ID with qsort needs the rows, so the order is built
+   from (id, row) pairs instead */
+typedef struct
+{
+    int id;
+    uint32_t row;
+} CmsDiffKey;
+
+static int cms_compare_diff_keys(const void *a, const void *b)
+{
+    int left = ((const CmsDiffKey *)a)->id;
+    int right = ((const CmsDiffKey *)b)->id;
+    return (left > right) - (left < right);
+}
+
+static CMS_STATUS cms_diff_base_init(CmsDiffBase *base, const StudentRecord *rows, size_t count)
+{
+    memset(base, 0, sizeof(*base));
+    if (count >= UINT32_MAX)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    CmsDiffKey *keys = cms_malloc(CMS_MEM_TEMP, (count + 1) * sizeof(CmsDiffKey));
+    base->order = cms_malloc(CMS_MEM_TEMP, (count + 1) * sizeof(uint32_t));
+    base->matched = cms_calloc(CMS_MEM_TEMP, count + 1, sizeof(bool));
+    if (keys == NULL || base->order == NULL || base->matched == NULL)
+    {
+        cms_free(keys);
+        return CMS_STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i].id = rows[i].id;
+        keys[i].row = (uint32_t)i;
+    }
+    qsort(keys, count, sizeof(CmsDiffKey), cms_compare_diff_keys);
+
+    CMS_STATUS status = CMS_STATUS_OK;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0 && keys[i].id == keys[i - 1].id)
+        {
+            status = CMS_STATUS_DUPLICATE;
+        }
+        base->order[i] = keys[i].row;
+    }
+    cms_free(keys);
+    base->rows = rows;
+    base->count = count;
+    return status;
+}
+
+static void cms_diff_base_free(CmsDiffBase *base)
+{
+    cms_free(base->order);
+    cms_free(base->matched);
+}
+
+/* First slot at or after from whose ID is >= id: gallop forward, then
+   binary search the last step, so a sorted chunk costs O(log gap) per row */
+static size_t cms_diff_seek(const CmsDiffBase *base, size_t from, int id)
+{
+    if (from >= base->count || cms_diff_base_id(base, from) >= id)
+    {
+        return from;
+    }
+
+    size_t low = from;
+    size_t step = 1;
+    while (low + step < base->count && cms_diff_base_id(base, low + step) < id)
+    {
+        low += step;
+        step *= 2;
+    }
+    size_t high = (low + step < base->count) ? low + step : base->count;
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (cms_diff_base_id(base, middle) < id)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+/* Merges one chunk of the other file (sorted here) against the base */
+static CMS_STATUS cms_diff_chunk(CmsDiffBase *base, StudentRecord *chunk, size_t count, CmsChangeList *list)
+{
+    qsort(chunk, count, sizeof(StudentRecord), cms_compare_record_ids);
+
+    size_t slot = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0 && chunk[i].id == chunk[i - 1].id)
+        {
+            return CMS_STATUS_DUPLICATE;
+        }
+
+        slot = cms_diff_seek(base, slot, chunk[i].id);
+        if (slot == base->count || cms_diff_base_id(base, slot) != chunk[i].id)
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_ADDED);
+            if (change == NULL)
+            {
+                return CMS_STATUS_ERROR;
+            }
+            change->after = chunk[i];
+            continue;
+        }
+
+        /* An ID repeated across chunks finds its slot taken */
+        if (base->matched[slot])
+        {
+            return CMS_STATUS_DUPLICATE;
+        }
+        base->matched[slot] = true;
+
+        const StudentRecord *before = cms_diff_base_row(base, slot);
+        unsigned fields = cms_diff_fields(before, &chunk[i]);
+        if (fields != 0)
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_CHANGED);
+            if (change == NULL)
+            {
+                return CMS_STATUS_ERROR;
+            }
+            change->fields = fields;
+            change->before = *before;
+            change->after = chunk[i];
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+/* Puts a list in ID order; an added ID the other file repeats then sits
+   next to itself */
+static CMS_STATUS cms_change_list_sort(CmsChangeList *list)
+{
+    qsort(list->changes, list->count, sizeof(CmsChange), cms_compare_change_ids);
+    for (size_t i = 1; i < list->count; ++i)
+    {
+        if (cms_compare_change_ids(&list->changes[i - 1], &list->changes[i]) == 0)
+        {
+            return CMS_STATUS_DUPLICATE;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+static CMS_STATUS cms_diff_stream(const StudentRecord *rows, size_t count, const char *other_path,
+                                  CmsChangeList *list)
+{
+    CmsDiffBase base;
+    CMS_STATUS status = cms_diff_base_init(&base, rows, count);
+    StudentRecord *chunk = cms_malloc(CMS_MEM_TEMP, CMS_DIFF_CHUNK_ROWS * sizeof(StudentRecord));
+    if (status == CMS_STATUS_OK && chunk == NULL)
+    {
+        status = CMS_STATUS_ERROR;
+    }
+
+    CmsRowReader reader;
+    reader.fp = NULL;
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_row_reader_open(&reader, other_path);
+    }
+
+    bool more = (status == CMS_STATUS_OK);
+    while (more)
+    {
+        size_t filled = 0;
+        while (filled < CMS_DIFF_CHUNK_ROWS)
+        {
+            status = cms_row_reader_next(&reader, &chunk[filled]);
+            if (status != CMS_STATUS_OK)
+            {
+                break;
+            }
+            filled++;
+        }
+        more = (status == CMS_STATUS_OK);
+        if (status == CMS_STATUS_NOT_FOUND)
+        {
+            status = CMS_STATUS_OK;
+        }
+        if (status == CMS_STATUS_OK && filled > 0)
+        {
+            status = cms_diff_chunk(&base, chunk, filled, list);
+        }
+        more = more && (status == CMS_STATUS_OK);
+    }
+    cms_row_reader_close(&reader);
+
+    /* Whatever the other file never matched is gone from it */
+    for (size_t slot = 0; status == CMS_STATUS_OK && slot < base.count; ++slot)
+    {
+        if (!base.matched[slot])
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_REMOVED);
+            if (change == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            change->before = *cms_diff_base_row(&base, slot);
+        }
+    }
+
+    /* Chunks come out sorted one by one; put the whole list in ID order */
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_change_list_sort(list);
+    }
+
+    cms_free(chunk);
+    cms_diff_base_free(&base);
+    return status;
+}
+
+CMS_STATUS cms_diff_files(const char *base_path, const char *other_path, CmsChangeList *out_list)
+{
+    if (base_path == NULL || other_path == NULL || out_list == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    cms_change_list_init(out_list);
+
+    CmsRowReader reader;
+    CMS_STATUS status = cms_row_reader_open(&reader, base_path);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    StudentRecord *rows = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    while (status == CMS_STATUS_OK)
+    {
+        if (count == capacity)
+        {
+            capacity = (capacity == 0) ? CMS_INITIAL_CAPACITY : capacity * CMS_GROWTH_FACTOR;
+            StudentRecord *grown = cms_realloc(CMS_MEM_TEMP, rows, capacity * sizeof(StudentRecord));
+            if (grown == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            rows = grown;
+        }
+        status = cms_row_reader_next(&reader, &rows[count]);
+        count += (status == CMS_STATUS_OK);
+    }
+    cms_row_reader_close(&reader);
+
+    if (status == CMS_STATUS_NOT_FOUND)
+    {
+        status = cms_diff_stream(rows, count, other_path, out_list);
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_change_list_free(out_list);
+    }
+    cms_free(rows);
+    return status;
+}
+
+/* The open table with its ID hash needs no sorted copy: each row of the
+   other file is looked up as it is read, so the cost is one pass over the
+   file, one over a flag per row and sorting the changes alone */
+static CMS_STATUS cms_diff_indexed(const StudentDatabase *db, const char *other_path, CmsChangeList *list)
+{
+    bool *matched = cms_calloc(CMS_MEM_TEMP, db->count + 1, sizeof(bool));
+    if (matched == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    CmsRowReader reader;
+    reader.fp = NULL;
+    CMS_STATUS status = cms_row_reader_open(&reader, other_path);
+    StudentRecord row;
+    while (status == CMS_STATUS_OK && (status = cms_row_reader_next(&reader, &row)) == CMS_STATUS_OK)
+    {
+        size_t index = 0;
+        if (!cms_index_find_id(db, row.id, &index))
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_ADDED);
+            if (change == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            change->after = row;
+            continue;
+        }
+        if (matched[index])
+        {
+            status = CMS_STATUS_DUPLICATE;
+            break;
+        }
+        matched[index] = true;
+
+        unsigned fields = cms_diff_fields(&db->records[index], &row);
+        if (fields != 0)
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_CHANGED);
+            if (change == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            change->fields = fields;
+            change->before = db->records[index];
+            change->after = row;
+        }
+    }
+    cms_row_reader_close(&reader);
+    if (status == CMS_STATUS_NOT_FOUND)
+    {
+        status = CMS_STATUS_OK;
+    }
+
+    for (size_t i = 0; status == CMS_STATUS_OK && i < db->count; ++i)
+    {
+        if (!matched[i])
+        {
+            CmsChange *change = cms_change_list_push(list, CMS_CHANGE_REMOVED);
+            if (change == NULL)
+            {
+                status = CMS_STATUS_ERROR;
+                break;
+            }
+            change->before = db->records[i];
+        }
+    }
+    cms_free(matched);
+
+    return (status == CMS_STATUS_OK) ? cms_change_list_sort(list) : status;
+}
+
+CMS_STATUS cms_diff_database(const StudentDatabase *db, const char *other_path, CmsChangeList *out_list)
+{
+    if (db == NULL || other_path == NULL || out_list == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    cms_change_list_init(out_list);
+
+    /* Inside a transaction the diff is of the rows it sees */
+    CMS_STATUS status = CMS_STATUS_OK;
+    if (cms_database_has_pending(db))
+    {
+        StudentRecord *rows = NULL;
+        size_t count = 0;
+        status = cms_database_copy_rows(db, &rows, &count);
+        if (status == CMS_STATUS_OK)
+        {
+            status = cms_diff_stream(rows, count, other_path, out_list);
+            cms_free(rows);
+        }
+    }
+    else
+    {
+        status = cms_index_has_ids(db) ? cms_diff_indexed(db, other_path, out_list)
+                                       : cms_diff_stream(db->records, db->count, other_path, out_list);
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        cms_change_list_free(out_list);
+    }
+    return status;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/export.h"
+#include "../include/alloc.h"
+#include "../include/utils.h"
+
+/* Worst case for one row: every name/programme byte escaped as \u00XX plus
+   the keys, an int and a mark */
+#define CMS_EXPORT_ROW_MAX (128 + 6 * (CMS_MAX_NAME_LEN + CMS_MAX_PROGRAMME_LEN) + CMS_MARK_TEXT_LEN)
+
+static const char cms_hex_digits[] = "0123456789abcdef";
+
+bool cms_export_format_from_name(const char *name, CmsExportFormat *out_format)
+{
+    if (name == NULL || out_format == NULL)
+    {
+        return false;
+    }
+
+    if (cms_string_equals_ignore_case(name, "CSV"))
+    {
+        *out_format = CMS_EXPORT_CSV;
+    }
+    else if (cms_string_equals_ignore_case(name, "JSON"))
+    {
+        *out_format = CMS_EXPORT_JSON;
+    }
+    else if (cms_string_equals_ignore_case(name, "NDJSON") ||
+             cms_string_equals_ignore_case(name, "JSONL"))
+    {
+        *out_format = CMS_EXPORT_NDJSON;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *cms_export_format_name(CmsExportFormat format)
+{
+    switch (format)
+    {
+    case CMS_EXPORT_CSV:
+        return "CSV";
+    case CMS_EXPORT_JSON:
+        return "JSON";
+    case CMS_EXPORT_NDJSON:
+        return "NDJSON";
+    default:
+        return "unknown";
+    }
+}
+
+/* Length of a fixed-size record field, which is normally NUL terminated */
+static size_t cms_export_field_length(const char *text, size_t max)
+{
+    const char *end = memchr(text, '\0', max);
+    return (end == NULL) ? max : (size_t)(end - text);
+}
+
+/* RFC 4180: quote a field holding a comma, quote or line break, doubling
+   embedded quotes */
+static char *cms_export_csv_field(char *out, const char *text, size_t length)
+{
+    size_t plain = 0;
+    while (plain < length && text[plain] != ',' && text[plain] != '"' && text[plain] != '\r' &&
+           text[plain] != '\n')
+    {
+        plain++;
+    }
+    if (plain == length)
+    {
+        memcpy(out, text, length);
+        return out + length;
+    }
+
+    *out++ = '"';
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (text[i] == '"')
+        {
+            *out++ = '"';
+        }
+        *out++ = text[i];
+    }
+    *out++ = '"';
+    return out;
+}
+
+/* JSON string body: escapes quotes, backslashes and control characters;
+   other bytes (UTF-8 included) pass through unchanged */
+static char *cms_export_json_string(char *out, const char *text, size_t length)
+{
+    *out++ = '"';
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        memcpy(out, text + start, i - start);
+        out += i - start;
+        start = i + 1;
+        *out++ = '\\';
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            *out++ = (char)c;
+            break;
+        case '\n':
+            *out++ = 'n';
+            break;
+        case '\r':
+            *out++ = 'r';
+            break;
+        case '\t':
+            *out++ = 't';
+            break;
+        default:
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = cms_hex_digits[c >> 4];
+            *out++ = cms_hex_digits[c & 0x0F];
+            break;
+        }
+    }
+    memcpy(out, text + start, length - start);
+    out += length - start;
+    *out++ = '"';
+    return out;
+}
+
+static char *cms_export_literal(char *out, const char *text)
+{
+    size_t length = strlen(text);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+/* Formats one record into out and returns the end of the row */
+static char *cms_export_row(char *out, const StudentRecord *record, CmsExportFormat format)
+{
+    size_t name_length = cms_export_field_length(record->name, sizeof(record->name));
+    size_t programme_length = cms_export_field_length(record->programme, sizeof(record->programme));
+
+    if (format == CMS_EXPORT_CSV)
+    {
+        out += cms_format_int(record->id, out);
+        *out++ = ',';
+        out = cms_export_csv_field(out, record->name, name_length);
+        *out++ = ',';
+        out = cms_export_csv_field(out, record->programme, programme_length);
+        *out++ = ',';
+        out += cms_format_fixed(record->mark, CMS_EXPORT_MARK_DECIMALS, out);
+        *out++ = '\n';
+        return out;
+    }
+
+    out = cms_export_literal(out, "{\"id\":");
+    out += cms_format_int(record->id, out);
+    out = cms_export_literal(out, ",\"name\":");
+    out = cms_export_json_string(out, record->name, name_length);
+    out = cms_export_literal(out, ",\"programme\":");
+    out = cms_export_json_string(out, record->programme, programme_length);
+    out = cms_export_literal(out, ",\"mark\":");
+    out += cms_format_fixed(record->mark, CMS_EXPORT_MARK_DECIMALS, out);
+    *out++ = '}';
+    return out;
+}
+
+CMS_STATUS cms_export_cursor(CmsWriter *writer, CmsCursor *cursor, CmsExportFormat format,
+                             size_t *out_rows)
+{
+    if (writer == NULL || cursor == NULL || format > CMS_EXPORT_NDJSON)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (format == CMS_EXPORT_CSV)
+    {
+        cms_writer_puts(writer, "id,name,programme,mark\n");
+    }
+    else if (format == CMS_EXPORT_JSON)
+    {
+        cms_writer_putc(writer, '[');
+    }
+
+    size_t rows = 0;
+    const StudentRecord *record = NULL;
+    CMS_STATUS status;
+    while ((status = cms_cursor_next(cursor, &record)) == CMS_STATUS_OK)
+    {
+        char *row = cms_writer_reserve(writer, CMS_EXPORT_ROW_MAX);
+        if (row == NULL)
+        {
+            break;
+        }
+
+        char *end = row;
+        if (format == CMS_EXPORT_JSON)
+        {
+            *end++ = (rows == 0) ? '\n' : ',';
+            if (rows > 0)
+            {
+                *end++ = '\n';
+            }
+        }
+        end = cms_export_row(end, record, format);
+        if (format == CMS_EXPORT_NDJSON)
+        {
+            *end++ = '\n';
+        }
+        cms_writer_commit(writer, (size_t)(end - row));
+        rows++;
+    }
+
+    if (format == CMS_EXPORT_JSON)
+    {
+        cms_writer_puts(writer, "\n]\n");
+    }
+
+    if (out_rows != NULL)
+    {
+        *out_rows = rows;
+    }
+
+    if (status == CMS_STATUS_ERROR)
+    {
+        /* The records changed underneath the cursor */
+        return CMS_STATUS_ERROR;
+    }
+    return cms_writer_flush(writer);
+}
+
+CMS_STATUS cms_export_file(const char *file_path, CmsCursor *cursor, CmsExportFormat format,
+                           size_t *out_rows)
+{
+    if (file_path == NULL || file_path[0] == '\0' || cursor == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    char *buffer = cms_malloc(CMS_MEM_TEMP, CMS_WRITER_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    FILE *fp = fopen(file_path, "wb");
+    if (fp == NULL)
+    {
+        cms_free(buffer);
+        return CMS_STATUS_IO;
+    }
+
+    CmsWriter writer;
+    cms_writer_init_stream(&writer, fp, buffer, CMS_WRITER_BUFFER_SIZE);
+    CMS_STATUS status = cms_export_cursor(&writer, cursor, format, out_rows);
+
+    if (fclose(fp) != 0 && status == CMS_STATUS_OK)
+    {
+        status = CMS_STATUS_IO;
+    }
+    cms_free(buffer);
+
+    if (status != CMS_STATUS_OK)
+    {
+        /* Do not leave a truncated export behind */
+        remove(file_path);
+    }
+    return status;
+}
@@ -0,0 +1,894 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "../include/fuzzy.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+
+#define CMS_BKTREE_NONE UINT32_MAX
+#define CMS_BKTREE_EXACT_LIMIT CMS_MAX_COMMAND_LEN
+#define CMS_BKTREE_REBUILD_MIN_NODES 1024
+
+/* One distinct (lower-cased) name and the students that carry it, in
+   ascending ID order so one can be found or dropped by binary search.
+   Children are kept as a first-child / next-sibling list, each tagged
+   with its distance to this node. */
+typedef struct
+{
+    char key[CMS_MAX_NAME_LEN + 1];
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint8_t edge;
+    uint8_t max_child_edge;
+    bool unsorted; /* IDs appended in bulk mode, sorted when it settles */
+    int *ids;
+    size_t id_count;
+    size_t id_capacity;
+} CmsBkNode;
+
+/* A remove queued in bulk mode */
+typedef struct
+{
+    uint32_t node;
+    int id;
+} CmsBkRemoval;
+
+struct CmsBkTree
+{
+    CmsBkNode *nodes;
+    size_t node_count;
+    size_t node_capacity;
+    /* Nodes left without IDs by deletes; they still route searches */
+    size_t empty_nodes;
+
+    /* Bulk mode: nodes with appended IDs, queued removes and the nodes of
+       names already looked up */
+    bool bulk;
+    bool bulk_failed;
+    uint32_t *unsorted;
+    size_t unsorted_count;
+    size_t unsorted_capacity;
+    CmsBkRemoval *removals;
+    size_t removal_count;
+    size_t removal_capacity;
+    uint32_t *seen; /* open-addressed node indexes, CMS_BKTREE_NONE when free */
+    size_t seen_count;
+    size_t seen_capacity;
+};
+
+int cms_edit_distance_bounded(const char *a, const char *b, int max_distance)
+{
+    if (a == NULL || b == NULL || max_distance < 0)
+    {
+        return max_distance + 1;
+    }
+
+    size_t la = strlen(a);
+    size_t lb = strlen(b);
+
+    /* Columns follow the shorter string */
+    if (la > lb)
+    {
+        const char *tmp_str = a;
+        a = b;
+        b = tmp_str;
+        size_t tmp_len = la;
+        la = lb;
+        lb = tmp_len;
+    }
+
+    int over = max_distance + 1;
+    if (lb - la > (size_t)max_distance || la > CMS_MAX_COMMAND_LEN)
+    {
+        return over;
+    }
+
+    /* Two rows of the DP matrix, restricted to the diagonal band |i - j| <= max */
+    int rows[2][CMS_MAX_COMMAND_LEN + 2];
+    int *prev = rows[0];
+    int *cur = rows[1];
+
+    for (size_t j = 0; j <= la; ++j)
+    {
+        prev[j] = (j <= (size_t)max_distance) ? (int)j : over;
+    }
+    prev[la + 1] = over;
+
+    for (size_t i = 1; i <= lb; ++i)
+    {
+        size_t lo = (i > (size_t)max_distance) ? i - (size_t)max_distance : 1;
+        size_t hi = (i + (size_t)max_distance < la) ? i + (size_t)max_distance : la;
+        int bi = tolower((unsigned char)b[i - 1]);
+
+        cur[lo - 1] = (lo == 1 && i <= (size_t)max_distance) ? (int)i : over;
+        int row_min = cur[lo - 1];
+
+        for (size_t j = lo; j <= hi; ++j)
+        {
+            int cost = (tolower((unsigned char)a[j - 1]) == bi) ? 0 : 1;
+            int best = prev[j - 1] + cost;
+            if (prev[j] + 1 < best)
+            {
+                best = prev[j] + 1;
+            }
+            if (cur[j - 1] + 1 < best)
+            {
+                best = cur[j - 1] + 1;
+            }
+            if (best > over)
+            {
+                best = over;
+            }
+            cur[j] = best;
+            if (best < row_min)
+            {
+                row_min = best;
+            }
+        }
+        if (hi < la)
+        {
+            cur[hi + 1] = over;
+        }
+
+        if (row_min > max_distance)
+        {
+            return over;
+        }
+
+        int *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    return (prev[la] <= max_distance) ? prev[la] : over;
+}
+
+static void cms_bktree_make_key(const char *name, char *key)
+{
+    size_t i = 0;
+    for (; name[i] != '\0' && i < CMS_MAX_NAME_LEN; ++i)
+    {
+        key[i] = (char)tolower((unsigned char)name[i]);
+    }
+    key[i] = '\0';
+}
+
+CmsBkTree *cms_bktree_create(void)
+{
+    return cms_calloc(CMS_MEM_INDEXES, 1, sizeof(CmsBkTree));
+}
+
+void cms_bktree_clear(CmsBkTree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < tree->node_count; ++i)
+    {
+        cms_free(tree->nodes[i].ids);
+    }
+    tree->node_count = 0;
+    tree->empty_nodes = 0;
+    tree->unsorted_count = 0;
+    tree->removal_count = 0;
+    cms_free(tree->seen);
+    tree->seen = NULL;
+    tree->seen_count = 0;
+    tree->seen_capacity = 0;
+}
+
+void cms_bktree_destroy(CmsBkTree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+
+    cms_bktree_clear(tree);
+    cms_free(tree->unsorted);
+    cms_free(tree->removals);
+    cms_free(tree->nodes);
+    cms_free(tree);
+}
+
+static int cms_compare_id(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int cms_compare_removal(const void *a, const void *b)
+{
+    const CmsBkRemoval *x = a;
+    const CmsBkRemoval *y = b;
+    if (x->node != y->node)
+    {
+        return (x->node > y->node) - (x->node < y->node);
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* Index of the first of the node's IDs >= id */
+static size_t cms_bknode_find(const CmsBkNode *node, int id)
+{
+    size_t lo = 0;
+    size_t hi = node->id_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (node->ids[mid] < id)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool cms_bknode_reserve(CmsBkNode *node, size_t count)
+{
+    if (count <= node->id_capacity)
+    {
+        return true;
+    }
+    size_t new_capacity = (node->id_capacity == 0) ? 1 : node->id_capacity * CMS_GROWTH_FACTOR;
+    while (new_capacity < count)
+    {
+        new_capacity *= CMS_GROWTH_FACTOR;
+    }
+    int *new_ids = cms_realloc(CMS_MEM_INDEXES, node->ids, new_capacity * sizeof(int));
+    if (new_ids == NULL)
+    {
+        return false;
+    }
+    node->ids = new_ids;
+    node->id_capacity = new_capacity;
+    return true;
+}
+
+/* Grows one of the bulk-mode queues by a slot; false if out of memory */
+static bool cms_bktree_queue_reserve(void **items, size_t *capacity, size_t count, size_t item_size)
+{
+    if (count < *capacity)
+    {
+        return true;
+    }
+    size_t new_capacity = (*capacity == 0) ? CMS_INITIAL_CAPACITY : *capacity * CMS_GROWTH_FACTOR;
+    void *grown = cms_realloc(CMS_MEM_TEMP, *items, new_capacity * item_size);
+    if (grown == NULL)
+    {
+        return false;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool cms_bknode_add_id(CmsBkTree *tree, uint32_t index, int id)
+{
+    CmsBkNode *node = &tree->nodes[index];
+    if (tree->bulk)
+    {
+        /* Appended as is: the caller vouches the ID is not in the tree, and
+           the node is sorted once when bulk mode settles */
+        if (!node->unsorted)
+        {
+            if (!cms_bktree_queue_reserve((void **)&tree->unsorted, &tree->unsorted_capacity,
+                                          tree->unsorted_count, sizeof(uint32_t)))
+            {
+                return false;
+            }
+            tree->unsorted[tree->unsorted_count++] = index;
+            node->unsorted = true;
+        }
+    }
+    else
+    {
+        size_t at = cms_bknode_find(node, id);
+        if (at < node->id_count && node->ids[at] == id)
+        {
+            return true;
+        }
+        if (!cms_bknode_reserve(node, node->id_count + 1))
+        {
+            return false;
+        }
+        memmove(&node->ids[at + 1], &node->ids[at], (node->id_count - at) * sizeof(int));
+        node->ids[at] = id;
+        tree->empty_nodes -= (node->id_count == 0);
+        node->id_count++;
+        return true;
+    }
+
+    if (!cms_bknode_reserve(node, node->id_count + 1))
+    {
+        return false;
+    }
+    tree->empty_nodes -= (node->id_count == 0);
+    node->ids[node->id_count++] = id;
+    return true;
+}
+
+static void cms_bknode_remove_id(CmsBkTree *tree, uint32_t index, int id)
+{
+    if (tree->bulk)
+    {
+        if (!cms_bktree_queue_reserve((void **)&tree->removals, &tree->removal_capacity, tree->removal_count,
+                                      sizeof(CmsBkRemoval)))
+        {
+            tree->bulk_failed = true;
+            return;
+        }
+        tree->removals[tree->removal_count].node = index;
+        tree->removals[tree->removal_count].id = id;
+        tree->removal_count++;
+        return;
+    }
+
+    CmsBkNode *node = &tree->nodes[index];
+    size_t at = cms_bknode_find(node, id);
+    if (at < node->id_count && node->ids[at] == id)
+    {
+        memmove(&node->ids[at], &node->ids[at + 1], (node->id_count - at - 1) * sizeof(int));
+        node->id_count--;
+        tree->empty_nodes += (node->id_count == 0);
+    }
+}
+
+/* Sorts every node appended to, then drops the queued removes: one sort
+   and one merge pass per node, however many of its IDs changed */
+static void cms_bktree_settle(CmsBkTree *tree)
+{
+    for (size_t i = 0; i < tree->unsorted_count; ++i)
+    {
+        CmsBkNode *node = &tree->nodes[tree->unsorted[i]];
+        node->unsorted = false;
+        qsort(node->ids, node->id_count, sizeof(int), cms_compare_id);
+        size_t unique = (node->id_count > 0) ? 1 : 0;
+        for (size_t j = 1; j < node->id_count; ++j)
+        {
+            if (node->ids[j] != node->ids[unique - 1])
+            {
+                node->ids[unique++] = node->ids[j];
+            }
+        }
+        node->id_count = unique;
+    }
+    tree->unsorted_count = 0;
+
+    if (tree->removal_count > 1)
+    {
+        qsort(tree->removals, tree->removal_count, sizeof(CmsBkRemoval), cms_compare_removal);
+    }
+    for (size_t first = 0; first < tree->removal_count;)
+    {
+        CmsBkNode *node = &tree->nodes[tree->removals[first].node];
+        size_t end = first;
+        while (end < tree->removal_count && tree->removals[end].node == tree->removals[first].node)
+        {
+            end++;
+        }
+
+        /* Both lists ascend: keep the node's IDs the queue does not name */
+        size_t kept = 0;
+        size_t next = first;
+        for (size_t j = 0; j < node->id_count; ++j)
+        {
+            while (next < end && tree->removals[next].id < node->ids[j])
+            {
+                next++;
+            }
+            if (next == end || tree->removals[next].id != node->ids[j])
+            {
+                node->ids[kept++] = node->ids[j];
+            }
+        }
+        tree->empty_nodes += (node->id_count > 0 && kept == 0);
+        node->id_count = kept;
+        first = end;
+    }
+    tree->removal_count = 0;
+}
+
+void cms_bktree_begin_bulk(CmsBkTree *tree)
+{
+    if (tree != NULL)
+    {
+        tree->bulk = true;
+        tree->bulk_failed = false;
+    }
+}
+
+bool cms_bktree_end_bulk(CmsBkTree *tree)
+{
+    if (tree == NULL || !tree->bulk)
+    {
+        return tree != NULL;
+    }
+    cms_bktree_settle(tree);
+    tree->bulk = false;
+    cms_free(tree->unsorted);
+    cms_free(tree->removals);
+    cms_free(tree->seen);
+    tree->unsorted = NULL;
+    tree->removals = NULL;
+    tree->seen = NULL;
+    tree->unsorted_capacity = 0;
+    tree->removal_capacity = 0;
+    tree->seen_count = 0;
+    tree->seen_capacity = 0;
+    return !tree->bulk_failed;
+}
+
+static uint32_t cms_bktree_new_node(CmsBkTree *tree, const char *key, uint8_t edge)
+{
+    if (tree->node_count == tree->node_capacity)
+    {
+        size_t new_capacity = (tree->node_capacity == 0) ? CMS_INITIAL_CAPACITY
+                                                         : tree->node_capacity * CMS_GROWTH_FACTOR;
+        CmsBkNode *new_nodes = cms_realloc(CMS_MEM_STRINGS, tree->nodes, new_capacity * sizeof(CmsBkNode));
+        if (new_nodes == NULL)
+        {
+            return CMS_BKTREE_NONE;
+        }
+        tree->nodes = new_nodes;
+        tree->node_capacity = new_capacity;
+    }
+
+    uint32_t index = (uint32_t)tree->node_count++;
+    CmsBkNode *node = &tree->nodes[index];
+    memset(node, 0, sizeof(CmsBkNode));
+    strcpy(node->key, key);
+    node->first_child = CMS_BKTREE_NONE;
+    node->next_sibling = CMS_BKTREE_NONE;
+    node->edge = edge;
+    tree->empty_nodes++;
+    return index;
+}
+
+static uint32_t cms_bktree_child_at(const CmsBkTree *tree, uint32_t parent, int edge)
+{
+    uint32_t child = tree->nodes[parent].first_child;
+    while (child != CMS_BKTREE_NONE && tree->nodes[child].edge != edge)
+    {
+        child = tree->nodes[child].next_sibling;
+    }
+    return child;
+}
+
+static uint32_t cms_bktree_hash_key(const char *key)
+{
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (; *key != '\0'; ++key)
+    {
+        hash = (hash ^ (unsigned char)*key) * 16777619u;
+    }
+    return hash;
+}
+
+/* Bulk mode remembers the node of every name it has looked up, so rows
+   sharing a name walk the tree once between them */
+static uint32_t cms_bktree_seen_find(const CmsBkTree *tree, const char *key)
+{
+    if (tree->seen_capacity == 0)
+    {
+        return CMS_BKTREE_NONE;
+    }
+    size_t mask = tree->seen_capacity - 1;
+    for (size_t i = cms_bktree_hash_key(key) & mask; tree->seen[i] != CMS_BKTREE_NONE; i = (i + 1) & mask)
+    {
+        if (strcmp(tree->nodes[tree->seen[i]].key, key) == 0)
+        {
+            return tree->seen[i];
+        }
+    }
+    return CMS_BKTREE_NONE;
+}
+
+/* A name the table cannot take is simply looked up again next time */
+static void cms_bktree_seen_put(CmsBkTree *tree, uint32_t node)
+{
+    if ((tree->seen_count + 1) * 2 > tree->seen_capacity)
+    {
+        size_t new_capacity = (tree->seen_capacity == 0) ? 1024 : tree->seen_capacity * 2;
+        uint32_t *grown = cms_malloc(CMS_MEM_TEMP, new_capacity * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            return;
+        }
+        memset(grown, 0xFF, new_capacity * sizeof(uint32_t));
+        for (size_t i = 0; i < tree->seen_capacity; ++i)
+        {
+            uint32_t seen = tree->seen[i];
+            if (seen == CMS_BKTREE_NONE)
+            {
+                continue;
+            }
+            size_t j = cms_bktree_hash_key(tree->nodes[seen].key) & (new_capacity - 1);
+            while (grown[j] != CMS_BKTREE_NONE)
+            {
+                j = (j + 1) & (new_capacity - 1);
+            }
+            grown[j] = seen;
+        }
+        cms_free(tree->seen);
+        tree->seen = grown;
+        tree->seen_capacity = new_capacity;
+    }
+
+    size_t mask = tree->seen_capacity - 1;
+    size_t i = cms_bktree_hash_key(tree->nodes[node].key) & mask;
+    while (tree->seen[i] != CMS_BKTREE_NONE)
+    {
+        i = (i + 1) & mask;
+    }
+    tree->seen[i] = node;
+    tree->seen_count++;
+}
+
+/* The node holding key; with create, a new one is linked in if there is
+   none. CMS_BKTREE_NONE if absent (or out of memory). */
+static uint32_t cms_bktree_locate(CmsBkTree *tree, const char *key, bool create)
+{
+    uint32_t found = tree->bulk ? cms_bktree_seen_find(tree, key) : CMS_BKTREE_NONE;
+    if (found != CMS_BKTREE_NONE)
+    {
+        return found;
+    }
+
+    if (tree->node_count == 0)
+    {
+        found = create ? cms_bktree_new_node(tree, key, 0) : CMS_BKTREE_NONE;
+    }
+    for (uint32_t current = 0; tree->node_count > 0 && found == CMS_BKTREE_NONE;)
+    {
+        int distance = cms_edit_distance_bounded(key, tree->nodes[current].key, CMS_BKTREE_EXACT_LIMIT);
+        if (distance == 0)
+        {
+            found = current;
+            break;
+        }
+
+        uint32_t child = cms_bktree_child_at(tree, current, distance);
+        if (child != CMS_BKTREE_NONE)
+        {
+            current = child;
+            continue;
+        }
+        if (!create)
+        {
+            break;
+        }
+
+        child = cms_bktree_new_node(tree, key, (uint8_t)distance);
+        if (child == CMS_BKTREE_NONE)
+        {
+            return CMS_BKTREE_NONE;
+        }
+        CmsBkNode *parent = &tree->nodes[current];
+        tree->nodes[child].next_sibling = parent->first_child;
+        parent->first_child = child;
+        if (distance > parent->max_child_edge)
+        {
+            parent->max_child_edge = (uint8_t)distance;
+        }
+        found = child;
+    }
+
+    if (found != CMS_BKTREE_NONE && tree->bulk)
+    {
+        cms_bktree_seen_put(tree, found);
+    }
+    return found;
+}
+
+bool cms_bktree_add(CmsBkTree *tree, const char *name, int id)
+{
+    if (tree == NULL || name == NULL)
+    {
+        return false;
+    }
+
+    char key[CMS_MAX_NAME_LEN + 1];
+    cms_bktree_make_key(name, key);
+
+    /* A remove queued in bulk mode must not take back an ID added after it */
+    if (tree->removal_count > 0)
+    {
+        cms_bktree_settle(tree);
+    }
+
+    uint32_t node = cms_bktree_locate(tree, key, true);
+    return node != CMS_BKTREE_NONE && cms_bknode_add_id(tree, node, id);
+}
+
+void cms_bktree_remove(CmsBkTree *tree, const char *name, int id)
+{
+    if (tree == NULL || name == NULL || tree->node_count == 0)
+    {
+        return;
+    }
+
+    char key[CMS_MAX_NAME_LEN + 1];
+    cms_bktree_make_key(name, key);
+
+    uint32_t node = cms_bktree_locate(tree, key, false);
+    if (node != CMS_BKTREE_NONE)
+    {
+        cms_bknode_remove_id(tree, node, id);
+    }
+}
+
+bool cms_bktree_needs_rebuild(const CmsBkTree *tree)
+{
+    return tree != NULL &&
+           tree->node_count >= CMS_BKTREE_REBUILD_MIN_NODES &&
+           tree->empty_nodes * 2 > tree->node_count;
+}
+
+/* Saved form: a u32 node count, then per node its key length (u8) and key,
+   first_child, next_sibling (u32), edge, max_child_edge (u8), id count
+   (u32) and the ids. Nodes keep their positions, so links need no fixing. */
+#define CMS_BKNODE_SAVED_FIXED (1 + 4 + 4 + 1 + 1 + 4)
+
+size_t cms_bktree_saved_size(const CmsBkTree *tree)
+{
+    size_t size = sizeof(uint32_t);
+    for (size_t i = 0; tree != NULL && i < tree->node_count; ++i)
+    {
+        const CmsBkNode *node = &tree->nodes[i];
+        size += CMS_BKNODE_SAVED_FIXED + strlen(node->key) + node->id_count * sizeof(int);
+    }
+    return size;
+}
+
+bool cms_bktree_save(const CmsBkTree *tree, FILE *fp)
+{
+    if (tree == NULL || fp == NULL || tree->node_count >= CMS_BKTREE_NONE)
+    {
+        return false;
+    }
+
+    uint32_t node_count = (uint32_t)tree->node_count;
+    if (fwrite(&node_count, sizeof(node_count), 1, fp) != 1)
+    {
+        return false;
+    }
+
+    unsigned char fixed[CMS_BKNODE_SAVED_FIXED + CMS_MAX_NAME_LEN];
+    for (size_t i = 0; i < tree->node_count; ++i)
+    {
+        const CmsBkNode *node = &tree->nodes[i];
+        uint8_t key_length = (uint8_t)strlen(node->key);
+        uint32_t id_count = (uint32_t)node->id_count;
+        unsigned char *out = fixed;
+
+        *out++ = key_length;
+        memcpy(out, node->key, key_length);
+        out += key_length;
+        memcpy(out, &node->first_child, 4);
+        memcpy(out + 4, &node->next_sibling, 4);
+        out[8] = node->edge;
+        out[9] = node->max_child_edge;
+        memcpy(out + 10, &id_count, 4);
+        out += 14;
+
+        size_t length = (size_t)(out - fixed);
+        if (fwrite(fixed, 1, length, fp) != length ||
+            fwrite(node->ids, sizeof(int), node->id_count, fp) != node->id_count)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A link must name a node other than the root that nothing else links to;
+   then every node is reached at most once and a search cannot loop */
+static bool cms_bktree_claim_link(uint32_t link, uint32_t node_count, unsigned char *linked)
+{
+    if (link == CMS_BKTREE_NONE)
+    {
+        return true;
+    }
+    if (link == 0 || link >= node_count || linked[link])
+    {
+        return false;
+    }
+    linked[link] = 1;
+    return true;
+}
+
+bool cms_bktree_restore(CmsBkTree *tree, const unsigned char *data, size_t size)
+{
+    if (tree == NULL || data == NULL)
+    {
+        return false;
+    }
+    cms_bktree_clear(tree);
+
+    uint32_t node_count = 0;
+    if (size < sizeof(node_count))
+    {
+        return false;
+    }
+    memcpy(&node_count, data, sizeof(node_count));
+    size_t at = sizeof(node_count);
+    if (node_count == CMS_BKTREE_NONE || node_count > (size - at) / CMS_BKNODE_SAVED_FIXED)
+    {
+        return false;
+    }
+
+    if (node_count > tree->node_capacity)
+    {
+        CmsBkNode *nodes = cms_realloc(CMS_MEM_STRINGS, tree->nodes, node_count * sizeof(CmsBkNode));
+        if (nodes == NULL)
+        {
+            return false;
+        }
+        tree->nodes = nodes;
+        tree->node_capacity = node_count;
+    }
+    unsigned char *linked = cms_calloc(CMS_MEM_TEMP, node_count + 1, 1);
+    if (linked == NULL)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < node_count; ++i)
+    {
+        CmsBkNode *node = &tree->nodes[i];
+        memset(node, 0, sizeof(*node));
+
+        size_t key_length = data[at];
+        ok = key_length <= CMS_MAX_NAME_LEN && size - at >= CMS_BKNODE_SAVED_FIXED + key_length;
+        if (!ok)
+        {
+            break;
+        }
+        const unsigned char *in = data + at + 1;
+        memcpy(node->key, in, key_length);
+        node->key[key_length] = '\0';
+        in += key_length;
+        memcpy(&node->first_child, in, 4);
+        memcpy(&node->next_sibling, in + 4, 4);
+        node->edge = in[8];
+        node->max_child_edge = in[9];
+        uint32_t id_count;
+        memcpy(&id_count, in + 10, 4);
+        at += CMS_BKNODE_SAVED_FIXED + key_length;
+        tree->node_count = i + 1;
+
+        ok = strlen(node->key) == key_length &&
+             cms_bktree_claim_link(node->first_child, node_count, linked) &&
+             cms_bktree_claim_link(node->next_sibling, node_count, linked) &&
+             id_count <= (size - at) / sizeof(int);
+        if (!ok)
+        {
+            break;
+        }
+
+        if (id_count > 0)
+        {
+            node->ids = cms_malloc(CMS_MEM_INDEXES, id_count * sizeof(int));
+            if (node->ids == NULL)
+            {
+                ok = false;
+                break;
+            }
+            memcpy(node->ids, data + at, id_count * sizeof(int));
+            at += id_count * sizeof(int);
+            /* Trees saved before IDs were kept in order */
+            for (uint32_t j = 1; j < id_count; ++j)
+            {
+                if (node->ids[j] < node->ids[j - 1])
+                {
+                    qsort(node->ids, id_count, sizeof(int), cms_compare_id);
+                    break;
+                }
+            }
+        }
+        node->id_count = id_count;
+        node->id_capacity = id_count;
+        tree->empty_nodes += (id_count == 0);
+    }
+    cms_free(linked);
+
+    if (!ok || at != size)
+    {
+        cms_bktree_clear(tree);
+        return false;
+    }
+    return true;
+}
+
+CMS_STATUS cms_bktree_search(const CmsBkTree *tree, const char *text, int max_distance,
+                             CmsFuzzyMatch **out, size_t *out_count)
+{
+    if (tree == NULL || text == NULL || out == NULL || out_count == NULL || max_distance < 0)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    *out = NULL;
+    *out_count = 0;
+    if (tree->node_count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    uint32_t *stack = cms_malloc(CMS_MEM_TEMP, tree->node_count * sizeof(uint32_t));
+    if (stack == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    CmsFuzzyMatch *matches = NULL;
+    size_t match_count = 0;
+    size_t match_capacity = 0;
+    size_t depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0)
+    {
+        const CmsBkNode *node = &tree->nodes[stack[--depth]];
+
+        /* Children sit at edge distances within [d - k, d + k]; when d exceeds
+           k + max_child_edge none qualify, so the exact value is not needed. */
+        int limit = max_distance + node->max_child_edge;
+        int distance = cms_edit_distance_bounded(text, node->key, limit);
+
+        if (distance <= max_distance)
+        {
+            for (size_t i = 0; i < node->id_count; ++i)
+            {
+                if (match_count == match_capacity)
+                {
+                    size_t new_capacity = (match_capacity == 0) ? CMS_INITIAL_CAPACITY
+                                                                : match_capacity * CMS_GROWTH_FACTOR;
+                    CmsFuzzyMatch *grown = cms_realloc(CMS_MEM_TEMP, matches, new_capacity * sizeof(CmsFuzzyMatch));
+                    if (grown == NULL)
+                    {
+                        cms_free(matches);
+                        cms_free(stack);
+                        return CMS_STATUS_ERROR;
+                    }
+                    matches = grown;
+                    match_capacity = new_capacity;
+                }
+                matches[match_count].id = node->ids[i];
+                matches[match_count].distance = distance;
+                match_count++;
+            }
+        }
+
+        if (distance > limit)
+        {
+            continue;
+        }
+
+        for (uint32_t child = node->first_child; child != CMS_BKTREE_NONE;
+             child = tree->nodes[child].next_sibling)
+        {
+            int edge = tree->nodes[child].edge;
+            if (edge >= distance - max_distance && edge <= distance + max_distance)
+            {
+                stack[depth++] = child;
+            }
+        }
+    }
+
+    cms_free(stack);
+    *out = matches;
+    *out_count = match_count;
+    return CMS_STATUS_OK;
+}
@@ -0,0 +1,2345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "../include/index.h"
+#include "../include/alloc.h"
+#include "../include/parallel.h"
+#include "../include/utils.h"
+
+#define CMS_ID_TABLE_MIN_CAPACITY 64
+#define CMS_TRIGRAM_TABLE_MIN_CAPACITY 1024
+#define CMS_MAX_NAME_TRIGRAMS (CMS_MAX_NAME_LEN)
+
+/* One slot of the ID hash table (open addressing, linear probing).
+   An id of 0 marks an empty slot; valid student IDs are 7 digits. */
+typedef struct
+{
+    int id;
+    size_t position;
+} CmsIdSlot;
+
+/* Posting list of one trigram: sorted, de-duplicated student IDs.
+   A key of 0 marks an empty slot; name bytes are never NUL. */
+typedef struct
+{
+    uint32_t key;
+    int *ids;
+    size_t count;
+    size_t capacity;
+} CmsPostingList;
+
+/* Members of one programme; programme names compare case-insensitively */
+typedef struct
+{
+    char name[CMS_MAX_PROGRAMME_LEN + 1];
+    CmsBitmap members;
+} CmsProgrammeBitmap;
+
+/* One entry of the mark index, ordered by mark then student ID */
+typedef struct
+{
+    float mark;
+    int id;
+} CmsMarkEntry;
+
+/* The mark index is a list of sorted blocks, so a change only shifts the
+   entries of one block instead of the whole index */
+#define CMS_MARK_BLOCK_SIZE 512
+#define CMS_MARK_BLOCK_FILL (CMS_MARK_BLOCK_SIZE * 3 / 4)
+
+typedef struct
+{
+    CmsMarkEntry *entries; /* CMS_MARK_BLOCK_SIZE slots; never empty */
+    size_t count;
+} CmsMarkBlock;
+
+struct CmsIndexSet
+{
+    CmsIdSlot *id_slots;
+    size_t id_capacity;
+    size_t id_count;
+
+    CmsPostingList *trigrams;
+    size_t trigram_capacity;
+    size_t trigram_count;
+
+    CmsBkTree *name_tree;
+
+    /* Facet bitmaps of student IDs, one per programme and per grade bucket */
+    CmsProgrammeBitmap *programmes;
+    size_t programme_count;
+    size_t programme_capacity;
+    CmsBitmap grades[CMS_GRADE_BUCKET_COUNT];
+
+    CmsMarkBlock *mark_blocks;
+    size_t mark_block_count;
+    size_t mark_block_capacity;
+    size_t mark_count;
+    /* Fenwick tree over the block counts (1-based, mark_block_capacity + 1
+       slots) so a rank finds its block in O(log blocks) */
+    size_t *mark_ranks;
+
+    /* Cleared when an allocation fails during maintenance; lookups then
+       fall back to scanning and the next mutation rebuilds everything. */
+    bool valid;
+};
+
+static size_t cms_hash_u32(uint32_t key, size_t mask)
+{
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return (size_t)key & mask;
+}
+
+/* ===== ID hash table ===== */
+
+static bool cms_id_table_insert_slot(CmsIdSlot *slots, size_t capacity, int id, size_t position)
+{
+    size_t mask = capacity - 1;
+    size_t i = cms_hash_u32((uint32_t)id, mask);
+    while (slots[i].id != 0)
+    {
+        if (slots[i].id == id)
+        {
+            slots[i].position = position;
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    slots[i].id = id;
+    slots[i].position = position;
+    return true;
+}
+
+static bool cms_id_table_reserve(CmsIndexSet *set, size_t count)
+{
+    if (count * 2 <= set->id_capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = (set->id_capacity == 0) ? CMS_ID_TABLE_MIN_CAPACITY : set->id_capacity;
+    while (new_capacity < count * 2)
+    {
+        new_capacity *= 2;
+    }
+
+    CmsIdSlot *new_slots = cms_calloc(CMS_MEM_INDEXES, new_capacity, sizeof(CmsIdSlot));
+    if (new_slots == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < set->id_capacity; ++i)
+    {
+        if (set->id_slots[i].id != 0)
+        {
+            cms_id_table_insert_slot(new_slots, new_capacity,
+                                     set->id_slots[i].id, set->id_slots[i].position);
+        }
+    }
+
+    cms_free(set->id_slots);
+    set->id_slots = new_slots;
+    set->id_capacity = new_capacity;
+    return true;
+}
+
+static bool cms_id_table_put(CmsIndexSet *set, int id, size_t position)
+{
+    if (!cms_id_table_reserve(set, set->id_count + 1))
+    {
+        return false;
+    }
+    if (cms_id_table_insert_slot(set->id_slots, set->id_capacity, id, position))
+    {
+        set->id_count++;
+    }
+    return true;
+}
+
+static bool cms_id_table_get(const CmsIndexSet *set, int id, size_t *out_position)
+{
+    if (set->id_capacity == 0)
+    {
+        return false;
+    }
+
+    size_t mask = set->id_capacity - 1;
+    size_t i = cms_hash_u32((uint32_t)id, mask);
+    while (set->id_slots[i].id != 0)
+    {
+        if (set->id_slots[i].id == id)
+        {
+            *out_position = set->id_slots[i].position;
+            return true;
+        }
+        i = (i + 1) & mask;
+    }
+    return false;
+}
+
+static void cms_id_table_remove(CmsIndexSet *set, int id)
+{
+    if (set->id_capacity == 0)
+    {
+        return;
+    }
+
+    size_t mask = set->id_capacity - 1;
+    size_t i = cms_hash_u32((uint32_t)id, mask);
+    while (set->id_slots[i].id != id)
+    {
+        if (set->id_slots[i].id == 0)
+        {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    /* Backward-shift deletion keeps probe chains intact without tombstones */
+    size_t j = i;
+    while (1)
+    {
+        j = (j + 1) & mask;
+        if (set->id_slots[j].id == 0)
+        {
+            break;
+        }
+        size_t home = cms_hash_u32((uint32_t)set->id_slots[j].id, mask);
+        bool home_between = (i <= j) ? (home > i && home <= j) : (home > i || home <= j);
+        if (!home_between)
+        {
+            set->id_slots[i] = set->id_slots[j];
+            i = j;
+        }
+    }
+    set->id_slots[i].id = 0;
+    set->id_slots[i].position = 0;
+    set->id_count--;
+}
+
+/* ===== Trigram posting lists ===== */
+
+static int cms_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cms_compare_int(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Collect the distinct lower-cased trigrams of a string; returns their count */
+static size_t cms_name_trigrams(const char *text, uint32_t *keys, size_t max_keys)
+{
+    size_t len = strlen(text);
+    size_t n = 0;
+    for (size_t i = 0; i + 2 < len && n < max_keys; ++i)
+    {
+        uint32_t a = (uint32_t)tolower((unsigned char)text[i]);
+        uint32_t b = (uint32_t)tolower((unsigned char)text[i + 1]);
+        uint32_t c = (uint32_t)tolower((unsigned char)text[i + 2]);
+        keys[n++] = (a << 16) | (b << 8) | c;
+    }
+
+    if (n < 2)
+    {
+        return n;
+    }
+
+    qsort(keys, n, sizeof(uint32_t), cms_compare_u32);
+    size_t unique = 1;
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (keys[i] != keys[unique - 1])
+        {
+            keys[unique++] = keys[i];
+        }
+    }
+    return unique;
+}
+
+static CmsPostingList *cms_trigram_lookup(const CmsIndexSet *set, uint32_t key)
+{
+    if (set->trigram_capacity == 0)
+    {
+        return NULL;
+    }
+
+    size_t mask = set->trigram_capacity - 1;
+    size_t i = cms_hash_u32(key, mask);
+    while (set->trigrams[i].key != 0)
+    {
+        if (set->trigrams[i].key == key)
+        {
+            return &set->trigrams[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static bool cms_trigram_table_reserve(CmsIndexSet *set, size_t count)
+{
+    if (count * 2 <= set->trigram_capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = (set->trigram_capacity == 0) ? CMS_TRIGRAM_TABLE_MIN_CAPACITY
+                                                       : set->trigram_capacity * 2;
+    while (new_capacity < count * 2)
+    {
+        new_capacity *= 2;
+    }
+
+    CmsPostingList *new_lists = cms_calloc(CMS_MEM_INDEXES, new_capacity, sizeof(CmsPostingList));
+    if (new_lists == NULL)
+    {
+        return false;
+    }
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < set->trigram_capacity; ++i)
+    {
+        if (set->trigrams[i].key == 0)
+        {
+            continue;
+        }
+        size_t j = cms_hash_u32(set->trigrams[i].key, mask);
+        while (new_lists[j].key != 0)
+        {
+            j = (j + 1) & mask;
+        }
+        new_lists[j] = set->trigrams[i];
+    }
+
+    cms_free(set->trigrams);
+    set->trigrams = new_lists;
+    set->trigram_capacity = new_capacity;
+    return true;
+}
+
+static CmsPostingList *cms_trigram_get_or_create(CmsIndexSet *set, uint32_t key)
+{
+    CmsPostingList *list = cms_trigram_lookup(set, key);
+    if (list != NULL)
+    {
+        return list;
+    }
+
+    if (!cms_trigram_table_reserve(set, set->trigram_count + 1))
+    {
+        return NULL;
+    }
+
+    size_t mask = set->trigram_capacity - 1;
+    size_t i = cms_hash_u32(key, mask);
+    while (set->trigrams[i].key != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    set->trigrams[i].key = key;
+    set->trigram_count++;
+    return &set->trigrams[i];
+}
+
+static bool cms_posting_reserve(CmsPostingList *list, size_t count)
+{
+    if (count <= list->capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = (list->capacity == 0) ? 4 : list->capacity * CMS_GROWTH_FACTOR;
+    while (new_capacity < count)
+    {
+        new_capacity *= CMS_GROWTH_FACTOR;
+    }
+
+    int *new_ids = cms_realloc(CMS_MEM_INDEXES, list->ids, new_capacity * sizeof(int));
+    if (new_ids == NULL)
+    {
+        return false;
+    }
+    list->ids = new_ids;
+    list->capacity = new_capacity;
+    return true;
+}
+
+/* Index of the first element >= id in ids[from..count) */
+static size_t cms_lower_bound(const int *ids, size_t from, size_t count, int id)
+{
+    size_t lo = from;
+    size_t hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool cms_posting_add(CmsPostingList *list, int id)
+{
+    size_t at = cms_lower_bound(list->ids, 0, list->count, id);
+    if (at < list->count && list->ids[at] == id)
+    {
+        return true;
+    }
+    if (!cms_posting_reserve(list, list->count + 1))
+    {
+        return false;
+    }
+    memmove(&list->ids[at + 1], &list->ids[at], (list->count - at) * sizeof(int));
+    list->ids[at] = id;
+    list->count++;
+    return true;
+}
+
+static void cms_posting_remove(CmsPostingList *list, int id)
+{
+    size_t at = cms_lower_bound(list->ids, 0, list->count, id);
+    if (at >= list->count || list->ids[at] != id)
+    {
+        return;
+    }
+    memmove(&list->ids[at], &list->ids[at + 1], (list->count - at - 1) * sizeof(int));
+    list->count--;
+}
+
+static bool cms_trigram_add_name(CmsIndexSet *set, const char *name, int id)
+{
+    uint32_t keys[CMS_MAX_NAME_TRIGRAMS];
+    size_t n = cms_name_trigrams(name, keys, CMS_MAX_NAME_TRIGRAMS);
+    for (size_t i = 0; i < n; ++i)
+    {
+        CmsPostingList *list = cms_trigram_get_or_create(set, keys[i]);
+        if (list == NULL || !cms_posting_add(list, id))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void cms_trigram_remove_name(CmsIndexSet *set, const char *name, int id)
+{
+    uint32_t keys[CMS_MAX_NAME_TRIGRAMS];
+    size_t n = cms_name_trigrams(name, keys, CMS_MAX_NAME_TRIGRAMS);
+    for (size_t i = 0; i < n; ++i)
+    {
+        CmsPostingList *list = cms_trigram_lookup(set, keys[i]);
+        if (list != NULL)
+        {
+            cms_posting_remove(list, id);
+        }
+    }
+}
+
+/* Changes to many rows at once visit each posting list once: the rows'
+   (trigram, ID) pairs are sorted, and each list is merged with its run of
+   pairs in one pass instead of shifting its tail once per row */
+typedef struct
+{
+    uint32_t key;
+    int id;
+} CmsTrigramPair;
+
+static int cms_compare_trigram_pair(const void *a, const void *b)
+{
+    const CmsTrigramPair *x = a;
+    const CmsTrigramPair *y = b;
+    if (x->key != y->key)
+    {
+        return (x->key > y->key) - (x->key < y->key);
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* Sorted pairs of records[rows[i]] (records[i] when rows is NULL); the caller frees them with cms_free */
+static CmsTrigramPair *cms_trigram_pairs(const StudentRecord *records, const size_t *rows, size_t count,
+                                         size_t *out_count)
+{
+    CmsTrigramPair *pairs = NULL;
+    size_t pair_count = 0;
+    size_t pair_capacity = 0;
+    uint32_t keys[CMS_MAX_NAME_TRIGRAMS];
+    for (size_t i = 0; i < count; ++i)
+    {
+        const StudentRecord *record = &records[(rows != NULL) ? rows[i] : i];
+        size_t n = cms_name_trigrams(record->name, keys, CMS_MAX_NAME_TRIGRAMS);
+        if (pair_count + n > pair_capacity)
+        {
+            size_t new_capacity = (pair_capacity == 0) ? CMS_INITIAL_CAPACITY : pair_capacity * CMS_GROWTH_FACTOR;
+            while (new_capacity < pair_count + n)
+            {
+                new_capacity *= CMS_GROWTH_FACTOR;
+            }
+            CmsTrigramPair *grown = cms_realloc(CMS_MEM_TEMP, pairs, new_capacity * sizeof(CmsTrigramPair));
+            if (grown == NULL)
+            {
+                cms_free(pairs);
+                return NULL;
+            }
+            pairs = grown;
+            pair_capacity = new_capacity;
+        }
+        for (size_t k = 0; k < n; ++k)
+        {
+            pairs[pair_count].key = keys[k];
+            pairs[pair_count].id = record->id;
+            pair_count++;
+        }
+    }
+
+    if (pair_count > 1)
+    {
+        qsort(pairs, pair_count, sizeof(CmsTrigramPair), cms_compare_trigram_pair);
+    }
+    *out_count = pair_count;
+    return pairs;
+}
+
+/* End of the run of pairs sharing pairs[first].key */
+static size_t cms_trigram_run_end(const CmsTrigramPair *pairs, size_t first, size_t count)
+{
+    size_t end = first;
+    while (end < count && pairs[end].key == pairs[first].key)
+    {
+        end++;
+    }
+    return end;
+}
+
+static bool cms_trigram_remove_names(CmsIndexSet *set, const StudentRecord *records, size_t count)
+{
+    size_t pair_count = 0;
+    CmsTrigramPair *pairs = cms_trigram_pairs(records, NULL, count, &pair_count);
+    if (pairs == NULL && count > 0)
+    {
+        return false;
+    }
+
+    for (size_t first = 0; first < pair_count;)
+    {
+        size_t end = cms_trigram_run_end(pairs, first, pair_count);
+        CmsPostingList *list = cms_trigram_lookup(set, pairs[first].key);
+        size_t kept = 0;
+        size_t next = first;
+        for (size_t j = 0; list != NULL && j < list->count; ++j)
+        {
+            while (next < end && pairs[next].id < list->ids[j])
+            {
+                next++;
+            }
+            if (next == end || pairs[next].id != list->ids[j])
+            {
+                list->ids[kept++] = list->ids[j];
+            }
+        }
+        if (list != NULL)
+        {
+            list->count = kept;
+        }
+        first = end;
+    }
+    cms_free(pairs);
+    return true;
+}
+
+static bool cms_trigram_add_names(CmsIndexSet *set, const StudentRecord *records, const size_t *rows,
+                                  size_t count)
+{
+    size_t pair_count = 0;
+    CmsTrigramPair *pairs = cms_trigram_pairs(records, rows, count, &pair_count);
+    if (pairs == NULL && count > 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t first = 0; ok && first < pair_count;)
+    {
+        size_t end = cms_trigram_run_end(pairs, first, pair_count);
+        CmsPostingList *list = cms_trigram_get_or_create(set, pairs[first].key);
+        ok = list != NULL && cms_posting_reserve(list, list->count + (end - first));
+        if (ok)
+        {
+            /* Merge from the back, then drop IDs the list already held */
+            size_t i = list->count;
+            size_t j = end;
+            size_t out = list->count + (end - first);
+            while (j > first)
+            {
+                if (i > 0 && list->ids[i - 1] > pairs[j - 1].id)
+                {
+                    list->ids[--out] = list->ids[--i];
+                }
+                else
+                {
+                    list->ids[--out] = pairs[--j].id;
+                }
+            }
+            size_t total = list->count + (end - first);
+            size_t unique = (total > 0) ? 1 : 0;
+            for (size_t k = 1; k < total; ++k)
+            {
+                if (list->ids[k] != list->ids[unique - 1])
+                {
+                    list->ids[unique++] = list->ids[k];
+                }
+            }
+            list->count = unique;
+        }
+        first = end;
+    }
+    cms_free(pairs);
+    return ok;
+}
+
+/* ===== Programme / grade bitmaps ===== */
+
+static CmsProgrammeBitmap *cms_programme_lookup(const CmsIndexSet *set, const char *programme)
+{
+    /* Programmes number in the tens, so a linear scan is cheapest */
+    for (size_t i = 0; i < set->programme_count; ++i)
+    {
+        if (cms_string_equals_ignore_case(set->programmes[i].name, programme))
+        {
+            return &set->programmes[i];
+        }
+    }
+    return NULL;
+}
+
+static CmsProgrammeBitmap *cms_programme_get_or_create(CmsIndexSet *set, const char *programme)
+{
+    CmsProgrammeBitmap *entry = cms_programme_lookup(set, programme);
+    if (entry != NULL)
+    {
+        return entry;
+    }
+
+    if (set->programme_count == set->programme_capacity)
+    {
+        size_t new_capacity = (set->programme_capacity == 0) ? 8 : set->programme_capacity * CMS_GROWTH_FACTOR;
+        CmsProgrammeBitmap *grown =
+            cms_realloc(CMS_MEM_INDEXES, set->programmes, new_capacity * sizeof(CmsProgrammeBitmap));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        set->programmes = grown;
+        set->programme_capacity = new_capacity;
+    }
+
+    entry = &set->programmes[set->programme_count++];
+    strncpy(entry->name, programme, CMS_MAX_PROGRAMME_LEN);
+    entry->name[CMS_MAX_PROGRAMME_LEN] = '\0';
+    cms_bitmap_init(&entry->members);
+    return entry;
+}
+
+static bool cms_facets_add(CmsIndexSet *set, const StudentRecord *record)
+{
+    CmsProgrammeBitmap *entry = cms_programme_get_or_create(set, record->programme);
+    CmsGradeBucket bucket = cms_grade_bucket_from_mark(record->mark);
+    return entry != NULL && cms_bitmap_add(&entry->members, (uint32_t)record->id) &&
+           cms_bitmap_add(&set->grades[bucket], (uint32_t)record->id);
+}
+
+static void cms_facets_remove(CmsIndexSet *set, const StudentRecord *record)
+{
+    CmsProgrammeBitmap *entry = cms_programme_lookup(set, record->programme);
+    if (entry != NULL)
+    {
+        cms_bitmap_remove(&entry->members, (uint32_t)record->id);
+    }
+    cms_bitmap_remove(&set->grades[cms_grade_bucket_from_mark(record->mark)], (uint32_t)record->id);
+}
+
+/* Bitmaps fill fastest in ascending ID order: every add then appends */
+static bool cms_facets_build(CmsIndexSet *set, const StudentDatabase *db)
+{
+    if (db->count == 0)
+    {
+        return true;
+    }
+
+    uint32_t *ids = cms_malloc(CMS_MEM_TEMP, db->count * sizeof(uint32_t));
+    if (ids == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        ids[i] = (uint32_t)db->records[i].id;
+    }
+    qsort(ids, db->count, sizeof(uint32_t), cms_compare_u32);
+
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        size_t position = 0;
+        if (cms_id_table_get(set, (int)ids[i], &position) &&
+            !cms_facets_add(set, &db->records[position]))
+        {
+            cms_free(ids);
+            return false;
+        }
+    }
+
+    cms_free(ids);
+    return true;
+}
+
+/* ===== Mark index ===== */
+
+static int cms_compare_mark_entry(const void *a, const void *b)
+{
+    const CmsMarkEntry *x = (const CmsMarkEntry *)a;
+    const CmsMarkEntry *y = (const CmsMarkEntry *)b;
+    if (x->mark != y->mark)
+    {
+        return (x->mark > y->mark) - (x->mark < y->mark);
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* Index of the first entry >= (mark, id) */
+static size_t cms_mark_lower_bound(const CmsMarkEntry *entries, size_t count, float mark, int id)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].mark < mark || (entries[mid].mark == mark && entries[mid].id < id))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Index of the first entry whose mark is >= mark (or > mark when after is set) */
+static size_t cms_mark_bound(const CmsMarkEntry *entries, size_t count, float mark, bool after)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].mark < mark || (after && entries[mid].mark == mark))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int cms_compare_mark_key(const CmsMarkEntry *entry, float mark, int id)
+{
+    if (entry->mark != mark)
+    {
+        return (entry->mark > mark) - (entry->mark < mark);
+    }
+    return (entry->id > id) - (entry->id < id);
+}
+
+/* First block whose last entry is >= (mark, id); mark_block_count if none */
+static size_t cms_mark_find_block(const CmsIndexSet *set, float mark, int id)
+{
+    size_t lo = 0;
+    size_t hi = set->mark_block_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const CmsMarkBlock *block = &set->mark_blocks[mid];
+        if (cms_compare_mark_key(&block->entries[block->count - 1], mark, id) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* First block whose last mark is >= mark (or > mark when after is set) */
+static size_t cms_mark_find_bound_block(const CmsIndexSet *set, float mark, bool after)
+{
+    size_t lo = 0;
+    size_t hi = set->mark_block_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const CmsMarkBlock *block = &set->mark_blocks[mid];
+        float last = block->entries[block->count - 1].mark;
+        if (last < mark || (after && last == mark))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Adds delta (which may wrap to subtract) to the running count of block at */
+static void cms_mark_ranks_add(CmsIndexSet *set, size_t at, size_t delta)
+{
+    for (size_t i = at + 1; i <= set->mark_block_count; i += i & (~i + 1))
+    {
+        set->mark_ranks[i] += delta;
+    }
+}
+
+/* Recomputes the running counts after blocks were opened, closed or refilled */
+static void cms_mark_ranks_rebuild(CmsIndexSet *set)
+{
+    size_t n = set->mark_block_count;
+    for (size_t i = 1; i <= n; ++i)
+    {
+        set->mark_ranks[i] = set->mark_blocks[i - 1].count;
+    }
+    for (size_t i = 1; i <= n; ++i)
+    {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= n)
+        {
+            set->mark_ranks[parent] += set->mark_ranks[i];
+        }
+    }
+}
+
+/* Block holding rank and the rank of that block's first entry */
+static size_t cms_mark_ranks_find(const CmsIndexSet *set, size_t rank, size_t *out_start)
+{
+    size_t n = set->mark_block_count;
+    size_t step = 1;
+    while (step <= n / 2)
+    {
+        step <<= 1;
+    }
+
+    size_t position = 0;
+    size_t remaining = rank;
+    for (; step > 0; step >>= 1)
+    {
+        if (position + step <= n && set->mark_ranks[position + step] <= remaining)
+        {
+            position += step;
+            remaining -= set->mark_ranks[position];
+        }
+    }
+    *out_start = rank - remaining;
+    return position;
+}
+
+/* Opens an empty block at position at in the block list. The caller
+   rebuilds the running counts once the block is filled. */
+static CmsMarkBlock *cms_mark_open_block(CmsIndexSet *set, size_t at)
+{
+    if (set->mark_block_count == set->mark_block_capacity)
+    {
+        size_t new_capacity = (set->mark_block_capacity == 0) ? CMS_INITIAL_CAPACITY
+                                                               : set->mark_block_capacity * CMS_GROWTH_FACTOR;
+        CmsMarkBlock *grown = cms_realloc(CMS_MEM_INDEXES, set->mark_blocks, new_capacity * sizeof(CmsMarkBlock));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        set->mark_blocks = grown;
+        size_t *ranks = cms_realloc(CMS_MEM_INDEXES, set->mark_ranks, (new_capacity + 1) * sizeof(size_t));
+        if (ranks == NULL)
+        {
+            return NULL;
+        }
+        set->mark_ranks = ranks;
+        set->mark_block_capacity = new_capacity;
+    }
+
+    CmsMarkEntry *entries = cms_malloc(CMS_MEM_INDEXES, CMS_MARK_BLOCK_SIZE * sizeof(CmsMarkEntry));
+    if (entries == NULL)
+    {
+        return NULL;
+    }
+
+    memmove(&set->mark_blocks[at + 1], &set->mark_blocks[at],
+            (set->mark_block_count - at) * sizeof(CmsMarkBlock));
+    set->mark_block_count++;
+    set->mark_blocks[at].entries = entries;
+    set->mark_blocks[at].count = 0;
+    return &set->mark_blocks[at];
+}
+
+static void cms_mark_close_block(CmsIndexSet *set, size_t at)
+{
+    cms_free(set->mark_blocks[at].entries);
+    memmove(&set->mark_blocks[at], &set->mark_blocks[at + 1],
+            (set->mark_block_count - at - 1) * sizeof(CmsMarkBlock));
+    set->mark_block_count--;
+}
+
+static void cms_mark_clear_blocks(CmsIndexSet *set)
+{
+    for (size_t i = 0; i < set->mark_block_count; ++i)
+    {
+        cms_free(set->mark_blocks[i].entries);
+    }
+    set->mark_block_count = 0;
+    set->mark_count = 0;
+}
+
+static bool cms_mark_insert(CmsIndexSet *set, float mark, int id)
+{
+    bool reshaped = (set->mark_block_count == 0);
+    if (reshaped && cms_mark_open_block(set, 0) == NULL)
+    {
+        return false;
+    }
+
+    /* The only empty block is a freshly opened first one */
+    size_t at = (set->mark_count == 0) ? 0 : cms_mark_find_block(set, mark, id);
+    if (at == set->mark_block_count)
+    {
+        at--; /* beyond every entry: append to the last block */
+    }
+
+    if (set->mark_blocks[at].count == CMS_MARK_BLOCK_SIZE)
+    {
+        /* Split a full block in half */
+        CmsMarkBlock *upper = cms_mark_open_block(set, at + 1);
+        if (upper == NULL)
+        {
+            return false;
+        }
+        CmsMarkBlock *lower = &set->mark_blocks[at];
+        size_t keep = CMS_MARK_BLOCK_SIZE / 2;
+        memcpy(upper->entries, lower->entries + keep, (CMS_MARK_BLOCK_SIZE - keep) * sizeof(CmsMarkEntry));
+        upper->count = CMS_MARK_BLOCK_SIZE - keep;
+        lower->count = keep;
+        if (cms_compare_mark_key(&lower->entries[keep - 1], mark, id) < 0)
+        {
+            at++;
+        }
+        reshaped = true;
+    }
+
+    CmsMarkBlock *block = &set->mark_blocks[at];
+    size_t slot = cms_mark_lower_bound(block->entries, block->count, mark, id);
+    memmove(&block->entries[slot + 1], &block->entries[slot], (block->count - slot) * sizeof(CmsMarkEntry));
+    block->entries[slot].mark = mark;
+    block->entries[slot].id = id;
+    block->count++;
+    set->mark_count++;
+    if (reshaped)
+    {
+        cms_mark_ranks_rebuild(set);
+    }
+    else
+    {
+        cms_mark_ranks_add(set, at, 1);
+    }
+    return true;
+}
+
+static void cms_mark_remove(CmsIndexSet *set, float mark, int id)
+{
+    size_t at = cms_mark_find_block(set, mark, id);
+    if (at == set->mark_block_count)
+    {
+        return;
+    }
+
+    CmsMarkBlock *block = &set->mark_blocks[at];
+    size_t slot = cms_mark_lower_bound(block->entries, block->count, mark, id);
+    if (slot >= block->count || cms_compare_mark_key(&block->entries[slot], mark, id) != 0)
+    {
+        return;
+    }
+
+    memmove(&block->entries[slot], &block->entries[slot + 1], (block->count - slot - 1) * sizeof(CmsMarkEntry));
+    block->count--;
+    set->mark_count--;
+
+    if (block->count == 0)
+    {
+        cms_mark_close_block(set, at);
+        cms_mark_ranks_rebuild(set);
+    }
+    else if (at + 1 < set->mark_block_count &&
+             block->count + set->mark_blocks[at + 1].count <= CMS_MARK_BLOCK_FILL)
+    {
+        /* Merge sparse neighbours so blocks stay reasonably full */
+        CmsMarkBlock *next = &set->mark_blocks[at + 1];
+        memcpy(block->entries + block->count, next->entries, next->count * sizeof(CmsMarkEntry));
+        block->count += next->count;
+        cms_mark_close_block(set, at + 1);
+        cms_mark_ranks_rebuild(set);
+    }
+    else
+    {
+        cms_mark_ranks_add(set, at, (size_t)-1);
+    }
+}
+
+/* Loads every record's mark into fresh, partly filled blocks */
+static bool cms_mark_build(CmsIndexSet *set, const StudentDatabase *db)
+{
+    cms_mark_clear_blocks(set);
+    if (db->count == 0)
+    {
+        return true;
+    }
+
+    CmsMarkEntry *sorted = cms_malloc(CMS_MEM_TEMP, db->count * sizeof(CmsMarkEntry));
+    if (sorted == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        sorted[i].mark = db->records[i].mark;
+        sorted[i].id = db->records[i].id;
+    }
+    qsort(sorted, db->count, sizeof(CmsMarkEntry), cms_compare_mark_entry);
+
+    for (size_t done = 0; done < db->count;)
+    {
+        CmsMarkBlock *block = cms_mark_open_block(set, set->mark_block_count);
+        if (block == NULL)
+        {
+            cms_free(sorted);
+            return false;
+        }
+        size_t take = db->count - done;
+        if (take > CMS_MARK_BLOCK_FILL)
+        {
+            take = CMS_MARK_BLOCK_FILL;
+        }
+        memcpy(block->entries, sorted + done, take * sizeof(CmsMarkEntry));
+        block->count = take;
+        done += take;
+    }
+    set->mark_count = db->count;
+    cms_mark_ranks_rebuild(set);
+    cms_free(sorted);
+    return true;
+}
+
+/* ===== Lifecycle ===== */
+
+CMS_STATUS cms_index_create(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsIndexSet *set = cms_calloc(CMS_MEM_INDEXES, 1, sizeof(CmsIndexSet));
+    if (set == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    set->name_tree = cms_bktree_create();
+    if (set->name_tree == NULL)
+    {
+        cms_free(set);
+        return CMS_STATUS_ERROR;
+    }
+
+    for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
+    {
+        cms_bitmap_init(&set->grades[i]);
+    }
+
+    set->valid = true;
+    db->indexes = set;
+    return CMS_STATUS_OK;
+}
+
+/* Everything but the ID table */
+static void cms_index_clear_secondary(CmsIndexSet *set)
+{
+    for (size_t i = 0; i < set->trigram_capacity; ++i)
+    {
+        cms_free(set->trigrams[i].ids);
+    }
+    cms_free(set->trigrams);
+    set->trigrams = NULL;
+    set->trigram_capacity = 0;
+    set->trigram_count = 0;
+
+    cms_bktree_clear(set->name_tree);
+
+    for (size_t i = 0; i < set->programme_count; ++i)
+    {
+        cms_bitmap_free(&set->programmes[i].members);
+    }
+    set->programme_count = 0;
+    for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
+    {
+        cms_bitmap_clear(&set->grades[i]);
+    }
+
+    cms_mark_clear_blocks(set);
+}
+
+void cms_index_clear(StudentDatabase *db)
+{
+    if (db == NULL || db->indexes == NULL)
+    {
+        return;
+    }
+
+    CmsIndexSet *set = db->indexes;
+    if (set->id_slots != NULL)
+    {
+        memset(set->id_slots, 0, set->id_capacity * sizeof(CmsIdSlot));
+    }
+    set->id_count = 0;
+
+    cms_index_clear_secondary(set);
+    set->valid = true;
+}
+
+void cms_index_destroy(StudentDatabase *db)
+{
+    if (db == NULL || db->indexes == NULL)
+    {
+        return;
+    }
+
+    cms_index_clear(db);
+    cms_free(db->indexes->id_slots);
+    cms_free(db->indexes->programmes);
+    cms_free(db->indexes->mark_blocks);
+    cms_free(db->indexes->mark_ranks);
+    for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
+    {
+        cms_bitmap_free(&db->indexes->grades[i]);
+    }
+    cms_bktree_destroy(db->indexes->name_tree);
+    cms_free(db->indexes);
+    db->indexes = NULL;
+}
+
+/* What each rebuild task reads and fills in */
+typedef struct
+{
+    CmsIndexSet *set;
+    const StudentDatabase *db;
+} CmsIndexBuild;
+
+/* Bulk build: append to posting lists, then sort each list once */
+static bool cms_trigrams_build(void *context)
+{
+    CmsIndexBuild *build = context;
+    CmsIndexSet *set = build->set;
+    const StudentDatabase *db = build->db;
+
+    uint32_t keys[CMS_MAX_NAME_TRIGRAMS];
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        const StudentRecord *record = &db->records[i];
+        size_t n = cms_name_trigrams(record->name, keys, CMS_MAX_NAME_TRIGRAMS);
+        for (size_t k = 0; k < n; ++k)
+        {
+            CmsPostingList *list = cms_trigram_get_or_create(set, keys[k]);
+            if (list == NULL || !cms_posting_reserve(list, list->count + 1))
+            {
+                return false;
+            }
+            list->ids[list->count++] = record->id;
+        }
+    }
+
+    for (size_t i = 0; i < set->trigram_capacity; ++i)
+    {
+        CmsPostingList *list = &set->trigrams[i];
+        if (list->key == 0 || list->count < 2)
+        {
+            continue;
+        }
+        qsort(list->ids, list->count, sizeof(int), cms_compare_int);
+        size_t unique = 1;
+        for (size_t j = 1; j < list->count; ++j)
+        {
+            if (list->ids[j] != list->ids[unique - 1])
+            {
+                list->ids[unique++] = list->ids[j];
+            }
+        }
+        list->count = unique;
+    }
+    return true;
+}
+
+/* Every row's name, appended in bulk: the ID table already holds each ID
+   once, so nodes need no duplicate check while they fill */
+static bool cms_name_tree_fill(CmsBkTree *tree, const StudentDatabase *db)
+{
+    cms_bktree_clear(tree);
+    cms_bktree_begin_bulk(tree);
+    bool ok = true;
+    for (size_t i = 0; ok && i < db->count; ++i)
+    {
+        ok = cms_bktree_add(tree, db->records[i].name, db->records[i].id);
+    }
+    return cms_bktree_end_bulk(tree) && ok;
+}
+
+static bool cms_name_tree_build(void *context)
+{
+    CmsIndexBuild *build = context;
+    return cms_name_tree_fill(build->set->name_tree, build->db);
+}
+
+static bool cms_facets_build_task(void *context)
+{
+    CmsIndexBuild *build = context;
+    return cms_facets_build(build->set, build->db);
+}
+
+static bool cms_mark_build_task(void *context)
+{
+    CmsIndexBuild *build = context;
+    return cms_mark_build(build->set, build->db);
+}
+
+/* Everything but the ID table, over rows whose IDs are already in it */
+static CMS_STATUS cms_index_build_secondary(StudentDatabase *db)
+{
+    /* The remaining indexes share nothing but the (read-only) records and
+       ID table, so with --threads they are built side by side. The BK-tree
+       is by far the slowest and goes first. */
+    CmsIndexSet *set = db->indexes;
+    CmsIndexBuild build = {set, db};
+    CmsTask tasks[] = {
+        {cms_name_tree_build, &build, false},
+        {cms_trigrams_build, &build, false},
+        {cms_facets_build_task, &build, false},
+        {cms_mark_build_task, &build, false}};
+    if (!cms_run_tasks(tasks, sizeof(tasks) / sizeof(tasks[0])))
+    {
+        set->valid = false;
+        return CMS_STATUS_ERROR;
+    }
+
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_index_rebuild(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (db->indexes == NULL)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    cms_index_clear(db);
+    CmsIndexSet *set = db->indexes;
+
+    if (!cms_id_table_reserve(set, db->count))
+    {
+        set->valid = false;
+        return CMS_STATUS_ERROR;
+    }
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (cms_id_table_insert_slot(set->id_slots, set->id_capacity, db->records[i].id, i))
+        {
+            set->id_count++;
+        }
+    }
+
+    return cms_index_build_secondary(db);
+}
+
+CMS_STATUS cms_index_load_id(StudentDatabase *db, size_t index)
+{
+    if (db == NULL || index >= db->capacity)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (db->indexes == NULL)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    size_t position = 0;
+    int id = db->records[index].id;
+    if (cms_id_table_get(db->indexes, id, &position))
+    {
+        return CMS_STATUS_DUPLICATE;
+    }
+    return cms_id_table_put(db->indexes, id, index) ? CMS_STATUS_OK : CMS_STATUS_ERROR;
+}
+
+/* ===== Saved name indexes ===== */
+
+/* Saved form (native byte order): a u64 byte count and the BK-tree as
+   cms_bktree_save writes it, then a u32 list count and per non-empty
+   trigram list its key, id count (u32) and ids */
+CMS_STATUS cms_index_save_names(const StudentDatabase *db, FILE *fp)
+{
+    if (db == NULL || fp == NULL || db->indexes == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    const CmsIndexSet *set = db->indexes;
+    if (!set->valid)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    uint64_t tree_size = cms_bktree_saved_size(set->name_tree);
+    if (fwrite(&tree_size, sizeof(tree_size), 1, fp) != 1 || !cms_bktree_save(set->name_tree, fp))
+    {
+        return CMS_STATUS_IO;
+    }
+
+    uint32_t list_count = 0;
+    for (size_t i = 0; i < set->trigram_capacity; ++i)
+    {
+        list_count += (set->trigrams[i].key != 0 && set->trigrams[i].count > 0);
+    }
+    if (fwrite(&list_count, sizeof(list_count), 1, fp) != 1)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    for (size_t i = 0; i < set->trigram_capacity; ++i)
+    {
+        const CmsPostingList *list = &set->trigrams[i];
+        if (list->key == 0 || list->count == 0)
+        {
+            continue;
+        }
+        uint32_t fixed[2] = {list->key, (uint32_t)list->count};
+        if (fwrite(fixed, sizeof(fixed), 1, fp) != 1 ||
+            fwrite(list->ids, sizeof(int), list->count, fp) != list->count)
+        {
+            return CMS_STATUS_IO;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+/* What each restore task reads from the saved bytes */
+typedef struct
+{
+    CmsIndexSet *set;
+    const unsigned char *tree;
+    size_t tree_size;
+    const unsigned char *trigrams;
+    size_t trigram_size;
+} CmsIndexRestore;
+
+static bool cms_name_tree_restore(void *context)
+{
+    CmsIndexRestore *restore = context;
+    return cms_bktree_restore(restore->set->name_tree, restore->tree, restore->tree_size);
+}
+
+/* Lists go back in as saved: keys distinct, ids ascending and unique */
+static bool cms_trigrams_restore(void *context)
+{
+    CmsIndexRestore *restore = context;
+    CmsIndexSet *set = restore->set;
+    const unsigned char *data = restore->trigrams;
+    size_t size = restore->trigram_size;
+
+    uint32_t list_count = 0;
+    if (size < sizeof(list_count))
+    {
+        return false;
+    }
+    memcpy(&list_count, data, sizeof(list_count));
+    size_t at = sizeof(list_count);
+    if (list_count > (size - at) / (2 * sizeof(uint32_t)) || !cms_trigram_table_reserve(set, list_count))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < list_count; ++i)
+    {
+        uint32_t fixed[2];
+        if (size - at < sizeof(fixed))
+        {
+            return false;
+        }
+        memcpy(fixed, data + at, sizeof(fixed));
+        at += sizeof(fixed);
+
+        uint32_t key = fixed[0];
+        size_t count = fixed[1];
+        if (key == 0 || count == 0 || count > (size - at) / sizeof(int) || cms_trigram_lookup(set, key) != NULL)
+        {
+            return false;
+        }
+
+        CmsPostingList *list = cms_trigram_get_or_create(set, key);
+        if (list == NULL || (list->ids = cms_malloc(CMS_MEM_INDEXES, count * sizeof(int))) == NULL)
+        {
+            return false;
+        }
+        memcpy(list->ids, data + at, count * sizeof(int));
+        at += count * sizeof(int);
+        list->count = count;
+        list->capacity = count;
+
+        for (size_t j = 1; j < count; ++j)
+        {
+            if (list->ids[j - 1] >= list->ids[j])
+            {
+                return false;
+            }
+        }
+    }
+    return at == size;
+}
+
+/* The name indexes from saved bytes, the cheap rest built as usual */
+static bool cms_index_restore_secondary(StudentDatabase *db, const unsigned char *saved, size_t saved_size)
+{
+    uint64_t tree_size = 0;
+    if (saved_size < sizeof(tree_size))
+    {
+        return false;
+    }
+    memcpy(&tree_size, saved, sizeof(tree_size));
+    size_t rest = saved_size - sizeof(tree_size);
+    if (tree_size > rest)
+    {
+        return false;
+    }
+
+    CmsIndexSet *set = db->indexes;
+    CmsIndexBuild build = {set, db};
+    CmsIndexRestore restore = {set, saved + sizeof(tree_size), (size_t)tree_size,
+                               saved + sizeof(tree_size) + tree_size, rest - (size_t)tree_size};
+    CmsTask tasks[] = {
+        {cms_name_tree_restore, &restore, false},
+        {cms_trigrams_restore, &restore, false},
+        {cms_facets_build_task, &build, false},
+        {cms_mark_build_task, &build, false}};
+    if (!cms_run_tasks(tasks, sizeof(tasks) / sizeof(tasks[0])))
+    {
+        cms_index_clear_secondary(set);
+        return false;
+    }
+    return true;
+}
+
+CMS_STATUS cms_index_load_finish(StudentDatabase *db, const unsigned char *saved, size_t saved_size,
+                                 bool *out_restored)
+{
+    if (out_restored != NULL)
+    {
+        *out_restored = false;
+    }
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (db->indexes == NULL)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    /* Rows placed without load_id leave the ID table short: start over */
+    if (db->indexes->id_count != db->count)
+    {
+        return cms_index_rebuild(db);
+    }
+    if (saved != NULL && cms_index_restore_secondary(db, saved, saved_size))
+    {
+        if (out_restored != NULL)
+        {
+            *out_restored = true;
+        }
+        return CMS_STATUS_OK;
+    }
+    return cms_index_build_secondary(db);
+}
+
+/* ===== Incremental maintenance ===== */
+
+/* Deletes leave empty BK-tree nodes behind; rebuild the tree once they dominate */
+static bool cms_index_compact_name_tree(CmsIndexSet *set, const StudentDatabase *db)
+{
+    if (!cms_bktree_needs_rebuild(set->name_tree))
+    {
+        return true;
+    }
+    return cms_name_tree_fill(set->name_tree, db);
+}
+
+/* Returns true when the caller should apply its incremental change. A stale
+   set is rebuilt from db->records instead, which already holds the change. */
+static bool cms_index_ready(StudentDatabase *db)
+{
+    if (db == NULL || db->indexes == NULL)
+    {
+        return false;
+    }
+    if (!db->indexes->valid)
+    {
+        cms_index_rebuild(db);
+        return false;
+    }
+    return true;
+}
+
+static bool cms_index_refresh_positions(CmsIndexSet *set, const StudentDatabase *db, size_t from)
+{
+    for (size_t i = from; i < db->count; ++i)
+    {
+        if (!cms_id_table_put(set, db->records[i].id, i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void cms_index_on_insert(StudentDatabase *db, size_t index)
+{
+    if (!cms_index_ready(db) || index >= db->count)
+    {
+        return;
+    }
+
+    CmsIndexSet *set = db->indexes;
+    const StudentRecord *record = &db->records[index];
+    if (!cms_index_refresh_positions(set, db, index) ||
+        !cms_trigram_add_name(set, record->name, record->id) ||
+        !cms_bktree_add(set->name_tree, record->name, record->id) ||
+        !cms_facets_add(set, record) ||
+        !cms_mark_insert(set, record->mark, record->id))
+    {
+        set->valid = false;
+    }
+}
+
+void cms_index_on_update(StudentDatabase *db, size_t index, const StudentRecord *before)
+{
+    if (!cms_index_ready(db) || index >= db->count || before == NULL)
+    {
+        return;
+    }
+
+    CmsIndexSet *set = db->indexes;
+    const StudentRecord *record = &db->records[index];
+    if (before->id != record->id)
+    {
+        cms_id_table_remove(set, before->id);
+        if (!cms_id_table_put(set, record->id, index))
+        {
+            set->valid = false;
+            return;
+        }
+    }
+
+    if (before->id != record->id || !cms_string_equals_ignore_case(before->name, record->name))
+    {
+        cms_trigram_remove_name(set, before->name, before->id);
+        cms_bktree_remove(set->name_tree, before->name, before->id);
+        if (!cms_trigram_add_name(set, record->name, record->id) ||
+            !cms_bktree_add(set->name_tree, record->name, record->id))
+        {
+            set->valid = false;
+            return;
+        }
+    }
+
+    if (before->id != record->id ||
+        !cms_string_equals_ignore_case(before->programme, record->programme) ||
+        cms_grade_bucket_from_mark(before->mark) != cms_grade_bucket_from_mark(record->mark))
+    {
+        cms_facets_remove(set, before);
+        if (!cms_facets_add(set, record))
+        {
+            set->valid = false;
+            return;
+        }
+    }
+
+    if (before->id != record->id || before->mark != record->mark)
+    {
+        cms_mark_remove(set, before->mark, before->id);
+        if (!cms_mark_insert(set, record->mark, record->id))
+        {
+            set->valid = false;
+        }
+    }
+}
+
+void cms_index_on_delete(StudentDatabase *db, size_t index, const StudentRecord *removed)
+{
+    if (!cms_index_ready(db) || removed == NULL)
+    {
+        return;
+    }
+
+    CmsIndexSet *set = db->indexes;
+    cms_id_table_remove(set, removed->id);
+    cms_trigram_remove_name(set, removed->name, removed->id);
+    cms_bktree_remove(set->name_tree, removed->name, removed->id);
+    cms_facets_remove(set, removed);
+    cms_mark_remove(set, removed->mark, removed->id);
+    if (!cms_index_refresh_positions(set, db, index) ||
+        !cms_index_compact_name_tree(set, db))
+    {
+        set->valid = false;
+    }
+}
+
+void cms_index_on_bulk_change(StudentDatabase *db, const StudentRecord *removed, size_t removed_count,
+                              const size_t *placed, size_t placed_count, size_t from)
+{
+    if (!cms_index_ready(db))
+    {
+        return;
+    }
+
+    /* Name indexes take the whole change at once: posting lists are merged
+       with their run of removed or added IDs, and the BK-tree settles each
+       name once, so many rows sharing a name or trigram cost no more than
+       a rebuild. Facets and marks stay per row: a bitmap container or mark
+       block bounds the work of each. */
+    CmsIndexSet *set = db->indexes;
+    bool ok = cms_trigram_remove_names(set, removed, removed_count);
+    cms_bktree_begin_bulk(set->name_tree);
+    for (size_t i = 0; i < removed_count; ++i)
+    {
+        cms_id_table_remove(set, removed[i].id);
+        cms_bktree_remove(set->name_tree, removed[i].name, removed[i].id);
+        cms_facets_remove(set, &removed[i]);
+        cms_mark_remove(set, removed[i].mark, removed[i].id);
+    }
+    ok = ok && cms_index_refresh_positions(set, db, from) &&
+         cms_trigram_add_names(set, db->records, placed, placed_count);
+    for (size_t i = 0; ok && i < placed_count; ++i)
+    {
+        const StudentRecord *record = &db->records[placed[i]];
+        ok = cms_id_table_put(set, record->id, placed[i]) &&
+             cms_bktree_add(set->name_tree, record->name, record->id) &&
+             cms_facets_add(set, record) &&
+             cms_mark_insert(set, record->mark, record->id);
+    }
+    ok = cms_bktree_end_bulk(set->name_tree) && ok;
+    if (!ok || (removed_count > 0 && !cms_index_compact_name_tree(set, db)))
+    {
+        set->valid = false;
+    }
+}
+
+void cms_index_on_reorder(StudentDatabase *db)
+{
+    if (!cms_index_ready(db))
+    {
+        return;
+    }
+
+    if (!cms_index_refresh_positions(db->indexes, db, 0))
+    {
+        db->indexes->valid = false;
+    }
+}
+
+/* ===== Lookups ===== */
+
+bool cms_index_has_ids(const StudentDatabase *db)
+{
+    return db != NULL && db->indexes != NULL && db->indexes->valid;
+}
+
+bool cms_index_find_id(const StudentDatabase *db, int student_id, size_t *out_index)
+{
+    if (db == NULL || db->records == NULL || db->count == 0)
+    {
+        return false;
+    }
+
+    size_t position = 0;
+    if (db->indexes != NULL && db->indexes->valid)
+    {
+        if (!cms_id_table_get(db->indexes, student_id, &position) || position >= db->count)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        for (position = 0; position < db->count; ++position)
+        {
+            if (db->records[position].id == student_id)
+            {
+                break;
+            }
+        }
+        if (position == db->count)
+        {
+            return false;
+        }
+    }
+
+    if (out_index != NULL)
+    {
+        *out_index = position;
+    }
+    return true;
+}
+
+static bool cms_name_matches(const char *name, const char *text, bool prefix_only)
+{
+    return prefix_only ? cms_string_starts_with_ignore_case(name, text)
+                       : cms_string_contains_ignore_case(name, text);
+}
+
+static int cms_compare_posting_size(const void *a, const void *b)
+{
+    const CmsPostingList *x = *(const CmsPostingList *const *)a;
+    const CmsPostingList *y = *(const CmsPostingList *const *)b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+/* Galloping search: first index >= id in ids[from..count) */
+static size_t cms_gallop(const int *ids, size_t from, size_t count, int id)
+{
+    size_t step = 1;
+    size_t hi = from;
+    while (hi < count && ids[hi] < id)
+    {
+        from = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > count)
+    {
+        hi = count;
+    }
+    return cms_lower_bound(ids, from, hi, id);
+}
+
+static CMS_STATUS cms_index_scan_names(const StudentDatabase *db, const char *text, bool prefix_only,
+                                       int **out_ids, size_t *out_count)
+{
+    int *ids = cms_malloc(CMS_MEM_TEMP, (db->count > 0 ? db->count : 1) * sizeof(int));
+    if (ids == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t matches = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (cms_name_matches(db->records[i].name, text, prefix_only))
+        {
+            ids[matches++] = db->records[i].id;
+        }
+    }
+    qsort(ids, matches, sizeof(int), cms_compare_int);
+
+    *out_ids = ids;
+    *out_count = matches;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_index_search_name(const StudentDatabase *db, const char *text, bool prefix_only,
+                                 int **out_ids, size_t *out_count)
+{
+    if (db == NULL || text == NULL || out_ids == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    *out_ids = NULL;
+    *out_count = 0;
+
+    if (text[0] == '\0')
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsIndexSet *set = db->indexes;
+    uint32_t keys[CMS_MAX_NAME_TRIGRAMS];
+    size_t key_count = 0;
+    if (strlen(text) <= CMS_MAX_NAME_LEN)
+    {
+        key_count = cms_name_trigrams(text, keys, CMS_MAX_NAME_TRIGRAMS);
+    }
+
+    /* Too short for a trigram (or no usable index): verify every name */
+    if (set == NULL || !set->valid || key_count == 0)
+    {
+        return cms_index_scan_names(db, text, prefix_only, out_ids, out_count);
+    }
+
+    const CmsPostingList *lists[CMS_MAX_NAME_TRIGRAMS];
+    for (size_t i = 0; i < key_count; ++i)
+    {
+        lists[i] = cms_trigram_lookup(set, keys[i]);
+        if (lists[i] == NULL || lists[i]->count == 0)
+        {
+            return CMS_STATUS_OK;
+        }
+    }
+
+    /* Intersect starting from the shortest posting list */
+    qsort(lists, key_count, sizeof(lists[0]), cms_compare_posting_size);
+
+    int *candidates = cms_malloc(CMS_MEM_TEMP, lists[0]->count * sizeof(int));
+    if (candidates == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    memcpy(candidates, lists[0]->ids, lists[0]->count * sizeof(int));
+    size_t candidate_count = lists[0]->count;
+
+    for (size_t l = 1; l < key_count && candidate_count > 0; ++l)
+    {
+        const CmsPostingList *list = lists[l];
+        size_t cursor = 0;
+        size_t kept = 0;
+        for (size_t c = 0; c < candidate_count && cursor < list->count; ++c)
+        {
+            cursor = cms_gallop(list->ids, cursor, list->count, candidates[c]);
+            if (cursor < list->count && list->ids[cursor] == candidates[c])
+            {
+                candidates[kept++] = candidates[c];
+            }
+        }
+        candidate_count = kept;
+    }
+
+    /* Trigrams only prove co-occurrence; check the actual name */
+    size_t matches = 0;
+    for (size_t c = 0; c < candidate_count; ++c)
+    {
+        size_t position = 0;
+        if (cms_id_table_get(set, candidates[c], &position) && position < db->count &&
+            cms_name_matches(db->records[position].name, text, prefix_only))
+        {
+            candidates[matches++] = candidates[c];
+        }
+    }
+
+    *out_ids = candidates;
+    *out_count = matches;
+    return CMS_STATUS_OK;
+}
+
+static int cms_compare_fuzzy_match(const void *a, const void *b)
+{
+    const CmsFuzzyMatch *x = (const CmsFuzzyMatch *)a;
+    const CmsFuzzyMatch *y = (const CmsFuzzyMatch *)b;
+    if (x->distance != y->distance)
+    {
+        return x->distance - y->distance;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static CMS_STATUS cms_index_scan_fuzzy(const StudentDatabase *db, const char *text, int max_distance,
+                                       CmsFuzzyMatch **out_matches, size_t *out_count)
+{
+    CmsFuzzyMatch *matches = cms_malloc(CMS_MEM_TEMP, (db->count > 0 ? db->count : 1) * sizeof(CmsFuzzyMatch));
+    if (matches == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        int distance = cms_edit_distance_bounded(text, db->records[i].name, max_distance);
+        if (distance <= max_distance)
+        {
+            matches[count].id = db->records[i].id;
+            matches[count].distance = distance;
+            count++;
+        }
+    }
+
+    *out_matches = matches;
+    *out_count = count;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_index_search_fuzzy(const StudentDatabase *db, const char *text, int max_distance,
+                                  CmsFuzzyMatch **out_matches, size_t *out_count)
+{
+    if (db == NULL || text == NULL || out_matches == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    *out_matches = NULL;
+    *out_count = 0;
+
+    if (text[0] == '\0' || max_distance < 0 || max_distance > CMS_FUZZY_MAX_DISTANCE)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    CMS_STATUS status;
+    if (db->indexes != NULL && db->indexes->valid)
+    {
+        status = cms_bktree_search(db->indexes->name_tree, text, max_distance, out_matches, out_count);
+    }
+    else
+    {
+        status = cms_index_scan_fuzzy(db, text, max_distance, out_matches, out_count);
+    }
+
+    if (status == CMS_STATUS_OK && *out_count > 1)
+    {
+        qsort(*out_matches, *out_count, sizeof(CmsFuzzyMatch), cms_compare_fuzzy_match);
+    }
+    return status;
+}
+
+/* ===== Programme / grade selection ===== */
+
+bool cms_selection_matches(const CmsSelection *selection, const StudentRecord *record)
+{
+    bool programme_ok = (selection->programme_count == 0);
+    for (size_t i = 0; i < selection->programme_count && !programme_ok; ++i)
+    {
+        programme_ok = cms_string_equals_ignore_case(record->programme, selection->programmes[i]);
+    }
+
+    bool grade_ok = (selection->grade_count == 0);
+    CmsGradeBucket bucket = cms_grade_bucket_from_mark(record->mark);
+    for (size_t i = 0; i < selection->grade_count && !grade_ok; ++i)
+    {
+        grade_ok = (selection->grades[i] == bucket);
+    }
+    return programme_ok && grade_ok;
+}
+
+/* Distinct bitmaps for each side of the selection. An unconstrained grade
+   side expands to every bucket; an unconstrained programme side yields 0. */
+static size_t cms_selection_programme_parts(const CmsIndexSet *set, const CmsSelection *selection,
+                                            const CmsBitmap **parts)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < selection->programme_count; ++i)
+    {
+        const CmsProgrammeBitmap *entry = cms_programme_lookup(set, selection->programmes[i]);
+        bool seen = (entry == NULL);
+        for (size_t j = 0; j < count && !seen; ++j)
+        {
+            seen = (parts[j] == &entry->members);
+        }
+        if (!seen)
+        {
+            parts[count++] = &entry->members;
+        }
+    }
+    return count;
+}
+
+static size_t cms_selection_grade_parts(const CmsIndexSet *set, const CmsSelection *selection,
+                                        const CmsBitmap **parts)
+{
+    bool wanted[CMS_GRADE_BUCKET_COUNT] = {false};
+    for (size_t i = 0; i < selection->grade_count; ++i)
+    {
+        if (selection->grades[i] >= 0 && selection->grades[i] < CMS_GRADE_BUCKET_COUNT)
+        {
+            wanted[selection->grades[i]] = true;
+        }
+    }
+
+    size_t count = 0;
+    for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
+    {
+        if (wanted[i] || selection->grade_count == 0)
+        {
+            parts[count++] = &set->grades[i];
+        }
+    }
+    return count;
+}
+
+static CMS_STATUS cms_bitmap_union(const CmsBitmap **parts, size_t count, CmsBitmap *out)
+{
+    cms_bitmap_clear(out);
+    CmsBitmap scratch;
+    cms_bitmap_init(&scratch);
+    for (size_t i = 0; i < count; ++i)
+    {
+        CMS_STATUS status = cms_bitmap_or(out, parts[i], &scratch);
+        if (status != CMS_STATUS_OK)
+        {
+            cms_bitmap_free(&scratch);
+            return status;
+        }
+        CmsBitmap swap = *out;
+        *out = scratch;
+        scratch = swap;
+    }
+    cms_bitmap_free(&scratch);
+    return CMS_STATUS_OK;
+}
+
+static bool cms_selection_valid(const CmsSelection *selection)
+{
+    return selection->programme_count <= CMS_MAX_SELECT_TERMS &&
+           selection->grade_count <= CMS_GRADE_BUCKET_COUNT;
+}
+
+CMS_STATUS cms_index_select(const StudentDatabase *db, const CmsSelection *selection, CmsBitmap *out_ids)
+{
+    if (db == NULL || selection == NULL || out_ids == NULL || !cms_selection_valid(selection))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    cms_bitmap_clear(out_ids);
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsIndexSet *set = db->indexes;
+    if (set == NULL || !set->valid)
+    {
+        for (size_t i = 0; i < db->count; ++i)
+        {
+            if (cms_selection_matches(selection, &db->records[i]) &&
+                !cms_bitmap_add(out_ids, (uint32_t)db->records[i].id))
+            {
+                return CMS_STATUS_ERROR;
+            }
+        }
+        return CMS_STATUS_OK;
+    }
+
+    const CmsBitmap *grade_parts[CMS_GRADE_BUCKET_COUNT];
+    size_t grade_count = cms_selection_grade_parts(set, selection, grade_parts);
+    if (selection->programme_count == 0)
+    {
+        return cms_bitmap_union(grade_parts, grade_count, out_ids);
+    }
+
+    const CmsBitmap *programme_parts[CMS_MAX_SELECT_TERMS];
+    size_t programme_count = cms_selection_programme_parts(set, selection, programme_parts);
+    if (programme_count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    if (selection->grade_count == 0)
+    {
+        return cms_bitmap_union(programme_parts, programme_count, out_ids);
+    }
+
+    CmsBitmap programmes;
+    CmsBitmap grades;
+    cms_bitmap_init(&programmes);
+    cms_bitmap_init(&grades);
+    CMS_STATUS status = cms_bitmap_union(programme_parts, programme_count, &programmes);
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_bitmap_union(grade_parts, grade_count, &grades);
+    }
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_bitmap_and(&programmes, &grades, out_ids);
+    }
+    cms_bitmap_free(&programmes);
+    cms_bitmap_free(&grades);
+    return status;
+}
+
+CMS_STATUS cms_index_count(const StudentDatabase *db, const CmsSelection *selection, size_t *out_count)
+{
+    if (db == NULL || selection == NULL || out_count == NULL || !cms_selection_valid(selection))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    *out_count = 0;
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsIndexSet *set = db->indexes;
+    if (set == NULL || !set->valid)
+    {
+        for (size_t i = 0; i < db->count; ++i)
+        {
+            if (cms_selection_matches(selection, &db->records[i]))
+            {
+                (*out_count)++;
+            }
+        }
+        return CMS_STATUS_OK;
+    }
+
+    /* A record has exactly one programme and one bucket, so the parts of
+       each side are disjoint and their counts simply add up */
+    const CmsBitmap *grade_parts[CMS_GRADE_BUCKET_COUNT];
+    size_t grade_count = cms_selection_grade_parts(set, selection, grade_parts);
+    if (selection->programme_count == 0)
+    {
+        for (size_t g = 0; g < grade_count; ++g)
+        {
+            *out_count += cms_bitmap_cardinality(grade_parts[g]);
+        }
+        return CMS_STATUS_OK;
+    }
+
+    const CmsBitmap *programme_parts[CMS_MAX_SELECT_TERMS];
+    size_t programme_count = cms_selection_programme_parts(set, selection, programme_parts);
+    for (size_t p = 0; p < programme_count; ++p)
+    {
+        if (selection->grade_count == 0)
+        {
+            *out_count += cms_bitmap_cardinality(programme_parts[p]);
+            continue;
+        }
+        for (size_t g = 0; g < grade_count; ++g)
+        {
+            *out_count += cms_bitmap_and_cardinality(programme_parts[p], grade_parts[g]);
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+/* ===== Mark range ===== */
+
+bool cms_mark_in_range(float mark, const CmsMarkRange *range)
+{
+    bool above = range->low_inclusive ? (mark >= range->low) : (mark > range->low);
+    bool below = range->high_inclusive ? (mark <= range->high) : (mark < range->high);
+    return above && below;
+}
+
+static CMS_STATUS cms_index_scan_marks(const StudentDatabase *db, const CmsMarkRange *range,
+                                       int **out_ids, size_t *out_count)
+{
+    CmsMarkEntry *entries = cms_malloc(CMS_MEM_TEMP, db->count * sizeof(CmsMarkEntry));
+    if (entries == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    size_t matches = 0;
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (cms_mark_in_range(db->records[i].mark, range))
+        {
+            entries[matches].mark = db->records[i].mark;
+            entries[matches].id = db->records[i].id;
+            matches++;
+        }
+    }
+    qsort(entries, matches, sizeof(CmsMarkEntry), cms_compare_mark_entry);
+
+    int *ids = cms_malloc(CMS_MEM_TEMP, (matches > 0 ? matches : 1) * sizeof(int));
+    if (ids == NULL)
+    {
+        cms_free(entries);
+        return CMS_STATUS_ERROR;
+    }
+    for (size_t i = 0; i < matches; ++i)
+    {
+        ids[i] = entries[i].id;
+    }
+    cms_free(entries);
+
+    *out_ids = ids;
+    *out_count = matches;
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_index_mark_range(const StudentDatabase *db, const CmsMarkRange *range,
+                                int **out_ids, size_t *out_count)
+{
+    if (db == NULL || range == NULL || out_ids == NULL || out_count == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    *out_ids = NULL;
+    *out_count = 0;
+
+    if (db->records == NULL || db->count == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsIndexSet *set = db->indexes;
+    if (set == NULL || !set->valid)
+    {
+        return cms_index_scan_marks(db, range, out_ids, out_count);
+    }
+
+    /* Binary searches over the blocks and then within one block find each
+       end of the run; copying it is O(k) */
+    bool low_after = !range->low_inclusive;
+    bool high_after = range->high_inclusive;
+    size_t first_block = cms_mark_find_bound_block(set, range->low, low_after);
+    size_t end_block = cms_mark_find_bound_block(set, range->high, high_after);
+    if (first_block == set->mark_block_count)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    const CmsMarkBlock *blocks = set->mark_blocks;
+    size_t first = cms_mark_bound(blocks[first_block].entries, blocks[first_block].count, range->low, low_after);
+    size_t end = (end_block == set->mark_block_count)
+                     ? 0
+                     : cms_mark_bound(blocks[end_block].entries, blocks[end_block].count, range->high, high_after);
+    if (end_block == set->mark_block_count)
+    {
+        /* The run reaches the last entry */
+        end_block = set->mark_block_count - 1;
+        end = blocks[end_block].count;
+    }
+    if (end_block < first_block || (end_block == first_block && end <= first))
+    {
+        return CMS_STATUS_OK;
+    }
+
+    size_t matches = 0;
+    for (size_t b = first_block; b <= end_block; ++b)
+    {
+        size_t from = (b == first_block) ? first : 0;
+        size_t to = (b == end_block) ? end : blocks[b].count;
+        matches += (to > from) ? to - from : 0;
+    }
+    if (matches == 0)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    int *ids = cms_malloc(CMS_MEM_TEMP, matches * sizeof(int));
+    if (ids == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    size_t written = 0;
+    for (size_t b = first_block; b <= end_block; ++b)
+    {
+        size_t from = (b == first_block) ? first : 0;
+        size_t to = (b == end_block) ? end : blocks[b].count;
+        for (size_t i = from; i < to; ++i)
+        {
+            ids[written++] = blocks[b].entries[i].id;
+        }
+    }
+
+    *out_ids = ids;
+    *out_count = matches;
+    return CMS_STATUS_OK;
+}
+
+bool cms_index_mark_at(const StudentDatabase *db, size_t rank, CmsMarkSeek *seek, int *out_id)
+{
+    if (db == NULL || db->indexes == NULL || !db->indexes->valid ||
+        db->indexes->mark_count != db->count || rank >= db->indexes->mark_count)
+    {
+        return false;
+    }
+
+    /* A sequential walk stays in or next to the block the caller found last
+       time; any other rank (an OFFSET jump) descends the running counts.
+       The hint lives with the caller so concurrent readers never write to
+       the index. */
+    const CmsIndexSet *set = db->indexes;
+    size_t block = 0;
+    size_t start = 0;
+    bool found = false;
+    if (seek != NULL && seek->block < set->mark_block_count && seek->rank < set->mark_count)
+    {
+        block = seek->block;
+        start = seek->rank;
+        size_t end = start + set->mark_blocks[block].count;
+        if (rank >= start && rank < end)
+        {
+            found = true;
+        }
+        else if (rank >= end && block + 1 < set->mark_block_count &&
+                 rank < end + set->mark_blocks[block + 1].count)
+        {
+            block++;
+            start = end;
+            found = true;
+        }
+        else if (rank < start && block > 0 && rank >= start - set->mark_blocks[block - 1].count)
+        {
+            block--;
+            start -= set->mark_blocks[block].count;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        block = cms_mark_ranks_find(set, rank, &start);
+    }
+    if (seek != NULL)
+    {
+        seek->block = block;
+        seek->rank = start;
+    }
+
+    if (out_id != NULL)
+    {
+        *out_id = set->mark_blocks[block].entries[rank - start].id;
+    }
+    return true;
+}
@@ -0,0 +1,471 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/journal.h"
+#include "../include/alloc.h"
+
+/* Entry layout, packed into the ring:
+       u16 length | u8 action (+ START flag) | u8 fields
+       varint index | varint zigzag ID | payload | u16 length
+   INSERT and DELETE carry the whole row; UPDATE carries the old and new
+   value of each changed field only. The length at both ends lets the
+   history be walked in either direction. */
+#define CMS_ENTRY_START 0x80u
+#define CMS_ENTRY_MAX (32 + 2 * (2 + CMS_MAX_NAME_LEN + CMS_MAX_PROGRAMME_LEN + 2 * sizeof(float)))
+#define CMS_RING_MIN_CAPACITY 4096u
+
+struct CmsJournal
+{
+    unsigned char *ring;
+    size_t capacity;
+    uint64_t tail;   /* offsets grow forever; the ring holds [tail, head) */
+    uint64_t cursor; /* end of the last applied entry; redo lies past it */
+    uint64_t head;
+    size_t undo_steps;
+    size_t redo_steps;
+    uint64_t position; /* steps applied, for finding the saved state */
+    uint64_t clean;
+    bool has_clean;
+    bool grouping;
+    bool group_started;
+    bool group_dropped; /* the open group did not fit; ignore the rest */
+    uint64_t group_start;
+};
+
+static void cms_ring_write(CmsJournal *journal, uint64_t at, const unsigned char *data, size_t length)
+{
+    size_t offset = (size_t)(at % journal->capacity);
+    size_t first = (length < journal->capacity - offset) ? length : journal->capacity - offset;
+    memcpy(journal->ring + offset, data, first);
+    memcpy(journal->ring, data + first, length - first);
+}
+
+static void cms_ring_read(const CmsJournal *journal, uint64_t at, unsigned char *data, size_t length)
+{
+    size_t offset = (size_t)(at % journal->capacity);
+    size_t first = (length < journal->capacity - offset) ? length : journal->capacity - offset;
+    memcpy(data, journal->ring + offset, first);
+    memcpy(data + first, journal->ring, length - first);
+}
+
+static size_t cms_ring_u16(const CmsJournal *journal, uint64_t at)
+{
+    unsigned char bytes[2];
+    cms_ring_read(journal, at, bytes, 2);
+    return (size_t)bytes[0] | ((size_t)bytes[1] << 8);
+}
+
+static bool cms_ring_starts_step(const CmsJournal *journal, uint64_t at)
+{
+    unsigned char flags = 0;
+    cms_ring_read(journal, at + 2, &flags, 1);
+    return (flags & CMS_ENTRY_START) != 0;
+}
+
+/* ===== Encoding ===== */
+
+static size_t cms_put_varint(unsigned char *out, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+static uint64_t cms_get_varint(const unsigned char *in, size_t *position)
+{
+    uint64_t value = 0;
+    unsigned shift = 0;
+    unsigned char byte = 0;
+    do
+    {
+        byte = in[(*position)++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while ((byte & 0x80) != 0 && shift < 64);
+    return value;
+}
+
+static size_t cms_put_text(unsigned char *out, const char *text, size_t max_length)
+{
+    const char *end = memchr(text, '\0', max_length);
+    size_t length = (end != NULL) ? (size_t)(end - text) : max_length;
+    out[0] = (unsigned char)length;
+    memcpy(out + 1, text, length);
+    return length + 1;
+}
+
+static size_t cms_get_text(const unsigned char *in, char *text)
+{
+    size_t length = in[0];
+    memcpy(text, in + 1, length);
+    text[length] = '\0';
+    return length + 1;
+}
+
+static size_t cms_encode_fields(unsigned char *out, const StudentRecord *record, unsigned fields)
+{
+    size_t length = 0;
+    if (fields & CMS_FIELD_NAME)
+    {
+        length += cms_put_text(out + length, record->name, CMS_MAX_NAME_LEN);
+    }
+    if (fields & CMS_FIELD_PROGRAMME)
+    {
+        length += cms_put_text(out + length, record->programme, CMS_MAX_PROGRAMME_LEN);
+    }
+    if (fields & CMS_FIELD_MARK)
+    {
+        memcpy(out + length, &record->mark, sizeof(float));
+        length += sizeof(float);
+    }
+    return length;
+}
+
+static size_t cms_decode_fields(const unsigned char *in, StudentRecord *record, unsigned fields)
+{
+    size_t length = 0;
+    if (fields & CMS_FIELD_NAME)
+    {
+        length += cms_get_text(in + length, record->name);
+    }
+    if (fields & CMS_FIELD_PROGRAMME)
+    {
+        length += cms_get_text(in + length, record->programme);
+    }
+    if (fields & CMS_FIELD_MARK)
+    {
+        memcpy(&record->mark, in + length, sizeof(float));
+        length += sizeof(float);
+    }
+    return length;
+}
+
+static size_t cms_encode_entry(const CmsJournalEntry *entry, bool starts_step, unsigned char *out)
+{
+    const unsigned all = CMS_FIELD_NAME | CMS_FIELD_PROGRAMME | CMS_FIELD_MARK;
+    const StudentRecord *row = (entry->action == CMS_JOURNAL_INSERT) ? &entry->after : &entry->before;
+    int id = row->id;
+
+    size_t length = 2;
+    out[length++] = (unsigned char)(entry->action | (starts_step ? CMS_ENTRY_START : 0));
+    out[length++] = (unsigned char)((entry->action == CMS_JOURNAL_UPDATE) ? (entry->fields & all) : all);
+    length += cms_put_varint(out + length, entry->index);
+    length += cms_put_varint(out + length, ((uint32_t)id << 1) ^ (uint32_t)(id >> 31));
+    if (entry->action == CMS_JOURNAL_UPDATE)
+    {
+        length += cms_encode_fields(out + length, &entry->before, entry->fields & all);
+        length += cms_encode_fields(out + length, &entry->after, entry->fields & all);
+    }
+    else
+    {
+        length += cms_encode_fields(out + length, row, all);
+    }
+
+    length += 2;
+    out[0] = out[length - 2] = (unsigned char)(length & 0xff);
+    out[1] = out[length - 1] = (unsigned char)(length >> 8);
+    return length;
+}
+
+static void cms_decode_entry(const unsigned char *in, CmsJournalEntry *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    size_t position = 2;
+    entry->action = (CmsJournalAction)(in[position++] & ~CMS_ENTRY_START);
+    entry->fields = in[position++];
+    entry->index = (size_t)cms_get_varint(in, &position);
+    uint32_t zigzag = (uint32_t)cms_get_varint(in, &position);
+    int id = (int)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+    entry->before.id = id;
+    entry->after.id = id;
+
+    StudentRecord *first = (entry->action == CMS_JOURNAL_INSERT) ? &entry->after : &entry->before;
+    position += cms_decode_fields(in + position, first, entry->fields);
+    if (entry->action == CMS_JOURNAL_UPDATE)
+    {
+        cms_decode_fields(in + position, &entry->after, entry->fields);
+    }
+}
+
+/* ===== Lifecycle ===== */
+
+CmsJournal *cms_journal_create(void)
+{
+    return cms_calloc(CMS_MEM_UNDO, 1, sizeof(CmsJournal));
+}
+
+void cms_journal_destroy(CmsJournal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    cms_free(journal->ring);
+    cms_free(journal);
+}
+
+static void cms_journal_forget(CmsJournal *journal)
+{
+    journal->tail = journal->cursor = journal->head = 0;
+    journal->undo_steps = 0;
+    journal->redo_steps = 0;
+    journal->has_clean = false;
+    journal->group_started = false;
+}
+
+void cms_journal_clear(CmsJournal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    cms_journal_forget(journal);
+    journal->position = 0;
+    journal->grouping = false;
+    journal->group_dropped = false;
+}
+
+/* Copies [tail, head) to the front of a larger ring */
+static bool cms_journal_grow(CmsJournal *journal, size_t capacity)
+{
+    unsigned char *ring = cms_malloc(CMS_MEM_UNDO, capacity);
+    if (ring == NULL)
+    {
+        return false;
+    }
+    uint64_t used = journal->head - journal->tail;
+    if (used > 0)
+    {
+        cms_ring_read(journal, journal->tail, ring, (size_t)used);
+    }
+    cms_free(journal->ring);
+    journal->ring = ring;
+    journal->capacity = capacity;
+    journal->cursor -= journal->tail;
+    journal->group_start -= journal->tail;
+    journal->head = used;
+    journal->tail = 0;
+    return true;
+}
+
+/* Drops the oldest step; false if that would cut into the open group */
+static bool cms_journal_evict(CmsJournal *journal)
+{
+    if (journal->tail == journal->head ||
+        (journal->grouping && journal->group_started && journal->tail == journal->group_start))
+    {
+        return false;
+    }
+    do
+    {
+        journal->tail += cms_ring_u16(journal, journal->tail);
+    } while (journal->tail < journal->head && !cms_ring_starts_step(journal, journal->tail));
+    journal->undo_steps--;
+    return true;
+}
+
+/* The change happened but cannot be undone, so neither can anything before it */
+static bool cms_journal_overflow(CmsJournal *journal)
+{
+    cms_journal_forget(journal);
+    journal->group_dropped = journal->grouping;
+    return false;
+}
+
+bool cms_journal_record(CmsJournal *journal, const CmsJournalEntry *entry, size_t limit)
+{
+    if (journal == NULL || entry == NULL)
+    {
+        return false;
+    }
+    if (journal->group_dropped)
+    {
+        return false;
+    }
+
+    unsigned char encoded[CMS_ENTRY_MAX];
+    bool starts_step = !journal->grouping || !journal->group_started;
+    size_t length = cms_encode_entry(entry, starts_step, encoded);
+    if (length > limit)
+    {
+        return cms_journal_overflow(journal);
+    }
+
+    if (journal->head != journal->cursor)
+    {
+        /* A new change makes the undone ones unreachable */
+        journal->head = journal->cursor;
+        journal->redo_steps = 0;
+        if (journal->has_clean && journal->clean > journal->position)
+        {
+            journal->has_clean = false;
+        }
+    }
+
+    /* The limit may have been lowered since the ring grew */
+    while (journal->head - journal->tail + length > ((journal->capacity < limit) ? journal->capacity : limit))
+    {
+        if (journal->capacity < limit)
+        {
+            size_t wanted = (size_t)(journal->head - journal->tail) + length;
+            size_t capacity = (journal->capacity < CMS_RING_MIN_CAPACITY / 2) ? CMS_RING_MIN_CAPACITY
+                                                                               : journal->capacity * 2;
+            capacity = (capacity < wanted) ? wanted : capacity;
+            capacity = (capacity > limit) ? limit : capacity;
+            if (!cms_journal_grow(journal, capacity))
+            {
+                return cms_journal_overflow(journal);
+            }
+        }
+        else if (!cms_journal_evict(journal))
+        {
+            return cms_journal_overflow(journal);
+        }
+    }
+
+    if (starts_step)
+    {
+        if (journal->grouping)
+        {
+            journal->group_started = true;
+            journal->group_start = journal->head;
+        }
+        journal->undo_steps++;
+        journal->position++;
+    }
+    cms_ring_write(journal, journal->head, encoded, length);
+    journal->head += length;
+    journal->cursor = journal->head;
+    return true;
+}
+
+void cms_journal_begin_group(CmsJournal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    journal->grouping = true;
+    journal->group_started = false;
+    journal->group_dropped = false;
+}
+
+void cms_journal_end_group(CmsJournal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    journal->grouping = false;
+    journal->group_started = false;
+    journal->group_dropped = false;
+}
+
+size_t cms_journal_undo_steps(const CmsJournal *journal)
+{
+    return (journal != NULL) ? journal->undo_steps : 0;
+}
+
+size_t cms_journal_redo_steps(const CmsJournal *journal)
+{
+    return (journal != NULL) ? journal->redo_steps : 0;
+}
+
+/* ===== Walking ===== */
+
+bool cms_journal_back(CmsJournal *journal, CmsJournalEntry *out_entry)
+{
+    if (journal == NULL || out_entry == NULL || journal->cursor == journal->tail)
+    {
+        return false;
+    }
+
+    unsigned char encoded[CMS_ENTRY_MAX];
+    size_t length = cms_ring_u16(journal, journal->cursor - 2);
+    journal->cursor -= length;
+    cms_ring_read(journal, journal->cursor, encoded, length);
+    cms_decode_entry(encoded, out_entry);
+    if (encoded[2] & CMS_ENTRY_START)
+    {
+        journal->undo_steps--;
+        journal->redo_steps++;
+        journal->position--;
+    }
+    return true;
+}
+
+bool cms_journal_forward(CmsJournal *journal, CmsJournalEntry *out_entry)
+{
+    if (journal == NULL || out_entry == NULL || journal->cursor == journal->head)
+    {
+        return false;
+    }
+
+    unsigned char encoded[CMS_ENTRY_MAX];
+    size_t length = cms_ring_u16(journal, journal->cursor);
+    cms_ring_read(journal, journal->cursor, encoded, length);
+    journal->cursor += length;
+    cms_decode_entry(encoded, out_entry);
+    if (encoded[2] & CMS_ENTRY_START)
+    {
+        journal->redo_steps--;
+        journal->undo_steps++;
+        journal->position++;
+    }
+    return true;
+}
+
+bool cms_journal_at_step(const CmsJournal *journal)
+{
+    return journal == NULL || journal->cursor == journal->head ||
+           cms_ring_starts_step(journal, journal->cursor);
+}
+
+void cms_journal_mark_clean(CmsJournal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    journal->clean = journal->position;
+    journal->has_clean = true;
+}
+
+bool cms_journal_is_clean(const CmsJournal *journal)
+{
+    return journal != NULL && journal->has_clean && journal->clean == journal->position;
+}
+
+bool cms_journal_since_clean(const CmsJournal *journal, CmsJournalVisit visit, void *context)
+{
+    if (journal == NULL || visit == NULL || !journal->has_clean)
+    {
+        return false;
+    }
+
+    /* A copy walks the ring; only its own offsets and counters move */
+    CmsJournal walker = *journal;
+    CmsJournalEntry entry;
+    while (walker.position > walker.clean)
+    {
+        if (!cms_journal_back(&walker, &entry))
+        {
+            return false;
+        }
+        visit(&entry, false, context);
+    }
+    while (walker.position < walker.clean || !cms_journal_at_step(&walker))
+    {
+        if (!cms_journal_forward(&walker, &entry))
+        {
+            return false;
+        }
+        visit(&entry, true, context);
+    }
+    return true;
+}
@@ -1,89 +1,435 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include "cms.h"
 #include "database.h"
 #include "commands.h"
 #include "utils.h"
+#include "render.h"
+#include "parallel.h"
+#include "server.h"
+#include "journal.h"
+#include "metrics.h"
+#include "alloc.h"
 
-int main(void)
+/* Everything the command line asks for, beyond the session options */
+typedef struct
 {
-    StudentDatabase db;
-    CMS_STATUS status;
+    CmsSessionOptions session;
+    const char *db_path;     /* --db: opened instead of the default database */
+    bool load_default;       /* cleared by --no-default-load */
+    const char *script;      /* -f: commands read from this file ("-" for stdin) */
+    char **commands;         /* -c: commands run in order, then the program exits */
+    size_t command_count;
+    const char *socket_path; /* --serve: answer clients on this UNIX socket */
+    unsigned threads;
+    CmsFileFormat format;    /* --format: how SAVE writes the database */
+    size_t undo_limit;       /* --undo-memory, in bytes */
+    const char *metrics_path; /* --metrics: commands are timed and the figures written here at exit */
+} LaunchOptions;
 
-    status = cms_database_init(&db);
-    if (status != CMS_STATUS_OK)
+static void print_usage(const char *program)
+{
+    printf("Usage: %s [options]\n", program);
+    printf("  --db <path>          Open <path> instead of %s\n", CMS_DEFAULT_DATABASE_FILE);
+    printf("  --no-default-load    Start without opening a database\n");
+    printf("  -c <command>         Run <command> and exit; repeat to run several in order\n");
+    printf("  -f <script>          Run the commands in <script> (- for standard input) and exit\n");
+    printf("  --serve <socket>     Keep the database loaded and serve clients on a UNIX socket\n");
+    printf("  --format text|binary Format SAVE writes (default: the format the file was read in)\n");
+    printf("  --threads <n>        Build indexes on up to <n> threads (default 1); --serve uses at least 4\n");
+    printf("  --undo-memory <MiB>  Memory kept for UNDO/REDO history (default %u, 0 disables undo)\n",
+           CMS_DEFAULT_UNDO_MEMORY >> 20);
+    printf("  --metrics <path>     Time every command (as TIMING ON) and write the figures to <path> as JSON at exit\n");
+    printf("  --lenient            Open files even with bad or repeated rows: skip them and list why\n");
+    printf("  -b, --batch          Read commands without prompts and print one status line per command\n");
+    printf("                       (the default when standard input is not a terminal)\n");
+    printf("  -i, --interactive    Prompt even when standard input is not a terminal\n");
+    printf("  -y, --yes            Answer yes to confirmations, including saving changes at exit\n");
+    printf("  -h, --help           Show this help\n");
+}
+
+/* Value of an option that takes one, or NULL (with a message) if it is missing */
+static const char *option_value(int argc, char *argv[], int *index)
+{
+    if (*index + 1 >= argc)
     {
-        fprintf(stderr, "Failed to initialize database\n");
+        fprintf(stderr, "Option %s needs a value\n", argv[*index]);
+        return NULL;
+    }
+    return argv[++*index];
+}
+
+/* Returns EXIT_SUCCESS to continue, or the exit code to stop with (-1 for --help) */
+static int parse_arguments(int argc, char *argv[], LaunchOptions *launch)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const char *value = NULL;
+        if (strcmp(arg, "-b") == 0 || strcmp(arg, "--batch") == 0)
+        {
+            launch->session.batch = true;
+        }
+        else if (strcmp(arg, "-i") == 0 || strcmp(arg, "--interactive") == 0)
+        {
+            launch->session.batch = false;
+        }
+        else if (strcmp(arg, "-y") == 0 || strcmp(arg, "--yes") == 0)
+        {
+            launch->session.assume_yes = true;
+        }
+        else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+        {
+            return -1;
+        }
+        else if (strcmp(arg, "--lenient") == 0)
+        {
+            launch->session.lenient = true;
+        }
+        else if (strcmp(arg, "--no-default-load") == 0)
+        {
+            launch->load_default = false;
+        }
+        else if (strcmp(arg, "--db") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            launch->db_path = value;
+        }
+        else if (strcmp(arg, "-c") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            launch->commands[launch->command_count++] = argv[i];
+        }
+        else if (strcmp(arg, "-f") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            launch->script = value;
+        }
+        else if (strcmp(arg, "--serve") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            launch->socket_path = value;
+        }
+        else if (strcmp(arg, "--format") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            if (!cms_file_format_from_name(value, &launch->format))
+            {
+                fprintf(stderr, "Unknown format: %s (use text or binary)\n", value);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            int threads = 0;
+            if (!cms_parse_int_argument(value, &threads) || threads < 1 || threads > CMS_MAX_THREADS)
+            {
+                fprintf(stderr, "--threads needs a number from 1 to %d\n", CMS_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+            launch->threads = (unsigned)threads;
+        }
+        else if (strcmp(arg, "--undo-memory") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            int megabytes = 0;
+            if (!cms_parse_int_argument(value, &megabytes) || megabytes < 0 || megabytes > CMS_MAX_UNDO_MEMORY_MIB)
+            {
+                fprintf(stderr, "--undo-memory needs a number of MiB from 0 to %d\n", CMS_MAX_UNDO_MEMORY_MIB);
+                return EXIT_FAILURE;
+            }
+            launch->undo_limit = (size_t)megabytes << 20;
+        }
+        else if (strcmp(arg, "--metrics") == 0)
+        {
+            if ((value = option_value(argc, argv, &i)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            launch->metrics_path = value;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (launch->command_count > 0 && launch->script != NULL)
+    {
+        fprintf(stderr, "Use either -c or -f, not both\n");
+        return EXIT_FAILURE;
+    }
+    if (launch->socket_path != NULL && (launch->command_count > 0 || launch->script != NULL))
+    {
+        fprintf(stderr, "--serve cannot be combined with -c or -f\n");
         return EXIT_FAILURE;
     }
+    if (launch->command_count > 0 || launch->script != NULL || launch->socket_path != NULL)
+    {
+        /* One-shot runs and the server never prompt */
+        launch->session.batch = true;
+    }
+    return EXIT_SUCCESS;
+}
 
-    cms_print_declaration();
+/* Opens --db or the default database; false if an explicit --db failed.
+   At an interactive prompt the default database is only named in
+   *background_path, to be loaded while the prompt is already up. */
+static bool open_startup_database(StudentDatabase *db, const LaunchOptions *launch, const char **background_path)
+{
+    bool quiet = launch->session.batch;
+    *background_path = NULL;
+    if (launch->db_path == NULL && !launch->load_default)
+    {
+        if (!quiet)
+        {
+            printf("No database opened. Use the OPEN command to load a file.\n\n");
+        }
+        return true;
+    }
 
-    printf("Type 'HELP' for the list of commands.\n");
-    printf("Default database: %s\n\n", CMS_DEFAULT_DATABASE_FILE);
+    const char *path = (launch->db_path != NULL) ? launch->db_path : CMS_DEFAULT_DATABASE_FILE;
+    if (!quiet && launch->db_path == NULL)
+    {
+        printf("Loading database '%s' in the background...\n\n", path);
+        *background_path = path;
+        return true;
+    }
+    if (!quiet)
+    {
+        printf("Loading database '%s'...\n", path);
+    }
 
-    /* Attempt to open default database file */
-    printf("Loading default database...\n");
-    status = cmd_open(&db, CMS_DEFAULT_DATABASE_FILE);
+    CMS_STATUS status = cmd_open(db, cms_slice(path));
     if (status == CMS_STATUS_OK)
     {
-        printf("Successfully loaded '%s'.\n\n", CMS_DEFAULT_DATABASE_FILE);
+        if (!quiet)
+        {
+            printf("Successfully loaded '%s'.\n\n", path);
+        }
+        return true;
     }
-    else
+
+    if (launch->db_path != NULL)
     {
-        printf("Warning: Failed to load '%s'.\n", CMS_DEFAULT_DATABASE_FILE);
-        cms_print_status(status);
-        printf("You may use the OPEgcc src/*.c -Iinclude -o cms.exeN command to load another file.\n\n");
+        /* A job that named its database must not run against another one */
+        fprintf(stderr, "Error: Failed to load '%s': %s\n", path, cms_status_message(status));
+        return false;
     }
 
-    cms_command_loop(&db);
+    printf("Warning: Failed to load '%s'.\n", path);
+    cms_print_status(status);
+    printf("You may use the OPEN command to load another file.\n\n");
+    return true;
+}
 
-    if (db.is_dirty)
+/* Runs -c commands, a -f script, the server or standard input; returns the number of failed commands */
+static int run_session(StudentDatabase *db, const LaunchOptions *launch, const char *background_path)
+{
+    if (launch->socket_path != NULL)
     {
-        char response[8];
-        while (1)
+        return (cms_serve(db, launch->socket_path) == CMS_STATUS_OK) ? 0 : 1;
+    }
+
+    if (launch->command_count > 0)
+    {
+        return cms_batch_commands(db, launch->commands, launch->command_count);
+    }
+
+    if (launch->script != NULL && strcmp(launch->script, "-") != 0)
+    {
+        FILE *script = fopen(launch->script, "r");
+        if (script == NULL)
+        {
+            fprintf(stderr, "Error: Cannot open script '%s'\n", launch->script);
+            return 1;
+        }
+        int failures = cms_batch_loop(db, script);
+        fclose(script);
+        return failures;
+    }
+
+    if (launch->session.batch)
+    {
+        return cms_batch_loop(db, stdin);
+    }
+    cms_command_loop_loading(db, background_path);
+    return 0;
+}
+
+/* Saves unsaved changes at exit if the user (or --yes) agrees */
+static CMS_STATUS confirm_save_at_exit(StudentDatabase *db, const CmsSessionOptions *options)
+{
+    char response[8];
+    while (1)
+    {
+        char choice = 'N';
+        if (options->assume_yes)
+        {
+            choice = 'Y';
+        }
+        else if (options->batch)
+        {
+            printf("CMS: Unsaved changes discarded. Use SAVE or --yes to keep them.\n");
+            return CMS_STATUS_OK;
+        }
+        else
         {
             printf("Unsaved changes detected. Save before exiting? (Y/N): ");
             if (!cms_read_line(response, sizeof(response)))
             {
                 printf("\nInput error detected. Exiting without saving.\n");
-                break;
+                return CMS_STATUS_OK;
             }
 
             if (response[0] == '\0')
             {
                 continue;
             }
+            choice = (char)toupper((unsigned char)response[0]);
+        }
 
-            char choice = (char)toupper((unsigned char)response[0]);
-            if (choice == 'Y')
-            {
-                CMS_STATUS save_status = cmd_save(&db, NULL);
-                if (save_status == CMS_STATUS_OK)
-                {
-                    printf("Changes saved successfully.\n");
-                }
-                else
-                {
-                    printf("Failed to save changes.\n");
-                    cms_print_status(save_status);
-                }
-                break;
-            }
-            else if (choice == 'N')
+        if (choice == 'Y')
+        {
+            CMS_STATUS save_status = cmd_save(db, cms_slice(NULL));
+            if (save_status == CMS_STATUS_OK)
             {
-                printf("Changes not saved.\n");
-                break;
+                printf("Changes saved successfully.\n");
             }
             else
             {
-                printf("Please enter 'Y' or 'N'.\n");
+                printf("Failed to save changes.\n");
+                cms_print_status(save_status);
             }
+            return save_status;
+        }
+        else if (choice == 'N')
+        {
+            printf("Changes not saved.\n");
+            return CMS_STATUS_OK;
+        }
+        else
+        {
+            printf("Please enter 'Y' or 'N'.\n");
         }
     }
+}
+
+int main(int argc, char *argv[])
+{
+    StudentDatabase db;
+    CMS_STATUS status;
+
+    /* Must run before anything is printed */
+    cms_configure_stdout();
+
+    LaunchOptions launch;
+    memset(&launch, 0, sizeof(launch));
+    launch.session.batch = !cms_is_terminal(stdin);
+    launch.load_default = true;
+    launch.threads = 1;
+    launch.format = CMS_FILE_FORMAT_AUTO;
+    launch.undo_limit = CMS_DEFAULT_UNDO_MEMORY;
+    launch.commands = cms_malloc(CMS_MEM_SESSION, (size_t)argc * sizeof(char *));
+    if (launch.commands == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int parsed = parse_arguments(argc, argv, &launch);
+    if (parsed != EXIT_SUCCESS)
+    {
+        if (parsed < 0)
+        {
+            print_usage(argv[0]);
+        }
+        cms_free(launch.commands);
+        return (parsed < 0) ? EXIT_SUCCESS : parsed;
+    }
+    cms_set_session_options(&launch.session);
+    cms_set_thread_count(launch.threads);
+    cms_metrics_set_enabled(launch.metrics_path != NULL);
+
+    status = cms_database_init(&db);
+    if (status != CMS_STATUS_OK)
+    {
+        fprintf(stderr, "Failed to initialize database\n");
+        cms_free(launch.commands);
+        return EXIT_FAILURE;
+    }
+    db.save_format = launch.format;
+    db.undo_limit = launch.undo_limit;
+
+    if (!launch.session.batch)
+    {
+        cms_print_declaration();
+
+        printf("Type 'HELP' for the list of commands.\n");
+        printf("Default database: %s\n\n", CMS_DEFAULT_DATABASE_FILE);
+    }
+
+    int failures = 0;
+    const char *background_path = NULL;
+    if (!open_startup_database(&db, &launch, &background_path))
+    {
+        failures++;
+    }
+    else
+    {
+        failures = run_session(&db, &launch, background_path);
+
+        if (db.transaction != NULL)
+        {
+            /* Uncommitted changes are never saved */
+            cmd_rollback(&db);
+        }
+        if (db.is_dirty && confirm_save_at_exit(&db, &launch.session) != CMS_STATUS_OK)
+        {
+            failures++;
+        }
+    }
+
+    if (launch.metrics_path != NULL)
+    {
+        CMS_STATUS metrics_status = cms_metrics_save_json(launch.metrics_path);
+        if (metrics_status != CMS_STATUS_OK)
+        {
+            fprintf(stderr, "Error: Cannot write metrics to '%s': %s\n", launch.metrics_path,
+                    cms_status_message(metrics_status));
+            failures++;
+        }
+    }
+    cms_metrics_reset();
 
     cms_database_cleanup(&db);
+    cms_free(launch.commands);
 
-    return EXIT_SUCCESS;
+    fflush(stdout);
+    return (failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
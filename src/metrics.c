@@ -0,0 +1,268 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/metrics.h"
+#include "../include/alloc.h"
+
+typedef struct
+{
+    const char *verb;
+    uint64_t statuses[CMS_METRICS_STATUSES];
+    CmsHistogram *latency; /* allocated when the verb is first run */
+} CmsVerbSlot;
+
+static bool cms_metrics_on = false;
+static CmsVerbSlot cms_metrics_verbs[CMS_METRICS_MAX_VERBS];
+/* Held while the slots are read or written: server workers record at once */
+static pthread_mutex_t cms_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ===== Histogram ===== */
+
+static size_t cms_histogram_bucket(uint64_t value)
+{
+    if (value < 2 * CMS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    unsigned shift = CMS_HISTOGRAM_SUB_BITS + 1;
+    while (shift < CMS_HISTOGRAM_MAX_SHIFT && (value >> (shift + 1)) != 0)
+    {
+        shift++;
+    }
+    if ((value >> (shift + 1)) != 0)
+    {
+        return CMS_HISTOGRAM_BUCKETS - 1;
+    }
+    /* The top CMS_HISTOGRAM_SUB_BITS bits below the leading one pick the sub-bucket */
+    size_t sub = (size_t)((value >> (shift - CMS_HISTOGRAM_SUB_BITS)) & (CMS_HISTOGRAM_SUB_BUCKETS - 1));
+    return CMS_HISTOGRAM_SUB_BUCKETS * (shift - CMS_HISTOGRAM_SUB_BITS + 1) + sub;
+}
+
+uint64_t cms_histogram_bucket_low(size_t bucket)
+{
+    if (bucket < 2 * CMS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    unsigned shift = (unsigned)(bucket / CMS_HISTOGRAM_SUB_BUCKETS) + CMS_HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = bucket % CMS_HISTOGRAM_SUB_BUCKETS;
+    return (CMS_HISTOGRAM_SUB_BUCKETS + sub) << (shift - CMS_HISTOGRAM_SUB_BITS);
+}
+
+void cms_histogram_record(CmsHistogram *histogram, uint64_t value)
+{
+    if (histogram == NULL)
+    {
+        return;
+    }
+    histogram->buckets[cms_histogram_bucket(value)]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+uint64_t cms_histogram_percentile(const CmsHistogram *histogram, double percentile)
+{
+    if (histogram == NULL || histogram->count == 0)
+    {
+        return 0;
+    }
+
+    double wanted = percentile / 100.0 * (double)histogram->count;
+    uint64_t rank = (uint64_t)wanted;
+    if ((double)rank < wanted || rank == 0)
+    {
+        rank++;
+    }
+
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < CMS_HISTOGRAM_BUCKETS; ++bucket)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint64_t high = (bucket + 1 < CMS_HISTOGRAM_BUCKETS) ? cms_histogram_bucket_low(bucket + 1) - 1
+                                                                 : histogram->max;
+            return (high < histogram->max) ? high : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/* ===== Per-verb metrics ===== */
+
+void cms_metrics_set_enabled(bool enabled)
+{
+    cms_metrics_on = enabled;
+}
+
+bool cms_metrics_enabled(void)
+{
+    return cms_metrics_on;
+}
+
+uint64_t cms_metrics_now(void)
+{
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+    timespec_get(&now, TIME_UTC);
+#endif
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void cms_metrics_record(size_t slot, const char *verb, CMS_STATUS status, uint64_t elapsed_ns)
+{
+    if (slot >= CMS_METRICS_MAX_VERBS || verb == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cms_metrics_lock);
+    CmsVerbSlot *entry = &cms_metrics_verbs[slot];
+    if (entry->latency == NULL)
+    {
+        /* A lost histogram only loses this verb's figures */
+        entry->latency = cms_calloc(CMS_MEM_SESSION, 1, sizeof(CmsHistogram));
+    }
+    if (entry->latency != NULL)
+    {
+        entry->verb = verb;
+        cms_histogram_record(entry->latency, elapsed_ns);
+        if ((unsigned)status < CMS_METRICS_STATUSES)
+        {
+            entry->statuses[status]++;
+        }
+    }
+    pthread_mutex_unlock(&cms_metrics_lock);
+}
+
+static void cms_metrics_fill(const CmsVerbSlot *entry, CmsVerbMetrics *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->verb = entry->verb;
+    out->count = entry->latency->count;
+    memcpy(out->statuses, entry->statuses, sizeof(out->statuses));
+    out->errors = out->count - entry->statuses[CMS_STATUS_OK];
+    out->p50 = cms_histogram_percentile(entry->latency, 50.0);
+    out->p99 = cms_histogram_percentile(entry->latency, 99.0);
+    out->max = entry->latency->max;
+    out->total = entry->latency->total;
+}
+
+size_t cms_metrics_list(CmsVerbMetrics *out, size_t max)
+{
+    size_t count = 0;
+    pthread_mutex_lock(&cms_metrics_lock);
+    for (size_t slot = 0; slot < CMS_METRICS_MAX_VERBS && count < max; ++slot)
+    {
+        const CmsVerbSlot *entry = &cms_metrics_verbs[slot];
+        if (entry->latency != NULL && entry->latency->count > 0)
+        {
+            cms_metrics_fill(entry, &out[count++]);
+        }
+    }
+    pthread_mutex_unlock(&cms_metrics_lock);
+    return count;
+}
+
+void cms_metrics_reset(void)
+{
+    pthread_mutex_lock(&cms_metrics_lock);
+    for (size_t slot = 0; slot < CMS_METRICS_MAX_VERBS; ++slot)
+    {
+        cms_free(cms_metrics_verbs[slot].latency);
+    }
+    memset(cms_metrics_verbs, 0, sizeof(cms_metrics_verbs));
+    pthread_mutex_unlock(&cms_metrics_lock);
+}
+
+/* ===== JSON ===== */
+
+CMS_STATUS cms_metrics_write_json(FILE *fp)
+{
+    if (fp == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&cms_metrics_lock);
+    fprintf(fp, "{\n  \"schema\": 1,\n  \"unit\": \"ns\",\n  \"sub_buckets\": %u,\n  \"commands\": [",
+            CMS_HISTOGRAM_SUB_BUCKETS);
+    bool first = true;
+    for (size_t slot = 0; slot < CMS_METRICS_MAX_VERBS; ++slot)
+    {
+        const CmsVerbSlot *entry = &cms_metrics_verbs[slot];
+        if (entry->latency == NULL || entry->latency->count == 0)
+        {
+            continue;
+        }
+        CmsVerbMetrics metrics;
+        cms_metrics_fill(entry, &metrics);
+
+        /* Verbs are the command table's own upper-case words: nothing to escape */
+        fprintf(fp, "%s\n    {\"verb\": \"%s\", \"count\": %llu, \"errors\": %llu, \"statuses\": {",
+                first ? "" : ",", metrics.verb, (unsigned long long)metrics.count,
+                (unsigned long long)metrics.errors);
+        first = false;
+        bool first_status = true;
+        for (unsigned status = 0; status < CMS_METRICS_STATUSES; ++status)
+        {
+            if (metrics.statuses[status] > 0)
+            {
+                fprintf(fp, "%s\"%s\": %llu", first_status ? "" : ", ", cms_status_name((CMS_STATUS)status),
+                        (unsigned long long)metrics.statuses[status]);
+                first_status = false;
+            }
+        }
+        fprintf(fp, "}, \"total\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu, \"buckets\": [",
+                (unsigned long long)metrics.total, (unsigned long long)metrics.p50,
+                (unsigned long long)metrics.p99, (unsigned long long)metrics.max);
+
+        /* [lowest value of the bucket, count] for every bucket in use */
+        bool first_bucket = true;
+        for (size_t bucket = 0; bucket < CMS_HISTOGRAM_BUCKETS; ++bucket)
+        {
+            if (entry->latency->buckets[bucket] > 0)
+            {
+                fprintf(fp, "%s[%llu, %llu]", first_bucket ? "" : ", ",
+                        (unsigned long long)cms_histogram_bucket_low(bucket),
+                        (unsigned long long)entry->latency->buckets[bucket]);
+                first_bucket = false;
+            }
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    pthread_mutex_unlock(&cms_metrics_lock);
+    return ferror(fp) ? CMS_STATUS_IO : CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_metrics_save_json(const char *path)
+{
+    if (path == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+    CMS_STATUS status = cms_metrics_write_json(fp);
+    if (fclose(fp) != 0 && status == CMS_STATUS_OK)
+    {
+        status = CMS_STATUS_IO;
+    }
+    return status;
+}
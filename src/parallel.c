@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include "../include/parallel.h"
+
+static unsigned cms_thread_count = 1;
+
+typedef struct
+{
+    CmsTask *tasks;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+} CmsTaskQueue;
+
+void cms_set_thread_count(unsigned count)
+{
+    if (count < 1)
+    {
+        count = 1;
+    }
+    if (count > CMS_MAX_THREADS)
+    {
+        count = CMS_MAX_THREADS;
+    }
+    cms_thread_count = count;
+}
+
+unsigned cms_get_thread_count(void)
+{
+    return cms_thread_count;
+}
+
+static void *cms_task_worker(void *argument)
+{
+    CmsTaskQueue *queue = argument;
+    while (1)
+    {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next;
+        if (index < queue->count)
+        {
+            queue->next++;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->count)
+        {
+            return NULL;
+        }
+        CmsTask *task = &queue->tasks[index];
+        task->ok = task->run(task->context);
+    }
+}
+
+bool cms_run_tasks(CmsTask *tasks, size_t count)
+{
+    if (tasks == NULL)
+    {
+        return false;
+    }
+
+    size_t workers = (cms_thread_count < count) ? cms_thread_count : count;
+    if (workers <= 1)
+    {
+        bool all_ok = true;
+        for (size_t i = 0; i < count; ++i)
+        {
+            tasks[i].ok = tasks[i].run(tasks[i].context);
+            all_ok = all_ok && tasks[i].ok;
+        }
+        return all_ok;
+    }
+
+    CmsTaskQueue queue;
+    queue.tasks = tasks;
+    queue.count = count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    /* The calling thread is one of the workers; if a thread cannot be
+       started the remaining ones simply take more of the tasks */
+    pthread_t threads[CMS_MAX_THREADS];
+    size_t started = 0;
+    while (started + 1 < workers &&
+           pthread_create(&threads[started], NULL, cms_task_worker, &queue) == 0)
+    {
+        started++;
+    }
+    cms_task_worker(&queue);
+    for (size_t i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+
+    bool all_ok = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        all_ok = all_ok && tasks[i].ok;
+    }
+    return all_ok;
+}
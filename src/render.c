@@ -0,0 +1,423 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "../include/render.h"
+#include "../include/alloc.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define cms_isatty _isatty
+#define cms_fileno _fileno
+#else
+#include <unistd.h>
+#define cms_isatty isatty
+#define cms_fileno fileno
+#endif
+
+static bool cms_write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        int chunk = (length > 0x40000000U) ? 0x40000000 : (int)length;
+        int written = _write(fd, data, (unsigned int)chunk);
+#else
+        ssize_t written = write(fd, data, length);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+void cms_writer_init(CmsWriter *writer, int fd, FILE *stream, char *buffer, size_t capacity)
+{
+    if (writer == NULL)
+    {
+        return;
+    }
+
+    writer->fd = fd;
+    writer->stream = stream;
+    writer->buffer = buffer;
+    writer->length = 0;
+    writer->capacity = capacity;
+    writer->bytes_written = 0;
+    writer->failed = (buffer == NULL || capacity == 0);
+    writer->grows = false;
+}
+
+/* First buffer of a memory writer; most responses fit */
+#define CMS_WRITER_MEMORY_START 4096
+
+void cms_writer_init_memory(CmsWriter *writer)
+{
+    if (writer == NULL)
+    {
+        return;
+    }
+
+    cms_writer_init(writer, -1, NULL, NULL, 0);
+    writer->failed = false;
+    writer->grows = true;
+}
+
+void cms_writer_free(CmsWriter *writer)
+{
+    if (writer != NULL && writer->grows)
+    {
+        cms_free(writer->buffer);
+        writer->buffer = NULL;
+        writer->length = 0;
+        writer->capacity = 0;
+    }
+}
+
+/* Makes room for length more bytes: a memory writer grows, any other
+   hands on what it holds */
+static void cms_writer_make_room(CmsWriter *writer, size_t length)
+{
+    if (!writer->grows)
+    {
+        cms_writer_flush(writer);
+        return;
+    }
+
+    size_t capacity = (writer->capacity > 0) ? writer->capacity : CMS_WRITER_MEMORY_START;
+    while (capacity < writer->length + length)
+    {
+        capacity *= 2;
+    }
+    if (capacity == writer->capacity)
+    {
+        return;
+    }
+    char *grown = cms_realloc(CMS_MEM_SESSION, writer->buffer, capacity);
+    if (grown == NULL)
+    {
+        writer->failed = true;
+        return;
+    }
+    writer->buffer = grown;
+    writer->capacity = capacity;
+}
+
+void cms_writer_init_stream(CmsWriter *writer, FILE *stream, char *buffer, size_t capacity)
+{
+    cms_writer_init(writer, cms_fileno(stream), stream, buffer, capacity);
+}
+
+CMS_STATUS cms_writer_flush(CmsWriter *writer)
+{
+    if (writer == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (writer->grows)
+    {
+        return writer->failed ? CMS_STATUS_ERROR : CMS_STATUS_OK;
+    }
+
+    if (writer->length > 0 && !writer->failed)
+    {
+        bool ok;
+        if (writer->stream != NULL)
+        {
+            /* Going through the stream keeps our output ordered with
+               printf() and costs no system call until its buffer fills;
+               stdio writes whole buffers straight to the descriptor */
+            ok = fwrite(writer->buffer, 1, writer->length, writer->stream) == writer->length;
+        }
+        else
+        {
+            ok = cms_write_all(writer->fd, writer->buffer, writer->length);
+        }
+
+        if (ok)
+        {
+            writer->bytes_written += writer->length;
+        }
+        else
+        {
+            writer->failed = true;
+        }
+    }
+    writer->length = 0;
+    return writer->failed ? CMS_STATUS_IO : CMS_STATUS_OK;
+}
+
+void cms_writer_put(CmsWriter *writer, const char *data, size_t length)
+{
+    if (writer->failed)
+    {
+        return;
+    }
+
+    if (writer->length + length > writer->capacity)
+    {
+        cms_writer_make_room(writer, length);
+        if (writer->failed)
+        {
+            return;
+        }
+        if (length > writer->capacity)
+        {
+            bool ok = (writer->stream != NULL) ? fwrite(data, 1, length, writer->stream) == length
+                                               : cms_write_all(writer->fd, data, length);
+            if (!ok)
+            {
+                writer->failed = true;
+                return;
+            }
+            writer->bytes_written += length;
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+char *cms_writer_reserve(CmsWriter *writer, size_t length)
+{
+    if (length > writer->capacity && !writer->grows)
+    {
+        return NULL;
+    }
+    if (writer->length + length > writer->capacity)
+    {
+        cms_writer_make_room(writer, length);
+    }
+    return writer->failed ? NULL : writer->buffer + writer->length;
+}
+
+void cms_writer_commit(CmsWriter *writer, size_t length)
+{
+    writer->length += length;
+}
+
+void cms_writer_puts(CmsWriter *writer, const char *text)
+{
+    cms_writer_put(writer, text, strlen(text));
+}
+
+void cms_writer_putc(CmsWriter *writer, char c)
+{
+    if (writer->length == writer->capacity)
+    {
+        cms_writer_make_room(writer, 1);
+    }
+    if (!writer->failed)
+    {
+        writer->buffer[writer->length++] = c;
+    }
+}
+
+void cms_writer_repeat(CmsWriter *writer, char c, size_t count)
+{
+    while (count > 0 && !writer->failed)
+    {
+        if (writer->length == writer->capacity)
+        {
+            cms_writer_make_room(writer, count);
+            continue;
+        }
+        size_t room = writer->capacity - writer->length;
+        size_t chunk = (count < room) ? count : room;
+        memset(writer->buffer + writer->length, c, chunk);
+        writer->length += chunk;
+        count -= chunk;
+    }
+}
+
+size_t cms_format_int(long long value, char *out)
+{
+    char digits[24];
+    size_t count = 0;
+    unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do
+    {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    size_t length = 0;
+    if (value < 0)
+    {
+        out[length++] = '-';
+    }
+    while (count > 0)
+    {
+        out[length++] = digits[--count];
+    }
+    return length;
+}
+
+size_t cms_format_fixed(float value, unsigned decimals, char *out)
+{
+    static const double scales[] = {1.0, 10.0, 100.0, 1000.0, 10000.0};
+    double number = (double)value;
+    if (decimals > CMS_FIXED_MAX_DECIMALS || !(number > -1e14 && number < 1e14))
+    {
+        /* NaN, infinities and huge values: leave them to printf */
+        int written = snprintf(out, CMS_MARK_TEXT_LEN, "%.*f", (int)decimals, number);
+        return (written < 0) ? 0 : (size_t)written;
+    }
+
+    /* A float has 24 significant bits and 10^4 needs at most 10 more, so
+       value * 10^decimals is exact in a double. Rounding it half-to-even
+       then matches printf's correctly rounded "%.Nf" under the default
+       rounding mode. */
+    bool negative = signbit(number);
+    double scaled = (negative ? -number : number) * scales[decimals];
+    unsigned long long units = (unsigned long long)scaled;
+    double fraction = scaled - (double)units;
+    if (fraction > 0.5 || (fraction == 0.5 && (units & 1ULL)))
+    {
+        units++;
+    }
+
+    unsigned long long scale = (unsigned long long)scales[decimals];
+    size_t length = 0;
+    if (negative)
+    {
+        out[length++] = '-';
+    }
+    length += cms_format_int((long long)(units / scale), out + length);
+    if (decimals > 0)
+    {
+        unsigned long long rest = units % scale;
+        out[length++] = '.';
+        for (unsigned i = decimals; i > 0; --i)
+        {
+            out[length + i - 1] = (char)('0' + rest % 10);
+            rest /= 10;
+        }
+        length += decimals;
+    }
+    out[length] = '\0';
+    return length;
+}
+
+size_t cms_format_mark(float mark, char *out)
+{
+    return cms_format_fixed(mark, 1, out);
+}
+
+void cms_writer_int(CmsWriter *writer, long long value)
+{
+    char text[24];
+    cms_writer_put(writer, text, cms_format_int(value, text));
+}
+
+void cms_writer_pad(CmsWriter *writer, const char *text, size_t width)
+{
+    size_t length = strlen(text);
+    cms_writer_put(writer, text, length);
+    if (length < width)
+    {
+        cms_writer_repeat(writer, ' ', width - length);
+    }
+}
+
+void cms_writer_pad_int(CmsWriter *writer, long long value, size_t width)
+{
+    char text[24];
+    size_t length = cms_format_int(value, text);
+    cms_writer_put(writer, text, length);
+    if (length < width)
+    {
+        cms_writer_repeat(writer, ' ', width - length);
+    }
+}
+
+void cms_writer_pad_mark(CmsWriter *writer, float mark, size_t width)
+{
+    char text[CMS_MARK_TEXT_LEN];
+    size_t length = cms_format_mark(mark, text);
+    cms_writer_put(writer, text, length);
+    if (length < width)
+    {
+        cms_writer_repeat(writer, ' ', width - length);
+    }
+}
+
+/* Set while a thread's output goes somewhere other than stdout */
+static _Thread_local CmsWriter *cms_thread_output = NULL;
+
+void cms_set_thread_output(CmsWriter *writer)
+{
+    cms_thread_output = writer;
+}
+
+int cms_printf(const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    if (cms_thread_output == NULL)
+    {
+        int written = vprintf(format, arguments);
+        va_end(arguments);
+        return written;
+    }
+
+    va_list measure;
+    va_copy(measure, arguments);
+    int length = vsnprintf(NULL, 0, format, measure);
+    va_end(measure);
+    char *out = (length >= 0) ? cms_writer_reserve(cms_thread_output, (size_t)length + 1) : NULL;
+    if (out != NULL)
+    {
+        vsnprintf(out, (size_t)length + 1, format, arguments);
+        cms_writer_commit(cms_thread_output, (size_t)length);
+    }
+    va_end(arguments);
+    return (out != NULL) ? length : -1;
+}
+
+CmsWriter *cms_stdout_writer(void)
+{
+    /* One per thread, so tables rendered by concurrent readers never share
+       a buffer (each is still flushed whole, under the stream's lock) */
+    static _Thread_local char buffer[CMS_WRITER_BUFFER_SIZE];
+    static _Thread_local CmsWriter writer;
+    static _Thread_local bool initialised = false;
+
+    if (cms_thread_output != NULL)
+    {
+        return cms_thread_output;
+    }
+    if (!initialised)
+    {
+        cms_writer_init_stream(&writer, stdout, buffer, sizeof(buffer));
+        initialised = true;
+    }
+    return &writer;
+}
+
+bool cms_is_terminal(FILE *stream)
+{
+    return stream != NULL && cms_isatty(cms_fileno(stream));
+}
+
+void cms_configure_stdout(void)
+{
+    if (!cms_is_terminal(stdout))
+    {
+        setvbuf(stdout, NULL, _IOFBF, CMS_WRITER_BUFFER_SIZE);
+    }
+}
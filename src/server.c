@@ -0,0 +1,961 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/server.h"
+#include "../include/alloc.h"
+#include "../include/commands.h"
+#include "../include/config.h"
+#include "../include/database.h"
+#include "../include/parallel.h"
+#include "../include/render.h"
+#include "../include/shared.h"
+#include "../include/tokenizer.h"
+#include "../include/transaction.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Bytes read from a client per read(); many pipelined lines fit at once */
+#define CMS_SERVER_INPUT_SIZE (64 * 1024)
+/* A client with this much unsent output is not read from until it catches up */
+#define CMS_SERVER_OUTPUT_HIGH (1024 * 1024)
+/* Output buffers larger than this are released once drained */
+#define CMS_SERVER_OUTPUT_KEEP (256 * 1024)
+#define CMS_SERVER_MAX_EVENTS 64
+/* Longest response header: "ERR <line> <STATUS> <bytes> <message>\n" */
+#define CMS_SERVER_HEADER_LEN 256
+/* Lines taken from one client per turn, so a long pipeline cannot keep the
+   others waiting */
+#define CMS_SERVER_LINES_PER_WAKEUP 64
+/* Worker threads when --threads asks for fewer */
+#define CMS_SERVER_MIN_WORKERS 4
+
+struct CmsClient;
+
+/* One command line of a request and, once it has run, its outcome */
+typedef struct
+{
+    const char *text;  /* terminated in place in the client's input */
+    unsigned long line_number;
+    CMS_STATUS status;
+    size_t body_offset; /* the command's output in the request's writer */
+    size_t body_length;
+} CmsRequestLine;
+
+/* Command lines taken from one client in one turn, run in order on a worker */
+typedef struct CmsRequest
+{
+    struct CmsRequest *next; /* in the waiting queue, then the finished list */
+    struct CmsClient *client;
+    CmsRequestLine lines[CMS_SERVER_LINES_PER_WAKEUP];
+    size_t line_count;
+    size_t line;        /* the one running, for the lock callbacks */
+    bool read_only;     /* it ran under the shared lock */
+    CmsWriter output;
+} CmsRequest;
+
+typedef struct CmsClient
+{
+    struct CmsClient *prev; /* neighbours in the server's client list */
+    struct CmsClient *next;
+    int fd;            /* -1 once closed while a request was still running */
+    char input[CMS_SERVER_INPUT_SIZE + 1]; /* one spare byte to terminate a final line */
+    size_t input_length;
+    size_t input_taken; /* bytes of input the running request reads from */
+    bool discarding;   /* dropping the rest of an over-long line */
+    bool peer_done;    /* the client has finished sending */
+    bool closing;      /* EXIT seen: send what is queued, then close */
+    bool runnable;     /* more lines buffered than its last turn took */
+    unsigned long line_number;
+    char *output;
+    size_t output_length;
+    size_t output_sent;
+    size_t output_capacity;
+    uint32_t events;   /* epoll interest currently registered */
+    CmsRequest *request; /* on a worker; nothing else runs for the client until it is done */
+
+    /* Session state, put in place only while the client's commands run */
+    CmsTransaction *transaction; /* the client's own BEGIN ... COMMIT, if any */
+    CmsCursor *page_cursor;      /* its SHOW ... PAGE listing, resumed by NEXT */
+    size_t page_size;
+    StudentDatabase view; /* the table plus the session state, for reads */
+} CmsClient;
+
+typedef struct
+{
+    CmsSharedDatabase *shared; /* the served database behind a reader-writer lock */
+    int listen_fd;
+    int epoll_fd;
+    int done_pipe[2];  /* a worker writes a byte here when a request is finished */
+    CmsClient *clients;
+    size_t runnable;   /* clients with runnable set */
+
+    pthread_t *workers;
+    size_t worker_count;
+    pthread_mutex_t lock; /* guards the queue and finished list */
+    pthread_cond_t work;
+    CmsRequest *waiting; /* oldest first */
+    CmsRequest *waiting_tail;
+    CmsRequest *finished; /* newest first */
+    bool workers_stopping;
+} CmsServer;
+
+/* Self-pipe that wakes epoll_wait when cms_server_stop is called */
+static int cms_server_wakeup[2] = {-1, -1};
+static volatile sig_atomic_t cms_server_stopping = 0;
+
+void cms_server_stop(void)
+{
+    cms_server_stopping = 1;
+    if (cms_server_wakeup[1] >= 0)
+    {
+        char byte = 0;
+        ssize_t ignored = write(cms_server_wakeup[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+static void cms_server_on_signal(int signal_number)
+{
+    (void)signal_number;
+    cms_server_stop();
+}
+
+/* ===== Client output ===== */
+
+static size_t cms_client_pending(const CmsClient *client)
+{
+    return client->output_length - client->output_sent;
+}
+
+/* Room for length more bytes of output, or NULL if memory ran out */
+static char *cms_client_reserve(CmsClient *client, size_t length)
+{
+    if (client->output_sent > 0 && client->output_sent == client->output_length)
+    {
+        client->output_sent = 0;
+        client->output_length = 0;
+    }
+    if (client->output_length + length > client->output_capacity)
+    {
+        size_t capacity = (client->output_capacity > 0) ? client->output_capacity : 4096;
+        while (capacity < client->output_length + length)
+        {
+            capacity *= 2;
+        }
+        char *grown = cms_realloc(CMS_MEM_SESSION, client->output, capacity);
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        client->output = grown;
+        client->output_capacity = capacity;
+    }
+    return client->output + client->output_length;
+}
+
+static bool cms_client_append(CmsClient *client, const char *data, size_t length)
+{
+    char *destination = cms_client_reserve(client, length);
+    if (destination == NULL)
+    {
+        return false;
+    }
+    memcpy(destination, data, length);
+    client->output_length += length;
+    return true;
+}
+
+/* Queues a response header; message NULL means the status's own message */
+static bool cms_client_respond(CmsClient *client, unsigned long line_number, CMS_STATUS status,
+                               size_t body_length, const char *message)
+{
+    char header[CMS_SERVER_HEADER_LEN];
+    int length;
+    if (status == CMS_STATUS_OK)
+    {
+        length = snprintf(header, sizeof(header), "OK %lu %zu\n", line_number, body_length);
+    }
+    else
+    {
+        length = snprintf(header, sizeof(header), "ERR %lu %s %zu %s\n", line_number,
+                          cms_status_name(status), body_length,
+                          (message != NULL) ? message : cms_status_message(status));
+    }
+    if (length < 0 || (size_t)length >= sizeof(header))
+    {
+        return false;
+    }
+    return cms_client_append(client, header, (size_t)length);
+}
+
+/* ===== Running commands ===== */
+
+/* Runs under the shared lock: a command that only reads runs on the
+   client's view, a copy of the table header carrying its own session state */
+static CMS_STATUS cms_request_read(const StudentDatabase *db, void *context)
+{
+    CmsRequest *request = context;
+    const char *text = request->lines[request->line].text;
+    request->read_only = cms_command_reads_only(text);
+    if (!request->read_only)
+    {
+        return CMS_STATUS_OK;
+    }
+
+    CmsClient *client = request->client;
+    client->view = *db;
+    client->view.transaction = client->transaction;
+    client->view.page_cursor = client->page_cursor;
+    client->view.page_size = client->page_size;
+    CMS_STATUS status = cms_parse_command(text, &client->view);
+    client->page_cursor = client->view.page_cursor;
+    client->page_size = client->view.page_size;
+    return status;
+}
+
+/* Runs under the exclusive lock with the client's session state in place */
+static CMS_STATUS cms_request_write(StudentDatabase *db, void *context)
+{
+    CmsRequest *request = context;
+    CmsClient *client = request->client;
+    CmsTransaction *transaction = db->transaction;
+    CmsCursor *page_cursor = db->page_cursor;
+    size_t page_size = db->page_size;
+
+    db->transaction = client->transaction;
+    db->page_cursor = client->page_cursor;
+    db->page_size = client->page_size;
+    CMS_STATUS status = cms_parse_command(request->lines[request->line].text, db);
+    client->transaction = db->transaction;
+    client->page_cursor = db->page_cursor;
+    client->page_size = db->page_size;
+
+    db->transaction = transaction;
+    db->page_cursor = page_cursor;
+    db->page_size = page_size;
+    return status;
+}
+
+/* Runs a request's lines in order on a worker, collecting their output */
+static void cms_request_execute(CmsServer *server, CmsRequest *request)
+{
+    cms_writer_init_memory(&request->output);
+    cms_set_thread_output(&request->output);
+    for (request->line = 0; request->line < request->line_count; ++request->line)
+    {
+        CmsRequestLine *line = &request->lines[request->line];
+        line->body_offset = request->output.length;
+        request->read_only = false;
+        CMS_STATUS status = cms_shared_read(server->shared, cms_request_read, request);
+        if (!request->read_only)
+        {
+            status = cms_shared_write(server->shared, cms_request_write, request);
+        }
+        line->status = status;
+        line->body_length = request->output.length - line->body_offset;
+    }
+    cms_set_thread_output(NULL);
+}
+
+static void *cms_server_worker(void *argument)
+{
+    CmsServer *server = argument;
+    pthread_mutex_lock(&server->lock);
+    while (1)
+    {
+        while (server->waiting == NULL && !server->workers_stopping)
+        {
+            pthread_cond_wait(&server->work, &server->lock);
+        }
+        CmsRequest *request = server->waiting;
+        if (request == NULL)
+        {
+            break;
+        }
+        server->waiting = request->next;
+        pthread_mutex_unlock(&server->lock);
+
+        cms_request_execute(server, request);
+
+        pthread_mutex_lock(&server->lock);
+        request->next = server->finished;
+        server->finished = request;
+        char byte = 0;
+        ssize_t ignored = write(server->done_pipe[1], &byte, 1);
+        (void)ignored;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+static void cms_server_submit(CmsServer *server, CmsRequest *request)
+{
+    request->next = NULL;
+    pthread_mutex_lock(&server->lock);
+    if (server->waiting == NULL)
+    {
+        server->waiting = request;
+    }
+    else
+    {
+        server->waiting_tail->next = request;
+    }
+    server->waiting_tail = request;
+    pthread_cond_signal(&server->work);
+    pthread_mutex_unlock(&server->lock);
+}
+
+typedef enum
+{
+    CMS_LINE_SKIP,    /* blank or a # comment: no response */
+    CMS_LINE_COMMAND,
+    CMS_LINE_EXIT,
+    CMS_LINE_TOO_LONG
+} CmsLineKind;
+
+static CmsLineKind cms_server_classify(const char *line, size_t length)
+{
+    if (length >= CMS_MAX_COMMAND_LEN)
+    {
+        /* Never run a command that would be cut short */
+        return CMS_LINE_TOO_LONG;
+    }
+
+    CmsSlice rest = {line, length};
+    rest = cms_slice_trim(rest);
+    if (cms_slice_is_empty(rest) || rest.text[0] == '#')
+    {
+        return CMS_LINE_SKIP;
+    }
+    CmsSlice verb = {NULL, 0};
+    cms_slice_next_word(&rest, &verb);
+    if (cms_slice_is_empty(cms_slice_trim(rest)) &&
+        (cms_slice_equals(verb, "EXIT") || cms_slice_equals(verb, "QUIT")))
+    {
+        return CMS_LINE_EXIT;
+    }
+    return CMS_LINE_COMMAND;
+}
+
+static void cms_client_set_runnable(CmsServer *server, CmsClient *client, bool runnable)
+{
+    if (client->runnable != runnable)
+    {
+        client->runnable = runnable;
+        server->runnable = runnable ? server->runnable + 1 : server->runnable - 1;
+    }
+}
+
+/* Drops the first length bytes of the client's input */
+static void cms_client_consume(CmsClient *client, size_t length)
+{
+    if (length > 0)
+    {
+        memmove(client->input, client->input + length, client->input_length - length);
+        client->input_length -= length;
+    }
+}
+
+/* Takes up to CMS_SERVER_LINES_PER_WAKEUP complete lines, in order, until the
+   output backlog is too large, and hands the commands among them to a worker
+   as one request. They run where they lie in the input, which is consumed
+   when the request is finished. EXIT and over-long lines are answered here
+   once everything before them has been. False on a fatal error. */
+static bool cms_client_run(CmsServer *server, CmsClient *client)
+{
+    if (client->request != NULL)
+    {
+        return true;
+    }
+
+    CmsRequest *request = NULL;
+    size_t start = 0;
+    size_t taken = 0;
+    bool ok = true;
+    while (ok && !client->closing && cms_client_pending(client) < CMS_SERVER_OUTPUT_HIGH &&
+           taken < CMS_SERVER_LINES_PER_WAKEUP)
+    {
+        char *line = client->input + start;
+        size_t available = client->input_length - start;
+        char *newline = memchr(line, '\n', available);
+        size_t length = (newline != NULL) ? (size_t)(newline - line) : available;
+        if (client->discarding)
+        {
+            start += (newline != NULL) ? length + 1 : available;
+            if (newline == NULL)
+            {
+                break;
+            }
+            client->discarding = false;
+            continue;
+        }
+        /* Without a newline, only an over-long line or the client's last one is complete */
+        if (newline == NULL && length < CMS_MAX_COMMAND_LEN && !(client->peer_done && length > 0))
+        {
+            break;
+        }
+
+        CmsLineKind kind = cms_server_classify(line, length);
+        if (request != NULL && (kind == CMS_LINE_EXIT || kind == CMS_LINE_TOO_LONG))
+        {
+            break;
+        }
+        start += (newline != NULL) ? length + 1 : available;
+        client->line_number++;
+        taken++;
+
+        if (kind == CMS_LINE_TOO_LONG)
+        {
+            /* Answer for the over-long line now and drop the rest of it */
+            client->discarding = (newline == NULL) && !client->peer_done;
+            ok = cms_client_respond(client, client->line_number, CMS_STATUS_INVALID_ARGUMENT, 0,
+                                    "Line too long");
+        }
+        else if (kind == CMS_LINE_EXIT)
+        {
+            client->closing = true;
+            ok = cms_client_respond(client, client->line_number, CMS_STATUS_OK, 0, NULL);
+        }
+        else if (kind == CMS_LINE_COMMAND)
+        {
+            if (request == NULL)
+            {
+                request = cms_calloc(CMS_MEM_SESSION, 1, sizeof(CmsRequest));
+                if (request == NULL)
+                {
+                    return false;
+                }
+                request->client = client;
+            }
+            line[length] = '\0';
+            request->lines[request->line_count].text = line;
+            request->lines[request->line_count].line_number = client->line_number;
+            request->line_count++;
+        }
+    }
+
+    /* Stopped only by the limit: come back to it after the other clients */
+    cms_client_set_runnable(server, client, ok && request == NULL && taken == CMS_SERVER_LINES_PER_WAKEUP);
+    if (request != NULL)
+    {
+        client->request = request;
+        client->input_taken = start;
+        cms_server_submit(server, request);
+    }
+    else
+    {
+        cms_client_consume(client, start);
+    }
+    return ok;
+}
+
+/* ===== Client I/O ===== */
+
+/* Reads what the client has sent; false if the connection failed */
+static bool cms_client_receive(CmsClient *client)
+{
+    size_t space = CMS_SERVER_INPUT_SIZE - client->input_length;
+    if (space == 0 || client->peer_done)
+    {
+        return true;
+    }
+    ssize_t got = read(client->fd, client->input + client->input_length, space);
+    if (got > 0)
+    {
+        client->input_length += (size_t)got;
+        return true;
+    }
+    if (got == 0)
+    {
+        client->peer_done = true;
+        return true;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+/* Sends queued output until the socket would block; false if it failed */
+static bool cms_client_send(CmsClient *client)
+{
+    while (cms_client_pending(client) > 0)
+    {
+        ssize_t sent = send(client->fd, client->output + client->output_sent,
+                            cms_client_pending(client), MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client->output_sent += (size_t)sent;
+    }
+
+    client->output_sent = 0;
+    client->output_length = 0;
+    if (client->output_capacity > CMS_SERVER_OUTPUT_KEEP)
+    {
+        /* Do not hold on to the buffer of one huge SHOW or EXPORT */
+        cms_free(client->output);
+        client->output = NULL;
+        client->output_capacity = 0;
+    }
+    return true;
+}
+
+static void cms_client_free(CmsClient *client)
+{
+    cms_transaction_destroy(client->transaction); /* never committed: rolled back */
+    if (client->page_cursor != NULL)
+    {
+        cms_cursor_close(client->page_cursor);
+        cms_free(client->page_cursor);
+    }
+    cms_free(client->output);
+    cms_free(client);
+}
+
+static void cms_client_close(CmsServer *server, CmsClient *client)
+{
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+    if (client->prev != NULL)
+    {
+        client->prev->next = client->next;
+    }
+    else
+    {
+        server->clients = client->next;
+    }
+    if (client->next != NULL)
+    {
+        client->next->prev = client->prev;
+    }
+    cms_client_set_runnable(server, client, false);
+    if (client->request == NULL)
+    {
+        cms_client_free(client);
+    }
+    /* otherwise cms_server_finish frees it once the worker is done */
+}
+
+/* Registers interest in reading (unless backed up, full or finished) and in
+   writing (while output is queued); false if the client is done */
+static bool cms_client_watch(CmsServer *server, CmsClient *client)
+{
+    size_t pending = cms_client_pending(client);
+    bool finished = client->request == NULL &&
+                    (client->closing || (client->peer_done && client->input_length == 0));
+    if (finished && pending == 0)
+    {
+        return false;
+    }
+
+    uint32_t events = 0;
+    if (!client->closing && !client->peer_done && pending < CMS_SERVER_OUTPUT_HIGH &&
+        client->input_length < CMS_SERVER_INPUT_SIZE)
+    {
+        events |= EPOLLIN;
+    }
+    if (pending > 0)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != client->events)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.ptr = client;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) != 0)
+        {
+            return false;
+        }
+        client->events = events;
+    }
+    return true;
+}
+
+/* Reads (if events say so), runs what is complete and sends what is queued */
+static void cms_client_service(CmsServer *server, CmsClient *client, uint32_t events)
+{
+    bool ok = (events & EPOLLERR) == 0;
+    if (ok && (events & (EPOLLIN | EPOLLHUP)) != 0)
+    {
+        ok = cms_client_receive(client);
+    }
+    if (ok)
+    {
+        ok = cms_client_run(server, client) && cms_client_send(client);
+    }
+    if (!ok || !cms_client_watch(server, client))
+    {
+        cms_client_close(server, client);
+    }
+}
+
+/* Queues the framed responses of a request a worker has finished and lets
+   the client carry on */
+static void cms_server_finish(CmsServer *server, CmsRequest *request)
+{
+    CmsClient *client = request->client;
+    client->request = NULL;
+    bool ok = !request->output.failed;
+    if (client->fd >= 0)
+    {
+        for (size_t i = 0; ok && i < request->line_count; ++i)
+        {
+            const CmsRequestLine *line = &request->lines[i];
+            ok = cms_client_respond(client, line->line_number, line->status, line->body_length, NULL) &&
+                 cms_client_append(client, request->output.buffer + line->body_offset, line->body_length);
+        }
+        cms_client_consume(client, client->input_taken);
+        client->input_taken = 0;
+    }
+    cms_writer_free(&request->output);
+    cms_free(request);
+
+    if (client->fd < 0)
+    {
+        cms_client_free(client);
+    }
+    else if (!ok)
+    {
+        cms_client_close(server, client);
+    }
+    else if (!server->workers_stopping)
+    {
+        cms_client_service(server, client, 0);
+    }
+}
+
+/* Takes every request the workers have finished */
+static void cms_server_collect(CmsServer *server)
+{
+    char bytes[64];
+    while (read(server->done_pipe[0], bytes, sizeof(bytes)) > 0)
+    {
+    }
+
+    pthread_mutex_lock(&server->lock);
+    CmsRequest *finished = server->finished;
+    server->finished = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (finished != NULL)
+    {
+        CmsRequest *next = finished->next;
+        cms_server_finish(server, finished);
+        finished = next;
+    }
+}
+
+static void cms_server_accept(CmsServer *server)
+{
+    while (1)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("CMS: accept");
+            }
+            return;
+        }
+
+        CmsClient *client = cms_calloc(CMS_MEM_SESSION, 1, sizeof(CmsClient));
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        if (client == NULL || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            cms_free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->events = EPOLLIN;
+        client->next = server->clients;
+        if (server->clients != NULL)
+        {
+            server->clients->prev = client;
+        }
+        server->clients = client;
+    }
+}
+
+/* ===== Setup ===== */
+
+/* Binds and listens on path, replacing a stale socket file left by a server
+   that is no longer running */
+static int cms_server_listen(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "CMS: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("CMS: socket");
+        return -1;
+    }
+
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE)
+    {
+        struct stat info;
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool in_use = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0)
+        {
+            close(probe);
+        }
+        if (in_use || stat(path, &info) != 0 || !S_ISSOCK(info.st_mode))
+        {
+            fprintf(stderr, "CMS: %s is in use\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    }
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        perror("CMS: cannot listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void cms_server_loop(CmsServer *server)
+{
+    struct epoll_event events[CMS_SERVER_MAX_EVENTS];
+    while (!cms_server_stopping)
+    {
+        /* Clients left runnable get their next turn once others have had theirs */
+        int ready = epoll_wait(server->epoll_fd, events, CMS_SERVER_MAX_EVENTS, (server->runnable > 0) ? 0 : -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("CMS: epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            if (events[i].data.ptr == &server->listen_fd)
+            {
+                cms_server_accept(server);
+            }
+            else if (events[i].data.ptr == &server->done_pipe[0])
+            {
+                cms_server_collect(server);
+            }
+            else if (events[i].data.ptr != &cms_server_wakeup[0])
+            {
+                cms_client_service(server, events[i].data.ptr, events[i].events);
+            }
+        }
+
+        CmsClient *client = server->clients;
+        while (server->runnable > 0 && client != NULL)
+        {
+            CmsClient *next = client->next;
+            if (client->runnable)
+            {
+                cms_client_service(server, client, 0);
+            }
+            client = next;
+        }
+    }
+}
+
+static bool cms_server_watch_fd(CmsServer *server, int fd, void *tag)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = tag;
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/* Starts the threads that run requests; false if none could be started */
+static bool cms_server_start_workers(CmsServer *server)
+{
+    size_t wanted = cms_get_thread_count();
+    if (wanted < CMS_SERVER_MIN_WORKERS)
+    {
+        wanted = CMS_SERVER_MIN_WORKERS;
+    }
+    server->workers = cms_calloc(CMS_MEM_SESSION, wanted, sizeof(pthread_t));
+    if (server->workers == NULL)
+    {
+        return false;
+    }
+    while (server->worker_count < wanted &&
+           pthread_create(&server->workers[server->worker_count], NULL, cms_server_worker, server) == 0)
+    {
+        server->worker_count++;
+    }
+    return server->worker_count > 0;
+}
+
+/* Lets the workers finish what is queued, then joins them */
+static void cms_server_stop_workers(CmsServer *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->workers_stopping = true;
+    pthread_cond_broadcast(&server->work);
+    pthread_mutex_unlock(&server->lock);
+    for (size_t i = 0; i < server->worker_count; ++i)
+    {
+        pthread_join(server->workers[i], NULL);
+    }
+    cms_free(server->workers);
+    server->workers = NULL;
+    server->worker_count = 0;
+}
+
+CMS_STATUS cms_serve(StudentDatabase *db, const char *socket_path)
+{
+    if (db == NULL || socket_path == NULL || socket_path[0] == '\0')
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsServer server;
+    memset(&server, 0, sizeof(server));
+    server.done_pipe[0] = -1;
+    server.done_pipe[1] = -1;
+    server.shared = cms_shared_attach(db);
+    if (server.shared == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.epoll_fd < 0)
+    {
+        cms_shared_destroy(server.shared);
+        return CMS_STATUS_ERROR;
+    }
+
+    cms_server_stopping = 0;
+    if (pipe2(cms_server_wakeup, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        close(server.epoll_fd);
+        cms_shared_destroy(server.shared);
+        return CMS_STATUS_ERROR;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.work, NULL);
+
+    /* Requests never prompt; confirmations follow the caller's --yes */
+    CmsSessionOptions previous = *cms_get_session_options();
+    CmsSessionOptions serving = previous;
+    serving.batch = true;
+    cms_set_session_options(&serving);
+
+    CMS_STATUS status = CMS_STATUS_ERROR;
+    server.listen_fd = cms_server_listen(socket_path);
+    if (server.listen_fd >= 0 && pipe2(server.done_pipe, O_NONBLOCK | O_CLOEXEC) == 0 &&
+        cms_server_watch_fd(&server, server.listen_fd, &server.listen_fd) &&
+        cms_server_watch_fd(&server, cms_server_wakeup[0], &cms_server_wakeup[0]) &&
+        cms_server_watch_fd(&server, server.done_pipe[0], &server.done_pipe[0]) &&
+        cms_server_start_workers(&server))
+    {
+        struct sigaction action;
+        struct sigaction old_int;
+        struct sigaction old_term;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = cms_server_on_signal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, &old_int);
+        sigaction(SIGTERM, &action, &old_term);
+
+        fprintf(stderr, "CMS: Serving %zu records on %s with %zu workers\n", db->count, socket_path,
+                server.worker_count);
+        cms_server_loop(&server);
+        fprintf(stderr, "CMS: Server stopped\n");
+
+        sigaction(SIGINT, &old_int, NULL);
+        sigaction(SIGTERM, &old_term, NULL);
+        status = CMS_STATUS_OK;
+    }
+    /* Requests already queued still run; their clients are closed below */
+    cms_server_stop_workers(&server);
+    cms_server_collect(&server);
+    cms_set_session_options(&previous);
+
+    /* Close the remaining connections; their clients see end of file */
+    while (server.clients != NULL)
+    {
+        cms_client_close(&server, server.clients);
+    }
+    close(server.epoll_fd);
+    if (server.listen_fd >= 0)
+    {
+        close(server.listen_fd);
+        unlink(socket_path);
+    }
+    if (server.done_pipe[0] >= 0)
+    {
+        close(server.done_pipe[0]);
+        close(server.done_pipe[1]);
+    }
+    close(cms_server_wakeup[0]);
+    close(cms_server_wakeup[1]);
+    cms_server_wakeup[0] = -1;
+    cms_server_wakeup[1] = -1;
+    pthread_cond_destroy(&server.work);
+    pthread_mutex_destroy(&server.lock);
+    cms_shared_destroy(server.shared);
+    return status;
+}
+
+#else /* !__linux__ */
+
+void cms_server_stop(void)
+{
+}
+
+CMS_STATUS cms_serve(StudentDatabase *db, const char *socket_path)
+{
+    (void)db;
+    (void)socket_path;
+    fprintf(stderr, "CMS: --serve is only available on Linux\n");
+    return CMS_STATUS_ERROR;
+}
+
+#endif /* __linux__ */
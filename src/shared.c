@@ -0,0 +1,646 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/shared.h"
+#include "../include/alloc.h"
+#include "../include/database.h"
+
+/* Snapshots store the table in fixed chunks of rows. A published version is
+   a table of chunk pointers; the next version shares every chunk the change
+   did not touch and copies the rest, so a write costs one chunk table plus
+   the changed chunks rather than the whole table. */
+#define CMS_SNAPSHOT_CHUNK 1024
+
+typedef struct
+{
+    unsigned refs; /* versions using this chunk; writers only */
+    StudentRecord records[CMS_SNAPSHOT_CHUNK];
+} CmsChunk;
+
+struct CmsVersion
+{
+    unsigned long version; /* db->version it was taken at */
+    size_t count;
+    size_t chunk_count;
+    CmsChunk **chunks;
+    unsigned long retired_epoch;
+    struct CmsVersion *next_retired;
+};
+
+/* One per pinned snapshot: the epoch it was pinned in, 0 when free. Padded
+   so readers on different cores do not share a cache line. */
+typedef struct
+{
+    atomic_ulong epoch;
+    char padding[64 - sizeof(atomic_ulong)];
+} CmsReaderSlot;
+
+struct CmsSharedDatabase
+{
+    StudentDatabase *db; /* own, or the caller's for cms_shared_attach */
+    StudentDatabase own;
+    bool snapshots;      /* versions are published (not when attached) */
+    pthread_rwlock_t lock;
+
+    /* Snapshot publication. Only writers (holding the lock exclusively)
+       publish, retire and free; readers touch just published and their
+       own slot. */
+    _Atomic(CmsVersion *) published;
+    atomic_ulong epoch;
+    CmsReaderSlot readers[CMS_MAX_SNAPSHOT_READERS];
+    CmsVersion *retired;
+    size_t stale_from; /* rows changed since the last publish */
+    size_t stale_to;
+};
+
+static CMS_STATUS cms_shared_publish(CmsSharedDatabase *shared);
+static void cms_version_free(CmsVersion *version);
+
+/* Allocates the handle and sets up its lock; db is filled in by the caller */
+static CmsSharedDatabase *cms_shared_new(void)
+{
+    CmsSharedDatabase *shared = cms_malloc(CMS_MEM_SESSION, sizeof(CmsSharedDatabase));
+    if (shared == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_rwlockattr_t attributes;
+    if (pthread_rwlockattr_init(&attributes) != 0)
+    {
+        cms_free(shared);
+        return NULL;
+    }
+#ifdef __GLIBC__
+    /* A steady stream of readers must not starve writers */
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int failed = pthread_rwlock_init(&shared->lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    if (failed != 0)
+    {
+        cms_free(shared);
+        return NULL;
+    }
+
+    shared->db = &shared->own;
+    shared->snapshots = false;
+    atomic_init(&shared->published, NULL);
+    atomic_init(&shared->epoch, 1);
+    for (size_t i = 0; i < CMS_MAX_SNAPSHOT_READERS; ++i)
+    {
+        atomic_init(&shared->readers[i].epoch, 0);
+    }
+    shared->retired = NULL;
+    shared->stale_from = 0;
+    shared->stale_to = SIZE_MAX;
+    return shared;
+}
+
+CmsSharedDatabase *cms_shared_create(void)
+{
+    CmsSharedDatabase *shared = cms_shared_new();
+    if (shared == NULL)
+    {
+        return NULL;
+    }
+
+    if (cms_database_init(&shared->own) != CMS_STATUS_OK)
+    {
+        pthread_rwlock_destroy(&shared->lock);
+        cms_free(shared);
+        return NULL;
+    }
+    shared->snapshots = true;
+    if (cms_shared_publish(shared) != CMS_STATUS_OK)
+    {
+        cms_database_cleanup(&shared->own);
+        pthread_rwlock_destroy(&shared->lock);
+        cms_free(shared);
+        return NULL;
+    }
+    return shared;
+}
+
+CmsSharedDatabase *cms_shared_attach(StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return NULL;
+    }
+    CmsSharedDatabase *shared = cms_shared_new();
+    if (shared != NULL)
+    {
+        shared->db = db;
+    }
+    return shared;
+}
+
+void cms_shared_destroy(CmsSharedDatabase *shared)
+{
+    if (shared == NULL)
+    {
+        return;
+    }
+    while (shared->retired != NULL)
+    {
+        CmsVersion *next = shared->retired->next_retired;
+        cms_version_free(shared->retired);
+        shared->retired = next;
+    }
+    cms_version_free(atomic_load(&shared->published));
+    if (shared->db == &shared->own)
+    {
+        cms_database_cleanup(&shared->own);
+    }
+    pthread_rwlock_destroy(&shared->lock);
+    cms_free(shared);
+}
+
+CMS_STATUS cms_shared_read(CmsSharedDatabase *shared, CmsReadFunction read, void *context)
+{
+    if (shared == NULL || read == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (pthread_rwlock_rdlock(&shared->lock) != 0)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    CMS_STATUS status = read(shared->db, context);
+    pthread_rwlock_unlock(&shared->lock);
+    return status;
+}
+
+typedef struct
+{
+    const char *file_path;
+    int student_id;
+    const StudentRecord *record;
+    size_t changed_from; /* rows the change touched, set by the operation */
+    size_t changed_to;
+} CmsSharedChange;
+
+/* Runs a change under the exclusive lock and, if it changed the database,
+   publishes a new snapshot version. change (may be NULL: everything) says
+   which rows it touched. If memory runs out the previous version stays
+   published and the rows stay marked, so the next change catches up. */
+static CMS_STATUS cms_shared_apply(CmsSharedDatabase *shared, CmsWriteFunction write, void *context,
+                                   const CmsSharedChange *change)
+{
+    if (shared == NULL || write == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (pthread_rwlock_wrlock(&shared->lock) != 0)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    unsigned long version = shared->db->version;
+    CMS_STATUS status = write(shared->db, context);
+    if (shared->snapshots && shared->db->version != version)
+    {
+        size_t from = (change != NULL) ? change->changed_from : 0;
+        size_t to = (change != NULL) ? change->changed_to : SIZE_MAX;
+        shared->stale_from = (from < shared->stale_from) ? from : shared->stale_from;
+        shared->stale_to = (to > shared->stale_to) ? to : shared->stale_to;
+        cms_shared_publish(shared);
+    }
+    pthread_rwlock_unlock(&shared->lock);
+    return status;
+}
+
+CMS_STATUS cms_shared_write(CmsSharedDatabase *shared, CmsWriteFunction write, void *context)
+{
+    return cms_shared_apply(shared, write, context, NULL);
+}
+
+/* ===== Exclusive operations ===== */
+
+
+static CMS_STATUS cms_shared_do_load(StudentDatabase *db, void *context)
+{
+    CmsSharedChange *change = context;
+    change->changed_from = 0;
+    change->changed_to = SIZE_MAX;
+    return cms_database_load(db, change->file_path);
+}
+
+static CMS_STATUS cms_shared_do_save(StudentDatabase *db, void *context)
+{
+    const char *file_path = ((const CmsSharedChange *)context)->file_path;
+    return cms_database_save(db, (file_path != NULL) ? file_path : db->file_path);
+}
+
+static CMS_STATUS cms_shared_do_insert(StudentDatabase *db, void *context)
+{
+    CmsSharedChange *change = context;
+    change->changed_from = db->count;
+    change->changed_to = SIZE_MAX;
+    return cms_database_insert(db, change->record);
+}
+
+static CMS_STATUS cms_shared_do_update(StudentDatabase *db, void *context)
+{
+    CmsSharedChange *change = context;
+    size_t index = 0;
+    if (cms_index_find_id(db, change->student_id, &index))
+    {
+        change->changed_from = index;
+        change->changed_to = index + 1;
+    }
+    return cms_database_update(db, change->student_id, change->record);
+}
+
+/* Removing a row shifts every row after it */
+static CMS_STATUS cms_shared_do_delete(StudentDatabase *db, void *context)
+{
+    CmsSharedChange *change = context;
+    size_t index = 0;
+    if (cms_index_find_id(db, change->student_id, &index))
+    {
+        change->changed_from = index;
+    }
+    return cms_database_delete(db, change->student_id);
+}
+
+/* Undo and redo may touch rows anywhere, so they republish everything */
+static CMS_STATUS cms_shared_do_undo(StudentDatabase *db, void *context)
+{
+    (void)context;
+    return cms_database_undo(db, 1, NULL);
+}
+
+static CMS_STATUS cms_shared_do_redo(StudentDatabase *db, void *context)
+{
+    (void)context;
+    return cms_database_redo(db, 1, NULL);
+}
+
+CMS_STATUS cms_shared_load(CmsSharedDatabase *shared, const char *file_path)
+{
+    CmsSharedChange change = {file_path, 0, NULL, 0, SIZE_MAX};
+    return cms_shared_apply(shared, cms_shared_do_load, &change, &change);
+}
+
+CMS_STATUS cms_shared_save(CmsSharedDatabase *shared, const char *file_path)
+{
+    CmsSharedChange change = {file_path, 0, NULL, 0, SIZE_MAX};
+    return cms_shared_apply(shared, cms_shared_do_save, &change, &change);
+}
+
+CMS_STATUS cms_shared_insert(CmsSharedDatabase *shared, const StudentRecord *record)
+{
+    CmsSharedChange change = {NULL, 0, record, 0, SIZE_MAX};
+    return cms_shared_apply(shared, cms_shared_do_insert, &change, &change);
+}
+
+CMS_STATUS cms_shared_update(CmsSharedDatabase *shared, int student_id, const StudentRecord *new_record)
+{
+    CmsSharedChange change = {NULL, student_id, new_record, 0, SIZE_MAX};
+    return cms_shared_apply(shared, cms_shared_do_update, &change, &change);
+}
+
+CMS_STATUS cms_shared_delete(CmsSharedDatabase *shared, int student_id)
+{
+    CmsSharedChange change = {NULL, student_id, NULL, 0, SIZE_MAX};
+    return cms_shared_apply(shared, cms_shared_do_delete, &change, &change);
+}
+
+CMS_STATUS cms_shared_undo(CmsSharedDatabase *shared)
+{
+    return cms_shared_apply(shared, cms_shared_do_undo, NULL, NULL);
+}
+
+CMS_STATUS cms_shared_redo(CmsSharedDatabase *shared)
+{
+    return cms_shared_apply(shared, cms_shared_do_redo, NULL, NULL);
+}
+
+/* ===== Shared operations ===== */
+
+typedef struct
+{
+    int student_id;
+    StudentRecord *record;
+    const CmsSelection *selection;
+    size_t *count;
+    SummaryStats *stats;
+} CmsLookup;
+
+static CMS_STATUS cms_shared_do_query(const StudentDatabase *db, void *context)
+{
+    CmsLookup *lookup = context;
+    return cms_database_query(db, lookup->student_id, lookup->record);
+}
+
+static CMS_STATUS cms_shared_do_count(const StudentDatabase *db, void *context)
+{
+    CmsLookup *lookup = context;
+    return cms_index_count(db, lookup->selection, lookup->count);
+}
+
+static CMS_STATUS cms_shared_do_summary(const StudentDatabase *db, void *context)
+{
+    return cms_calculate_summary(db, ((CmsLookup *)context)->stats);
+}
+
+CMS_STATUS cms_shared_query(CmsSharedDatabase *shared, int student_id, StudentRecord *out_record)
+{
+    CmsLookup lookup = {student_id, out_record, NULL, NULL, NULL};
+    return cms_shared_read(shared, cms_shared_do_query, &lookup);
+}
+
+CMS_STATUS cms_shared_count(CmsSharedDatabase *shared, const CmsSelection *selection, size_t *out_count)
+{
+    CmsLookup lookup = {0, NULL, selection, out_count, NULL};
+    return cms_shared_read(shared, cms_shared_do_count, &lookup);
+}
+
+CMS_STATUS cms_shared_summary(CmsSharedDatabase *shared, SummaryStats *out_stats)
+{
+    CmsLookup lookup = {0, NULL, NULL, NULL, out_stats};
+    return cms_shared_read(shared, cms_shared_do_summary, &lookup);
+}
+
+typedef struct
+{
+    CmsSortKey sort_key;
+    CmsSortOrder sort_order;
+    size_t offset;
+    StudentRecord *records;
+    size_t capacity;
+    size_t *count;
+} CmsSortedCopy;
+
+static CMS_STATUS cms_shared_do_sorted(const StudentDatabase *db, void *context)
+{
+    CmsSortedCopy *copy = context;
+    CmsCursor cursor;
+    CMS_STATUS status = cms_cursor_open_sorted(&cursor, db, copy->sort_key, copy->sort_order);
+    if (status != CMS_STATUS_OK)
+    {
+        return status;
+    }
+
+    const StudentRecord *record = NULL;
+    cms_cursor_skip(&cursor, copy->offset);
+    while (*copy->count < copy->capacity && cms_cursor_next(&cursor, &record) == CMS_STATUS_OK)
+    {
+        copy->records[(*copy->count)++] = *record;
+    }
+    cms_cursor_close(&cursor);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_shared_sorted(CmsSharedDatabase *shared, CmsSortKey sort_key, CmsSortOrder sort_order,
+                             size_t offset, StudentRecord *out_records, size_t capacity, size_t *out_count)
+{
+    if (out_count == NULL || (out_records == NULL && capacity > 0))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    *out_count = 0;
+    CmsSortedCopy copy = {sort_key, sort_order, offset, out_records, capacity, out_count};
+    return cms_shared_read(shared, cms_shared_do_sorted, &copy);
+}
+
+typedef struct
+{
+    const char *text;
+    bool prefix_only;
+    int **ids;
+    size_t *count;
+} CmsNameSearch;
+
+static CMS_STATUS cms_shared_do_search_name(const StudentDatabase *db, void *context)
+{
+    CmsNameSearch *search = context;
+    return cms_index_search_name(db, search->text, search->prefix_only, search->ids, search->count);
+}
+
+CMS_STATUS cms_shared_search_name(CmsSharedDatabase *shared, const char *text, bool prefix_only,
+                                  int **out_ids, size_t *out_count)
+{
+    CmsNameSearch search = {text, prefix_only, out_ids, out_count};
+    return cms_shared_read(shared, cms_shared_do_search_name, &search);
+}
+
+/* ===== Snapshots ===== */
+
+static void cms_version_free(CmsVersion *version)
+{
+    if (version == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < version->chunk_count; ++i)
+    {
+        if (--version->chunks[i]->refs == 0)
+        {
+            cms_free(version->chunks[i]);
+        }
+    }
+    cms_free(version->chunks);
+    cms_free(version);
+}
+
+/* Frees retired versions no pinned snapshot can still be reading: one
+   retired in epoch E is unreachable once every pinned reader entered a
+   later epoch, because those readers loaded the pointer after it was
+   replaced. */
+static void cms_shared_reclaim(CmsSharedDatabase *shared)
+{
+    unsigned long oldest = ULONG_MAX;
+    for (size_t i = 0; i < CMS_MAX_SNAPSHOT_READERS; ++i)
+    {
+        unsigned long epoch = atomic_load(&shared->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    CmsVersion **link = &shared->retired;
+    while (*link != NULL)
+    {
+        CmsVersion *version = *link;
+        if (version->retired_epoch < oldest)
+        {
+            *link = version->next_retired;
+            cms_version_free(version);
+        }
+        else
+        {
+            link = &version->next_retired;
+        }
+    }
+}
+
+/* Called with the lock held exclusively */
+static CMS_STATUS cms_shared_publish(CmsSharedDatabase *shared)
+{
+    const StudentDatabase *db = shared->db;
+    CmsVersion *previous = atomic_load(&shared->published);
+    CmsVersion *next = cms_calloc(CMS_MEM_RECORDS, 1, sizeof(CmsVersion));
+    if (next == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    next->version = db->version;
+    next->count = db->count;
+    size_t chunk_count = (db->count + CMS_SNAPSHOT_CHUNK - 1) / CMS_SNAPSHOT_CHUNK;
+    if (chunk_count > 0)
+    {
+        next->chunks = cms_malloc(CMS_MEM_RECORDS, chunk_count * sizeof(CmsChunk *));
+        if (next->chunks == NULL)
+        {
+            cms_free(next);
+            return CMS_STATUS_ERROR;
+        }
+    }
+
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        size_t first = i * CMS_SNAPSHOT_CHUNK;
+        size_t end = (first + CMS_SNAPSHOT_CHUNK < db->count) ? first + CMS_SNAPSHOT_CHUNK : db->count;
+        bool unchanged = end <= shared->stale_from || first >= shared->stale_to;
+        if (previous != NULL && i < previous->chunk_count && unchanged)
+        {
+            size_t previous_end = (first + CMS_SNAPSHOT_CHUNK < previous->count)
+                                      ? first + CMS_SNAPSHOT_CHUNK
+                                      : previous->count;
+            if (previous_end == end)
+            {
+                next->chunks[i] = previous->chunks[i];
+                next->chunks[i]->refs++;
+                next->chunk_count++;
+                continue;
+            }
+        }
+
+        CmsChunk *chunk = cms_malloc(CMS_MEM_RECORDS, sizeof(CmsChunk));
+        if (chunk == NULL)
+        {
+            cms_version_free(next);
+            return CMS_STATUS_ERROR;
+        }
+        chunk->refs = 1;
+        memcpy(chunk->records, &db->records[first], (end - first) * sizeof(StudentRecord));
+        next->chunks[i] = chunk;
+        next->chunk_count++;
+    }
+
+    atomic_store(&shared->published, next);
+    shared->stale_from = SIZE_MAX;
+    shared->stale_to = 0;
+    if (previous != NULL)
+    {
+        previous->retired_epoch = atomic_fetch_add(&shared->epoch, 1);
+        previous->next_retired = shared->retired;
+        shared->retired = previous;
+    }
+    cms_shared_reclaim(shared);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_snapshot_acquire(CmsSharedDatabase *shared, CmsSnapshot *out_snapshot)
+{
+    if (shared == NULL || out_snapshot == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (!shared->snapshots)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    /* Announce the epoch before loading the pointer, so a writer that
+       retires the version loaded here will see this slot */
+    for (size_t i = 0; i < CMS_MAX_SNAPSHOT_READERS; ++i)
+    {
+        unsigned long free_slot = 0;
+        unsigned long epoch = atomic_load(&shared->epoch);
+        if (atomic_compare_exchange_strong(&shared->readers[i].epoch, &free_slot, epoch))
+        {
+            out_snapshot->shared = shared;
+            out_snapshot->slot = i;
+            out_snapshot->version = atomic_load(&shared->published);
+            return CMS_STATUS_OK;
+        }
+    }
+    return CMS_STATUS_ERROR;
+}
+
+void cms_snapshot_release(CmsSnapshot *snapshot)
+{
+    if (snapshot == NULL || snapshot->version == NULL)
+    {
+        return;
+    }
+    atomic_store(&snapshot->shared->readers[snapshot->slot].epoch, 0);
+    snapshot->version = NULL;
+}
+
+size_t cms_snapshot_count(const CmsSnapshot *snapshot)
+{
+    return (snapshot != NULL && snapshot->version != NULL) ? snapshot->version->count : 0;
+}
+
+unsigned long cms_snapshot_version(const CmsSnapshot *snapshot)
+{
+    return (snapshot != NULL && snapshot->version != NULL) ? snapshot->version->version : 0;
+}
+
+const StudentRecord *cms_snapshot_rows(const CmsSnapshot *snapshot, size_t position, size_t *out_count)
+{
+    if (out_count != NULL)
+    {
+        *out_count = 0;
+    }
+    if (snapshot == NULL || snapshot->version == NULL || position >= snapshot->version->count)
+    {
+        return NULL;
+    }
+
+    const CmsVersion *version = snapshot->version;
+    size_t chunk = position / CMS_SNAPSHOT_CHUNK;
+    size_t end = (chunk + 1) * CMS_SNAPSHOT_CHUNK;
+    if (out_count != NULL)
+    {
+        *out_count = ((end < version->count) ? end : version->count) - position;
+    }
+    return &version->chunks[chunk]->records[position % CMS_SNAPSHOT_CHUNK];
+}
+
+CMS_STATUS cms_snapshot_summary(const CmsSnapshot *snapshot, SummaryStats *out_stats)
+{
+    if (snapshot == NULL || snapshot->version == NULL || out_stats == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    if (snapshot->version->count == 0)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    memset(out_stats, 0, sizeof(SummaryStats));
+    float total = 0.0f;
+    size_t position = 0;
+    size_t run = 0;
+    const StudentRecord *rows = NULL;
+    while ((rows = cms_snapshot_rows(snapshot, position, &run)) != NULL)
+    {
+        cms_summary_add(out_stats, &total, rows, run);
+        position += run;
+    }
+    cms_summary_finish(out_stats, total);
+    return CMS_STATUS_OK;
+}
@@ -0,0 +1,318 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../include/sidecar.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+#include "../include/index.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define CMS_SIDECAR_VERSION 1u
+#define CMS_SIDECAR_BYTE_ORDER 0x01020304u
+#define CMS_SIDECAR_PATH_LEN (CMS_MAX_FILE_PATH_LEN + sizeof(CMS_SIDECAR_SUFFIX))
+
+#define CMS_CHECKSUM_SEED 0x9e3779b97f4a7c15ULL
+#define CMS_CHECKSUM_MULTIPLIER 0xff51afd7ed558ccdULL
+#define CMS_CHECKSUM_CHUNK 65536
+
+static const unsigned char cms_sidecar_magic[8] = {'C', 'M', 'S', 'I', 'D', 'X', '\0', 1};
+
+/* Start of the file, written as laid out in memory */
+typedef struct
+{
+    unsigned char magic[8];
+    uint32_t version;
+    uint32_t byte_order; /* CMS_SIDECAR_BYTE_ORDER as this machine stores it */
+    uint64_t data_size;
+    int64_t data_mtime;
+    uint64_t data_checksum;
+    uint64_t record_count;
+    uint64_t rows_checksum; /* IDs and names in row order */
+    uint64_t body_size;
+    uint64_t body_checksum;
+} CmsSidecarHeader;
+
+/* Word-at-a-time multiply-xorshift hash. Chained calls give the same value
+   as one call over the joined bytes while every call but the last covers a
+   multiple of 8 bytes. */
+static uint64_t cms_checksum(uint64_t hash, const unsigned char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * CMS_CHECKSUM_MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+    if (i < size)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        hash = (hash ^ word ^ ((uint64_t)(size - i) << 56)) * CMS_CHECKSUM_MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/* Checksum and length of the rest of fp; fread fills every chunk but the last */
+static bool cms_stream_checksum(FILE *fp, uint64_t *out_checksum, uint64_t *out_size)
+{
+    unsigned char *buffer = cms_malloc(CMS_MEM_TEMP, CMS_CHECKSUM_CHUNK);
+    if (buffer == NULL)
+    {
+        return false;
+    }
+
+    uint64_t hash = CMS_CHECKSUM_SEED;
+    uint64_t size = 0;
+    size_t got;
+    while ((got = fread(buffer, 1, CMS_CHECKSUM_CHUNK, fp)) > 0)
+    {
+        hash = cms_checksum(hash, buffer, got);
+        size += got;
+    }
+    cms_free(buffer);
+
+    *out_checksum = hash;
+    if (out_size != NULL)
+    {
+        *out_size = size;
+    }
+    return !ferror(fp);
+}
+
+static bool cms_file_checksum(const char *path, uint64_t *out_checksum)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    bool ok = cms_stream_checksum(fp, out_checksum, NULL);
+    fclose(fp);
+    return ok;
+}
+
+/* What the name indexes are built from: each row's ID and name */
+static uint64_t cms_rows_checksum(const StudentDatabase *db)
+{
+    uint64_t hash = CMS_CHECKSUM_SEED;
+    unsigned char row[sizeof(int) + CMS_MAX_NAME_LEN + 1];
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        size_t name_length = strlen(db->records[i].name);
+        memcpy(row, &db->records[i].id, sizeof(int));
+        memcpy(row + sizeof(int), db->records[i].name, name_length);
+        hash = cms_checksum(hash, row, sizeof(int) + name_length);
+    }
+    return hash;
+}
+
+static bool cms_sidecar_path(const char *data_path, char *out, size_t size)
+{
+    int length = snprintf(out, size, "%s%s", data_path, CMS_SIDECAR_SUFFIX);
+    return data_path[0] != '\0' && length > 0 && (size_t)length < size;
+}
+
+#ifndef _WIN32
+static bool cms_sidecar_map(const char *path, CmsSidecar *sidecar)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(CmsSidecarHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    sidecar->base = base;
+    sidecar->length = (size_t)info.st_size;
+    sidecar->mapped = true;
+    return true;
+}
+#else
+/* No mmap: read the file into memory instead */
+static bool cms_sidecar_map(const char *path, CmsSidecar *sidecar)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    long length = -1;
+    if (fseek(fp, 0, SEEK_END) == 0)
+    {
+        length = ftell(fp);
+    }
+    void *base = NULL;
+    if (length >= (long)sizeof(CmsSidecarHeader) && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        base = cms_malloc(CMS_MEM_INDEXES, (size_t)length);
+    }
+    if (base == NULL || fread(base, 1, (size_t)length, fp) != (size_t)length)
+    {
+        cms_free(base);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    sidecar->base = base;
+    sidecar->length = (size_t)length;
+    sidecar->mapped = false;
+    return true;
+}
+#endif
+
+void cms_sidecar_close(CmsSidecar *sidecar)
+{
+    if (sidecar == NULL || sidecar->base == NULL)
+    {
+        return;
+    }
+#ifndef _WIN32
+    if (sidecar->mapped)
+    {
+        munmap(sidecar->base, sidecar->length);
+    }
+    else
+#endif
+    {
+        cms_free(sidecar->base);
+    }
+    memset(sidecar, 0, sizeof(*sidecar));
+}
+
+CMS_STATUS cms_sidecar_open(const StudentDatabase *db, CmsSidecar *out_sidecar)
+{
+    if (db == NULL || out_sidecar == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    memset(out_sidecar, 0, sizeof(*out_sidecar));
+
+    char path[CMS_SIDECAR_PATH_LEN];
+    struct stat info;
+    if (!cms_sidecar_path(db->file_path, path, sizeof(path)) || stat(db->file_path, &info) != 0 ||
+        !cms_sidecar_map(path, out_sidecar))
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    /* Cheapest checks first; the file checksum reads the data file again */
+    CmsSidecarHeader header;
+    memcpy(&header, out_sidecar->base, sizeof(header));
+    const unsigned char *body = (const unsigned char *)out_sidecar->base + sizeof(header);
+    uint64_t data_checksum = 0;
+    bool fresh = memcmp(header.magic, cms_sidecar_magic, sizeof(header.magic)) == 0 &&
+                 header.version == CMS_SIDECAR_VERSION &&
+                 header.byte_order == CMS_SIDECAR_BYTE_ORDER &&
+                 header.data_size == (uint64_t)info.st_size &&
+                 header.data_mtime == (int64_t)info.st_mtime &&
+                 header.record_count == db->count &&
+                 header.body_size == out_sidecar->length - sizeof(header) &&
+                 cms_checksum(CMS_CHECKSUM_SEED, body, out_sidecar->length - sizeof(header)) ==
+                     header.body_checksum &&
+                 cms_rows_checksum(db) == header.rows_checksum &&
+                 cms_file_checksum(db->file_path, &data_checksum) &&
+                 data_checksum == header.data_checksum;
+    if (!fresh)
+    {
+        cms_sidecar_close(out_sidecar);
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    out_sidecar->body = body;
+    out_sidecar->body_size = out_sidecar->length - sizeof(header);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_sidecar_save(const StudentDatabase *db)
+{
+    if (db == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    char path[CMS_SIDECAR_PATH_LEN];
+    if (!cms_sidecar_path(db->file_path, path, sizeof(path)))
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    CmsSidecarHeader header;
+    memset(&header, 0, sizeof(header));
+    struct stat info;
+    if (stat(db->file_path, &info) != 0 || !cms_file_checksum(db->file_path, &header.data_checksum))
+    {
+        return CMS_STATUS_IO;
+    }
+
+    FILE *fp = fopen(path, "w+b");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+
+    /* The header goes in last, so a sidecar cut short never checks out */
+    CMS_STATUS status = (fwrite(&header, sizeof(header), 1, fp) == 1) ? CMS_STATUS_OK : CMS_STATUS_IO;
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_index_save_names(db, fp);
+    }
+    if (status == CMS_STATUS_OK &&
+        (fseek(fp, (long)sizeof(header), SEEK_SET) != 0 ||
+         !cms_stream_checksum(fp, &header.body_checksum, &header.body_size)))
+    {
+        status = CMS_STATUS_IO;
+    }
+
+    if (status == CMS_STATUS_OK)
+    {
+        memcpy(header.magic, cms_sidecar_magic, sizeof(header.magic));
+        header.version = CMS_SIDECAR_VERSION;
+        header.byte_order = CMS_SIDECAR_BYTE_ORDER;
+        header.data_size = (uint64_t)info.st_size;
+        header.data_mtime = (int64_t)info.st_mtime;
+        header.record_count = db->count;
+        header.rows_checksum = cms_rows_checksum(db);
+        if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1)
+        {
+            status = CMS_STATUS_IO;
+        }
+    }
+
+    if (fclose(fp) != 0)
+    {
+        status = CMS_STATUS_IO;
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        remove(path);
+    }
+    return status;
+}
@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../include/summary.h"
+#include "../include/alloc.h"
 #include <string.h>
 #include "../include/database.h"
+#include "../include/index.h"
+#include "../include/utils.h"
+#include "../include/render.h"
 
-static CmsGradeBucket cms_grade_bucket_from_mark(float mark)
+CmsGradeBucket cms_grade_bucket_from_mark(float mark)
 {
     if (mark >= 85.0f)
     {
@@ -40,6 +44,33 @@ static CmsGradeBucket cms_grade_bucket_from_mark(float mark)
 static const char *cms_grade_labels[CMS_GRADE_BUCKET_COUNT] = {
     "A+", "A", "B+", "B", "C+", "C", "D", "F"};
 
+const char *cms_grade_bucket_label(CmsGradeBucket bucket)
+{
+    if (bucket < 0 || bucket >= CMS_GRADE_BUCKET_COUNT)
+    {
+        return "?";
+    }
+    return cms_grade_labels[bucket];
+}
+
+bool cms_grade_bucket_from_label(const char *label, CmsGradeBucket *out_bucket)
+{
+    if (label == NULL || out_bucket == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
+    {
+        if (cms_string_equals_ignore_case(label, cms_grade_labels[i]))
+        {
+            *out_bucket = (CmsGradeBucket)i;
+            return true;
+        }
+    }
+    return false;
+}
+
 /* Render a simple ASCII bar chart for grade counts */
 static void cms_print_grade_bar_chart(const SummaryStats *stats)
 {
@@ -61,28 +92,53 @@ static void cms_print_grade_bar_chart(const SummaryStats *stats)
 
     if (max_count == 0)
     {
-        printf("  Grade Distribution (bar chart): no data available.\n\n");
+        cms_printf("  Grade Distribution (bar chart): no data available.\n\n");
         return;
     }
 
     const int max_bar_width = 40; /* terminal-friendly width */
-    printf("  Grade Distribution (bar chart):\n");
-    printf("    %-3s | %-*s Count\n", "Grade", max_bar_width, "");
-    printf("    ----   %.*s ------\n", max_bar_width, "----------------------------------------");
+    cms_printf("  Grade Distribution (bar chart):\n");
+    cms_printf("    %-3s | %-*s Count\n", "Grade", max_bar_width, "");
+    cms_printf("    ----   %.*s ------\n", max_bar_width, "----------------------------------------");
 
     for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
     {
         size_t count = stats->grade_counts[i];
         int bar_length = (int)((double)count / (double)max_count * max_bar_width + 0.5);
 
-        printf("    %-3s | ", cms_grade_labels[i]);
+        cms_printf("    %-3s | ", cms_grade_labels[i]);
         for (int j = 0; j < bar_length; ++j)
         {
-            putchar(bar_char);
+            cms_printf("%c", bar_char);
         }
-        printf(" (%zu)\n", count);
+        cms_printf(" (%zu)\n", count);
     }
-    printf("\n");
+    cms_printf("\n");
+}
+
+int cms_compare_records(const StudentRecord *a, const StudentRecord *b, CmsSortKey sort_key)
+{
+    int result = 0;
+    switch (sort_key)
+    {
+    case CMS_SORT_KEY_MARK:
+        result = (a->mark > b->mark) - (a->mark < b->mark);
+        break;
+    case CMS_SORT_KEY_NAME:
+        result = strcmp(a->name, b->name);
+        break;
+    case CMS_SORT_KEY_PROGRAMME:
+        result = strcmp(a->programme, b->programme);
+        break;
+    default:
+        break;
+    }
+
+    if (result == 0)
+    {
+        result = (a->id > b->id) - (a->id < b->id);
+    }
+    return result;
 }
 
 /* Comparison functions for qsort */
@@ -161,6 +217,8 @@ CMS_STATUS cms_sort_by_name(StudentDatabase *db, SortOrder order)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
+    db->version++;
+    cms_index_on_reorder(db);
     return CMS_STATUS_OK;
 }
 
@@ -185,6 +243,8 @@ CMS_STATUS cms_sort_by_prog(StudentDatabase *db, SortOrder order)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
+    db->version++;
+    cms_index_on_reorder(db);
     return CMS_STATUS_OK;
 }
 
@@ -209,6 +269,8 @@ CMS_STATUS cms_sort_by_id(StudentDatabase *db, SortOrder order)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
+    db->version++;
+    cms_index_on_reorder(db);
     return CMS_STATUS_OK;
 }
 
@@ -232,40 +294,19 @@ CMS_STATUS cms_sort_by_mark(StudentDatabase *db, SortOrder order)
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
+    db->version++;
+    cms_index_on_reorder(db);
     return CMS_STATUS_OK;
 }
 
-CMS_STATUS cms_calculate_summary(const StudentDatabase *db, SummaryStats *stats)
+void cms_summary_add(SummaryStats *stats, float *total, const StudentRecord *records, size_t count)
 {
-    if (db == NULL || stats == NULL)
-    {
-        return CMS_STATUS_INVALID_ARGUMENT;
-    }
-
-    if (db->records == NULL || db->count == 0)
-    {
-        return CMS_STATUS_NOT_FOUND;
-    }
-
-    memset(stats, 0, sizeof(SummaryStats));
-    stats->count = db->count;
-    float total = 0.0f;
-
-    stats->highest = db->records[0].mark;
-    stats->lowest = db->records[0].mark;
-    stats->highest_id = db->records[0].id;
-    stats->lowest_id = db->records[0].id;
-    strncpy(stats->highest_name, db->records[0].name, CMS_MAX_NAME_LEN);
-    stats->highest_name[CMS_MAX_NAME_LEN] = '\0';
-    strncpy(stats->lowest_name, db->records[0].name, CMS_MAX_NAME_LEN);
-    stats->lowest_name[CMS_MAX_NAME_LEN] = '\0';
-
-    for (size_t i = 0; i < db->count; ++i)
+    for (size_t i = 0; i < count; ++i)
     {
-        const StudentRecord *record = &db->records[i];
-        total += record->mark;
+        const StudentRecord *record = &records[i];
+        *total += record->mark;
 
-        if (record->mark > stats->highest)
+        if (stats->count == 0 || record->mark > stats->highest)
         {
             stats->highest = record->mark;
             stats->highest_id = record->id;
@@ -273,7 +314,7 @@ CMS_STATUS cms_calculate_summary(const StudentDatabase *db, SummaryStats *stats)
             stats->highest_name[CMS_MAX_NAME_LEN] = '\0';
         }
 
-        if (record->mark < stats->lowest)
+        if (stats->count == 0 || record->mark < stats->lowest)
         {
             stats->lowest = record->mark;
             stats->lowest_id = record->id;
@@ -286,10 +327,44 @@ CMS_STATUS cms_calculate_summary(const StudentDatabase *db, SummaryStats *stats)
         {
             stats->grade_counts[bucket]++;
         }
+        stats->count++;
     }
+}
 
-    stats->average = total / (float)stats->count;
+void cms_summary_finish(SummaryStats *stats, float total)
+{
+    stats->average = (stats->count > 0) ? total / (float)stats->count : 0.0f;
+}
 
+CMS_STATUS cms_calculate_summary(const StudentDatabase *db, SummaryStats *stats)
+{
+    if (db == NULL || stats == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (cms_database_row_count(db) == 0)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    /* Inside a transaction the summary covers the rows it sees */
+    StudentRecord *rows = db->records;
+    size_t count = db->count;
+    if (cms_database_has_pending(db) && cms_database_copy_rows(db, &rows, &count) != CMS_STATUS_OK)
+    {
+        return CMS_STATUS_ERROR;
+    }
+
+    memset(stats, 0, sizeof(SummaryStats));
+    float total = 0.0f;
+    cms_summary_add(stats, &total, rows, count);
+    cms_summary_finish(stats, total);
+
+    if (rows != db->records)
+    {
+        cms_free(rows);
+    }
     return CMS_STATUS_OK;
 }
 
@@ -305,7 +380,7 @@ CMS_STATUS cms_display_summary(const StudentDatabase *db)
 
     if (status == CMS_STATUS_NOT_FOUND)
     {
-        printf("\nNo records available to summarize.\n\n");
+        cms_printf("\nNo records available to summarize.\n\n");
         return CMS_STATUS_OK;
     }
 
@@ -314,17 +389,17 @@ CMS_STATUS cms_display_summary(const StudentDatabase *db)
         return status;
     }
 
-    printf("\nSummary Statistics:\n");
-    printf("  Total Students: %zu\n", stats.count);
-    printf("  Average Mark: %.2f\n", stats.average);
-    printf("  Highest Mark: %.2f (ID: %d | Student: %s)\n", stats.highest, stats.highest_id, stats.highest_name);
-    printf("  Lowest Mark: %.2f (ID: %d | Student: %s)\n\n", stats.lowest, stats.lowest_id, stats.lowest_name);
-    printf("  Grade Counts:\n");
+    cms_printf("\nSummary Statistics:\n");
+    cms_printf("  Total Students: %zu\n", stats.count);
+    cms_printf("  Average Mark: %.2f\n", stats.average);
+    cms_printf("  Highest Mark: %.2f (ID: %d | Student: %s)\n", stats.highest, stats.highest_id, stats.highest_name);
+    cms_printf("  Lowest Mark: %.2f (ID: %d | Student: %s)\n\n", stats.lowest, stats.lowest_id, stats.lowest_name);
+    cms_printf("  Grade Counts:\n");
     for (int i = 0; i < CMS_GRADE_BUCKET_COUNT; ++i)
     {
-        printf("    %-3s: %zu\n", cms_grade_labels[i], stats.grade_counts[i]);
+        cms_printf("    %-3s: %zu\n", cms_grade_labels[i], stats.grade_counts[i]);
     }
-    printf("\n");
+    cms_printf("\n");
 
     cms_print_grade_bar_chart(&stats);
 
@@ -348,20 +423,19 @@ CMS_STATUS cms_show_all_sorted(const StudentDatabase *db, CmsSortKey sort_key, C
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    if (db->records == NULL || db->count == 0)
+    if (cms_database_row_count(db) == 0)
     {
-        printf("\nNo records available.\n\n");
+        cms_printf("\nNo records available.\n\n");
         return CMS_STATUS_OK;
     }
 
-    StudentRecord *buffer = malloc(db->count * sizeof(StudentRecord));
-    if (buffer == NULL)
+    StudentRecord *buffer = NULL;
+    size_t count = 0;
+    if (cms_database_copy_rows(db, &buffer, &count) != CMS_STATUS_OK)
     {
         return CMS_STATUS_ERROR;
     }
 
-    memcpy(buffer, db->records, db->count * sizeof(StudentRecord));
-
     int (*cmp)(const void *, const void *) = NULL;
     if (sort_key == CMS_SORT_KEY_ID)
     {
@@ -381,18 +455,19 @@ CMS_STATUS cms_show_all_sorted(const StudentDatabase *db, CmsSortKey sort_key, C
     }
     else
     {
-        free(buffer);
+        cms_free(buffer);
         return CMS_STATUS_INVALID_ARGUMENT;
     }
 
-    qsort(buffer, db->count, sizeof(StudentRecord), cmp);
+    qsort(buffer, count, sizeof(StudentRecord), cmp);
 
-    StudentDatabase view = *db;
+    StudentDatabase view;
+    memset(&view, 0, sizeof(view));
     view.records = buffer;
-    view.count = db->count;
-    view.capacity = db->count;
+    view.count = count;
+    view.capacity = count;
 
     CMS_STATUS status = cms_database_show_all(&view);
-    free(buffer);
+    cms_free(buffer);
     return status;
 }
@@ -0,0 +1,232 @@
+#include <ctype.h>
+#include <string.h>
+#include "../include/tokenizer.h"
+#include "../include/utils.h"
+
+/* Longest number token worth handing to strtol/strtof */
+#define CMS_NUMBER_TEXT_LEN 64
+
+static const char *const cms_record_field_keys[CMS_RECORD_FIELD_COUNT] = {"ID", "NAME", "PROGRAMME", "MARK"};
+
+CmsSlice cms_slice(const char *text)
+{
+    CmsSlice slice = {text, (text != NULL) ? strlen(text) : 0};
+    return slice;
+}
+
+CmsSlice cms_slice_trim(CmsSlice slice)
+{
+    while (slice.length > 0 && isspace((unsigned char)slice.text[0]))
+    {
+        slice.text++;
+        slice.length--;
+    }
+    while (slice.length > 0 && isspace((unsigned char)slice.text[slice.length - 1]))
+    {
+        slice.length--;
+    }
+    return slice;
+}
+
+bool cms_slice_is_empty(CmsSlice slice)
+{
+    return slice.length == 0;
+}
+
+bool cms_slice_next_word(CmsSlice *rest, CmsSlice *word)
+{
+    *rest = cms_slice_trim(*rest);
+    if (rest->length == 0)
+    {
+        return false;
+    }
+
+    size_t length = 0;
+    while (length < rest->length && !isspace((unsigned char)rest->text[length]))
+    {
+        length++;
+    }
+    word->text = rest->text;
+    word->length = length;
+    rest->text += length;
+    rest->length -= length;
+    return true;
+}
+
+bool cms_slice_equals(CmsSlice slice, const char *keyword)
+{
+    size_t i = 0;
+    for (; i < slice.length; ++i)
+    {
+        if (keyword[i] == '\0' ||
+            tolower((unsigned char)slice.text[i]) != tolower((unsigned char)keyword[i]))
+        {
+            return false;
+        }
+    }
+    return keyword[i] == '\0';
+}
+
+bool cms_slice_next_token(CmsSlice *rest, CmsSlice *word)
+{
+    *rest = cms_slice_trim(*rest);
+    if (rest->length == 0 || rest->text[0] != '"')
+    {
+        return cms_slice_next_word(rest, word);
+    }
+
+    const char *close = memchr(rest->text + 1, '"', rest->length - 1);
+    if (close == NULL)
+    {
+        return false;
+    }
+    word->text = rest->text + 1;
+    word->length = (size_t)(close - word->text);
+    rest->length -= (size_t)(close + 1 - rest->text);
+    rest->text = close + 1;
+    return true;
+}
+
+bool cms_slice_skip_prefix(CmsSlice *text, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    if (text->length < length)
+    {
+        return false;
+    }
+    CmsSlice head = {text->text, length};
+    if (!cms_slice_equals(head, prefix))
+    {
+        return false;
+    }
+    text->text += length;
+    text->length -= length;
+    return true;
+}
+
+bool cms_slice_skip_word(CmsSlice *text, const char *keyword)
+{
+    CmsSlice rest = *text;
+    if (!cms_slice_skip_prefix(&rest, keyword) ||
+        (rest.length > 0 && !isspace((unsigned char)rest.text[0])))
+    {
+        return false;
+    }
+    *text = rest;
+    return true;
+}
+
+bool cms_slice_split_at_word(CmsSlice text, const char *keyword, CmsSlice *before, CmsSlice *after)
+{
+    for (size_t at = 0; at < text.length; ++at)
+    {
+        if (at > 0 && !isspace((unsigned char)text.text[at - 1]))
+        {
+            continue;
+        }
+        CmsSlice rest = {text.text + at, text.length - at};
+        if (cms_slice_skip_word(&rest, keyword))
+        {
+            before->text = text.text;
+            before->length = at;
+            *after = rest;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cms_slice_copy(CmsSlice slice, char *out, size_t size)
+{
+    if (slice.length >= size)
+    {
+        out[0] = '\0';
+        return false;
+    }
+    memcpy(out, slice.text, slice.length);
+    out[slice.length] = '\0';
+    return true;
+}
+
+bool cms_slice_to_int(CmsSlice slice, int *out_value)
+{
+    char text[CMS_NUMBER_TEXT_LEN];
+    return cms_slice_copy(slice, text, sizeof(text)) && cms_parse_int_argument(text, out_value);
+}
+
+bool cms_slice_to_float(CmsSlice slice, float *out_value)
+{
+    char text[CMS_NUMBER_TEXT_LEN];
+    return cms_slice_copy(slice, text, sizeof(text)) && cms_parse_float_argument(text, out_value);
+}
+
+void cms_tokenize_command(const char *line, CmsCommandLine *out)
+{
+    CmsSlice rest = cms_slice(line);
+    if (!cms_slice_next_word(&rest, &out->verb))
+    {
+        out->verb = rest;
+    }
+    out->args = cms_slice_trim(rest);
+}
+
+/* Which field key (exactly "ID=", "NAME=", ...) starts at text, or -1 */
+static int cms_record_field_at(const char *text, size_t length)
+{
+    for (int field = 0; field < CMS_RECORD_FIELD_COUNT; ++field)
+    {
+        size_t key_length = strlen(cms_record_field_keys[field]);
+        if (length > key_length && text[key_length] == '=' &&
+            memcmp(text, cms_record_field_keys[field], key_length) == 0)
+        {
+            return field;
+        }
+    }
+    return -1;
+}
+
+void cms_scan_record_fields(CmsSlice text, CmsSlice fields[CMS_RECORD_FIELD_COUNT])
+{
+    for (int field = 0; field < CMS_RECORD_FIELD_COUNT; ++field)
+    {
+        fields[field].text = NULL;
+        fields[field].length = 0;
+    }
+
+    const char *at = text.text;
+    const char *end = text.text + text.length;
+    while (at < end)
+    {
+        while (at < end && *at == ' ')
+        {
+            at++;
+        }
+        const char *equals = memchr(at, '=', (size_t)(end - at));
+        if (equals == NULL)
+        {
+            break;
+        }
+
+        CmsSlice key = {at, (size_t)(equals - at)};
+        key = cms_slice_trim(key);
+
+        /* The value ends where a space is followed by the next key */
+        const char *value_end = equals + 1;
+        while (value_end < end &&
+               !(*value_end == ' ' && cms_record_field_at(value_end + 1, (size_t)(end - value_end - 1)) >= 0))
+        {
+            value_end++;
+        }
+
+        CmsSlice value = {equals + 1, (size_t)(value_end - equals - 1)};
+        for (int field = 0; field < CMS_RECORD_FIELD_COUNT; ++field)
+        {
+            if (key.length == strlen(cms_record_field_keys[field]) &&
+                memcmp(key.text, cms_record_field_keys[field], key.length) == 0)
+            {
+                fields[field] = cms_slice_trim(value);
+            }
+        }
+        at = value_end;
+    }
+}
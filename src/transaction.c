@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/transaction.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+
+#define CMS_TRANSACTION_MIN_SLOTS 64u
+
+static size_t cms_transaction_hash(int student_id, size_t mask)
+{
+    uint32_t key = (uint32_t)student_id;
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return (size_t)key & mask;
+}
+
+CmsTransaction *cms_transaction_create(void)
+{
+    CmsTransaction *transaction = cms_calloc(CMS_MEM_UNDO, 1, sizeof(CmsTransaction));
+    if (transaction == NULL)
+    {
+        return NULL;
+    }
+    transaction->slots = cms_calloc(CMS_MEM_UNDO, CMS_TRANSACTION_MIN_SLOTS, sizeof(uint32_t));
+    if (transaction->slots == NULL)
+    {
+        cms_free(transaction);
+        return NULL;
+    }
+    transaction->slot_count = CMS_TRANSACTION_MIN_SLOTS;
+    return transaction;
+}
+
+void cms_transaction_destroy(CmsTransaction *transaction)
+{
+    if (transaction == NULL)
+    {
+        return;
+    }
+    cms_free(transaction->rows);
+    cms_free(transaction->slots);
+    cms_free(transaction);
+}
+
+CmsPendingRow *cms_transaction_find(const CmsTransaction *transaction, int student_id)
+{
+    if (transaction == NULL)
+    {
+        return NULL;
+    }
+
+    size_t mask = transaction->slot_count - 1;
+    for (size_t i = cms_transaction_hash(student_id, mask);; i = (i + 1) & mask)
+    {
+        uint32_t slot = transaction->slots[i];
+        if (slot == 0)
+        {
+            return NULL;
+        }
+        if (transaction->rows[slot - 1].record.id == student_id)
+        {
+            return &transaction->rows[slot - 1];
+        }
+    }
+}
+
+static void cms_transaction_place(uint32_t *slots, size_t mask, int student_id, uint32_t row)
+{
+    size_t i = cms_transaction_hash(student_id, mask);
+    while (slots[i] != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    slots[i] = row + 1;
+}
+
+/* Keeps the table at most half full */
+static bool cms_transaction_grow(CmsTransaction *transaction)
+{
+    if ((transaction->count + 1) * 2 <= transaction->slot_count)
+    {
+        return true;
+    }
+
+    size_t slot_count = transaction->slot_count * 2;
+    uint32_t *slots = cms_calloc(CMS_MEM_UNDO, slot_count, sizeof(uint32_t));
+    if (slots == NULL)
+    {
+        return false;
+    }
+    for (size_t row = 0; row < transaction->count; ++row)
+    {
+        cms_transaction_place(slots, slot_count - 1, transaction->rows[row].record.id, (uint32_t)row);
+    }
+    cms_free(transaction->slots);
+    transaction->slots = slots;
+    transaction->slot_count = slot_count;
+    return true;
+}
+
+CmsPendingRow *cms_transaction_add(CmsTransaction *transaction, int student_id)
+{
+    if (transaction == NULL || transaction->count >= UINT32_MAX - 1)
+    {
+        return NULL;
+    }
+
+    if (transaction->count == transaction->capacity)
+    {
+        size_t capacity = (transaction->capacity == 0) ? CMS_INITIAL_CAPACITY
+                                                       : transaction->capacity * CMS_GROWTH_FACTOR;
+        CmsPendingRow *rows = cms_realloc(CMS_MEM_UNDO, transaction->rows, capacity * sizeof(CmsPendingRow));
+        if (rows == NULL)
+        {
+            return NULL;
+        }
+        transaction->rows = rows;
+        transaction->capacity = capacity;
+    }
+    if (!cms_transaction_grow(transaction))
+    {
+        return NULL;
+    }
+
+    CmsPendingRow *row = &transaction->rows[transaction->count];
+    memset(row, 0, sizeof(*row));
+    row->record.id = student_id;
+    cms_transaction_place(transaction->slots, transaction->slot_count - 1, student_id,
+                          (uint32_t)transaction->count);
+    transaction->count++;
+    return row;
+}
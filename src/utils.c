@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 #include "../include/utils.h"
 #include "../include/config.h"
+#include "../include/render.h"
 
 bool cms_validate_student_id(int id)
 {
@@ -120,6 +122,75 @@ void cms_string_to_upper(char *str)
     }
 }
 
+bool cms_string_starts_with_ignore_case(const char *str, const char *prefix)
+{
+    if (str == NULL || prefix == NULL)
+    {
+        return false;
+    }
+
+    while (*prefix)
+    {
+        if (tolower((unsigned char)*str) != tolower((unsigned char)*prefix))
+        {
+            return false;
+        }
+        str++;
+        prefix++;
+    }
+
+    return true;
+}
+
+bool cms_string_contains_ignore_case(const char *haystack, const char *needle)
+{
+    if (haystack == NULL || needle == NULL)
+    {
+        return false;
+    }
+
+    for (; *haystack; haystack++)
+    {
+        if (cms_string_starts_with_ignore_case(haystack, needle))
+        {
+            return true;
+        }
+    }
+
+    return needle[0] == '\0';
+}
+
+char *cms_next_token(char **rest, char delimiter)
+{
+    if (rest == NULL || *rest == NULL)
+    {
+        return NULL;
+    }
+
+    char *token = *rest;
+    while (*token == delimiter)
+    {
+        token++;
+    }
+    if (*token == '\0')
+    {
+        *rest = token;
+        return NULL;
+    }
+
+    char *end = strchr(token, delimiter);
+    if (end != NULL)
+    {
+        *end = '\0';
+        *rest = end + 1;
+    }
+    else
+    {
+        *rest = token + strlen(token);
+    }
+    return token;
+}
+
 bool cms_read_line(char *buffer, size_t size)
 {
     if (buffer == NULL || size == 0)
@@ -205,6 +276,113 @@ bool cms_read_string(const char *prompt, char *buffer, size_t size)
     return cms_read_line(buffer, size);
 }
 
+/* Column widths of the record table */
+#define CMS_TABLE_ID_WIDTH 12
+#define CMS_TABLE_NAME_WIDTH 20
+#define CMS_TABLE_PROG_WIDTH 30
+#define CMS_TABLE_MARK_WIDTH 10
+
+static void cms_display_table_border(CmsWriter *out)
+{
+    cms_writer_putc(out, '+');
+    cms_writer_repeat(out, '-', CMS_TABLE_ID_WIDTH);
+    cms_writer_putc(out, '+');
+    cms_writer_repeat(out, '-', CMS_TABLE_NAME_WIDTH);
+    cms_writer_putc(out, '+');
+    cms_writer_repeat(out, '-', CMS_TABLE_PROG_WIDTH);
+    cms_writer_putc(out, '+');
+    cms_writer_repeat(out, '-', CMS_TABLE_MARK_WIDTH);
+    cms_writer_puts(out, "+\n");
+}
+
+/**
+ * Prints the table's top border and column headers. Rows are buffered until
+ * cms_display_table_footer, so nothing else may print in between.
+ */
+void cms_display_table_header(void)
+{
+    CmsWriter *out = cms_stdout_writer();
+    cms_writer_putc(out, '\n');
+    cms_display_table_border(out);
+    cms_writer_puts(out, "| ");
+    cms_writer_pad(out, "ID", CMS_TABLE_ID_WIDTH - 1);
+    cms_writer_puts(out, "| ");
+    cms_writer_pad(out, "Name", CMS_TABLE_NAME_WIDTH - 1);
+    cms_writer_puts(out, "| ");
+    cms_writer_pad(out, "Programme", CMS_TABLE_PROG_WIDTH - 1);
+    cms_writer_puts(out, "| ");
+    cms_writer_pad(out, "Mark", CMS_TABLE_MARK_WIDTH - 1);
+    cms_writer_puts(out, "|\n");
+    cms_display_table_border(out);
+}
+
+/* Longest row: four separators, an int, two capped strings and a mark */
+#define CMS_TABLE_ROW_MAX (16 + 24 + CMS_MAX_NAME_LEN + CMS_MAX_PROGRAMME_LEN + CMS_MARK_TEXT_LEN + 3 * 32)
+
+/* cms_field_length() is POSIX-only; fields are normally terminated well before max */
+static size_t cms_field_length(const char *text, size_t max)
+{
+    const char *end = memchr(text, '\0', max);
+    return (end == NULL) ? max : (size_t)(end - text);
+}
+
+/* Copies text into a cell padded with spaces to width, like "%-*s" */
+static char *cms_table_cell(char *out, const char *text, size_t length, size_t width)
+{
+    memcpy(out, text, length);
+    if (length < width)
+    {
+        memset(out + length, ' ', width - length);
+        return out + width;
+    }
+    return out + length;
+}
+
+/**
+ * Prints one record as a table row.
+ * @param record Pointer to the StudentRecord to print.
+ */
+void cms_display_table_row(const StudentRecord *record)
+{
+    /* Hot path for large listings: format the whole row in place */
+    CmsWriter *out = cms_stdout_writer();
+    char *row = cms_writer_reserve(out, CMS_TABLE_ROW_MAX);
+    if (row == NULL)
+    {
+        return;
+    }
+
+    char number[CMS_MARK_TEXT_LEN];
+    char *p = row;
+    *p++ = '|';
+    *p++ = ' ';
+    p = cms_table_cell(p, number, cms_format_int(record->id, number), CMS_TABLE_ID_WIDTH - 1);
+    *p++ = '|';
+    *p++ = ' ';
+    p = cms_table_cell(p, record->name, cms_field_length(record->name, CMS_MAX_NAME_LEN), CMS_TABLE_NAME_WIDTH - 1);
+    *p++ = '|';
+    *p++ = ' ';
+    p = cms_table_cell(p, record->programme, cms_field_length(record->programme, CMS_MAX_PROGRAMME_LEN),
+                       CMS_TABLE_PROG_WIDTH - 1);
+    *p++ = '|';
+    *p++ = ' ';
+    p = cms_table_cell(p, number, cms_format_mark(record->mark, number), CMS_TABLE_MARK_WIDTH - 1);
+    *p++ = '|';
+    *p++ = '\n';
+    cms_writer_commit(out, (size_t)(p - row));
+}
+
+/**
+ * Prints the table's bottom border and flushes the buffered table.
+ */
+void cms_display_table_footer(void)
+{
+    CmsWriter *out = cms_stdout_writer();
+    cms_display_table_border(out);
+    cms_writer_putc(out, '\n');
+    cms_writer_flush(out);
+}
+
 /**
  * Displays a formatted table of student records with ASCII borders.
  * @param db Pointer to StudentDatabase structure containing records to display.
@@ -216,47 +394,12 @@ void cms_display_table(const StudentDatabase *db)
         return;
     }
 
-    int id_width = 12;
-    int name_width = 20;
-    int prog_width = 30;
-    int mark_width = 10;
-
-    /* Print table header border */
-    printf("\n+%.*s+%.*s+%.*s+%.*s+\n",
-           id_width, "------------",
-           name_width, "--------------------",
-           prog_width, "------------------------------",
-           mark_width, "----------");
-
-    /* Print column headers */
-    printf("| %-*s| %-*s| %-*s| %-*s|\n",
-           id_width - 1, "ID",
-           name_width - 1, "Name",
-           prog_width - 1, "Programme",
-           mark_width - 1, "Mark");
-    printf("+%.*s+%.*s+%.*s+%.*s+\n",
-           id_width, "------------",
-           name_width, "--------------------",
-           prog_width, "------------------------------",
-           mark_width, "----------");
-
-    /* Print each student record */
+    cms_display_table_header();
     for (size_t i = 0; i < db->count; i++)
     {
-        const StudentRecord *rec = &db->records[i];
-        printf("| %-*d| %-*s| %-*s| %-*.1f|\n",
-               id_width - 1, rec->id,
-               name_width - 1, rec->name,
-               prog_width - 1, rec->programme,
-               mark_width - 1, rec->mark);
+        cms_display_table_row(&db->records[i]);
     }
-
-    /* Print table footer border */
-    printf("+%.*s+%.*s+%.*s+%.*s+\n\n",
-           id_width, "------------",
-           name_width, "--------------------",
-           prog_width, "------------------------------",
-           mark_width, "----------");
+    cms_display_table_footer();
 }
 
 bool cms_parse_int_argument(const char *arg, int *out_value)
@@ -277,3 +420,22 @@ bool cms_parse_int_argument(const char *arg, int *out_value)
     *out_value = (int)val;
     return true;
 }
+
+bool cms_parse_float_argument(const char *arg, float *out_value)
+{
+    if (arg == NULL || out_value == NULL)
+    {
+        return false;
+    }
+
+    char *endptr;
+    float val = strtof(arg, &endptr);
+
+    if (endptr == arg || *endptr != '\0' || !isfinite(val))
+    {
+        return false; /* Not a valid number, trailing garbage, inf or nan */
+    }
+
+    *out_value = val;
+    return true;
+}
@@ -0,0 +1,640 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/watch.h"
+#include "../include/alloc.h"
+#include "../include/config.h"
+#include "../include/database.h"
+#include "../include/diff.h"
+#include "../include/index.h"
+#include "../include/journal.h"
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define CMS_WATCH_EVENT_BUFFER 4096
+
+/* A row as one version of the file holds it, or its absence */
+typedef struct
+{
+    StudentRecord record; /* record.id is the key */
+    bool present;
+} CmsWatchRow;
+
+/* Rows sorted by ID */
+typedef struct
+{
+    CmsWatchRow *rows;
+    size_t count;
+    size_t capacity;
+    CmsMemKind kind; /* CMS_MEM_RECORDS when kept between reloads */
+} CmsWatchRows;
+
+struct CmsWatch
+{
+    int fd;        /* inotify, non-blocking */
+    int directory; /* watch descriptor of the file's directory, -1 if none */
+    char path[CMS_MAX_FILE_PATH_LEN];
+    const char *name; /* file name part of path */
+    CmsWatchPolicy policy;
+    bool pending;     /* changed on disk and not reloaded yet */
+    const char *held; /* why a pending change waits, once reported */
+    /* Rows the file held at the last reload that the table may not match:
+       everything that reload saw differ or changed since the saved state.
+       Empty while the table's saved state is the file's. */
+    CmsWatchRows remote;
+};
+
+/* ===== Row sets ===== */
+
+static void cms_watch_rows_free(CmsWatchRows *rows)
+{
+    cms_free(rows->rows);
+    rows->rows = NULL;
+    rows->count = 0;
+    rows->capacity = 0;
+}
+
+static CmsWatchRow *cms_watch_rows_push(CmsWatchRows *rows, int student_id)
+{
+    if (rows->count == rows->capacity)
+    {
+        size_t capacity = (rows->capacity == 0) ? CMS_INITIAL_CAPACITY : rows->capacity * CMS_GROWTH_FACTOR;
+        CmsWatchRow *grown = cms_realloc(rows->kind, rows->rows, capacity * sizeof(CmsWatchRow));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        rows->rows = grown;
+        rows->capacity = capacity;
+    }
+    CmsWatchRow *row = &rows->rows[rows->count++];
+    memset(row, 0, sizeof(*row));
+    row->record.id = student_id;
+    return row;
+}
+
+static int cms_compare_watch_rows(const void *a, const void *b)
+{
+    int left = ((const CmsWatchRow *)a)->record.id;
+    int right = ((const CmsWatchRow *)b)->record.id;
+    return (left > right) - (left < right);
+}
+
+/* Looks among the first count rows, which must be in ID order */
+static CmsWatchRow *cms_watch_rows_find(const CmsWatchRows *rows, size_t count, int student_id)
+{
+    CmsWatchRow key;
+    key.record.id = student_id;
+    return (count == 0) ? NULL : bsearch(&key, rows->rows, count, sizeof(CmsWatchRow), cms_compare_watch_rows);
+}
+
+static bool cms_same_row(const CmsWatchRow *a, const CmsWatchRow *b)
+{
+    if (a->present != b->present)
+    {
+        return false;
+    }
+    return !a->present || (a->record.id == b->record.id && a->record.mark == b->record.mark &&
+                           strcmp(a->record.name, b->record.name) == 0 &&
+                           strcmp(a->record.programme, b->record.programme) == 0);
+}
+
+/* The table's row for an ID, or its absence */
+static void cms_table_row(const StudentDatabase *db, int student_id, CmsWatchRow *out_row)
+{
+    size_t index = 0;
+    memset(out_row, 0, sizeof(*out_row));
+    out_row->record.id = student_id;
+    out_row->present = cms_index_find_id(db, student_id, &index);
+    if (out_row->present)
+    {
+        out_row->record = db->records[index];
+    }
+}
+
+/* ===== The table's saved state ===== */
+
+/* A history entry on the way back to the saved state, with the order it
+   was visited in */
+typedef struct
+{
+    CmsJournalEntry entry;
+    bool redo;
+    size_t order;
+} CmsWatchStep;
+
+typedef struct
+{
+    CmsWatchStep *steps;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} CmsWatchSteps;
+
+static void cms_watch_note_step(const CmsJournalEntry *entry, bool redo, void *context)
+{
+    CmsWatchSteps *steps = context;
+    if (steps->failed)
+    {
+        return;
+    }
+    if (steps->count == steps->capacity)
+    {
+        size_t capacity = (steps->capacity == 0) ? CMS_INITIAL_CAPACITY : steps->capacity * CMS_GROWTH_FACTOR;
+        CmsWatchStep *grown = cms_realloc(CMS_MEM_TEMP, steps->steps, capacity * sizeof(CmsWatchStep));
+        if (grown == NULL)
+        {
+            steps->failed = true;
+            return;
+        }
+        steps->steps = grown;
+        steps->capacity = capacity;
+    }
+    CmsWatchStep *step = &steps->steps[steps->count];
+    step->entry = *entry;
+    step->redo = redo;
+    step->order = steps->count++;
+}
+
+static int cms_compare_watch_steps(const void *a, const void *b)
+{
+    const CmsWatchStep *left = a;
+    const CmsWatchStep *right = b;
+    if (left->entry.before.id != right->entry.before.id)
+    {
+        return (left->entry.before.id > right->entry.before.id) - (left->entry.before.id < right->entry.before.id);
+    }
+    return (left->order > right->order) - (left->order < right->order);
+}
+
+static void cms_set_fields(StudentRecord *record, const StudentRecord *values, unsigned fields)
+{
+    if (fields & CMS_FIELD_NAME)
+    {
+        memcpy(record->name, values->name, sizeof(record->name));
+    }
+    if (fields & CMS_FIELD_PROGRAMME)
+    {
+        memcpy(record->programme, values->programme, sizeof(record->programme));
+    }
+    if (fields & CMS_FIELD_MARK)
+    {
+        record->mark = values->mark;
+    }
+}
+
+/* Moves a row one entry back towards the saved state */
+static void cms_watch_step_row(CmsWatchRow *row, const CmsWatchStep *step)
+{
+    const CmsJournalEntry *entry = &step->entry;
+    switch (entry->action)
+    {
+    case CMS_JOURNAL_INSERT:
+        row->present = step->redo;
+        if (step->redo)
+        {
+            row->record = entry->after;
+        }
+        break;
+    case CMS_JOURNAL_DELETE:
+        row->present = !step->redo;
+        if (!step->redo)
+        {
+            row->record = entry->before;
+        }
+        break;
+    case CMS_JOURNAL_UPDATE:
+        cms_set_fields(&row->record, step->redo ? &entry->after : &entry->before, entry->fields);
+        break;
+    }
+}
+
+/* The rows the table had at its saved state, for every ID changed since:
+   each is walked back from the table through its own history entries.
+   CMS_STATUS_NOT_FOUND when the history no longer reaches that far. */
+static CMS_STATUS cms_watch_saved_rows(const StudentDatabase *db, CmsWatchRows *out_rows)
+{
+    CmsWatchSteps steps;
+    memset(&steps, 0, sizeof(steps));
+    bool reached = cms_journal_since_clean(db->journal, cms_watch_note_step, &steps);
+    if (steps.failed)
+    {
+        cms_free(steps.steps);
+        return CMS_STATUS_ERROR;
+    }
+    if (!reached)
+    {
+        cms_free(steps.steps);
+        return db->is_dirty ? CMS_STATUS_NOT_FOUND : CMS_STATUS_OK;
+    }
+
+    qsort(steps.steps, steps.count, sizeof(CmsWatchStep), cms_compare_watch_steps);
+    CMS_STATUS status = CMS_STATUS_OK;
+    for (size_t i = 0; i < steps.count; ++i)
+    {
+        int student_id = steps.steps[i].entry.before.id;
+        if (i > 0 && steps.steps[i - 1].entry.before.id == student_id)
+        {
+            cms_watch_step_row(&out_rows->rows[out_rows->count - 1], &steps.steps[i]);
+            continue;
+        }
+        CmsWatchRow *row = cms_watch_rows_push(out_rows, student_id);
+        if (row == NULL)
+        {
+            status = CMS_STATUS_ERROR;
+            break;
+        }
+        cms_table_row(db, student_id, row);
+        cms_watch_step_row(row, &steps.steps[i]);
+    }
+    cms_free(steps.steps);
+    return status;
+}
+
+/* What the table was last in step with, per row that may differ from it
+   now: the row at the saved state, unless a reload since brought the file's */
+static CMS_STATUS cms_watch_synced_rows(const CmsWatch *watch, const StudentDatabase *db, CmsWatchRows *out_rows)
+{
+    CMS_STATUS status = cms_watch_saved_rows(db, out_rows);
+    size_t saved_count = out_rows->count;
+    for (size_t i = 0; status == CMS_STATUS_OK && i < watch->remote.count; ++i)
+    {
+        /* Rows found nowhere else go past the sorted ones; sorted below */
+        const CmsWatchRow *remote = &watch->remote.rows[i];
+        CmsWatchRow *row = cms_watch_rows_find(out_rows, saved_count, remote->record.id);
+        if (row == NULL && (row = cms_watch_rows_push(out_rows, remote->record.id)) == NULL)
+        {
+            status = CMS_STATUS_ERROR;
+            break;
+        }
+        *row = *remote;
+    }
+    if (status == CMS_STATUS_OK)
+    {
+        qsort(out_rows->rows, out_rows->count, sizeof(CmsWatchRow), cms_compare_watch_rows);
+    }
+    return status;
+}
+
+/* ===== Watching ===== */
+
+static void cms_watch_forget(CmsWatch *watch)
+{
+    watch->pending = false;
+    watch->held = NULL;
+    cms_watch_rows_free(&watch->remote);
+}
+
+/* Watches the directory of path for the file being rewritten or renamed
+   over; its other files are ignored when the events are read */
+static bool cms_watch_arm(CmsWatch *watch, const char *path)
+{
+    if (watch->directory >= 0)
+    {
+        inotify_rm_watch(watch->fd, watch->directory);
+        watch->directory = -1;
+    }
+
+    strncpy(watch->path, path, sizeof(watch->path) - 1);
+    watch->path[sizeof(watch->path) - 1] = '\0';
+    char directory[CMS_MAX_FILE_PATH_LEN];
+    const char *slash = strrchr(watch->path, '/');
+    if (slash == NULL)
+    {
+        strcpy(directory, ".");
+        watch->name = watch->path;
+    }
+    else
+    {
+        size_t length = (slash == watch->path) ? 1 : (size_t)(slash - watch->path);
+        memcpy(directory, watch->path, length);
+        directory[length] = '\0';
+        watch->name = slash + 1;
+    }
+
+    watch->directory = inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    return watch->directory >= 0;
+}
+
+CMS_STATUS cms_watch_start(const StudentDatabase *db, CmsWatchPolicy policy, CmsWatch **out_watch)
+{
+    if (db == NULL || out_watch == NULL || !db->is_loaded || db->file_path[0] == '\0')
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    *out_watch = NULL;
+
+    CmsWatch *watch = cms_calloc(CMS_MEM_SESSION, 1, sizeof(CmsWatch));
+    if (watch == NULL)
+    {
+        return CMS_STATUS_ERROR;
+    }
+    watch->directory = -1;
+    watch->policy = policy;
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0 || !cms_watch_arm(watch, db->file_path))
+    {
+        cms_watch_stop(watch);
+        return CMS_STATUS_IO;
+    }
+
+    *out_watch = watch;
+    return CMS_STATUS_OK;
+}
+
+void cms_watch_stop(CmsWatch *watch)
+{
+    if (watch == NULL)
+    {
+        return;
+    }
+    if (watch->fd >= 0)
+    {
+        close(watch->fd);
+    }
+    cms_watch_rows_free(&watch->remote);
+    cms_free(watch);
+}
+
+void cms_watch_set_policy(CmsWatch *watch, CmsWatchPolicy policy)
+{
+    if (watch != NULL)
+    {
+        watch->policy = policy;
+        watch->held = NULL;
+    }
+}
+
+CmsWatchPolicy cms_watch_policy(const CmsWatch *watch)
+{
+    return (watch != NULL) ? watch->policy : CMS_WATCH_PREFER_LOCAL;
+}
+
+void cms_watch_synced(CmsWatch *watch, const StudentDatabase *db)
+{
+    if (watch == NULL || db == NULL || db->file_path[0] == '\0')
+    {
+        return;
+    }
+    if (strcmp(watch->path, db->file_path) != 0)
+    {
+        cms_watch_arm(watch, db->file_path);
+    }
+    cms_watch_forget(watch);
+
+    /* The file's events are queued by the time the write that caused them
+       returns, so whatever is queued now is for what db holds */
+    char buffer[CMS_WATCH_EVENT_BUFFER];
+    while (read(watch->fd, buffer, sizeof(buffer)) > 0)
+    {
+    }
+}
+
+/* Reads the queued events; any for the watched name leaves a change pending */
+static void cms_watch_drain(CmsWatch *watch)
+{
+    _Alignas(struct inotify_event) char buffer[CMS_WATCH_EVENT_BUFFER];
+    ssize_t got;
+    while ((got = read(watch->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t at = 0; at < got;)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)(buffer + at);
+            if ((event->mask & IN_Q_OVERFLOW) ||
+                (event->wd == watch->directory && event->len > 0 && strcmp(event->name, watch->name) == 0))
+            {
+                watch->pending = true;
+            }
+            at += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+
+static CMS_STATUS cms_watch_hold(CmsWatch *watch, CmsWatchReport *report, const char *reason)
+{
+    if (watch->held == reason)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+    watch->held = reason;
+    report->held = reason;
+    return CMS_STATUS_INVALID_ARGUMENT;
+}
+
+/* Keeps the changes to apply at the front of list and records in remote
+   what the file now holds for every row the table may not match;
+   out_in_step tells whether the table matches the file once they apply */
+static CMS_STATUS cms_watch_sort_changes(const CmsWatch *watch, const StudentDatabase *db,
+                                         const CmsWatchRows *synced, CmsChangeList *list, CmsWatchRows *remote,
+                                         CmsWatchReport *report, bool *out_in_step)
+{
+    size_t applied = 0;
+    size_t differing = 0;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        CmsChange change = list->changes[i];
+        int student_id = (change.kind == CMS_CHANGE_ADDED) ? change.after.id : change.before.id;
+        CmsWatchRow table = {change.before, change.kind != CMS_CHANGE_ADDED};
+        CmsWatchRow file = {change.after, change.kind != CMS_CHANGE_REMOVED};
+        file.record.id = student_id;
+        const CmsWatchRow *last = cms_watch_rows_find(synced, synced->count, student_id);
+        bool local = (last != NULL) && !cms_same_row(&table, last);
+        bool remote_changed = (last == NULL) || !cms_same_row(&file, last);
+
+        CmsWatchRow *row = cms_watch_rows_push(remote, student_id);
+        if (row == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        *row = file;
+
+        if (local && (!remote_changed || watch->policy == CMS_WATCH_PREFER_LOCAL))
+        {
+            /* Only edited here, or a conflict the table wins: leave it */
+            report->kept += remote_changed;
+            differing++;
+            continue;
+        }
+        report->overwritten += local;
+        report->added += (change.kind == CMS_CHANGE_ADDED);
+        report->removed += (change.kind == CMS_CHANGE_REMOVED);
+        report->changed += (change.kind == CMS_CHANGE_CHANGED);
+        list->changes[applied++] = change;
+    }
+    list->count = applied;
+    *out_in_step = (differing == 0);
+
+    /* Rows this reload found equal to the file are in step with it now.
+       The file's rows so far came in ID order with the list. */
+    size_t listed = remote->count;
+    for (size_t i = 0; differing > 0 && i < synced->count; ++i)
+    {
+        int student_id = synced->rows[i].record.id;
+        if (cms_watch_rows_find(remote, listed, student_id) != NULL)
+        {
+            continue;
+        }
+        CmsWatchRow *row = cms_watch_rows_push(remote, student_id);
+        if (row == NULL)
+        {
+            return CMS_STATUS_ERROR;
+        }
+        cms_table_row(db, student_id, row);
+    }
+    qsort(remote->rows, remote->count, sizeof(CmsWatchRow), cms_compare_watch_rows);
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_watch_poll(CmsWatch *watch, StudentDatabase *db, CmsWatchReport *out_report)
+{
+    if (watch == NULL || db == NULL || out_report == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    memset(out_report, 0, sizeof(*out_report));
+
+    if (!db->is_loaded)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+    if (strcmp(watch->path, db->file_path) != 0)
+    {
+        /* Saved elsewhere or another file opened: follow it */
+        cms_watch_synced(watch, db);
+        return CMS_STATUS_NOT_FOUND;
+    }
+
+    cms_watch_drain(watch);
+    struct stat info;
+    if (!watch->pending)
+    {
+        return CMS_STATUS_NOT_FOUND;
+    }
+    if (stat(watch->path, &info) != 0)
+    {
+        /* Renamed away; a file put back in its place is a new event */
+        watch->pending = false;
+        return CMS_STATUS_NOT_FOUND;
+    }
+    if (db->transaction != NULL)
+    {
+        return cms_watch_hold(watch, out_report, "a transaction is open; it is reloaded after COMMIT or ROLLBACK");
+    }
+
+    CmsWatchRows synced;
+    memset(&synced, 0, sizeof(synced));
+    synced.kind = CMS_MEM_TEMP;
+    CMS_STATUS status = cms_watch_synced_rows(watch, db, &synced);
+    if (status == CMS_STATUS_NOT_FOUND && watch->policy == CMS_WATCH_PREFER_LOCAL)
+    {
+        /* Which rows were edited here is lost with the undo history */
+        cms_watch_rows_free(&synced);
+        return cms_watch_hold(watch, out_report,
+                              "the undo history no longer shows which rows were edited here; "
+                              "SAVE or WATCH ON REMOTE to settle it");
+    }
+    if (status == CMS_STATUS_NOT_FOUND)
+    {
+        /* PREFER_REMOTE takes the whole file */
+        status = CMS_STATUS_OK;
+    }
+
+    CmsChangeList list;
+    cms_change_list_init(&list);
+    if (status == CMS_STATUS_OK)
+    {
+        status = cms_diff_database(db, watch->path, &list);
+    }
+    if (status != CMS_STATUS_OK)
+    {
+        /* Not retried until the file is written again */
+        cms_watch_rows_free(&synced);
+        watch->pending = false;
+        return status;
+    }
+
+    CmsWatchRows remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.kind = CMS_MEM_RECORDS;
+    bool in_step = false;
+    status = cms_watch_sort_changes(watch, db, &synced, &list, &remote, out_report, &in_step);
+
+    size_t applied = 0;
+    if (status == CMS_STATUS_OK && list.count > 0)
+    {
+        status = cms_database_apply_changes(db, &list, CMS_APPLY_ADDED | CMS_APPLY_REMOVED | CMS_APPLY_CHANGED,
+                                            &applied);
+    }
+    if (status == CMS_STATUS_OK)
+    {
+        cms_watch_forget(watch);
+        if (in_step)
+        {
+            /* The table is the file again */
+            cms_database_mark_clean(db);
+            cms_watch_rows_free(&remote);
+        }
+        watch->remote = remote;
+    }
+    else
+    {
+        cms_watch_rows_free(&remote);
+    }
+    cms_watch_rows_free(&synced);
+    cms_change_list_free(&list);
+    return status;
+}
+
+#else /* !__linux__ */
+
+CMS_STATUS cms_watch_start(const StudentDatabase *db, CmsWatchPolicy policy, CmsWatch **out_watch)
+{
+    (void)db;
+    (void)policy;
+    if (out_watch != NULL)
+    {
+        *out_watch = NULL;
+    }
+    return CMS_STATUS_NOT_IMPLEMENTED;
+}
+
+void cms_watch_stop(CmsWatch *watch)
+{
+    (void)watch;
+}
+
+void cms_watch_set_policy(CmsWatch *watch, CmsWatchPolicy policy)
+{
+    (void)watch;
+    (void)policy;
+}
+
+CmsWatchPolicy cms_watch_policy(const CmsWatch *watch)
+{
+    (void)watch;
+    return CMS_WATCH_PREFER_LOCAL;
+}
+
+void cms_watch_synced(CmsWatch *watch, const StudentDatabase *db)
+{
+    (void)watch;
+    (void)db;
+}
+
+CMS_STATUS cms_watch_poll(CmsWatch *watch, StudentDatabase *db, CmsWatchReport *out_report)
+{
+    (void)watch;
+    (void)db;
+    (void)out_report;
+    return CMS_STATUS_NOT_FOUND;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,710 @@
+#define _XOPEN_SOURCE 600
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "cms_gen.h"
+#include "../include/alloc.h"
+#include "../include/commands.h"
+#include "../include/config.h"
+#include "../include/database.h"
+#include "../include/export.h"
+#include "../include/sidecar.h"
+#include "../include/summary.h"
+
+/* Benchmarks the database layer on generated files (cms_gen.h) and prints
+   one JSON document: for every measurement the rows, the operations per
+   run and the fastest and median of --repeat runs. Progress goes to
+   standard error; anything the library prints is sent to /dev/null.
+   POSIX only: it times startup through a pseudo-terminal. */
+
+#define BENCH_DEFAULT_ROWS "10000,100000"
+#define BENCH_DEFAULT_REPEAT 5
+#define BENCH_MAX_SIZES 16
+#define BENCH_MAX_REPEAT 100
+#define BENCH_MAX_QUERIES 100000
+#define BENCH_PROMPT "CMS> "
+#define BENCH_PROMPT_TIMEOUT_MS 600000
+#define BENCH_PATH_LEN 512
+
+typedef struct
+{
+    const char *rows_list;
+    unsigned long long seed;
+    int repeat;
+    const char *dir;
+    const char *cms_path;  /* interactive binary for the startup timings */
+    const char *json_path;
+    const char *label;
+} BenchOptions;
+
+typedef struct
+{
+    FILE *json;
+    bool first_result;
+    int repeat;
+    int failures;
+} BenchReport;
+
+static double bench_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+}
+
+static int bench_compare_double(const void *a, const void *b)
+{
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+static void bench_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const char *c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', out);
+            fputc(*c, out);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(out, "\\u%04x", (unsigned)(unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* One measurement from samples[count] milliseconds, ops operations each */
+static void bench_result(BenchReport *report, const char *name, unsigned long long rows, unsigned long long ops,
+                         double *samples, int count)
+{
+    qsort(samples, (size_t)count, sizeof(double), bench_compare_double);
+    double median = (count % 2 != 0) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+
+    fprintf(report->json, "%s\n    {\"name\": ", report->first_result ? "" : ",");
+    bench_json_string(report->json, name);
+    fprintf(report->json,
+            ", \"rows\": %llu, \"ops\": %llu, \"runs\": %d, \"min_ms\": %.3f, \"median_ms\": %.3f, "
+            "\"max_ms\": %.3f, \"ns_per_op\": %.1f}",
+            rows, ops, count, samples[0], median, samples[count - 1], (ops > 0) ? median * 1e6 / (double)ops : 0.0);
+    report->first_result = false;
+    fprintf(stderr, "  %-28s %10.3f ms (min %.3f)\n", name, median, samples[0]);
+}
+
+static void bench_failed(BenchReport *report, const char *name, CMS_STATUS status)
+{
+    fprintf(stderr, "  %-28s failed: %s\n", name, cms_status_message(status));
+    report->failures++;
+}
+
+/* ------------------------------------------------------------------ */
+/* Database layer                                                      */
+/* ------------------------------------------------------------------ */
+
+static CMS_STATUS bench_load(StudentDatabase *db, const char *path)
+{
+    cms_database_cleanup(db);
+    CMS_STATUS status = cms_database_init(db);
+    return (status == CMS_STATUS_OK) ? cms_database_load(db, path) : status;
+}
+
+/* Loads path report->repeat times; remove_sidecar times the load that has
+   to build every index */
+static void bench_time_load(BenchReport *report, StudentDatabase *db, const char *name, const char *path,
+                            unsigned long long rows, bool remove_sidecar)
+{
+    char sidecar[BENCH_PATH_LEN];
+    snprintf(sidecar, sizeof(sidecar), "%s%s", path, CMS_SIDECAR_SUFFIX);
+
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        if (remove_sidecar)
+        {
+            remove(sidecar);
+        }
+        double start = bench_now_ms();
+        CMS_STATUS status = bench_load(db, path);
+        samples[run] = bench_now_ms() - start;
+        if (status != CMS_STATUS_OK)
+        {
+            bench_failed(report, name, status);
+            return;
+        }
+    }
+    bench_result(report, name, rows, rows, samples, report->repeat);
+}
+
+static void bench_time_save(BenchReport *report, StudentDatabase *db, const char *name, const char *path,
+                            CmsFileFormat format, unsigned long long rows)
+{
+    double samples[BENCH_MAX_REPEAT];
+    db->save_format = format;
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        double start = bench_now_ms();
+        CMS_STATUS status = cms_database_save(db, path);
+        samples[run] = bench_now_ms() - start;
+        if (status != CMS_STATUS_OK)
+        {
+            bench_failed(report, name, status);
+            return;
+        }
+    }
+    bench_result(report, name, rows, rows, samples, report->repeat);
+}
+
+/* Exports the whole table through a table cursor, as EXPORT with no view
+   does; the file is removed afterwards */
+static void bench_time_export(BenchReport *report, const StudentDatabase *db, const char *name, const char *path,
+                              CmsExportFormat format, unsigned long long rows)
+{
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        CmsCursor cursor;
+        size_t written = 0;
+        double start = bench_now_ms();
+        CMS_STATUS status = cms_cursor_open(&cursor, db);
+        if (status == CMS_STATUS_OK)
+        {
+            status = cms_export_file(path, &cursor, format, &written);
+            cms_cursor_close(&cursor);
+        }
+        samples[run] = bench_now_ms() - start;
+        if (status == CMS_STATUS_OK && written != db->count)
+        {
+            status = CMS_STATUS_ERROR;
+        }
+        if (status != CMS_STATUS_OK)
+        {
+            remove(path);
+            bench_failed(report, name, status);
+            return;
+        }
+    }
+    remove(path);
+    bench_result(report, name, rows, rows, samples, report->repeat);
+}
+
+/* Looks up the IDs of rows [first, first + count) of the generated file,
+   spread over it; past the last row they are IDs the file does not hold */
+static void bench_time_query(BenchReport *report, const StudentDatabase *db, const char *name,
+                             unsigned long long seed, unsigned long long first, unsigned long long span,
+                             unsigned long long rows, CMS_STATUS expected)
+{
+    unsigned long long count = (span < BENCH_MAX_QUERIES) ? span : BENCH_MAX_QUERIES;
+    int *ids = cms_malloc(CMS_MEM_TEMP, (size_t)count * sizeof(int));
+    if (ids == NULL)
+    {
+        bench_failed(report, name, CMS_STATUS_ERROR);
+        return;
+    }
+    for (unsigned long long i = 0; i < count; ++i)
+    {
+        ids[i] = cms_gen_id(seed, first + i * (span / count));
+    }
+
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        StudentRecord record;
+        unsigned long long unexpected = 0;
+        double start = bench_now_ms();
+        for (unsigned long long i = 0; i < count; ++i)
+        {
+            unexpected += (cms_database_query(db, ids[i], &record) != expected);
+        }
+        samples[run] = bench_now_ms() - start;
+        if (unexpected > 0)
+        {
+            cms_free(ids);
+            bench_failed(report, name, CMS_STATUS_ERROR);
+            return;
+        }
+    }
+    cms_free(ids);
+    bench_result(report, name, rows, count, samples, report->repeat);
+}
+
+/* Walks the whole sorted view, as SHOW ALL SORT BY does before printing */
+static void bench_time_sort(BenchReport *report, const StudentDatabase *db, CmsSortKey key, CmsSortOrder order,
+                            const char *key_name, unsigned long long rows)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "sort_%s_%s", key_name, (order == CMS_SORT_ASC) ? "asc" : "desc");
+
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        CmsCursor cursor;
+        const StudentRecord *record;
+        size_t seen = 0;
+        double start = bench_now_ms();
+        CMS_STATUS status = cms_cursor_open_sorted(&cursor, db, key, order);
+        if (status == CMS_STATUS_OK)
+        {
+            while (cms_cursor_next(&cursor, &record) == CMS_STATUS_OK)
+            {
+                seen++;
+            }
+            cms_cursor_close(&cursor);
+        }
+        samples[run] = bench_now_ms() - start;
+        if (status != CMS_STATUS_OK || seen != db->count)
+        {
+            bench_failed(report, name, (status != CMS_STATUS_OK) ? status : CMS_STATUS_ERROR);
+            return;
+        }
+    }
+    bench_result(report, name, rows, rows, samples, report->repeat);
+}
+
+/* FILTER prints every match; standard output is /dev/null here, so this
+   times selecting and formatting the rows */
+static void bench_time_filter(BenchReport *report, const StudentDatabase *db, const char *name,
+                              const char *argument, unsigned long long rows)
+{
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        double start = bench_now_ms();
+        CMS_STATUS status = cms_filter(db, cms_slice(argument));
+        fflush(stdout);
+        samples[run] = bench_now_ms() - start;
+        if (status != CMS_STATUS_OK)
+        {
+            bench_failed(report, name, status);
+            return;
+        }
+    }
+    bench_result(report, name, rows, rows, samples, report->repeat);
+}
+
+static void bench_time_summary(BenchReport *report, const StudentDatabase *db, unsigned long long rows)
+{
+    double samples[BENCH_MAX_REPEAT];
+    for (int run = 0; run < report->repeat; ++run)
+    {
+        SummaryStats stats;
+        double start = bench_now_ms();
+        CMS_STATUS status = cms_calculate_summary(db, &stats);
+        samples[run] = bench_now_ms() - start;
+        if (status != CMS_STATUS_OK)
+        {
+            bench_failed(report, "summary", status);
+            return;
+        }
+    }
+    bench_result(report, "summary", rows, rows, samples, report->repeat);
+}
+
+/* ------------------------------------------------------------------ */
+/* Startup of the interactive program                                  */
+/* ------------------------------------------------------------------ */
+
+/* Reads from fd until text has been seen; false on timeout or exit */
+static bool bench_wait_for(int fd, const char *text, char *buffer, size_t size, size_t *length)
+{
+    double deadline = bench_now_ms() + BENCH_PROMPT_TIMEOUT_MS;
+    while (strstr(buffer, text) == NULL)
+    {
+        struct pollfd ready = {fd, POLLIN, 0};
+        int wait_ms = (int)(deadline - bench_now_ms());
+        if (wait_ms <= 0 || poll(&ready, 1, wait_ms) <= 0)
+        {
+            return false;
+        }
+        /* Keep the tail only: what is searched for is never that long */
+        if (*length + 256 >= size)
+        {
+            memmove(buffer, buffer + *length - 128, 128);
+            *length = 128;
+        }
+        ssize_t got = read(fd, buffer + *length, size - *length - 1);
+        if (got <= 0)
+        {
+            return false;
+        }
+        *length += (size_t)got;
+        buffer[*length] = '\0';
+    }
+    return true;
+}
+
+/* Starts cms_path on a pseudo-terminal in directory dir, as a user at a
+   prompt would, and times the first prompt and the first answered QUERY */
+static bool bench_startup_once(const char *cms_path, const char *dir, const char *db_path, int query_id,
+                               double *out_prompt_ms, double *out_query_ms)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        if (master >= 0)
+        {
+            close(master);
+        }
+        return false;
+    }
+    const char *slave_name = ptsname(master);
+
+    double start = bench_now_ms();
+    pid_t child = fork();
+    if (child < 0)
+    {
+        close(master);
+        return false;
+    }
+    if (child == 0)
+    {
+        setsid();
+        int slave = open(slave_name, O_RDWR);
+        struct termios mode;
+        if (slave < 0 || chdir(dir) != 0)
+        {
+            _exit(127);
+        }
+        if (tcgetattr(slave, &mode) == 0)
+        {
+            mode.c_lflag &= ~(tcflag_t)ECHO;
+            tcsetattr(slave, TCSANOW, &mode);
+        }
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        close(slave);
+        close(master);
+        if (db_path != NULL)
+        {
+            execl(cms_path, cms_path, "--db", db_path, (char *)NULL);
+        }
+        else
+        {
+            execl(cms_path, cms_path, (char *)NULL);
+        }
+        _exit(127);
+    }
+
+    static char buffer[1 << 16];
+    size_t length = 0;
+    buffer[0] = '\0';
+    bool ok = bench_wait_for(master, BENCH_PROMPT, buffer, sizeof(buffer), &length);
+    *out_prompt_ms = bench_now_ms() - start;
+
+    if (ok)
+    {
+        char command[64];
+        char answer[32];
+        int command_length = snprintf(command, sizeof(command), "QUERY %d\n", query_id);
+        snprintf(answer, sizeof(answer), "ID: %d,", query_id);
+        length = 0;
+        buffer[0] = '\0';
+        ok = write(master, command, (size_t)command_length) == command_length &&
+             bench_wait_for(master, answer, buffer, sizeof(buffer), &length);
+        *out_query_ms = bench_now_ms() - start;
+    }
+
+    if (ok)
+    {
+        ok = write(master, "EXIT\n", 5) == 5;
+    }
+    if (!ok)
+    {
+        kill(child, SIGKILL);
+    }
+    /* Drain until the program closes the terminal, then reap it */
+    char drain[4096];
+    struct pollfd ready = {master, POLLIN, 0};
+    while (poll(&ready, 1, 5000) > 0 && read(master, drain, sizeof(drain)) > 0)
+    {
+    }
+    int wait_status = 0;
+    waitpid(child, &wait_status, 0);
+    close(master);
+    return ok;
+}
+
+/* Time to the first prompt and to the first answer, opening the file with
+   --db (loaded before the prompt) and as the default database (loaded in
+   the background behind the prompt) */
+static void bench_time_startup(BenchReport *report, const BenchOptions *options, const char *data_path,
+                               unsigned long long rows)
+{
+    char default_path[BENCH_PATH_LEN];
+    snprintf(default_path, sizeof(default_path), "%s/%s", options->dir, CMS_DEFAULT_DATABASE_FILE);
+    remove(default_path);
+    if (symlink(data_path, default_path) != 0)
+    {
+        bench_failed(report, "startup", CMS_STATUS_IO);
+        return;
+    }
+
+    int query_id = cms_gen_id(options->seed, rows - 1);
+    for (int background = 0; background <= 1; ++background)
+    {
+        double prompt[BENCH_MAX_REPEAT];
+        double query[BENCH_MAX_REPEAT];
+        const char *mode = background ? "background" : "db_option";
+        char name[64];
+        for (int run = 0; run < report->repeat; ++run)
+        {
+            if (!bench_startup_once(options->cms_path, options->dir, background ? NULL : data_path, query_id,
+                                    &prompt[run], &query[run]))
+            {
+                snprintf(name, sizeof(name), "startup_%s", mode);
+                bench_failed(report, name, CMS_STATUS_ERROR);
+                remove(default_path);
+                return;
+            }
+        }
+        snprintf(name, sizeof(name), "first_prompt_%s", mode);
+        bench_result(report, name, rows, 1, prompt, report->repeat);
+        snprintf(name, sizeof(name), "first_query_%s", mode);
+        bench_result(report, name, rows, 1, query, report->repeat);
+    }
+    remove(default_path);
+}
+
+/* ------------------------------------------------------------------ */
+/* Driver                                                              */
+/* ------------------------------------------------------------------ */
+
+static void bench_size(BenchReport *report, const BenchOptions *options, unsigned long long rows)
+{
+    char text_path[BENCH_PATH_LEN];
+    char saved_path[BENCH_PATH_LEN];
+    char binary_path[BENCH_PATH_LEN];
+    char export_path[BENCH_PATH_LEN];
+    char absolute_path[BENCH_PATH_LEN];
+    snprintf(text_path, sizeof(text_path), "%s/cms_%llu_%llu.txt", options->dir, rows, options->seed);
+    snprintf(saved_path, sizeof(saved_path), "%s/cms_%llu_%llu_saved.txt", options->dir, rows, options->seed);
+    snprintf(binary_path, sizeof(binary_path), "%s/cms_%llu_%llu.bin", options->dir, rows, options->seed);
+    snprintf(export_path, sizeof(export_path), "%s/cms_%llu_%llu_export.out", options->dir, rows, options->seed);
+
+    fprintf(stderr, "%llu rows:\n", rows);
+    struct stat info;
+    if (stat(text_path, &info) != 0)
+    {
+        fprintf(stderr, "  generating %s\n", text_path);
+        CMS_STATUS status = cms_gen_write_file(text_path, options->seed, rows);
+        if (status != CMS_STATUS_OK)
+        {
+            bench_failed(report, "generate", status);
+            return;
+        }
+    }
+
+    StudentDatabase db;
+    if (cms_database_init(&db) != CMS_STATUS_OK)
+    {
+        bench_failed(report, "init", CMS_STATUS_ERROR);
+        return;
+    }
+
+    bench_time_load(report, &db, "load_text", text_path, rows, true);
+    if (db.is_loaded)
+    {
+        bench_time_save(report, &db, "save_text", saved_path, CMS_FILE_FORMAT_TEXT, rows);
+        bench_time_load(report, &db, "load_text_sidecar", saved_path, rows, false);
+        bench_time_save(report, &db, "save_binary", binary_path, CMS_FILE_FORMAT_BINARY, rows);
+        bench_time_load(report, &db, "load_binary", binary_path, rows, false);
+        bench_time_export(report, &db, "export_csv", export_path, CMS_EXPORT_CSV, rows);
+        bench_time_export(report, &db, "export_json", export_path, CMS_EXPORT_JSON, rows);
+        bench_time_export(report, &db, "export_ndjson", export_path, CMS_EXPORT_NDJSON, rows);
+    }
+
+    if (db.is_loaded && db.count == rows)
+    {
+        bench_time_query(report, &db, "query_hit", options->seed, 0, rows, rows, CMS_STATUS_OK);
+        if (rows < CMS_GEN_MAX_ROWS)
+        {
+            bench_time_query(report, &db, "query_miss", options->seed, rows, CMS_GEN_MAX_ROWS - rows, rows,
+                             CMS_STATUS_NOT_FOUND);
+        }
+
+        static const struct
+        {
+            CmsSortKey key;
+            const char *name;
+        } keys[] = {{CMS_SORT_KEY_ID, "id"},
+                    {CMS_SORT_KEY_MARK, "mark"},
+                    {CMS_SORT_KEY_NAME, "name"},
+                    {CMS_SORT_KEY_PROGRAMME, "programme"}};
+        for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); ++k)
+        {
+            bench_time_sort(report, &db, keys[k].key, CMS_SORT_ASC, keys[k].name, rows);
+            bench_time_sort(report, &db, keys[k].key, CMS_SORT_DESC, keys[k].name, rows);
+        }
+
+        bench_time_filter(report, &db, "filter_programme", "Computer Science", rows);
+        bench_time_filter(report, &db, "filter_mark", "MARK >= 70", rows);
+        bench_time_summary(report, &db, rows);
+    }
+    cms_database_cleanup(&db);
+
+    if (options->cms_path != NULL && realpath(text_path, absolute_path) != NULL)
+    {
+        bench_time_startup(report, options, absolute_path, rows);
+    }
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --rows <list>     Row counts, comma separated, k/M suffixes allowed (default %s)\n"
+            "  --repeat <n>      Runs per measurement (default %d)\n"
+            "  --seed <n>        Generator seed (default %u)\n"
+            "  --dir <path>      Where generated files are kept and reused (default .)\n"
+            "  --cms <path>      The cms program, to time startup (skipped without it)\n"
+            "  --json <path>     Write the results there instead of standard output\n"
+            "  --label <text>    Recorded in the results, e.g. a release or commit\n",
+            program, BENCH_DEFAULT_ROWS, BENCH_DEFAULT_REPEAT, CMS_GEN_DEFAULT_SEED);
+}
+
+static bool parse_count(const char *text, char **end, unsigned long long *out_value)
+{
+    unsigned long long value = strtoull(text, end, 10);
+    if (*end == text)
+    {
+        return false;
+    }
+    if (**end == 'k' || **end == 'K')
+    {
+        value *= 1000ULL;
+        ++*end;
+    }
+    else if (**end == 'm' || **end == 'M')
+    {
+        value *= 1000000ULL;
+        ++*end;
+    }
+    *out_value = value;
+    return value > 0 && value <= CMS_GEN_MAX_ROWS;
+}
+
+static int parse_rows(const char *list, unsigned long long *sizes)
+{
+    int count = 0;
+    const char *at = list;
+    while (*at != '\0' && count < BENCH_MAX_SIZES)
+    {
+        char *end = NULL;
+        if (!parse_count(at, &end, &sizes[count]) || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        count++;
+        at = (*end == ',') ? end + 1 : end;
+    }
+    return (*at == '\0') ? count : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {BENCH_DEFAULT_ROWS, CMS_GEN_DEFAULT_SEED, BENCH_DEFAULT_REPEAT, ".", NULL, NULL, ""};
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value == NULL)
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--rows") == 0)
+        {
+            options.rows_list = value;
+        }
+        else if (strcmp(argv[i], "--repeat") == 0)
+        {
+            options.repeat = atoi(value);
+        }
+        else if (strcmp(argv[i], "--seed") == 0)
+        {
+            options.seed = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--dir") == 0)
+        {
+            options.dir = value;
+        }
+        else if (strcmp(argv[i], "--cms") == 0)
+        {
+            options.cms_path = value;
+        }
+        else if (strcmp(argv[i], "--json") == 0)
+        {
+            options.json_path = value;
+        }
+        else if (strcmp(argv[i], "--label") == 0)
+        {
+            options.label = value;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    unsigned long long sizes[BENCH_MAX_SIZES];
+    int size_count = parse_rows(options.rows_list, sizes);
+    if (size_count <= 0 || options.repeat < 1 || options.repeat > BENCH_MAX_REPEAT)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Results go to the real standard output (or --json); the library's
+       own printing goes to /dev/null */
+    BenchReport report = {NULL, true, options.repeat, 0};
+    if (options.json_path != NULL)
+    {
+        report.json = fopen(options.json_path, "w");
+    }
+    else
+    {
+        int result_fd = dup(STDOUT_FILENO);
+        report.json = (result_fd >= 0) ? fdopen(result_fd, "w") : NULL;
+    }
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (report.json == NULL || null_fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot open the results output\n");
+        return EXIT_FAILURE;
+    }
+    fflush(stdout);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    fprintf(report.json, "{\n  \"schema\": 1,\n  \"label\": ");
+    bench_json_string(report.json, options.label);
+    fprintf(report.json, ",\n  \"seed\": %llu,\n  \"repeat\": %d,\n  \"results\": [", options.seed, options.repeat);
+    for (int i = 0; i < size_count; ++i)
+    {
+        bench_size(&report, &options, sizes[i]);
+    }
+    fprintf(report.json, "\n  ],\n  \"failures\": %d\n}\n", report.failures);
+
+    if (fclose(report.json) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    return (report.failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -12,37 +12,51 @@ if not exist "build" mkdir build
 
 REM Compiler settings
 set CC=gcc
-set CFLAGS=-I../include -I./unity -Wall -std=c11
-set SRC_FILES=../src/cms_status.c ../src/database.c ../src/summary.c ../src/utils.c
+set CFLAGS=-I../include -I./unity -Wall -std=c11 -pthread
+set SRC_FILES=../src/alloc.c ../src/bitmap.c ../src/cms_status.c ../src/database.c ../src/diff.c ../src/export.c ../src/fuzzy.c ../src/index.c ../src/journal.c ../src/metrics.c ../src/parallel.c ../src/render.c ../src/shared.c ../src/sidecar.c ../src/summary.c ../src/tokenizer.c ../src/transaction.c ../src/utils.c ../src/watch.c
 
-echo [1/4] Compiling test_utils...
+echo [1/6] Compiling test_utils...
 %CC% %CFLAGS% -o build/test_utils.exe test_utils.c unity/unity.c %SRC_FILES%
 if %ERRORLEVEL% NEQ 0 (
     echo ERROR: Failed to compile test_utils
     goto :error
 )
 
-echo [2/4] Compiling test_database...
+echo [2/6] Compiling test_database...
 %CC% %CFLAGS% -o build/test_database.exe test_database.c unity/unity.c %SRC_FILES%
 if %ERRORLEVEL% NEQ 0 (
     echo ERROR: Failed to compile test_database
     goto :error
 )
 
-echo [3/4] Compiling test_summary...
+echo [3/6] Compiling test_summary...
 %CC% %CFLAGS% -o build/test_summary.exe test_summary.c unity/unity.c %SRC_FILES%
 if %ERRORLEVEL% NEQ 0 (
     echo ERROR: Failed to compile test_summary
     goto :error
 )
 
-echo [4/4] Compiling test_commands...
-%CC% %CFLAGS% -o build/test_commands.exe test_commands.c unity/unity.c %SRC_FILES% ../src/commands.c
+echo [4/6] Compiling test_commands...
+%CC% %CFLAGS% -o build/test_commands.exe test_commands.c unity/unity.c %SRC_FILES% ../src/commands.c ../src/server.c
 if %ERRORLEVEL% NEQ 0 (
     echo ERROR: Failed to compile test_commands
     goto :error
 )
 
+echo [5/6] Compiling test_index...
+%CC% %CFLAGS% -o build/test_index.exe test_index.c unity/unity.c %SRC_FILES%
+if %ERRORLEVEL% NEQ 0 (
+    echo ERROR: Failed to compile test_index
+    goto :error
+)
+
+echo [6/6] Compiling test_shared...
+%CC% %CFLAGS% -o build/test_shared.exe test_shared.c unity/unity.c %SRC_FILES%
+if %ERRORLEVEL% NEQ 0 (
+    echo ERROR: Failed to compile test_shared
+    goto :error
+)
+
 echo.
 echo =====================================
 echo Build Successful!
@@ -55,6 +69,8 @@ echo   build\test_utils.exe
 echo   build\test_database.exe
 echo   build\test_summary.exe
 echo   build\test_commands.exe
+echo   build\test_index.exe
+echo   build\test_shared.exe
 echo.
 
 goto :end
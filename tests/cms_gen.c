@@ -0,0 +1,152 @@
+#include "cms_gen.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Mostly common names with a long tail: a draw u in [0, 1) picks entry
+   floor(count * u^2), so the first entries come up most */
+static const char *cms_gen_first_names[] = {
+    "Wei",     "Jia Hui", "Ming",    "Aisyah",   "Muhammad", "Priya",   "Arjun",  "Daniel",  "Sarah",
+    "Joshua",  "Isaac",   "Rachel",  "Nur",      "Siti",     "Ethan",   "Chloe",  "Ryan",    "Hui Min",
+    "Kumar",   "Ahmad",   "Grace",   "Jun Jie",  "Xin Yi",   "Li Na",   "Ravi",   "Farah",   "Nathan",
+    "Sophia",  "Marcus",  "Amelia",  "Hafiz",    "Zhi Hao",  "Kai",     "Divya",  "Benjamin", "Olivia",
+    "Aaron",   "Yusuf",   "Mei Ling", "Lucas",   "Ananya",   "Hannah",  "Irfan",  "Jasmine", "Vikram",
+    "Zachary", "Leah",    "Tariq",   "Bao",      "Anjali",   "Elijah",  "Hana",   "Rizwan",  "Yi Xuan"};
+
+static const char *cms_gen_last_names[] = {
+    "Tan",     "Lim",     "Lee",      "Ng",     "Ong",       "Wong",   "Goh",      "Chua",   "Chan",
+    "Koh",     "Teo",     "Ang",      "Yeo",    "Tay",       "Ho",     "Low",      "Toh",    "Sim",
+    "Chong",   "Chia",    "Kumar",    "Singh",  "Abdullah",  "Rahman", "Ismail",   "Ibrahim", "Nair",
+    "Pillai",  "Raj",     "Menon",    "Chen",   "Levoy",     "Smith",  "Brown",    "Fernandez", "Santos",
+    "Nguyen",  "Tran",    "Kim",      "Park",   "Sato",      "Suzuki", "Hassan",   "Osman",  "Das",
+    "Iyer",    "Gupta",   "O'Brien",  "Murphy", "Rodriguez", "Lopez",  "Wijaya",   "Halim",  "Yap"};
+
+/* Programmes with their share of students (out of 1000) and mean mark */
+typedef struct
+{
+    const char *name;
+    unsigned share;
+    float mean;
+} CmsGenProgramme;
+
+static const CmsGenProgramme cms_gen_programmes[] = {
+    {"Computer Science", 190, 68.0f},        {"Software Engineering", 150, 66.5f},
+    {"Information Security", 110, 64.0f},    {"Applied Artificial Intelligence", 95, 70.0f},
+    {"Digital Supply Chain", 80, 62.5f},     {"Electrical Engineering", 75, 61.0f},
+    {"Mechanical Engineering", 65, 60.5f},   {"Accountancy", 60, 67.0f},
+    {"Nursing", 55, 71.0f},                  {"Hospitality Business", 45, 63.5f},
+    {"Chemical Engineering", 40, 59.0f},     {"Interactive Media Design", 35, 69.0f}};
+
+#define CMS_GEN_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+/* splitmix64: a fresh, well-mixed stream per (seed, row, draw) */
+static uint64_t cms_gen_mix(uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+static double cms_gen_uniform(uint64_t seed, uint64_t index, unsigned draw)
+{
+    uint64_t bits = cms_gen_mix(cms_gen_mix(seed ^ (index * 0x632be59bd9b4e019ULL)) + draw);
+    return (double)(bits >> 11) / 9007199254740992.0; /* 2^53 */
+}
+
+static const char *cms_gen_pick_skewed(const char *const *names, size_t count, double u)
+{
+    size_t at = (size_t)((double)count * u * u);
+    return names[(at < count) ? at : count - 1];
+}
+
+/* ID permutation: index * step + offset modulo the ID range, with a step
+   coprime to 9,000,000 (= 2^6 * 3^2 * 5^6) so every index gets its own ID */
+static uint64_t cms_gen_step(uint64_t seed)
+{
+    static const uint64_t steps[] = {7919, 104729, 1299709, 15485863, 2750159, 6291469, 3021377, 4256249};
+    return steps[cms_gen_mix(seed) % CMS_GEN_COUNT(steps)];
+}
+
+int cms_gen_id(uint64_t seed, uint64_t index)
+{
+    uint64_t offset = cms_gen_mix(seed ^ 0x5851f42d4c957f2dULL) % CMS_GEN_MAX_ROWS;
+    uint64_t slot = (index % CMS_GEN_MAX_ROWS * cms_gen_step(seed) + offset) % CMS_GEN_MAX_ROWS;
+    return CMS_GEN_FIRST_ID + (int)slot;
+}
+
+void cms_gen_record(uint64_t seed, uint64_t index, StudentRecord *out_record)
+{
+    memset(out_record, 0, sizeof(*out_record));
+    out_record->id = cms_gen_id(seed, index);
+
+    snprintf(out_record->name, sizeof(out_record->name), "%s %s",
+             cms_gen_pick_skewed(cms_gen_first_names, CMS_GEN_COUNT(cms_gen_first_names),
+                                 cms_gen_uniform(seed, index, 0)),
+             cms_gen_pick_skewed(cms_gen_last_names, CMS_GEN_COUNT(cms_gen_last_names),
+                                 cms_gen_uniform(seed, index, 1)));
+
+    unsigned share = (unsigned)(cms_gen_uniform(seed, index, 2) * 1000.0);
+    const CmsGenProgramme *programme = &cms_gen_programmes[0];
+    for (size_t i = 0; i < CMS_GEN_COUNT(cms_gen_programmes); ++i)
+    {
+        programme = &cms_gen_programmes[i];
+        if (share < programme->share)
+        {
+            break;
+        }
+        share -= programme->share;
+    }
+    strcpy(out_record->programme, programme->name);
+
+    /* Sum of four uniforms: a bell curve with a standard deviation of 12 */
+    double spread = 0.0;
+    for (unsigned draw = 3; draw < 7; ++draw)
+    {
+        spread += cms_gen_uniform(seed, index, draw) - 0.5;
+    }
+    double mark = (double)programme->mean + spread * 12.0 / 0.57735;
+    mark = (mark < 0.0) ? 0.0 : (mark > 100.0) ? 100.0 : mark;
+    out_record->mark = (float)((double)(long)(mark * 10.0 + 0.5) / 10.0);
+}
+
+CMS_STATUS cms_gen_write(FILE *fp, uint64_t seed, uint64_t rows)
+{
+    if (fp == NULL || rows > CMS_GEN_MAX_ROWS)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n") < 0)
+    {
+        return CMS_STATUS_IO;
+    }
+    for (uint64_t i = 0; i < rows; ++i)
+    {
+        StudentRecord record;
+        cms_gen_record(seed, i, &record);
+        if (fprintf(fp, "%d\t%s\t%s\t%.1f\n", record.id, record.name, record.programme, record.mark) < 0)
+        {
+            return CMS_STATUS_IO;
+        }
+    }
+    return CMS_STATUS_OK;
+}
+
+CMS_STATUS cms_gen_write_file(const char *path, uint64_t seed, uint64_t rows)
+{
+    if (path == NULL)
+    {
+        return CMS_STATUS_INVALID_ARGUMENT;
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return CMS_STATUS_IO;
+    }
+    CMS_STATUS status = cms_gen_write(fp, seed, rows);
+    if (fclose(fp) != 0 && status == CMS_STATUS_OK)
+    {
+        status = CMS_STATUS_IO;
+    }
+    return status;
+}
@@ -0,0 +1,28 @@
+#ifndef CMS_GEN_H
+#define CMS_GEN_H
+
+#include "../include/cms.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Synthetic cohort files for benchmarks. Row i of a file depends only on
+   the seed and i, so any row can be made again without the file. Student
+   IDs are a seeded permutation of the whole 7-digit range, which caps a
+   file at CMS_GEN_MAX_ROWS rows; names are drawn from common first and
+   last names with a long tail, programmes from a skewed catalogue, and
+   marks from a bell curve around a per-programme mean. */
+#define CMS_GEN_FIRST_ID 1000000
+#define CMS_GEN_MAX_ROWS 9000000u
+#define CMS_GEN_DEFAULT_SEED 42u
+
+/* The ID of row index; indexes past the last row give IDs the file does
+   not hold, for lookups that miss */
+int cms_gen_id(uint64_t seed, uint64_t index);
+void cms_gen_record(uint64_t seed, uint64_t index, StudentRecord *out_record);
+
+/* Writes rows records in the text database format. CMS_STATUS_IO if the
+   file cannot be written, CMS_STATUS_INVALID_ARGUMENT past the ID range. */
+CMS_STATUS cms_gen_write(FILE *fp, uint64_t seed, uint64_t rows);
+CMS_STATUS cms_gen_write_file(const char *path, uint64_t seed, uint64_t rows);
+
+#endif /* CMS_GEN_H */
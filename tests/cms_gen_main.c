@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cms_gen.h"
+
+/* cms_gen [--seed N] <rows> <path>: writes a synthetic database file */
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--seed N] <rows> <path>\n", program);
+    fprintf(stderr, "  rows: 1 to %u (every row has its own 7-digit ID); suffixes k and M allowed\n",
+            CMS_GEN_MAX_ROWS);
+}
+
+/* "250000", "250k" or "2M" */
+static int parse_count(const char *text, unsigned long long *out_value)
+{
+    char *end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text)
+    {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K')
+    {
+        value *= 1000ULL;
+        ++end;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        value *= 1000000ULL;
+        ++end;
+    }
+    *out_value = value;
+    return *end == '\0';
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long seed = CMS_GEN_DEFAULT_SEED;
+    const char *positional[2] = {NULL, NULL};
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            char *end = NULL;
+            seed = strtoull(argv[++i], &end, 10);
+            if (*end != '\0')
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (positional_count < 2 && argv[i][0] != '-')
+        {
+            positional[positional_count++] = argv[i];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned long long rows = 0;
+    if (positional_count != 2 || !parse_count(positional[0], &rows) || rows == 0 || rows > CMS_GEN_MAX_ROWS)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    CMS_STATUS status = cms_gen_write_file(positional[1], seed, rows);
+    if (status != CMS_STATUS_OK)
+    {
+        fprintf(stderr, "Error: Cannot write '%s': %s\n", positional[1], cms_status_message(status));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
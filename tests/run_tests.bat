@@ -23,25 +23,35 @@ echo.
 
 set TOTAL_FAILURES=0
 
-echo [1/4] Running test_utils...
+echo [1/6] Running test_utils...
 build\test_utils.exe
 set /a TOTAL_FAILURES+=%ERRORLEVEL%
 
 echo.
-echo [2/4] Running test_database...
+echo [2/6] Running test_database...
 build\test_database.exe
 set /a TOTAL_FAILURES+=%ERRORLEVEL%
 
 echo.
-echo [3/4] Running test_summary...
+echo [3/6] Running test_summary...
 build\test_summary.exe
 set /a TOTAL_FAILURES+=%ERRORLEVEL%
 
 echo.
-echo [4/4] Running test_commands...
+echo [4/6] Running test_commands...
 build\test_commands.exe
 set /a TOTAL_FAILURES+=%ERRORLEVEL%
 
+echo.
+echo [5/6] Running test_index...
+build\test_index.exe
+set /a TOTAL_FAILURES+=%ERRORLEVEL%
+
+echo.
+echo [6/6] Running test_shared...
+build\test_shared.exe
+set /a TOTAL_FAILURES+=%ERRORLEVEL%
+
 echo.
 echo =====================================
 echo Test Results Summary
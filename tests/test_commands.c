@@ -1,9 +1,27 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "unity/unity.h"
 #include "../include/commands.h"
 #include "../include/database.h"
+#include "../include/index.h"
 #include "../include/cms.h"
+#include "../include/server.h"
+#include "../include/metrics.h"
+#include "../include/summary.h"
+#include "../include/alloc.h"
+#include <stdio.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
 /* Global test database */
 static StudentDatabase test_db;
 
@@ -26,7 +44,7 @@ void tearDown(void)
 void test_cmd_open_valid_file(void)
 {
     /* TODO: Test opening a valid database file */
-    CMS_STATUS status = cmd_open(&test_db, "tests/test_data/test_valid.txt");
+    CMS_STATUS status = cmd_open(&test_db, cms_slice("tests/test_data/test_valid.txt"));
 
     /* Note: Will work once database load is implemented */
     /* TEST_ASSERT_EQUAL(CMS_STATUS_OK, status); */
@@ -36,7 +54,7 @@ void test_cmd_open_valid_file(void)
 void test_cmd_open_empty_file(void)
 {
     /* TODO: Test opening an empty database file */
-    CMS_STATUS status = cmd_open(&test_db, "tests/test_data/test_empty.txt");
+    CMS_STATUS status = cmd_open(&test_db, cms_slice("tests/test_data/test_empty.txt"));
 
     /* Should succeed but have 0 records */
     /* TEST_ASSERT_EQUAL(CMS_STATUS_OK, status); */
@@ -45,7 +63,7 @@ void test_cmd_open_empty_file(void)
 void test_cmd_open_nonexistent_file(void)
 {
     /* TODO: Test opening a non-existent file */
-    CMS_STATUS status = cmd_open(&test_db, "tests/test_data/nonexistent.txt");
+    CMS_STATUS status = cmd_open(&test_db, cms_slice("tests/test_data/nonexistent.txt"));
 
     /* Should return IO error */
     /* TEST_ASSERT_EQUAL(CMS_STATUS_IO, status); */
@@ -54,10 +72,10 @@ void test_cmd_open_nonexistent_file(void)
 void test_cmd_open_null_arguments(void)
 {
     /* Test OPEN with NULL database pointer - should fail */
-    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_open(NULL, "tests/test_data/test_valid.txt"));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_open(NULL, cms_slice("tests/test_data/test_valid.txt")));
 
     /* Test OPEN with NULL filename - should NOT return INVALID_ARGUMENT */
-    CMS_STATUS status = cmd_open(&test_db, NULL);
+    CMS_STATUS status = cmd_open(&test_db, cms_slice(NULL));
     TEST_ASSERT_TRUE(status != CMS_STATUS_INVALID_ARGUMENT);
 }
 
@@ -116,7 +134,7 @@ void test_cmd_insert_valid(void)
     test_db.is_loaded = true;
 
     char *params = "ID=2500605 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=67.0";
-    CMS_STATUS status = cmd_insert(&test_db, params);
+    CMS_STATUS status = cmd_insert(&test_db, cms_slice(params));
 
     TEST_ASSERT_EQUAL(CMS_STATUS_OK, status);
     TEST_ASSERT_EQUAL(1, test_db.count);
@@ -132,11 +150,11 @@ void test_cmd_insert_duplicate_id(void)
 
     /* Insert first record */
     char *params1 = "ID=2500605 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=67.0";
-    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_insert(&test_db, params1));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_insert(&test_db, cms_slice(params1)));
 
     /* Try to insert same ID again */
     char *params2 = "ID=2500605 NAME=Wendy Wee PROGRAMME=Software Engineering MARK=70.0";
-    CMS_STATUS status = cmd_insert(&test_db, params2);
+    CMS_STATUS status = cmd_insert(&test_db, cms_slice(params2));
 
     TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, status);
     TEST_ASSERT_EQUAL(1, test_db.count); /* Should still be 1 */
@@ -148,24 +166,24 @@ void test_cmd_insert_invalid_data(void)
 
     /* Invalid ID (too short) */
     char *params_bad_id = "ID=2000 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=67.0";
-    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_insert(&test_db, params_bad_id));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_insert(&test_db, cms_slice(params_bad_id)));
 
     /* Invalid Mark (out of range) */
     char *params_bad_mark = "ID=2500605 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=420.0";
-    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_insert(&test_db, params_bad_mark));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_insert(&test_db, cms_slice(params_bad_mark)));
 }
 
 void test_cmd_insert_null_database(void)
 {
     /* Test INSERT with NULL database */
-    CMS_STATUS status = cmd_insert(NULL, NULL);
+    CMS_STATUS status = cmd_insert(NULL, cms_slice(NULL));
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, status);
 }
 
 void test_cmd_insert_not_loaded(void)
 {
     test_db.is_loaded = false;
-    CMS_STATUS status = cmd_insert(&test_db, "ID=2500605 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=67.0");
+    CMS_STATUS status = cmd_insert(&test_db, cms_slice("ID=2500605 NAME=Randy See PROGRAMME=Artificial Intelligence MARK=67.0"));
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, status);
 }
 
@@ -212,6 +230,29 @@ void test_cmd_update_null_database(void)
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, status);
 }
 
+void test_cmd_update_fields_inline(void)
+{
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_insert(&test_db, cms_slice("ID=2500605 NAME=Amy Lim PROGRAMME=Computer Science MARK=80")));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_update_fields(&test_db, 2500605, cms_slice("MARK=91.5 PROGRAMME=Data Science")));
+    TEST_ASSERT_EQUAL_FLOAT(91.5f, test_db.records[0].mark);
+    TEST_ASSERT_EQUAL_STRING("Data Science", test_db.records[0].programme);
+    TEST_ASSERT_EQUAL_STRING("Amy Lim", test_db.records[0].name);
+
+    /* Bad values leave the record untouched; batch mode reports them */
+    CmsSessionOptions batch = {true, false};
+    cms_set_session_options(&batch);
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_update_fields(&test_db, 2500605, cms_slice("MARK=9x")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_update_fields(&test_db, 2500605, cms_slice("MARK=150")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cmd_update_fields(&test_db, 9999999, cms_slice("MARK=50")));
+    TEST_ASSERT_EQUAL_FLOAT(91.5f, test_db.records[0].mark);
+
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+}
+
 /* ===== DELETE Command Tests ===== */
 
 void test_cmd_delete_existing(void)
@@ -246,7 +287,7 @@ void test_cmd_save_default_path(void)
 {
     /* TODO: Test SAVE command with default path */
     strcpy(test_db.file_path, "tests/test_data/test_output.txt");
-    CMS_STATUS status = cmd_save(&test_db, NULL);
+    CMS_STATUS status = cmd_save(&test_db, cms_slice(NULL));
 
     /* Note: Will work once save is implemented */
     /* TEST_ASSERT_EQUAL(CMS_STATUS_OK, status); */
@@ -255,7 +296,7 @@ void test_cmd_save_default_path(void)
 void test_cmd_save_custom_path(void)
 {
     /* TODO: Test SAVE command with custom path */
-    CMS_STATUS status = cmd_save(&test_db, "tests/test_data/custom_output.txt");
+    CMS_STATUS status = cmd_save(&test_db, cms_slice("tests/test_data/custom_output.txt"));
 
     /* Note: Will work once save is implemented */
     /* TEST_ASSERT_EQUAL(CMS_STATUS_OK, status); */
@@ -264,10 +305,176 @@ void test_cmd_save_custom_path(void)
 void test_cmd_save_null_database(void)
 {
     /* TODO: Test SAVE with NULL database */
-    CMS_STATUS status = cmd_save(NULL, "test.txt");
+    CMS_STATUS status = cmd_save(NULL, cms_slice("test.txt"));
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, status);
 }
 
+/* ===== EXPORT Command Tests ===== */
+
+static void read_export_file(const char *path, char *buffer, size_t size)
+{
+    FILE *fp = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+    size_t length = fread(buffer, 1, size - 1, fp);
+    buffer[length] = '\0';
+    fclose(fp);
+    remove(path);
+}
+
+void test_cmd_export_csv_escapes_fields(void)
+{
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_insert(&test_db, cms_slice("ID=2500605 NAME=Randy \"R\" See PROGRAMME=AI, Robotics MARK=67.5")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_insert(&test_db, cms_slice("ID=2500606 NAME=Amy Lim PROGRAMME=Computer Science MARK=80")));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_export(&test_db, cms_slice("CSV tests/test_data/export_output.csv")));
+
+    char contents[512];
+    read_export_file("tests/test_data/export_output.csv", contents, sizeof(contents));
+    TEST_ASSERT_EQUAL_STRING("id,name,programme,mark\n"
+                             "2500605,\"Randy \"\"R\"\" See\",\"AI, Robotics\",67.50\n"
+                             "2500606,Amy Lim,Computer Science,80.00\n",
+                             contents);
+}
+
+void test_cmd_export_json_views(void)
+{
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_insert(&test_db, cms_slice("ID=2500605 NAME=Randy \"R\" See PROGRAMME=AI\\ML MARK=67.5")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_insert(&test_db, cms_slice("ID=2500606 NAME=Amy Lim PROGRAMME=Computer Science MARK=80")));
+
+    char contents[512];
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_export(&test_db, cms_slice("JSON tests/test_data/export_output.json SORT MARK DESC")));
+    read_export_file("tests/test_data/export_output.json", contents, sizeof(contents));
+    TEST_ASSERT_EQUAL_STRING("[\n"
+                             "{\"id\":2500606,\"name\":\"Amy Lim\",\"programme\":\"Computer Science\",\"mark\":80.00},\n"
+                             "{\"id\":2500605,\"name\":\"Randy \\\"R\\\" See\",\"programme\":\"AI\\\\ML\",\"mark\":67.50}\n"
+                             "]\n",
+                             contents);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cmd_export(&test_db, cms_slice("NDJSON tests/test_data/export_output.json FILTER MARK < 70")));
+    read_export_file("tests/test_data/export_output.json", contents, sizeof(contents));
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2500605,\"name\":\"Randy \\\"R\\\" See\",\"programme\":\"AI\\\\ML\",\"mark\":67.50}\n",
+                             contents);
+}
+
+void test_cmd_export_rejects_bad_arguments(void)
+{
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_export(NULL, cms_slice("CSV out.csv")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cmd_export(&test_db, cms_slice("CSV out.csv")));
+
+    /* Usage errors print help and create no file */
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_export(&test_db, cms_slice("XML tests/test_data/export_output.xml")));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_export(&test_db, cms_slice("CSV tests/test_data/export_output.csv SORT AGE")));
+    TEST_ASSERT_NULL(fopen("tests/test_data/export_output.xml", "rb"));
+    TEST_ASSERT_NULL(fopen("tests/test_data/export_output.csv", "rb"));
+}
+
+/* ===== Batch Mode Tests ===== */
+
+void test_batch_loop_counts_failures(void)
+{
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+
+    FILE *input = tmpfile();
+    TEST_ASSERT_NOT_NULL(input);
+    fputs("# comment lines and blank lines are skipped\n"
+          "\n"
+          "INSERT ID=2500605 NAME=Amy Lim PROGRAMME=Computer Science MARK=80\n"
+          "INSERT ID=2500606 NAME=Ng Wei\n"
+          "UPDATE 2500605 MARK=85\n"
+          "FROBNICATE\n"
+          "DELETE 2500605\n"
+          "EXIT\n"
+          "QUERY ID=2500605\n",
+          input);
+    rewind(input);
+
+    test_db.is_loaded = true;
+    /* The incomplete INSERT and the unknown command fail; nothing after EXIT runs */
+    TEST_ASSERT_EQUAL(2, cms_batch_loop(&test_db, input));
+    TEST_ASSERT_EQUAL(0, test_db.count);
+    fclose(input);
+
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+}
+
+/* ===== WATCH Command Tests ===== */
+
+#ifdef __linux__
+/* Writes three rows with the given marks, as another program would */
+static void write_watched_rows(const char *path, int first, int second, int third)
+{
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    fprintf(fp, "2500701\tAmy Lim\tPhysics\t%d\n", first);
+    fprintf(fp, "2500702\tNg Wei\tPhysics\t%d\n", second);
+    fprintf(fp, "2500703\tTan Mei\tPhysics\t%d\n", third);
+    fclose(fp);
+}
+
+static float watched_mark(int student_id)
+{
+    StudentRecord found;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, student_id, &found));
+    return found.mark;
+}
+#endif
+
+void test_watch_off_and_on_keeps_reloaded_rows_with_unsaved_changes(void)
+{
+#ifdef __linux__
+    const char *path = "tests/test_data/test_output_watch.txt";
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+
+    write_watched_rows(path, 10, 20, 30);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load(&test_db, path));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("WATCH ON", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("UPDATE 2500701 MARK=11", &test_db));
+
+    /* Row 2 comes from the file; row 1 is still edited here, so the table stays dirty */
+    write_watched_rows(path, 10, 70, 30);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("QUERY 2500702", &test_db));
+    TEST_ASSERT_EQUAL_FLOAT(70.0f, watched_mark(2500702));
+    TEST_ASSERT_TRUE(test_db.is_dirty);
+
+    /* Turned off and on again, row 2 is still known to be the file's and
+       follows its next change instead of counting as an edit made here */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("WATCH OFF", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("WATCH ON", &test_db));
+    write_watched_rows(path, 10, 80, 90);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("QUERY 2500702", &test_db));
+    TEST_ASSERT_EQUAL_FLOAT(11.0f, watched_mark(2500701));
+    TEST_ASSERT_EQUAL_FLOAT(80.0f, watched_mark(2500702));
+    TEST_ASSERT_EQUAL_FLOAT(90.0f, watched_mark(2500703));
+
+    /* With nothing unsaved, OFF stops following the file */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SAVE", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("WATCH OFF", &test_db));
+    write_watched_rows(path, 10, 20, 30);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("QUERY 2500702", &test_db));
+    TEST_ASSERT_EQUAL_FLOAT(80.0f, watched_mark(2500702));
+
+    remove(path);
+    remove("tests/test_data/test_output_watch.txt.idx");
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+#else
+    TEST_IGNORE_MESSAGE("WATCH needs inotify");
+#endif
+}
+
 /* ===== HELP Command Tests ===== */
 
 void test_cmd_help(void)
@@ -277,6 +484,104 @@ void test_cmd_help(void)
     TEST_ASSERT_EQUAL(CMS_STATUS_OK, status);
 }
 
+void test_timing_counts_commands_and_errors(void)
+{
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+    cms_metrics_reset();
+    test_db.is_loaded = true;
+
+    /* Nothing is recorded while TIMING is off */
+    cms_parse_command("QUERY 2500607", &test_db);
+    CmsVerbMetrics verbs[CMS_METRICS_MAX_VERBS];
+    TEST_ASSERT_EQUAL(0, cms_metrics_list(verbs, CMS_METRICS_MAX_VERBS));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("TIMING SOMETIMES", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("timing on", &test_db));
+    TEST_ASSERT_TRUE(cms_metrics_enabled());
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("INSERT ID=2500607 NAME=Lee Mei PROGRAMME=Physics MARK=71", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("QUERY 2500607", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("QUERY 2500607 extra", &test_db));
+    cms_parse_command("QUERY 2599999", &test_db);
+    /* Unknown verbs are not counted */
+    cms_parse_command("QUERYX 1", &test_db);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("STATS", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("TIMING OFF", &test_db));
+    TEST_ASSERT_FALSE(cms_metrics_enabled());
+    cms_parse_command("QUERY 2500607", &test_db);
+
+    size_t count = cms_metrics_list(verbs, CMS_METRICS_MAX_VERBS);
+    const CmsVerbMetrics *query = NULL;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strcmp(verbs[i].verb, "QUERY") == 0)
+        {
+            query = &verbs[i];
+        }
+    }
+    TEST_ASSERT_NOT_NULL(query);
+    TEST_ASSERT_EQUAL(3, query->count);
+    TEST_ASSERT_EQUAL(2, query->errors);
+    TEST_ASSERT_EQUAL(1, query->statuses[CMS_STATUS_OK]);
+    TEST_ASSERT_EQUAL(1, query->statuses[CMS_STATUS_INVALID_ARGUMENT]);
+    TEST_ASSERT_TRUE(query->p50 <= query->p99 && query->p99 <= query->max);
+    /* INSERT, QUERY, STATS and the TIMING OFF itself */
+    TEST_ASSERT_EQUAL(4, count);
+
+    const char *path = "tests/test_data/test_output_metrics.json";
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_metrics_save_json(path));
+    FILE *fp = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char json[4096];
+    size_t length = fread(json, 1, sizeof(json) - 1, fp);
+    json[length] = '\0';
+    fclose(fp);
+    remove(path);
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"verb\": \"QUERY\", \"count\": 3, \"errors\": 2"));
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"INVALID_ARGUMENT\": 1"));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("STATS RESET", &test_db));
+    TEST_ASSERT_EQUAL(0, cms_metrics_list(verbs, CMS_METRICS_MAX_VERBS));
+}
+
+void test_stats_memory_counts_the_table(void)
+{
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+    /* Start from no table at all, so the open below accounts for every row */
+    cms_database_cleanup(&test_db);
+    CmsMemUsage before = cms_mem_usage(CMS_MEM_RECORDS);
+    CmsMemUsage undo = cms_mem_usage(CMS_MEM_UNDO);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_open(&test_db, cms_slice("tests/test_data/test_valid.txt")));
+    TEST_ASSERT_TRUE(test_db.count > 0);
+    /* The row array is counted at its capacity, not its count */
+    CmsMemUsage loaded = cms_mem_usage(CMS_MEM_RECORDS);
+    TEST_ASSERT_TRUE(loaded.current >= before.current + test_db.capacity * sizeof(StudentRecord));
+    TEST_ASSERT_TRUE(loaded.peak >= loaded.current);
+    CmsMemUsage total = cms_mem_usage(CMS_MEM_KIND_COUNT);
+    TEST_ASSERT_TRUE(total.current >= loaded.current);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("STATS MEMORY", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("STATS MEMORY NOW", &test_db));
+    /* Temporary buffers are gone once the command returns */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SHOW NAME DESC", &test_db));
+    TEST_ASSERT_EQUAL(0, cms_mem_usage(CMS_MEM_TEMP).current);
+    /* ...and so are the result lists that searches hand back */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SEARCH NAME chen", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SEARCH NAME ~Jushua Chen", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("FILTER MARK > 60", &test_db));
+    TEST_ASSERT_EQUAL(0, cms_mem_usage(CMS_MEM_TEMP).current);
+
+    cms_database_cleanup(&test_db);
+    TEST_ASSERT_EQUAL(before.current, cms_mem_usage(CMS_MEM_RECORDS).current);
+    TEST_ASSERT_EQUAL(undo.current, cms_mem_usage(CMS_MEM_UNDO).current);
+
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+}
+
 /* ===== Command Parsing Tests ===== */
 
 void test_parse_command_valid(void)
@@ -302,6 +607,319 @@ void test_parse_command_null_arguments(void)
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("HELP", NULL));
 }
 
+void test_parse_command_table_dispatch(void)
+{
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("insert ID=2500607 NAME=Lee Mei PROGRAMME=Physics MARK=71", &test_db));
+    /* Keywords are case-insensitive and a bare SHOW lists by ID */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("show id desc", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SHOW", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("Query 2500607", &test_db));
+    /* Arguments that do not fit the command's schema are usage errors */
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("QUERY 2500607 extra", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("DELETE abc", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("NEXT 2", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("SHOWALL", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("   ", &test_db));
+    /* UNDO and REDO take an optional positive step count */
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("UNDO 0", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("REDO two", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("undo 1", &test_db));
+    TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 2500607, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("REDO", &test_db));
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2500607, NULL));
+    /* BEGIN ... ROLLBACK leaves the table as it was */
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("BEGIN now", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("begin", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("UPDATE 2500607 MARK=12", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("ROLLBACK", &test_db));
+    TEST_ASSERT_EQUAL_FLOAT(71.0f, test_db.records[0].mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("COMMIT", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("IMPORT", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT,
+                      cms_parse_command("IMPORT tests/test_data/test_valid.txt ON CONFLICT MERGE", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("import tests/test_data/test_valid.txt on conflict skip", &test_db));
+    /* DELETE and UPDATE also take a WHERE filter */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("DELETE WHERE MARK < 0", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("update set mark = mark + 3 where Physics", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("DELETE WHERE", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("DELETE 2500607 x", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("UPDATE SET MARK = MARK WHERE Physics", &test_db));
+    /* DIFF takes one or two files, MERGE a file and a preference */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("DIFF tests/test_data/test_valid.txt", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_parse_command("DIFF a b c", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT,
+                      cms_parse_command("MERGE tests/test_data/test_valid.txt PREFER BOTH", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("merge tests/test_data/test_valid.txt prefer remote", &test_db));
+
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+}
+
+void test_transaction_reads_see_the_write_set(void)
+{
+    CmsSessionOptions options = {true, false};
+    cms_set_session_options(&options);
+
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("INSERT ID=2500609 NAME=Lee Mei PROGRAMME=Physics MARK=71", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("INSERT ID=2500610 NAME=Ana Ruiz PROGRAMME=Physics MARK=64", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("BEGIN", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("DELETE 2500609", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("INSERT ID=2500611 NAME=Lee Ann PROGRAMME=Physics MARK=88", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("UPDATE 2500610 MARK=40", &test_db));
+
+    /* An ID the transaction inserted is taken */
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE,
+                      cms_parse_command("INSERT ID=2500611 NAME=Kim Lo PROGRAMME=Physics MARK=50", &test_db));
+
+    /* Listings, counts and copies see the pending rows, not the committed table */
+    TEST_ASSERT_EQUAL(2, cms_database_row_count(&test_db));
+    CmsCursor cursor;
+    const StudentRecord *record = NULL;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_open_sorted(&cursor, &test_db, CMS_SORT_KEY_MARK, CMS_SORT_DESC));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL(2500611, record->id);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL(2500610, record->id);
+    TEST_ASSERT_EQUAL_FLOAT(40.0f, record->mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_cursor_next(&cursor, &record));
+    cms_cursor_close(&cursor);
+
+    SummaryStats stats;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_calculate_summary(&test_db, &stats));
+    TEST_ASSERT_EQUAL(2, stats.count);
+    TEST_ASSERT_EQUAL(2500611, stats.highest_id);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SHOW ALL", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SHOW SUMMARY", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("SEARCH NAME Lee", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("COUNT PROGRAMME Physics", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("FILTER MARK < 50", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("DIFF tests/test_data/test_valid.txt", &test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("DELETE WHERE PROGRAMME Chemistry", &test_db));
+
+    char csv[512];
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_parse_command("EXPORT CSV tests/test_data/test_output_export.csv FILTER Physics", &test_db));
+    read_export_file("tests/test_data/test_output_export.csv", csv, sizeof(csv));
+    TEST_ASSERT_NULL(strstr(csv, "2500609"));
+    TEST_ASSERT_NOT_NULL(strstr(csv, "2500610,Ana Ruiz,Physics,40.00"));
+    TEST_ASSERT_NOT_NULL(strstr(csv, "2500611,Lee Ann"));
+    TEST_ASSERT_TRUE(strstr(csv, "2500610") < strstr(csv, "2500611"));
+
+    /* The table itself waits for COMMIT */
+    TEST_ASSERT_EQUAL(2, test_db.count);
+    TEST_ASSERT_EQUAL(2500609, test_db.records[0].id);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_parse_command("COMMIT", &test_db));
+    TEST_ASSERT_EQUAL(2, test_db.count);
+    TEST_ASSERT_EQUAL(2500610, test_db.records[0].id);
+    TEST_ASSERT_EQUAL(2500611, test_db.records[1].id);
+
+    CmsSessionOptions interactive = {false, false};
+    cms_set_session_options(&interactive);
+}
+
+/* ===== Server Tests ===== */
+
+#ifdef __linux__
+#define TEST_SERVER_SOCKET "tests/test_data/test_server.sock"
+
+static CMS_STATUS server_status;
+
+static void *run_test_server(void *argument)
+{
+    server_status = cms_serve(argument, TEST_SERVER_SOCKET);
+    return NULL;
+}
+
+/* Connects once the server is listening */
+static int connect_test_client(void)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, TEST_SERVER_SOCKET);
+
+    for (int attempt = 0; attempt < 500; ++attempt)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+        {
+            return fd;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        struct timespec pause = {0, 10 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+/* Sends requests and reads every response until the server closes the connection */
+static size_t exchange(int fd, const char *requests, char *reply, size_t size)
+{
+    size_t length = 0;
+    ssize_t got;
+    TEST_ASSERT_EQUAL((ssize_t)strlen(requests), write(fd, requests, strlen(requests)));
+    /* Finishing the request stream makes a last line without a newline count */
+    shutdown(fd, SHUT_WR);
+    while (length + 1 < size && (got = read(fd, reply + length, size - length - 1)) > 0)
+    {
+        length += (size_t)got;
+    }
+    reply[length] = '\0';
+    close(fd);
+    return length;
+}
+
+/* Walks the framed responses, recording each one's line number (negated for ERR) */
+static size_t parse_frames(const char *reply, long *lines, size_t max)
+{
+    size_t count = 0;
+    const char *at = reply;
+    while (*at != '\0' && count < max)
+    {
+        unsigned long line = 0;
+        size_t bytes = 0;
+        char name[32];
+        const char *end = strchr(at, '\n');
+        if (end == NULL)
+        {
+            break;
+        }
+        if (sscanf(at, "OK %lu %zu", &line, &bytes) == 2)
+        {
+            lines[count++] = (long)line;
+        }
+        else if (sscanf(at, "ERR %lu %31s %zu", &line, name, &bytes) == 3)
+        {
+            lines[count++] = -(long)line;
+        }
+        else
+        {
+            break;
+        }
+        at = end + 1 + bytes;
+    }
+    return count;
+}
+#endif
+
+void test_server_pipelined_clients(void)
+{
+#ifdef __linux__
+    char reply[8192];
+    long lines[8];
+    pthread_t thread;
+
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, run_test_server, &test_db));
+    int idle = connect_test_client();
+    int busy = connect_test_client();
+    TEST_ASSERT_TRUE(idle >= 0 && busy >= 0);
+
+    /* Pipelined requests are answered in order; blank lines get no reply and
+       nothing after EXIT runs */
+    exchange(busy,
+             "INSERT ID=2500608 NAME=Tan Wei PROGRAMME=Physics MARK=66\n"
+             "\n"
+             "QUERY 2500608\n"
+             "FROBNICATE\n"
+             "exit\n"
+             "DELETE 2500608\n",
+             reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(4, parse_frames(reply, lines, 8));
+    TEST_ASSERT_EQUAL(1, lines[0]);
+    TEST_ASSERT_EQUAL(3, lines[1]);
+    TEST_ASSERT_EQUAL(-4, lines[2]);
+    TEST_ASSERT_EQUAL(5, lines[3]);
+    TEST_ASSERT_NOT_NULL(strstr(reply, "Tan Wei"));
+    TEST_ASSERT_NOT_NULL(strstr(reply, "ERR 4 INVALID_ARGUMENT "));
+
+    /* The other connection sees the same resident database */
+    exchange(idle, "QUERY 2500608\nQUIT", reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(2, parse_frames(reply, lines, 8));
+    TEST_ASSERT_NOT_NULL(strstr(reply, "Tan Wei"));
+
+    cms_server_stop();
+    pthread_join(thread, NULL);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, server_status);
+    TEST_ASSERT_EQUAL(1, test_db.count);
+#else
+    TEST_IGNORE_MESSAGE("Server mode needs Linux");
+#endif
+}
+
+void test_server_concurrent_pipelines(void)
+{
+#ifdef __linux__
+    static char requests[2][16384];
+    static char reply[262144];
+    long lines[256];
+    pthread_t thread;
+
+    test_db.is_loaded = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cmd_insert(&test_db, cms_slice("ID=2500610 NAME=Lim Mei PROGRAMME=Law MARK=71")));
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, run_test_server, &test_db));
+    int reader = connect_test_client();
+    int writer = connect_test_client();
+    TEST_ASSERT_TRUE(reader >= 0 && writer >= 0);
+
+    /* More lines than one turn takes, from two clients at once */
+    size_t length[2] = {0, 0};
+    for (int i = 0; i < 200; ++i)
+    {
+        length[0] += (size_t)snprintf(requests[0] + length[0], sizeof(requests[0]) - length[0], "QUERY 2500610\n");
+        length[1] += (size_t)snprintf(requests[1] + length[1], sizeof(requests[1]) - length[1],
+                                      "INSERT ID=%d NAME=Student %d PROGRAMME=Law MARK=50\n", 2600000 + i, i);
+    }
+    TEST_ASSERT_EQUAL((ssize_t)length[0], write(reader, requests[0], length[0]));
+    exchange(writer, requests[1], reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(200, parse_frames(reply, lines, 256));
+    TEST_ASSERT_EQUAL(200, lines[199]);
+
+    exchange(reader, "", reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(200, parse_frames(reply, lines, 256));
+    for (long i = 0; i < 200; ++i)
+    {
+        TEST_ASSERT_EQUAL(i + 1, lines[i]);
+    }
+    TEST_ASSERT_NOT_NULL(strstr(reply, "Lim Mei"));
+
+    /* A paged listing belongs to the connection that opened it */
+    int pager = connect_test_client();
+    int other = connect_test_client();
+    TEST_ASSERT_TRUE(pager >= 0 && other >= 0);
+    TEST_ASSERT_EQUAL(17, write(pager, "SHOW ALL PAGE 50\n", 17));
+    exchange(other, "NEXT\n", reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(1, parse_frames(reply, lines, 256));
+    TEST_ASSERT_NOT_NULL(strstr(reply, "No paged listing"));
+    exchange(pager, "NEXT\n", reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(2, parse_frames(reply, lines, 256));
+    TEST_ASSERT_EQUAL(2, lines[1]);
+    TEST_ASSERT_NULL(strstr(reply, "No paged listing"));
+
+    cms_server_stop();
+    pthread_join(thread, NULL);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, server_status);
+    TEST_ASSERT_EQUAL(201, test_db.count);
+#else
+    TEST_IGNORE_MESSAGE("Server mode needs Linux");
+#endif
+}
+
 /* Main test runner for this module */
 int main(void)
 {
@@ -335,6 +953,7 @@ int main(void)
     /* UPDATE command tests */
     RUN_TEST(test_cmd_update_valid);
     RUN_TEST(test_cmd_update_null_database);
+    RUN_TEST(test_cmd_update_fields_inline);
 
     /* DELETE command tests */
     RUN_TEST(test_cmd_delete_existing);
@@ -346,13 +965,32 @@ int main(void)
     RUN_TEST(test_cmd_save_custom_path);
     RUN_TEST(test_cmd_save_null_database);
 
+    /* WATCH command tests */
+    RUN_TEST(test_watch_off_and_on_keeps_reloaded_rows_with_unsaved_changes);
+
     /* HELP command tests */
     RUN_TEST(test_cmd_help);
 
+    /* EXPORT command tests */
+    RUN_TEST(test_cmd_export_csv_escapes_fields);
+    RUN_TEST(test_cmd_export_json_views);
+    RUN_TEST(test_cmd_export_rejects_bad_arguments);
+
+    /* Batch mode tests */
+    RUN_TEST(test_batch_loop_counts_failures);
+
     /* Command parsing tests */
     RUN_TEST(test_parse_command_valid);
     RUN_TEST(test_parse_command_invalid);
     RUN_TEST(test_parse_command_null_arguments);
+    RUN_TEST(test_parse_command_table_dispatch);
+    RUN_TEST(test_transaction_reads_see_the_write_set);
+    RUN_TEST(test_timing_counts_commands_and_errors);
+    RUN_TEST(test_stats_memory_counts_the_table);
+
+    /* Server tests */
+    RUN_TEST(test_server_pipelined_clients);
+    RUN_TEST(test_server_concurrent_pipelines);
 
     return UnityEnd();
 }
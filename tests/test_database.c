@@ -1,6 +1,13 @@
 #include "unity/unity.h"
 #include "../include/database.h"
+#include "../include/diff.h"
+#include "../include/sidecar.h"
+#include "../include/watch.h"
+#include "../include/alloc.h"
 #include "../include/cms.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Global test database */
@@ -84,6 +91,147 @@ void test_database_load_null_arguments(void)
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_load(&test_db, NULL));
 }
 
+void test_database_load_lenient_skips_bad_and_repeated_rows(void)
+{
+    const char *path = "tests/test_data/test_output_lenient.txt";
+    CmsLoadReport report;
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    fprintf(fp, "2300001\tFirst\tPhysics\t50\n");
+    fprintf(fp, "2300002\tBad Mark\tPhysics\t500\n");
+    fprintf(fp, "2300003\tMissing Mark\tPhysics\n");
+    fprintf(fp, "2300001\tRepeat\tPhysics\t60\n");
+    fprintf(fp, "2300004\tLast\tPhysics\t70\n");
+    fclose(fp);
+
+    /* Strict: the first bad row fails the load */
+    TEST_ASSERT_EQUAL(CMS_STATUS_PARSE_ERROR, cms_database_load_checked(&test_db, path, false, &report));
+    TEST_ASSERT_EQUAL(0, test_db.count);
+    TEST_ASSERT_EQUAL(1, report.error_count);
+    TEST_ASSERT_EQUAL(4, report.errors[0].line);
+    TEST_ASSERT_EQUAL_STRING("Mark", report.errors[0].field);
+
+    /* Lenient: every bad row is skipped and reported in one pass */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load_checked(&test_db, path, true, &report));
+    TEST_ASSERT_EQUAL(2, test_db.count);
+    TEST_ASSERT_EQUAL(3, report.skipped);
+    TEST_ASSERT_EQUAL(3, report.error_count);
+    TEST_ASSERT_EQUAL(5, report.errors[1].line);
+    TEST_ASSERT_EQUAL(6, report.errors[2].line);
+    TEST_ASSERT_EQUAL_STRING("ID", report.errors[2].field);
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300004, NULL));
+    TEST_ASSERT_EQUAL_STRING("First", test_db.records[0].name);
+
+    /* A repeated ID alone fails a strict load */
+    fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    fprintf(fp, "2300001\tFirst\tPhysics\t50\n2300001\tRepeat\tPhysics\t60\n");
+    fclose(fp);
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, cms_database_load(&test_db, path));
+    TEST_ASSERT_FALSE(test_db.is_loaded);
+    remove(path);
+}
+
+void test_database_sidecar_restores_name_indexes_until_file_changes(void)
+{
+    const char *path = "tests/test_data/test_output_sidecar.txt";
+    const char *sidecar_path = "tests/test_data/test_output_sidecar.txt" CMS_SIDECAR_SUFFIX;
+    StudentRecord records[] = {
+        {2300001, "Joshua Chen", "Software Engineering", 70.0f},
+        {2300002, "Isaac Teo", "Computer Science", 63.0f},
+        {2300003, "Joshua Chan", "Physics", 55.0f},
+        {2300004, "Mei Chen", "Physics", 81.0f}};
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &records[i]));
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_save(&test_db, path));
+
+    /* SAVE wrote the sidecar; a load of the unchanged file restores from it */
+    CmsLoadReport report;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load_checked(&test_db, path, false, &report));
+    TEST_ASSERT_TRUE(report.indexes_restored);
+
+    int *ids = NULL;
+    size_t count = 0;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2300001, ids[0]);
+    TEST_ASSERT_EQUAL(2300004, ids[1]);
+    cms_free(ids);
+
+    CmsFuzzyMatch *matches = NULL;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "joshua chen", 1, &matches, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2300001, matches[0].id);
+    TEST_ASSERT_EQUAL(2300003, matches[1].id);
+    cms_free(matches);
+
+    /* The restored indexes take changes like built ones */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2300004));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    cms_free(ids);
+
+    /* An edited file no longer matches: the indexes are built from the rows */
+    FILE *fp = fopen(path, "a");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "2300005\tAmy Chen\tPhysics\t77.00\n");
+    fclose(fp);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load_checked(&test_db, path, false, &report));
+    TEST_ASSERT_FALSE(report.indexes_restored);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(3, count);
+    cms_free(ids);
+
+    /* SAVE brings the sidecar up to date again */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_save(&test_db, path));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load_checked(&test_db, path, false, &report));
+    TEST_ASSERT_TRUE(report.indexes_restored);
+
+    /* A damaged sidecar is ignored */
+    fp = fopen(sidecar_path, "r+b");
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_EQUAL(0, fseek(fp, -3, SEEK_END));
+    fputc(0x5A, fp);
+    fclose(fp);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load_checked(&test_db, path, false, &report));
+    TEST_ASSERT_FALSE(report.indexes_restored);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(3, count);
+    cms_free(ids);
+
+    remove(path);
+    remove(sidecar_path);
+}
+
+void test_database_take_moves_loaded_table_and_keeps_settings(void)
+{
+    StudentDatabase loaded;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_init(&loaded));
+    StudentRecord record = {2300001, "Joshua Chen", "Software Engineering", 70.0f};
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&loaded, &record));
+
+    test_db.save_format = CMS_FILE_FORMAT_BINARY;
+    test_db.undo_limit = 1024;
+    unsigned long version = test_db.version;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_take(&test_db, &loaded));
+
+    TEST_ASSERT_EQUAL(1, test_db.count);
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300001, NULL));
+    TEST_ASSERT_EQUAL(CMS_FILE_FORMAT_BINARY, test_db.save_format);
+    TEST_ASSERT_EQUAL(1024, test_db.undo_limit);
+    TEST_ASSERT_TRUE(test_db.version > version);
+    TEST_ASSERT_EQUAL(0, loaded.count);
+
+    /* The history came along: the insert can be undone */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(0, test_db.count);
+    cms_database_cleanup(&loaded);
+}
+
 /* ===== Database Save Tests ===== */
 
 void test_database_save_success(void)
@@ -95,6 +243,33 @@ void test_database_save_success(void)
     /* TEST_ASSERT_EQUAL(CMS_STATUS_OK, status); */
 }
 
+void test_database_binary_round_trip(void)
+{
+    StudentRecord records[] = {
+        {2301234, "Joshua Chen", "Software Engineering", 70.123f},
+        {2201234, "Isaac Teo", "Computer Science", 0.0f}};
+    for (int i = 0; i < 2; i++)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &records[i]));
+    }
+
+    test_db.save_format = CMS_FILE_FORMAT_BINARY;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_save(&test_db, "tests/test_data/test_output.bin"));
+    cms_database_cleanup(&test_db);
+    cms_database_init(&test_db);
+
+    /* The format is detected on load, and marks keep every digit */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load(&test_db, "tests/test_data/test_output.bin"));
+    remove("tests/test_data/test_output.bin");
+    remove("tests/test_data/test_output.bin.idx");
+    TEST_ASSERT_EQUAL(CMS_FILE_FORMAT_BINARY, test_db.file_format);
+    TEST_ASSERT_EQUAL(2, test_db.count);
+    TEST_ASSERT_EQUAL(2301234, test_db.records[0].id);
+    TEST_ASSERT_EQUAL_STRING("Software Engineering", test_db.records[0].programme);
+    TEST_ASSERT_TRUE(test_db.records[0].mark == 70.123f);
+    TEST_ASSERT_EQUAL_STRING("Isaac Teo", test_db.records[1].name);
+}
+
 void test_database_save_null_database(void)
 {
     /* TODO: Test save with NULL database */
@@ -235,6 +410,749 @@ void test_database_delete_null_database(void)
     TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, status);
 }
 
+/* ===== Cursor Tests ===== */
+
+static void insert_cursor_records(void)
+{
+    StudentRecord records[] = {
+        {2301234, "Joshua Chen", "Software Engineering", 70.5f},
+        {2201234, "Isaac Teo", "Computer Science", 63.4f},
+        {2304567, "John Levoy", "Digital Supply Chain", 85.9f},
+        {2202345, "Josh Tan", "Information Systems", 63.4f}};
+
+    for (int i = 0; i < 4; i++)
+    {
+        cms_database_insert(&test_db, &records[i]);
+    }
+}
+
+void test_cursor_sorted_view_with_skip(void)
+{
+    CmsCursor cursor;
+    const StudentRecord *record = NULL;
+    insert_cursor_records();
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_open_sorted(&cursor, &test_db, CMS_SORT_KEY_NAME, CMS_SORT_ASC));
+    TEST_ASSERT_EQUAL(1, cms_cursor_skip(&cursor, 1));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL_STRING("John Levoy", record->name);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL_STRING("Josh Tan", record->name);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL_STRING("Joshua Chen", record->name);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_cursor_next(&cursor, &record));
+    cms_cursor_close(&cursor);
+}
+
+void test_cursor_mark_order_breaks_ties_by_id(void)
+{
+    CmsCursor cursor;
+    const StudentRecord *record = NULL;
+    insert_cursor_records();
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_open_sorted(&cursor, &test_db, CMS_SORT_KEY_MARK, CMS_SORT_DESC));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL(2304567, record->id);
+    TEST_ASSERT_EQUAL(2, cms_cursor_skip(&cursor, 2));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL(2201234, record->id);
+    TEST_ASSERT_FALSE(cms_cursor_has_next(&cursor));
+    cms_cursor_close(&cursor);
+}
+
+void test_cursor_ids_and_staleness(void)
+{
+    CmsCursor cursor;
+    const StudentRecord *record = NULL;
+    StudentRecord extra = {2305678, "Chen Mei Ling", "Cybersecurity", 78.5f};
+    int *ids = cms_malloc(CMS_MEM_TEMP, 2 * sizeof(int));
+    insert_cursor_records();
+    ids[0] = 9999999;
+    ids[1] = 2202345;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_open_ids(&cursor, &test_db, ids, 2));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &record));
+    TEST_ASSERT_EQUAL(2202345, record->id);
+
+    /* Any change to the table invalidates the cursor */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &extra));
+    TEST_ASSERT_TRUE(cms_cursor_is_stale(&cursor));
+    TEST_ASSERT_EQUAL(CMS_STATUS_ERROR, cms_cursor_next(&cursor, &record));
+    cms_cursor_close(&cursor);
+}
+
+/* ===== Undo / Redo Tests ===== */
+
+static void make_undo_record(int number, StudentRecord *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->id = 2300000 + number;
+    snprintf(record->name, sizeof(record->name), "Student %d", number);
+    strcpy(record->programme, (number % 2 == 0) ? "Computer Science" : "Cybersecurity");
+    record->mark = (float)(number % 101);
+}
+
+/* Compares rows field by field; padding bytes are not part of a row */
+static bool same_rows(const StudentRecord *expected, const StudentRecord *actual, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (expected[i].id != actual[i].id || strcmp(expected[i].name, actual[i].name) != 0 ||
+            strcmp(expected[i].programme, actual[i].programme) != 0 || expected[i].mark != actual[i].mark)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_undo_redo_multiple_steps(void)
+{
+    StudentRecord record;
+    StudentRecord found;
+    insert_cursor_records();
+
+    StudentRecord changed = test_db.records[1];
+    changed.mark = 99.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, 2201234, &changed));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2301234));
+    TEST_ASSERT_EQUAL(3, test_db.count);
+
+    /* The delete comes back in its old place, then the update is reverted */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 2, NULL));
+    TEST_ASSERT_EQUAL(4, test_db.count);
+    TEST_ASSERT_EQUAL(2301234, test_db.records[0].id);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2201234, &found));
+    TEST_ASSERT_EQUAL_FLOAT(63.4f, found.mark);
+    TEST_ASSERT_EQUAL_STRING("Isaac Teo", found.name);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_redo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2201234, &found));
+    TEST_ASSERT_EQUAL_FLOAT(99.0f, found.mark);
+
+    /* A new change drops what could still have been redone */
+    make_undo_record(1, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_redo(&test_db, 1, NULL));
+
+    /* Asking for more than there is undoes everything */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 100, NULL));
+    TEST_ASSERT_EQUAL(0, test_db.count);
+    TEST_ASSERT_FALSE(test_db.is_dirty);
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_undo(&test_db, 1, NULL));
+}
+
+void test_undo_large_batch_restores_row_order(void)
+{
+    enum { ROWS = 3000 };
+    StudentRecord record;
+    StudentRecord found;
+    static StudentRecord before[ROWS];
+    static StudentRecord after[ROWS];
+    size_t after_count = 0;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    memcpy(before, test_db.records, ROWS * sizeof(StudentRecord));
+
+    /* Delete a third of the rows in a scattered order */
+    for (int i = 0; i < ROWS / 3; ++i)
+    {
+        int number = (i * 7 % (ROWS / 3)) * 3;
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2300000 + number));
+    }
+    after_count = test_db.count;
+    memcpy(after, test_db.records, after_count * sizeof(StudentRecord));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, ROWS / 3, NULL));
+    TEST_ASSERT_EQUAL(ROWS, test_db.count);
+    TEST_ASSERT_TRUE(same_rows(before, test_db.records, ROWS));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300000 + 3 * 17, &found));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_redo(&test_db, ROWS / 3, NULL));
+    TEST_ASSERT_EQUAL(after_count, test_db.count);
+    TEST_ASSERT_TRUE(same_rows(after, test_db.records, after_count));
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_database_query(&test_db, 2300000 + 3 * 17, &found));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300000 + 3 * 17 + 1, &found));
+}
+
+void test_undo_history_respects_memory_limit(void)
+{
+    StudentRecord record;
+    make_undo_record(0, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+
+    /* Room for a handful of one-field deltas only */
+    test_db.undo_limit = 160;
+    for (int i = 1; i <= 20; ++i)
+    {
+        record.mark = (float)i;
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 20, NULL));
+    TEST_ASSERT_EQUAL(1, test_db.count);
+    TEST_ASSERT_TRUE(test_db.records[0].mark > 1.0f);
+    TEST_ASSERT_TRUE(test_db.is_dirty);
+
+    test_db.undo_limit = 0;
+    record.mark = 50.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_undo(&test_db, 1, NULL));
+}
+
+void test_transaction_reads_own_writes_and_commits_as_one_step(void)
+{
+    StudentRecord record;
+    StudentRecord found;
+    StudentRecord before[10];
+    StudentRecord after[10];
+    const int order[] = {0, 1, 2, 4, 6, 7, 8, 9, 100, 5};
+
+    for (int i = 0; i < 10; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    memcpy(before, test_db.records, sizeof(before));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_begin(&test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_begin(&test_db));
+    make_undo_record(2, &record);
+    record.mark = 99.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2300003));
+    make_undo_record(100, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, cms_database_insert(&test_db, &record));
+    /* Deleted and inserted again: the row moves to the end */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2300005));
+    make_undo_record(5, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    /* Inserted and deleted again: no change at all */
+    make_undo_record(101, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2300101));
+
+    /* Reads go through the write set; the table is untouched */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300002, &found));
+    TEST_ASSERT_EQUAL_FLOAT(99.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_database_query(&test_db, 2300003, &found));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300100, &found));
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_database_delete(&test_db, 2300003));
+    TEST_ASSERT_EQUAL(10, test_db.count);
+    TEST_ASSERT_TRUE(same_rows(before, test_db.records, 10));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_undo(&test_db, 1, NULL));
+
+    /* Cursors already see the rows in the order COMMIT will leave them */
+    CmsCursor cursor;
+    const StudentRecord *row = NULL;
+    TEST_ASSERT_EQUAL(10, cms_database_row_count(&test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_open(&cursor, &test_db));
+    for (size_t i = 0; i < 10; ++i)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_cursor_next(&cursor, &row));
+        TEST_ASSERT_EQUAL(2300000 + order[i], row->id);
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_cursor_next(&cursor, &row));
+    cms_cursor_close(&cursor);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_commit(&test_db, NULL));
+    TEST_ASSERT_NULL(test_db.transaction);
+    TEST_ASSERT_EQUAL(10, test_db.count);
+    for (size_t i = 0; i < 10; ++i)
+    {
+        TEST_ASSERT_EQUAL(2300000 + order[i], test_db.records[i].id);
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300002, &found));
+    TEST_ASSERT_EQUAL_FLOAT(99.0f, found.mark);
+
+    /* The indexes took the commit in one pass: every ID at its new place,
+       the updated row under its new mark */
+    TEST_ASSERT_TRUE(cms_index_has_ids(&test_db));
+    for (size_t i = 0; i < 10; ++i)
+    {
+        size_t index = 0;
+        TEST_ASSERT_TRUE(cms_index_find_id(&test_db, test_db.records[i].id, &index));
+        TEST_ASSERT_EQUAL(i, index);
+    }
+    CmsMarkRange range = {99.0f, 99.0f, true, true};
+    int *ids = NULL;
+    size_t id_count = 0;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &range, &ids, &id_count));
+    TEST_ASSERT_EQUAL(1, id_count);
+    TEST_ASSERT_EQUAL(2300002, ids[0]);
+    cms_free(ids);
+    memcpy(after, test_db.records, sizeof(after));
+
+    /* One UNDO reverts the whole transaction */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_TRUE(same_rows(before, test_db.records, 10));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_redo(&test_db, 1, NULL));
+    TEST_ASSERT_TRUE(same_rows(after, test_db.records, 10));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_database_commit(&test_db, NULL));
+}
+
+void test_transaction_rollback_and_bulk_commit(void)
+{
+    enum { ROWS = 5000 };
+    StudentRecord record;
+    StudentRecord found;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_begin(&test_db));
+    make_undo_record(7, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, record.id));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_rollback(&test_db));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, record.id, &found));
+    TEST_ASSERT_EQUAL(ROWS, test_db.count);
+
+    /* A mark correction over every row */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_begin(&test_db));
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        record.mark = (float)((i + 1) % 101);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_commit(&test_db, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300000 + 42, &found));
+    TEST_ASSERT_EQUAL_FLOAT(43.0f, found.mark);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300000 + 42, &found));
+    TEST_ASSERT_EQUAL_FLOAT(42.0f, found.mark);
+}
+
+void test_import_conflict_policies(void)
+{
+    const char *path = "tests/test_data/test_output_import.txt";
+    StudentRecord record;
+    StudentRecord found;
+    CmsImportReport report;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+
+    /* One ID already in the table and one repeated within the file */
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    fprintf(fp, "2300010\tNew Student\tPhysics\t60\n");
+    fprintf(fp, "2300002\tStudent 2\tPhysics\t50\n");
+    fprintf(fp, "2300011\tOther Student\tPhysics\t71\n");
+    fprintf(fp, "2300010\tNew Student\tPhysics\t65\n");
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, cms_database_import(&test_db, path, CMS_CONFLICT_FAIL, &report));
+    TEST_ASSERT_EQUAL(5, test_db.count);
+    TEST_ASSERT_EQUAL(4, report.read);
+    TEST_ASSERT_EQUAL(2, report.conflicts);
+    TEST_ASSERT_EQUAL(2, report.conflict_id_count);
+    TEST_ASSERT_EQUAL(2300002, report.conflict_ids[0]);
+    TEST_ASSERT_EQUAL(2300010, report.conflict_ids[1]);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_import(&test_db, path, CMS_CONFLICT_SKIP, &report));
+    TEST_ASSERT_EQUAL(2, report.inserted);
+    TEST_ASSERT_EQUAL(2, report.skipped);
+    TEST_ASSERT_EQUAL(7, test_db.count);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300010, &found));
+    TEST_ASSERT_EQUAL_FLOAT(60.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300002, &found));
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, found.mark);
+
+    /* The import is a single undo step */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(5, test_db.count);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_import(&test_db, path, CMS_CONFLICT_REPLACE, &report));
+    TEST_ASSERT_EQUAL(2, report.inserted);
+    TEST_ASSERT_EQUAL(2, report.replaced);
+    TEST_ASSERT_EQUAL(7, test_db.count);
+    TEST_ASSERT_EQUAL(2300010, test_db.records[5].id);
+    TEST_ASSERT_EQUAL(2300011, test_db.records[6].id);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300010, &found));
+    TEST_ASSERT_EQUAL_FLOAT(65.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300002, &found));
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, found.mark);
+    remove(path);
+}
+
+/* Odd-numbered rows are Cybersecurity; a range keeps the marks below 50 */
+static void make_where_filter(CmsRowFilter *filter, const char *programme, float below)
+{
+    memset(filter, 0, sizeof(*filter));
+    if (programme != NULL)
+    {
+        filter->selection.programmes[0] = programme;
+        filter->selection.programme_count = 1;
+    }
+    filter->mark.low = -FLT_MAX;
+    filter->mark.high = below;
+    filter->mark.low_inclusive = true;
+    filter->mark.high_inclusive = false;
+}
+
+void test_delete_where_keeps_row_order_and_undoes_in_one_step(void)
+{
+    enum { ROWS = 200 };
+    StudentRecord before[ROWS];
+    StudentRecord record;
+    CmsRowFilter filter;
+    size_t deleted = 0;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    memcpy(before, test_db.records, sizeof(before));
+
+    make_where_filter(&filter, "Cybersecurity", 50.0f);
+    TEST_ASSERT_EQUAL(50, cms_database_count_where(&test_db, &filter));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete_where(&test_db, &filter, &deleted));
+    TEST_ASSERT_EQUAL(50, deleted);
+    TEST_ASSERT_EQUAL(ROWS - 50, test_db.count);
+
+    /* Survivors keep their relative order and stay reachable by ID */
+    size_t next = 0;
+    for (int i = 0; i < ROWS; ++i)
+    {
+        bool gone = (i % 2 == 1) && (i % 101) < 50;
+        TEST_ASSERT_EQUAL(!gone, cms_index_find_id(&test_db, 2300000 + i, NULL));
+        if (!gone)
+        {
+            TEST_ASSERT_EQUAL(2300000 + i, test_db.records[next++].id);
+        }
+    }
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete_where(&test_db, &filter, &deleted));
+    TEST_ASSERT_EQUAL(0, deleted);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(ROWS, test_db.count);
+    TEST_ASSERT_TRUE(same_rows(before, test_db.records, ROWS));
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300001, NULL));
+}
+
+/* Counts the rows the name indexes find for "Kim Lee", exactly and fuzzily */
+static void assert_shared_name_hits(size_t expected)
+{
+    int *ids = NULL;
+    CmsFuzzyMatch *matches = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "kim lee", false, &ids, &count));
+    TEST_ASSERT_EQUAL(expected, count);
+    cms_free(ids);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "Kim Lea", 1, &matches, &count));
+    TEST_ASSERT_EQUAL(expected, count);
+    cms_free(matches);
+}
+
+void test_delete_where_many_rows_sharing_a_name(void)
+{
+    enum { ROWS = 40000 };
+    StudentRecord record;
+    CmsRowFilter filter;
+    size_t deleted = 0;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        strcpy(record.name, "Kim Lee");
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+
+    /* Half the rows leave in one change; all of them share one name */
+    make_where_filter(&filter, "Computer Science", 101.0f);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete_where(&test_db, &filter, &deleted));
+    TEST_ASSERT_EQUAL(ROWS / 2, deleted);
+    TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 2300000, NULL));
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300001, NULL));
+    assert_shared_name_hits(ROWS / 2);
+}
+
+void test_undo_redo_large_batch_sharing_a_name(void)
+{
+    enum { ROWS = 40000 };
+    StudentRecord record;
+    CmsRowFilter filter;
+    size_t deleted = 0;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        strcpy(record.name, "Kim Lee");
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    make_where_filter(&filter, "Cybersecurity", 101.0f);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete_where(&test_db, &filter, &deleted));
+    TEST_ASSERT_EQUAL(ROWS / 2, deleted);
+
+    /* Replaying the step puts back and takes away 20000 rows of one name */
+    for (int round = 0; round < 2; ++round)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+        TEST_ASSERT_EQUAL(ROWS, test_db.count);
+        TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300001, NULL));
+        assert_shared_name_hits(ROWS);
+
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_redo(&test_db, 1, NULL));
+        TEST_ASSERT_EQUAL(ROWS / 2, test_db.count);
+        TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 2300001, NULL));
+        assert_shared_name_hits(ROWS / 2);
+    }
+}
+
+void test_import_many_rows_sharing_a_name(void)
+{
+    enum { ROWS = 30000, IMPORTED = 20000 };
+    const char *path = "tests/test_data/test_output_import.txt";
+    StudentRecord record;
+    CmsImportReport report;
+
+    for (int i = 0; i < ROWS; ++i)
+    {
+        make_undo_record(i, &record);
+        strcpy(record.name, "Kim Lee");
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+
+    /* Fewer new rows than the table holds, so the indexes take them as one change */
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    for (int i = 0; i < IMPORTED; ++i)
+    {
+        fprintf(fp, "%d\tKim Lee\tPhysics\t%d\n", 2300000 + ROWS - 10 + i, i % 101);
+    }
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_import(&test_db, path, CMS_CONFLICT_SKIP, &report));
+    remove(path);
+    TEST_ASSERT_EQUAL(IMPORTED - 10, report.inserted);
+    TEST_ASSERT_EQUAL(10, report.skipped);
+    TEST_ASSERT_EQUAL(ROWS + IMPORTED - 10, test_db.count);
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2300000 + ROWS + IMPORTED - 11, NULL));
+    assert_shared_name_hits(ROWS + IMPORTED - 10);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(ROWS, test_db.count);
+    TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 2300000 + ROWS, NULL));
+    assert_shared_name_hits(ROWS);
+}
+
+void test_update_marks_where_clamps_and_undoes_in_one_step(void)
+{
+    StudentRecord record;
+    StudentRecord found;
+    CmsRowFilter filter;
+    size_t changed = 0;
+
+    for (int i = 95; i < 105; ++i)
+    {
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+
+    /* Computer Science rows 96, 98, 100 (marks 96, 98, 100) and 102, 104 (1, 3) */
+    make_where_filter(&filter, "Computer Science", FLT_MAX);
+    filter.mark.high_inclusive = true;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update_marks_where(&test_db, &filter, 1.0f, 3.0f, &changed));
+    /* The row already at 100 does not change */
+    TEST_ASSERT_EQUAL(4, changed);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300098, &found));
+    TEST_ASSERT_EQUAL_FLOAT(100.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300102, &found));
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300097, &found));
+    TEST_ASSERT_EQUAL_FLOAT(97.0f, found.mark);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300098, &found));
+    TEST_ASSERT_EQUAL_FLOAT(98.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300102, &found));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, found.mark);
+}
+
+static void write_undo_rows(const char *path, const int *numbers, size_t count, int changed)
+{
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "Table Name: StudentRecords\nID\tName\tProgramme\tMark\n");
+    for (size_t i = 0; i < count; ++i)
+    {
+        StudentRecord record;
+        make_undo_record(numbers[i], &record);
+        if (numbers[i] == changed)
+        {
+            record.mark = 100.0f - record.mark;
+        }
+        fprintf(fp, "%d\t%s\t%s\t%.1f\n", record.id, record.name, record.programme, record.mark);
+    }
+    fclose(fp);
+}
+
+void test_diff_streams_chunks_and_merge_applies_in_one_step(void)
+{
+    enum { ROWS = 10000 };
+    const char *ours = "tests/test_data/test_output_diff_a.txt";
+    const char *theirs = "tests/test_data/test_output_diff_b.txt";
+    static int numbers[ROWS + 1];
+    StudentRecord record;
+    StudentRecord found;
+    CmsChangeList list;
+    size_t applied = 0;
+
+    /* Ours: rows 0..ROWS-1. Theirs: newest first across several chunks,
+       without row 10, with row 20's mark changed and row ROWS added. */
+    size_t count = 0;
+    for (int i = ROWS; i >= 0; --i)
+    {
+        if (i != 10)
+        {
+            numbers[count++] = i;
+        }
+    }
+    write_undo_rows(theirs, numbers, count, 20);
+    for (int i = 0; i < ROWS; ++i)
+    {
+        numbers[i] = i;
+        make_undo_record(i, &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    write_undo_rows(ours, numbers, ROWS, -1);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_diff_files(ours, theirs, &list));
+    TEST_ASSERT_EQUAL(3, list.count);
+    TEST_ASSERT_EQUAL(CMS_CHANGE_REMOVED, list.changes[0].kind);
+    TEST_ASSERT_EQUAL(2300010, list.changes[0].before.id);
+    TEST_ASSERT_EQUAL(CMS_CHANGE_CHANGED, list.changes[1].kind);
+    TEST_ASSERT_EQUAL(CMS_CHANGE_MARK, list.changes[1].fields);
+    TEST_ASSERT_EQUAL(CMS_CHANGE_ADDED, list.changes[2].kind);
+    TEST_ASSERT_EQUAL(2300000 + ROWS, list.changes[2].after.id);
+    cms_change_list_free(&list);
+
+    /* Merge preferring the other file: additions and changes, no removals */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_diff_database(&test_db, theirs, &list));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK,
+                      cms_database_apply_changes(&test_db, &list, CMS_APPLY_ADDED | CMS_APPLY_CHANGED, &applied));
+    TEST_ASSERT_EQUAL(2, applied);
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, cms_database_apply_changes(&test_db, &list, CMS_APPLY_ADDED, &applied));
+    cms_change_list_free(&list);
+    TEST_ASSERT_EQUAL(ROWS + 1, test_db.count);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300010, &found));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300020, &found));
+    TEST_ASSERT_EQUAL_FLOAT(80.0f, found.mark);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(ROWS, test_db.count);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300020, &found));
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, found.mark);
+
+    /* A repeated ID in either file is refused */
+    numbers[1] = 0;
+    write_undo_rows(theirs, numbers, ROWS, -1);
+    TEST_ASSERT_EQUAL(CMS_STATUS_DUPLICATE, cms_diff_files(ours, theirs, &list));
+    remove(ours);
+    remove(theirs);
+}
+
+void test_watch_reloads_changed_rows_and_settles_conflicts(void)
+{
+#ifdef __linux__
+    const char *path = "tests/test_data/test_output_watch.txt";
+    int numbers[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int theirs[] = {0, 1, 3, 4, 5, 6, 7, 8, 9, 10};
+    CmsWatch *watch = NULL;
+    CmsWatchReport report;
+    StudentRecord record;
+    StudentRecord found;
+
+    write_undo_rows(path, numbers, 10, -1);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_load(&test_db, path));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_watch_start(&test_db, CMS_WATCH_PREFER_LOCAL, &watch));
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_watch_poll(watch, &test_db, &report));
+
+    /* Edited here: rows 3 and 5. The file drops row 2, adds row 10 and
+       changes row 5, so row 5 is a conflict and row 3 is only local. */
+    make_undo_record(3, &record);
+    record.mark = 33.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    make_undo_record(5, &record);
+    record.mark = 55.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    write_undo_rows(path, theirs, 10, 5);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_watch_poll(watch, &test_db, &report));
+    TEST_ASSERT_EQUAL(1, report.added);
+    TEST_ASSERT_EQUAL(1, report.removed);
+    TEST_ASSERT_EQUAL(0, report.changed);
+    TEST_ASSERT_EQUAL(1, report.kept);
+    TEST_ASSERT_EQUAL(10, test_db.count);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_database_query(&test_db, 2300002, &found));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300003, &found));
+    TEST_ASSERT_EQUAL_FLOAT(33.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300005, &found));
+    TEST_ASSERT_EQUAL_FLOAT(55.0f, found.mark);
+    TEST_ASSERT_TRUE(test_db.is_dirty);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_watch_poll(watch, &test_db, &report));
+
+    /* The same file written again changes nothing; the edits are still local */
+    write_undo_rows(path, theirs, 10, 5);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_watch_poll(watch, &test_db, &report));
+    TEST_ASSERT_EQUAL(0, report.added + report.removed + report.changed + report.kept);
+
+    /* A save of our own is not read back */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_save(&test_db, path));
+    cms_watch_synced(watch, &test_db);
+    TEST_ASSERT_EQUAL(CMS_STATUS_NOT_FOUND, cms_watch_poll(watch, &test_db, &report));
+
+    /* Preferring the file: row 5 edited on both sides takes the file's mark,
+       row 3 changed only in the file follows it, and the table is clean */
+    cms_watch_set_policy(watch, CMS_WATCH_PREFER_REMOTE);
+    make_undo_record(5, &record);
+    record.mark = 66.0f;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, record.id, &record));
+    write_undo_rows(path, theirs, 10, 5);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_watch_poll(watch, &test_db, &report));
+    TEST_ASSERT_EQUAL(2, report.changed);
+    TEST_ASSERT_EQUAL(1, report.overwritten);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300003, &found));
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, found.mark);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300005, &found));
+    TEST_ASSERT_EQUAL_FLOAT(95.0f, found.mark);
+    TEST_ASSERT_FALSE(test_db.is_dirty);
+
+    /* One UNDO brings the local edit back, and it counts as local again */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_undo(&test_db, 1, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300005, &found));
+    TEST_ASSERT_EQUAL_FLOAT(66.0f, found.mark);
+    cms_watch_set_policy(watch, CMS_WATCH_PREFER_LOCAL);
+    write_undo_rows(path, theirs, 10, -1);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_watch_poll(watch, &test_db, &report));
+    TEST_ASSERT_EQUAL(0, report.changed);
+    TEST_ASSERT_EQUAL(1, report.kept);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_query(&test_db, 2300005, &found));
+    TEST_ASSERT_EQUAL_FLOAT(66.0f, found.mark);
+
+    cms_watch_stop(watch);
+    remove(path);
+#else
+    TEST_IGNORE_MESSAGE("WATCH needs inotify");
+#endif
+}
+
 /* Main test runner for this module */
 int main(void)
 {
@@ -249,10 +1167,14 @@ int main(void)
     RUN_TEST(test_database_load_empty_file);
     RUN_TEST(test_database_load_invalid_file);
     RUN_TEST(test_database_load_null_arguments);
+    RUN_TEST(test_database_load_lenient_skips_bad_and_repeated_rows);
 
     /* Database save tests */
     RUN_TEST(test_database_save_success);
     RUN_TEST(test_database_save_null_database);
+    RUN_TEST(test_database_binary_round_trip);
+    RUN_TEST(test_database_sidecar_restores_name_indexes_until_file_changes);
+    RUN_TEST(test_database_take_moves_loaded_table_and_keeps_settings);
 
     /* Record insertion tests */
     RUN_TEST(test_database_insert_valid_record);
@@ -273,5 +1195,33 @@ int main(void)
     RUN_TEST(test_database_delete_nonexistent);
     RUN_TEST(test_database_delete_null_database);
 
+    /* Cursor tests */
+    RUN_TEST(test_cursor_sorted_view_with_skip);
+    RUN_TEST(test_cursor_mark_order_breaks_ties_by_id);
+    RUN_TEST(test_cursor_ids_and_staleness);
+
+    /* Undo / redo tests */
+    RUN_TEST(test_undo_redo_multiple_steps);
+    RUN_TEST(test_undo_large_batch_restores_row_order);
+    RUN_TEST(test_undo_history_respects_memory_limit);
+
+    /* Transaction tests */
+    RUN_TEST(test_transaction_reads_own_writes_and_commits_as_one_step);
+    RUN_TEST(test_transaction_rollback_and_bulk_commit);
+
+    /* Import tests */
+    RUN_TEST(test_import_conflict_policies);
+
+    /* Set-oriented change tests */
+    RUN_TEST(test_delete_where_keeps_row_order_and_undoes_in_one_step);
+    RUN_TEST(test_delete_where_many_rows_sharing_a_name);
+    RUN_TEST(test_undo_redo_large_batch_sharing_a_name);
+    RUN_TEST(test_import_many_rows_sharing_a_name);
+    RUN_TEST(test_update_marks_where_clamps_and_undoes_in_one_step);
+
+    /* Diff and merge tests */
+    RUN_TEST(test_diff_streams_chunks_and_merge_applies_in_one_step);
+    RUN_TEST(test_watch_reloads_changed_rows_and_settles_conflicts);
+
     return UnityEnd();
 }
@@ -0,0 +1,496 @@
+#include "unity/unity.h"
+#include "../include/index.h"
+#include "../include/database.h"
+#include "../include/alloc.h"
+#include "../include/cms.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Global test database */
+static StudentDatabase test_db;
+
+/* Helper function to add test records */
+static void add_test_records(void)
+{
+    StudentRecord records[] = {
+        {2301234, "Joshua Chen", "Software Engineering", 70.5f},
+        {2201234, "Isaac Teo", "Computer Science", 63.4f},
+        {2304567, "John Levoy", "Digital Supply Chain", 85.9f},
+        {2202345, "Josh Tan", "Information Systems", 65.0f},
+        {2305678, "Chen Mei Ling", "Cybersecurity", 78.5f}};
+
+    for (int i = 0; i < 5; i++)
+    {
+        cms_database_insert(&test_db, &records[i]);
+    }
+}
+
+/* Test setUp - runs before each test */
+void setUp(void)
+{
+    cms_database_init(&test_db);
+    add_test_records();
+}
+
+/* Test tearDown - runs after each test */
+void tearDown(void)
+{
+    cms_database_cleanup(&test_db);
+}
+
+/* ===== ID Lookup Tests ===== */
+
+void test_index_find_id(void)
+{
+    size_t index = 0;
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2304567, &index));
+    TEST_ASSERT_EQUAL(2, index);
+    TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 9999999, &index));
+}
+
+void test_index_find_id_after_delete(void)
+{
+    size_t index = 0;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2201234));
+    TEST_ASSERT_FALSE(cms_index_find_id(&test_db, 2201234, &index));
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, 2305678, &index));
+    TEST_ASSERT_EQUAL(3, index);
+}
+
+/* ===== Name Search Tests ===== */
+
+void test_index_search_substring(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2301234, ids[0]);
+    TEST_ASSERT_EQUAL(2305678, ids[1]);
+    cms_free(ids);
+}
+
+void test_index_search_prefix(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "Jos", true, &ids, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2202345, ids[0]);
+    TEST_ASSERT_EQUAL(2301234, ids[1]);
+    cms_free(ids);
+}
+
+void test_index_search_short_text(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+
+    /* Shorter than a trigram: falls back to verifying every name */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "Te", false, &ids, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(2201234, ids[0]);
+    cms_free(ids);
+}
+
+void test_index_search_tracks_update(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+    StudentRecord updated = {2201234, "Isaac Chen", "Computer Science", 63.4f};
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, 2201234, &updated));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "Chen", false, &ids, &count));
+    TEST_ASSERT_EQUAL(3, count);
+    cms_free(ids);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_name(&test_db, "Teo", false, &ids, &count));
+    TEST_ASSERT_EQUAL(0, count);
+    cms_free(ids);
+}
+
+void test_index_search_null_arguments(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_index_search_name(NULL, "a", false, &ids, &count));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_index_search_name(&test_db, NULL, false, &ids, &count));
+}
+
+/* ===== Fuzzy Name Tests ===== */
+
+void test_edit_distance_bounded(void)
+{
+    TEST_ASSERT_EQUAL(0, cms_edit_distance_bounded("Joshua Chen", "joshua chen", 2));
+    TEST_ASSERT_EQUAL(1, cms_edit_distance_bounded("Jushua Chen", "Joshua Chen", 2));
+    TEST_ASSERT_EQUAL(3, cms_edit_distance_bounded("kitten", "sitting", 5));
+    /* Beyond the bound the distance is reported as bound + 1 */
+    TEST_ASSERT_EQUAL(3, cms_edit_distance_bounded("kitten", "sitting", 2));
+    TEST_ASSERT_EQUAL(2, cms_edit_distance_bounded("Chen", "Isaac Chen", 1));
+}
+
+void test_index_search_fuzzy_ranked(void)
+{
+    CmsFuzzyMatch *matches = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "Jushua Chen", 3, &matches, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(2301234, matches[0].id);
+    TEST_ASSERT_EQUAL(1, matches[0].distance);
+    cms_free(matches);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "Jon Levy", 2, &matches, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(2304567, matches[0].id);
+    TEST_ASSERT_EQUAL(2, matches[0].distance);
+    cms_free(matches);
+}
+
+void test_index_search_fuzzy_tracks_delete(void)
+{
+    CmsFuzzyMatch *matches = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2301234));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "Joshua Chen", 2, &matches, &count));
+    TEST_ASSERT_EQUAL(0, count);
+    cms_free(matches);
+}
+
+void test_index_search_fuzzy_shared_name(void)
+{
+    /* Thousands of students with one name share a BK-tree node */
+    for (int i = 20000; i > 0; --i)
+    {
+        StudentRecord record = {3000000 + i, "Kim Lee", "Physics", 60.0f};
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    for (int i = 1; i <= 20000; i += 4)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 3000000 + i));
+    }
+
+    CmsFuzzyMatch *matches = NULL;
+    size_t count = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_search_fuzzy(&test_db, "Kim Lea", 1, &matches, &count));
+        TEST_ASSERT_EQUAL(15000, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            TEST_ASSERT_TRUE((matches[i].id - 3000000) % 4 != 1);
+            TEST_ASSERT_EQUAL(1, matches[i].distance);
+        }
+        cms_free(matches);
+
+        /* Same answer from a tree built in bulk */
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_rebuild(&test_db));
+    }
+}
+
+/* ===== Bitmap Tests ===== */
+
+void test_bitmap_array_and_bitset_containers(void)
+{
+    CmsBitmap evens;
+    CmsBitmap threes;
+    CmsBitmap both;
+    cms_bitmap_init(&evens);
+    cms_bitmap_init(&threes);
+    cms_bitmap_init(&both);
+
+    /* 10000 evens in one chunk forces a bitset container; threes stay an array */
+    for (uint32_t v = 0; v < 20000; v += 2)
+    {
+        TEST_ASSERT_TRUE(cms_bitmap_add(&evens, v));
+    }
+    for (uint32_t v = 0; v < 12000; v += 3)
+    {
+        TEST_ASSERT_TRUE(cms_bitmap_add(&threes, v));
+    }
+    TEST_ASSERT_TRUE(cms_bitmap_add(&threes, 70000));
+
+    TEST_ASSERT_EQUAL(10000, cms_bitmap_cardinality(&evens));
+    TEST_ASSERT_EQUAL(4001, cms_bitmap_cardinality(&threes));
+    TEST_ASSERT_TRUE(cms_bitmap_contains(&threes, 70000));
+    TEST_ASSERT_FALSE(cms_bitmap_contains(&evens, 3));
+
+    /* Multiples of 6 below 12000 */
+    TEST_ASSERT_EQUAL(2000, cms_bitmap_and_cardinality(&evens, &threes));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_bitmap_and(&evens, &threes, &both));
+    TEST_ASSERT_EQUAL(2000, cms_bitmap_cardinality(&both));
+    TEST_ASSERT_TRUE(cms_bitmap_contains(&both, 11994));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_bitmap_or(&evens, &threes, &both));
+    TEST_ASSERT_EQUAL(10000 + 4001 - 2000, cms_bitmap_cardinality(&both));
+
+    cms_bitmap_free(&evens);
+    cms_bitmap_free(&threes);
+    cms_bitmap_free(&both);
+}
+
+void test_bitmap_remove_and_to_array(void)
+{
+    CmsBitmap bitmap;
+    uint32_t values[3];
+    cms_bitmap_init(&bitmap);
+
+    cms_bitmap_add(&bitmap, 2305678);
+    cms_bitmap_add(&bitmap, 2201234);
+    cms_bitmap_add(&bitmap, 2301234);
+    cms_bitmap_add(&bitmap, 2201234);
+    cms_bitmap_remove(&bitmap, 2301234);
+    cms_bitmap_remove(&bitmap, 9999999);
+
+    TEST_ASSERT_EQUAL(2, cms_bitmap_to_array(&bitmap, values));
+    TEST_ASSERT_EQUAL(2201234, values[0]);
+    TEST_ASSERT_EQUAL(2305678, values[1]);
+
+    cms_bitmap_free(&bitmap);
+}
+
+/* ===== Programme / Grade Selection Tests ===== */
+
+void test_index_select_programmes_and_grades(void)
+{
+    CmsSelection selection;
+    CmsBitmap ids;
+    cms_bitmap_init(&ids);
+
+    memset(&selection, 0, sizeof(selection));
+    selection.programmes[0] = "software engineering";
+    selection.programmes[1] = "Cybersecurity";
+    selection.programme_count = 2;
+    selection.grades[0] = CMS_GRADE_A;
+    selection.grade_count = 1;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_select(&test_db, &selection, &ids));
+    TEST_ASSERT_EQUAL(1, cms_bitmap_cardinality(&ids));
+    TEST_ASSERT_TRUE(cms_bitmap_contains(&ids, 2305678));
+
+    /* Grade only: B (65.0) and C+ (63.4) */
+    selection.programme_count = 0;
+    selection.grades[0] = CMS_GRADE_B;
+    selection.grades[1] = CMS_GRADE_C_PLUS;
+    selection.grade_count = 2;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_select(&test_db, &selection, &ids));
+    TEST_ASSERT_EQUAL(2, cms_bitmap_cardinality(&ids));
+    TEST_ASSERT_TRUE(cms_bitmap_contains(&ids, 2201234));
+    TEST_ASSERT_TRUE(cms_bitmap_contains(&ids, 2202345));
+
+    cms_bitmap_free(&ids);
+}
+
+void test_index_count_tracks_update_and_delete(void)
+{
+    CmsSelection selection;
+    size_t count = 0;
+    StudentRecord updated = {2201234, "Isaac Teo", "Cybersecurity", 80.0f};
+
+    memset(&selection, 0, sizeof(selection));
+    selection.programmes[0] = "Cybersecurity";
+    selection.programme_count = 1;
+    selection.grades[0] = CMS_GRADE_A;
+    selection.grade_count = 1;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_count(&test_db, &selection, &count));
+    TEST_ASSERT_EQUAL(1, count);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, 2201234, &updated));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_count(&test_db, &selection, &count));
+    TEST_ASSERT_EQUAL(2, count);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2305678));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_count(&test_db, &selection, &count));
+    TEST_ASSERT_EQUAL(1, count);
+
+    /* Nothing selected counts every record */
+    memset(&selection, 0, sizeof(selection));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_count(&test_db, &selection, &count));
+    TEST_ASSERT_EQUAL(4, count);
+}
+
+/* ===== Mark Range Tests ===== */
+
+void test_index_mark_range_between_in_mark_order(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+    CmsMarkRange range = {63.4f, 78.5f, true, true};
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &range, &ids, &count));
+    TEST_ASSERT_EQUAL(4, count);
+    TEST_ASSERT_EQUAL(2201234, ids[0]);
+    TEST_ASSERT_EQUAL(2202345, ids[1]);
+    TEST_ASSERT_EQUAL(2301234, ids[2]);
+    TEST_ASSERT_EQUAL(2305678, ids[3]);
+    cms_free(ids);
+
+    /* Exclusive bounds drop both ends */
+    range.low_inclusive = false;
+    range.high_inclusive = false;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &range, &ids, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    cms_free(ids);
+}
+
+void test_index_mark_range_tracks_changes(void)
+{
+    int *ids = NULL;
+    size_t count = 0;
+    CmsMarkRange above = {80.0f, 100.0f, false, true};
+    StudentRecord updated = {2201234, "Isaac Teo", "Computer Science", 92.0f};
+    StudentRecord inserted = {2309999, "Ng Wei", "Cybersecurity", 81.0f};
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, 2201234, &updated));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &inserted));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 2304567));
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &above, &ids, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2309999, ids[0]);
+    TEST_ASSERT_EQUAL(2201234, ids[1]);
+    cms_free(ids);
+}
+
+void test_index_mark_order_across_many_records(void)
+{
+    /* Enough records to span several index blocks, all inserted with
+       colliding marks so ties are broken by ID */
+    for (int i = 0; i < 3000; i++)
+    {
+        StudentRecord record = {3000000 + i, "Many", "Data Science", (float)((i * 7) % 50)};
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    for (int i = 0; i < 3000; i += 3)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 3000000 + i));
+    }
+
+    int *ids = NULL;
+    size_t count = 0;
+    CmsMarkRange everything = {0.0f, 100.0f, true, true};
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &everything, &ids, &count));
+    TEST_ASSERT_EQUAL(test_db.count, count);
+
+    size_t previous = 0;
+    TEST_ASSERT_TRUE(cms_index_find_id(&test_db, ids[0], &previous));
+    for (size_t rank = 1; rank < count; ++rank)
+    {
+        size_t index = 0;
+        TEST_ASSERT_TRUE(cms_index_find_id(&test_db, ids[rank], &index));
+        const StudentRecord *before = &test_db.records[previous];
+        const StudentRecord *after = &test_db.records[index];
+        TEST_ASSERT_TRUE(before->mark < after->mark ||
+                         (before->mark == after->mark && before->id < after->id));
+        previous = index;
+    }
+
+    /* Ranks agree with the range in both walking directions */
+    int id = 0;
+    CmsMarkSeek seek = {0, 0};
+    for (size_t rank = count; rank > 0; --rank)
+    {
+        TEST_ASSERT_TRUE(cms_index_mark_at(&test_db, rank - 1, &seek, &id));
+        TEST_ASSERT_EQUAL(ids[rank - 1], id);
+    }
+    for (size_t rank = 0; rank < count; rank += 97)
+    {
+        TEST_ASSERT_TRUE(cms_index_mark_at(&test_db, rank, &seek, &id));
+        TEST_ASSERT_EQUAL(ids[rank], id);
+    }
+    TEST_ASSERT_FALSE(cms_index_mark_at(&test_db, count, &seek, &id));
+    cms_free(ids);
+
+    /* Marks of exactly 10 */
+    CmsMarkRange ten = {10.0f, 10.0f, true, true};
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &ten, &ids, &count));
+    TEST_ASSERT_EQUAL(40, count);
+    cms_free(ids);
+}
+
+void test_index_mark_at_jumps_to_any_rank(void)
+{
+    /* Splits, merges and in-place updates all move the running block
+       counts that an OFFSET jump descends */
+    for (int i = 0; i < 5000; i++)
+    {
+        StudentRecord record = {4000000 + i, "Jump", "Data Science", (float)((i * 13) % 100)};
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_insert(&test_db, &record));
+    }
+    for (int i = 0; i < 5000; i += 4)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_delete(&test_db, 4000000 + i));
+    }
+    for (int i = 1; i < 5000; i += 9)
+    {
+        if (i % 4 == 0)
+        {
+            continue;
+        }
+        StudentRecord record = {4000000 + i, "Jump", "Data Science", 99.5f};
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_database_update(&test_db, 4000000 + i, &record));
+    }
+
+    int *ids = NULL;
+    size_t count = 0;
+    CmsMarkRange everything = {0.0f, 100.0f, true, true};
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_index_mark_range(&test_db, &everything, &ids, &count));
+    TEST_ASSERT_EQUAL(test_db.count, count);
+
+    /* Without a hint, and with one left far from the requested rank */
+    int id = 0;
+    CmsMarkSeek seek = {0, 0};
+    for (size_t step = 0; step < count; ++step)
+    {
+        size_t rank = (step * 2711) % count;
+        TEST_ASSERT_TRUE(cms_index_mark_at(&test_db, rank, NULL, &id));
+        TEST_ASSERT_EQUAL(ids[rank], id);
+        TEST_ASSERT_TRUE(cms_index_mark_at(&test_db, rank, &seek, &id));
+        TEST_ASSERT_EQUAL(ids[rank], id);
+    }
+    cms_free(ids);
+}
+
+/* Main test runner for this module */
+int main(void)
+{
+    UnityBegin("test_index.c");
+
+    /* ID lookup tests */
+    RUN_TEST(test_index_find_id);
+    RUN_TEST(test_index_find_id_after_delete);
+
+    /* Name search tests */
+    RUN_TEST(test_index_search_substring);
+    RUN_TEST(test_index_search_prefix);
+    RUN_TEST(test_index_search_short_text);
+    RUN_TEST(test_index_search_tracks_update);
+    RUN_TEST(test_index_search_null_arguments);
+
+    /* Fuzzy name tests */
+    RUN_TEST(test_edit_distance_bounded);
+    RUN_TEST(test_index_search_fuzzy_ranked);
+    RUN_TEST(test_index_search_fuzzy_tracks_delete);
+    RUN_TEST(test_index_search_fuzzy_shared_name);
+
+    /* Bitmap tests */
+    RUN_TEST(test_bitmap_array_and_bitset_containers);
+    RUN_TEST(test_bitmap_remove_and_to_array);
+
+    /* Programme / grade selection tests */
+    RUN_TEST(test_index_select_programmes_and_grades);
+    RUN_TEST(test_index_count_tracks_update_and_delete);
+
+    /* Mark range tests */
+    RUN_TEST(test_index_mark_range_between_in_mark_order);
+    RUN_TEST(test_index_mark_range_tracks_changes);
+    RUN_TEST(test_index_mark_order_across_many_records);
+    RUN_TEST(test_index_mark_at_jumps_to_any_rank);
+
+    return UnityEnd();
+}
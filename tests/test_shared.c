@@ -0,0 +1,363 @@
+#include "unity/unity.h"
+#include "../include/shared.h"
+#include "../include/database.h"
+#include "../include/alloc.h"
+#include "../include/cms.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Run under ThreadSanitizer with "make tsan" */
+#define STRESS_RECORDS 2000
+#define STRESS_READERS 6
+#define STRESS_WRITERS 2
+#define STRESS_ROUNDS 1500
+#define STRESS_FIRST_ID 2500000
+
+static CmsSharedDatabase *shared;
+
+static const char *programmes[] = {"Computer Science", "Physics", "Mathematics", "Chemistry"};
+
+static void make_record(int number, float mark, StudentRecord *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->id = STRESS_FIRST_ID + number;
+    snprintf(record->name, sizeof(record->name), "Student %d", number);
+    strcpy(record->programme, programmes[number % 4]);
+    record->mark = mark;
+}
+
+/* Test setUp - runs before each test */
+void setUp(void)
+{
+    StudentRecord record;
+    shared = cms_shared_create();
+    TEST_ASSERT_NOT_NULL(shared);
+    for (int i = 0; i < STRESS_RECORDS; ++i)
+    {
+        make_record(i, (float)(i % 101), &record);
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_insert(shared, &record));
+    }
+}
+
+/* Test tearDown - runs after each test */
+void tearDown(void)
+{
+    cms_shared_destroy(shared);
+}
+
+/* Each thread draws its own numbers; rand() would be shared state */
+static unsigned next_random(unsigned *state)
+{
+    *state = *state * 1103515245U + 12345U;
+    return *state >> 16;
+}
+
+/* Counts anything a reader sees that no consistent state could produce */
+static void *stress_reader(void *argument)
+{
+    unsigned seed = (unsigned)(uintptr_t)argument;
+    uintptr_t failures = 0;
+    StudentRecord window[32];
+    StudentRecord record;
+    SummaryStats stats;
+    char expected[CMS_MAX_NAME_LEN + 1];
+
+    for (int round = 0; round < STRESS_ROUNDS; ++round)
+    {
+        int number = (int)(next_random(&seed) % STRESS_RECORDS);
+        size_t count = 0;
+        int *ids = NULL;
+        switch (round % 4)
+        {
+        case 0:
+            /* A record being deleted and re-inserted may be missing, never torn */
+            if (cms_shared_query(shared, STRESS_FIRST_ID + number, &record) == CMS_STATUS_OK)
+            {
+                snprintf(expected, sizeof(expected), "Student %d", number);
+                failures += strcmp(record.name, expected) != 0;
+            }
+            break;
+        case 1:
+            failures += cms_shared_sorted(shared, CMS_SORT_KEY_MARK, CMS_SORT_ASC, (size_t)number,
+                                          window, 32, &count) != CMS_STATUS_OK;
+            for (size_t i = 1; i < count; ++i)
+            {
+                failures += window[i - 1].mark > window[i].mark;
+            }
+            break;
+        case 2:
+            failures += cms_shared_summary(shared, &stats) != CMS_STATUS_OK;
+            failures += stats.count < STRESS_RECORDS - STRESS_WRITERS || stats.count > STRESS_RECORDS;
+            failures += stats.lowest > stats.highest;
+            break;
+        default:
+            failures += cms_shared_search_name(shared, "Student 1", true, &ids, &count) != CMS_STATUS_OK;
+            for (size_t i = 1; i < count; ++i)
+            {
+                failures += ids[i - 1] >= ids[i];
+            }
+            cms_free(ids);
+            break;
+        }
+    }
+    return (void *)failures;
+}
+
+/* Writer w owns the records whose number is w modulo the writer count, so
+   at most one record per writer is ever missing */
+static void *stress_writer(void *argument)
+{
+    unsigned writer = (unsigned)(uintptr_t)argument;
+    unsigned seed = writer + 17U;
+    uintptr_t failures = 0;
+    StudentRecord record;
+
+    for (int round = 0; round < STRESS_ROUNDS; ++round)
+    {
+        int number = (int)(next_random(&seed) % (STRESS_RECORDS / STRESS_WRITERS)) * STRESS_WRITERS + (int)writer;
+        make_record(number, (float)(next_random(&seed) % 101), &record);
+        if (round % 3 == 0)
+        {
+            failures += cms_shared_delete(shared, record.id) != CMS_STATUS_OK;
+            failures += cms_shared_insert(shared, &record) != CMS_STATUS_OK;
+        }
+        else
+        {
+            failures += cms_shared_update(shared, record.id, &record) != CMS_STATUS_OK;
+        }
+    }
+    return (void *)failures;
+}
+
+void test_shared_concurrent_readers_and_writers(void)
+{
+    pthread_t readers[STRESS_READERS];
+    pthread_t writers[STRESS_WRITERS];
+    uintptr_t failures = 0;
+    void *result = NULL;
+
+    for (uintptr_t i = 0; i < STRESS_READERS; ++i)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&readers[i], NULL, stress_reader, (void *)(i + 1)));
+    }
+    for (uintptr_t i = 0; i < STRESS_WRITERS; ++i)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&writers[i], NULL, stress_writer, (void *)i));
+    }
+    for (size_t i = 0; i < STRESS_READERS; ++i)
+    {
+        pthread_join(readers[i], &result);
+        failures += (uintptr_t)result;
+    }
+    for (size_t i = 0; i < STRESS_WRITERS; ++i)
+    {
+        pthread_join(writers[i], &result);
+        failures += (uintptr_t)result;
+    }
+    TEST_ASSERT_EQUAL(0, failures);
+
+    /* Every record is back and the indexes still agree with the table */
+    StudentRecord record;
+    StudentRecord window[STRESS_RECORDS];
+    size_t count = 0;
+    SummaryStats stats;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_summary(shared, &stats));
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, stats.count);
+    for (int i = 0; i < STRESS_RECORDS; ++i)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_query(shared, STRESS_FIRST_ID + i, &record));
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_sorted(shared, CMS_SORT_KEY_MARK, CMS_SORT_DESC, 0,
+                                                       window, STRESS_RECORDS, &count));
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, count);
+    for (size_t i = 1; i < count; ++i)
+    {
+        TEST_ASSERT_TRUE(window[i - 1].mark >= window[i].mark);
+    }
+}
+
+void test_shared_sorted_window(void)
+{
+    StudentRecord window[3];
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_sorted(shared, CMS_SORT_KEY_ID, CMS_SORT_DESC, 1,
+                                                       window, 3, &count));
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(STRESS_FIRST_ID + STRESS_RECORDS - 2, window[0].id);
+    TEST_ASSERT_EQUAL(STRESS_FIRST_ID + STRESS_RECORDS - 4, window[2].id);
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_sorted(shared, CMS_SORT_KEY_ID, CMS_SORT_ASC, STRESS_RECORDS,
+                                                       window, 3, &count));
+    TEST_ASSERT_EQUAL(0, count);
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_shared_sorted(shared, CMS_SORT_KEY_ID, CMS_SORT_ASC, 0,
+                                                                     NULL, 3, &count));
+}
+
+/* Every row a snapshot holds is whole, and versions only move forward */
+static void *snapshot_reader(void *argument)
+{
+    unsigned seed = (unsigned)(uintptr_t)argument;
+    uintptr_t failures = 0;
+    unsigned long last_version = 0;
+    char expected[CMS_MAX_NAME_LEN + 1];
+    CmsSnapshot snapshot;
+    SummaryStats stats;
+
+    for (int round = 0; round < STRESS_ROUNDS / 10; ++round)
+    {
+        if (cms_snapshot_acquire(shared, &snapshot) != CMS_STATUS_OK)
+        {
+            return (void *)(failures + 1);
+        }
+        size_t count = cms_snapshot_count(&snapshot);
+        failures += count < STRESS_RECORDS - STRESS_WRITERS || count > STRESS_RECORDS;
+        failures += cms_snapshot_version(&snapshot) < last_version;
+        last_version = cms_snapshot_version(&snapshot);
+
+        size_t position = 0;
+        size_t run = 0;
+        const StudentRecord *rows = NULL;
+        while ((rows = cms_snapshot_rows(&snapshot, position, &run)) != NULL)
+        {
+            for (size_t i = 0; i < run; ++i)
+            {
+                snprintf(expected, sizeof(expected), "Student %d", rows[i].id - STRESS_FIRST_ID);
+                failures += strcmp(rows[i].name, expected) != 0;
+            }
+            position += run;
+        }
+        failures += position != count;
+        failures += cms_snapshot_summary(&snapshot, &stats) != CMS_STATUS_OK || stats.count != count;
+
+        /* Now and then hold on while writers publish more versions */
+        if (next_random(&seed) % 4 == 0)
+        {
+            sched_yield();
+        }
+        cms_snapshot_release(&snapshot);
+    }
+    return (void *)failures;
+}
+
+void test_snapshot_readers_alongside_writers(void)
+{
+    pthread_t readers[STRESS_READERS];
+    pthread_t writers[STRESS_WRITERS];
+    uintptr_t failures = 0;
+    void *result = NULL;
+
+    for (uintptr_t i = 0; i < STRESS_READERS; ++i)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&readers[i], NULL, snapshot_reader, (void *)(i + 1)));
+    }
+    for (uintptr_t i = 0; i < STRESS_WRITERS; ++i)
+    {
+        TEST_ASSERT_EQUAL(0, pthread_create(&writers[i], NULL, stress_writer, (void *)i));
+    }
+    for (size_t i = 0; i < STRESS_READERS; ++i)
+    {
+        pthread_join(readers[i], &result);
+        failures += (uintptr_t)result;
+    }
+    for (size_t i = 0; i < STRESS_WRITERS; ++i)
+    {
+        pthread_join(writers[i], &result);
+        failures += (uintptr_t)result;
+    }
+    TEST_ASSERT_EQUAL(0, failures);
+
+    CmsSnapshot snapshot;
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_snapshot_acquire(shared, &snapshot));
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, cms_snapshot_count(&snapshot));
+    cms_snapshot_release(&snapshot);
+}
+
+void test_snapshot_keeps_its_version(void)
+{
+    CmsSnapshot before;
+    CmsSnapshot after;
+    StudentRecord record;
+    SummaryStats stats;
+    size_t run = 0;
+
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_snapshot_acquire(shared, &before));
+    make_record(0, 42.5f, &record);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_update(shared, record.id, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_delete(shared, STRESS_FIRST_ID + 5));
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_snapshot_acquire(shared, &after));
+
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, cms_snapshot_count(&before));
+    TEST_ASSERT_EQUAL(0.0f, cms_snapshot_rows(&before, 0, &run)->mark);
+    TEST_ASSERT_EQUAL(STRESS_FIRST_ID + 5, cms_snapshot_rows(&before, 5, &run)->id);
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_snapshot_summary(&before, &stats));
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, stats.count);
+
+    TEST_ASSERT_EQUAL(STRESS_RECORDS - 1, cms_snapshot_count(&after));
+    TEST_ASSERT_EQUAL(42.5f, cms_snapshot_rows(&after, 0, &run)->mark);
+    TEST_ASSERT_EQUAL(STRESS_FIRST_ID + 6, cms_snapshot_rows(&after, 5, &run)->id);
+    TEST_ASSERT_TRUE(cms_snapshot_version(&after) > cms_snapshot_version(&before));
+    TEST_ASSERT_NULL(cms_snapshot_rows(&after, STRESS_RECORDS - 1, &run));
+    TEST_ASSERT_EQUAL(0, run);
+
+    cms_snapshot_release(&before);
+    cms_snapshot_release(&after);
+}
+
+static CMS_STATUS snapshot_inside_write(StudentDatabase *db, void *context)
+{
+    CmsSnapshot snapshot;
+    (void)db;
+    CMS_STATUS status = cms_snapshot_acquire(shared, &snapshot);
+    *(size_t *)context = cms_snapshot_count(&snapshot);
+    cms_snapshot_release(&snapshot);
+    return status;
+}
+
+void test_snapshot_does_not_wait_for_writers(void)
+{
+    CmsSnapshot held[CMS_MAX_SNAPSHOT_READERS];
+    CmsSnapshot extra;
+    size_t count = 0;
+
+    /* The write lock is held while the callback runs */
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_shared_write(shared, snapshot_inside_write, &count));
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, count);
+
+    for (size_t i = 0; i < CMS_MAX_SNAPSHOT_READERS; ++i)
+    {
+        TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_snapshot_acquire(shared, &held[i]));
+    }
+    TEST_ASSERT_EQUAL(CMS_STATUS_ERROR, cms_snapshot_acquire(shared, &extra));
+    for (size_t i = 0; i < CMS_MAX_SNAPSHOT_READERS; ++i)
+    {
+        cms_snapshot_release(&held[i]);
+    }
+}
+
+void test_shared_null_arguments(void)
+{
+    StudentRecord record;
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_shared_query(NULL, STRESS_FIRST_ID, &record));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_shared_read(shared, NULL, NULL));
+    TEST_ASSERT_EQUAL(CMS_STATUS_INVALID_ARGUMENT, cms_shared_write(shared, NULL, NULL));
+}
+
+/* Main test runner for this module */
+int main(void)
+{
+    UnityBegin("test_shared.c");
+
+    RUN_TEST(test_shared_concurrent_readers_and_writers);
+    RUN_TEST(test_shared_sorted_window);
+    RUN_TEST(test_snapshot_readers_alongside_writers);
+    RUN_TEST(test_snapshot_keeps_its_version);
+    RUN_TEST(test_snapshot_does_not_wait_for_writers);
+    RUN_TEST(test_shared_null_arguments);
+
+    return UnityEnd();
+}
@@ -1,6 +1,16 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
 #include "unity/unity.h"
 #include "../include/utils.h"
 #include "../include/config.h"
+#include "../include/render.h"
+#include "../include/tokenizer.h"
+#include "../include/metrics.h"
+#include "../include/alloc.h"
+#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
 /* Test setUp - runs before each test */
@@ -162,6 +172,201 @@ void test_trim_string(void)
     /* TEST_ASSERT_EQUAL_STRING("hello", test_str); */
 }
 
+/* ===== Buffered Writer Tests ===== */
+
+void test_format_mark_matches_printf(void)
+{
+    float marks[] = {0.0f, 0.05f, 0.25f, 63.45f, 70.5f, 84.95f, 99.99f, 100.0f, -0.04f, 12345.65f};
+    char expected[CMS_MARK_TEXT_LEN];
+    char actual[CMS_MARK_TEXT_LEN];
+
+    for (size_t i = 0; i < sizeof(marks) / sizeof(marks[0]); ++i)
+    {
+        snprintf(expected, sizeof(expected), "%.1f", marks[i]);
+        cms_format_mark(marks[i], actual);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+    }
+}
+
+void test_writer_pads_and_flushes(void)
+{
+    FILE *file = tmpfile();
+    char buffer[8];
+    char text[64];
+    CmsWriter writer;
+
+    TEST_ASSERT_NOT_NULL(file);
+    /* A tiny buffer forces several flushes mid-row */
+    cms_writer_init(&writer, fileno(file), NULL, buffer, sizeof(buffer));
+    cms_writer_puts(&writer, "| ");
+    cms_writer_pad_int(&writer, 2301234, 11);
+    cms_writer_puts(&writer, "| ");
+    cms_writer_pad(&writer, "Joshua Chen", 14);
+    cms_writer_puts(&writer, "| ");
+    cms_writer_pad_mark(&writer, 70.5f, 6);
+    cms_writer_putc(&writer, '|');
+    TEST_ASSERT_EQUAL(CMS_STATUS_OK, cms_writer_flush(&writer));
+
+    rewind(file);
+    TEST_ASSERT_NOT_NULL(fgets(text, sizeof(text), file));
+    TEST_ASSERT_EQUAL_STRING("| 2301234    | Joshua Chen   | 70.5  |", text);
+    TEST_ASSERT_EQUAL(strlen(text), writer.bytes_written);
+    fclose(file);
+}
+
+/* ===== Tokenizer Tests ===== */
+
+void test_tokenize_command_slices_in_place(void)
+{
+    const char *line = "  show   mark DESC  ";
+    CmsCommandLine command;
+    CmsSlice rest;
+    CmsSlice word;
+
+    cms_tokenize_command(line, &command);
+    TEST_ASSERT_TRUE(cms_slice_equals(command.verb, "SHOW"));
+    TEST_ASSERT_TRUE(command.verb.text == line + 2);
+    TEST_ASSERT_EQUAL(strlen("mark DESC"), command.args.length);
+
+    rest = command.args;
+    TEST_ASSERT_TRUE(cms_slice_next_word(&rest, &word));
+    TEST_ASSERT_TRUE(cms_slice_equals(word, "MARK"));
+    TEST_ASSERT_FALSE(cms_slice_equals(word, "MAR"));
+    TEST_ASSERT_TRUE(cms_slice_next_word(&rest, &word));
+    TEST_ASSERT_TRUE(cms_slice_equals(word, "desc"));
+    TEST_ASSERT_FALSE(cms_slice_next_word(&rest, &word));
+}
+
+void test_scan_record_fields(void)
+{
+    CmsSlice fields[CMS_RECORD_FIELD_COUNT];
+    char value[64];
+
+    cms_scan_record_fields(cms_slice("ID=2500605 NAME= Amy  Lim  MARK=80 PROGRAMME=Computer Science"), fields);
+    TEST_ASSERT_TRUE(cms_slice_copy(fields[CMS_RECORD_FIELD_ID], value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("2500605", value);
+    TEST_ASSERT_TRUE(cms_slice_copy(fields[CMS_RECORD_FIELD_NAME], value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("Amy  Lim", value);
+    TEST_ASSERT_TRUE(cms_slice_copy(fields[CMS_RECORD_FIELD_PROGRAMME], value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("Computer Science", value);
+    TEST_ASSERT_TRUE(cms_slice_copy(fields[CMS_RECORD_FIELD_MARK], value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("80", value);
+
+    /* Lower-case keys are not keys, so they stay part of the value */
+    cms_scan_record_fields(cms_slice("NAME=Tan mark=80"), fields);
+    TEST_ASSERT_EQUAL(strlen("Tan mark=80"), fields[CMS_RECORD_FIELD_NAME].length);
+    TEST_ASSERT_NULL(fields[CMS_RECORD_FIELD_MARK].text);
+}
+
+void test_slice_keywords_and_tokens(void)
+{
+    CmsSlice before;
+    CmsSlice after;
+    char value[64];
+
+    /* Only a whole word splits: "Marketing" does not contain MARK */
+    TEST_ASSERT_TRUE(cms_slice_split_at_word(cms_slice("Marketing mark < 40"), "MARK", &before, &after));
+    TEST_ASSERT_TRUE(cms_slice_copy(before, value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("Marketing ", value);
+    TEST_ASSERT_TRUE(cms_slice_copy(after, value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING(" < 40", value);
+    TEST_ASSERT_FALSE(cms_slice_split_at_word(cms_slice("Marketing"), "MARK", &before, &after));
+
+    CmsSlice text = cms_slice("PROGRAMMEs");
+    TEST_ASSERT_FALSE(cms_slice_skip_word(&text, "PROGRAMME"));
+    TEST_ASSERT_TRUE(cms_slice_skip_prefix(&text, "programme"));
+    TEST_ASSERT_EQUAL(1, text.length);
+
+    CmsSlice rest = cms_slice("CSV \"my file.csv\" SORT");
+    CmsSlice word;
+    TEST_ASSERT_TRUE(cms_slice_next_token(&rest, &word));
+    TEST_ASSERT_TRUE(cms_slice_equals(word, "csv"));
+    TEST_ASSERT_TRUE(cms_slice_next_token(&rest, &word));
+    TEST_ASSERT_TRUE(cms_slice_copy(word, value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("my file.csv", value);
+    TEST_ASSERT_TRUE(cms_slice_next_token(&rest, &word));
+    TEST_ASSERT_TRUE(cms_slice_equals(word, "SORT"));
+    TEST_ASSERT_FALSE(cms_slice_next_token(&rest, &word));
+
+    rest = cms_slice("\"unterminated");
+    TEST_ASSERT_FALSE(cms_slice_next_token(&rest, &word));
+}
+
+void test_histogram_percentiles_within_a_bucket(void)
+{
+    CmsHistogram *histogram = calloc(1, sizeof(CmsHistogram));
+    TEST_ASSERT_NOT_NULL(histogram);
+    TEST_ASSERT_EQUAL(0, cms_histogram_percentile(histogram, 50.0));
+
+    /* Small values are exact */
+    cms_histogram_record(histogram, 7);
+    TEST_ASSERT_EQUAL(7, cms_histogram_percentile(histogram, 50.0));
+
+    /* 1..1000 microseconds: every percentile is within 1/16 above the true value */
+    memset(histogram, 0, sizeof(*histogram));
+    for (uint64_t value = 1; value <= 1000; ++value)
+    {
+        cms_histogram_record(histogram, value * 1000);
+    }
+    uint64_t p50 = cms_histogram_percentile(histogram, 50.0);
+    uint64_t p99 = cms_histogram_percentile(histogram, 99.0);
+    TEST_ASSERT_TRUE(p50 >= 500000 && p50 <= 500000 + 500000 / 16);
+    TEST_ASSERT_TRUE(p99 >= 990000 && p99 <= 1000000);
+    TEST_ASSERT_EQUAL(1000000, cms_histogram_percentile(histogram, 100.0));
+    TEST_ASSERT_EQUAL(1000, histogram->count);
+
+    /* Bucket bounds run on without gaps, and huge values land in the last bucket */
+    for (size_t bucket = 1; bucket < CMS_HISTOGRAM_BUCKETS; ++bucket)
+    {
+        TEST_ASSERT_TRUE(cms_histogram_bucket_low(bucket) > cms_histogram_bucket_low(bucket - 1));
+    }
+    cms_histogram_record(histogram, UINT64_MAX / 2);
+    TEST_ASSERT_EQUAL(1, histogram->buckets[CMS_HISTOGRAM_BUCKETS - 1]);
+    TEST_ASSERT_TRUE(cms_histogram_percentile(histogram, 100.0) == UINT64_MAX / 2);
+    free(histogram);
+}
+
+void test_tracked_allocations_count_per_kind(void)
+{
+    CmsMemUsage records = cms_mem_usage(CMS_MEM_RECORDS);
+    CmsMemUsage temp = cms_mem_usage(CMS_MEM_TEMP);
+    CmsMemUsage total = cms_mem_usage(CMS_MEM_KIND_COUNT);
+
+    char *block = cms_malloc(CMS_MEM_TEMP, 100);
+    TEST_ASSERT_NOT_NULL(block);
+    memset(block, 'x', 100);
+    TEST_ASSERT_EQUAL(temp.current + 100, cms_mem_usage(CMS_MEM_TEMP).current);
+    TEST_ASSERT_EQUAL(temp.blocks + 1, cms_mem_usage(CMS_MEM_TEMP).blocks);
+
+    /* Growing keeps the kind the block was allocated with and its contents */
+    block = cms_realloc(CMS_MEM_RECORDS, block, 1000);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL('x', block[99]);
+    TEST_ASSERT_EQUAL(temp.current + 1000, cms_mem_usage(CMS_MEM_TEMP).current);
+    TEST_ASSERT_EQUAL(records.current, cms_mem_usage(CMS_MEM_RECORDS).current);
+
+    int *zeroed = cms_calloc(CMS_MEM_RECORDS, 10, sizeof(int));
+    TEST_ASSERT_NOT_NULL(zeroed);
+    TEST_ASSERT_EQUAL(0, zeroed[9]);
+    TEST_ASSERT_EQUAL(total.current + 1000 + 10 * sizeof(int), cms_mem_usage(CMS_MEM_KIND_COUNT).current);
+
+    cms_free(block);
+    cms_free(zeroed);
+    cms_free(NULL);
+    TEST_ASSERT_EQUAL(temp.current, cms_mem_usage(CMS_MEM_TEMP).current);
+    TEST_ASSERT_EQUAL(records.current, cms_mem_usage(CMS_MEM_RECORDS).current);
+    TEST_ASSERT_EQUAL(total.blocks, cms_mem_usage(CMS_MEM_KIND_COUNT).blocks);
+
+    /* Peaks remember the high point until reset */
+    TEST_ASSERT_TRUE(cms_mem_usage(CMS_MEM_TEMP).peak >= temp.current + 1000);
+    cms_mem_reset_peaks();
+    TEST_ASSERT_EQUAL(temp.current, cms_mem_usage(CMS_MEM_TEMP).peak);
+
+    TEST_ASSERT_NULL(cms_malloc(CMS_MEM_KIND_COUNT, 10));
+    TEST_ASSERT_EQUAL_STRING("Indexes", cms_mem_kind_name(CMS_MEM_INDEXES));
+    TEST_ASSERT_EQUAL_STRING("Total", cms_mem_kind_name(CMS_MEM_KIND_COUNT));
+}
+
 /* Main test runner for this module */
 int main(void)
 {
@@ -194,5 +399,18 @@ int main(void)
     RUN_TEST(test_string_to_upper_null);
     RUN_TEST(test_trim_string);
 
+    /* Run buffered writer tests */
+    RUN_TEST(test_format_mark_matches_printf);
+    RUN_TEST(test_writer_pads_and_flushes);
+
+    /* Tokenizer tests */
+    RUN_TEST(test_tokenize_command_slices_in_place);
+    RUN_TEST(test_scan_record_fields);
+    RUN_TEST(test_slice_keywords_and_tokens);
+
+    /* Latency histogram tests */
+    RUN_TEST(test_histogram_percentiles_within_a_bucket);
+    RUN_TEST(test_tracked_allocations_count_per_kind);
+
     return UnityEnd();
 }